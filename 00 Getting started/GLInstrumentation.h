@@ -0,0 +1,153 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Entry points wrapped by installGlInstrumentation: everything the chapters call through glad. The
+// ImGui backend has its own loader and is not included.
+#define GL_INSTRUMENTED_FUNCTIONS(X) \
+    X(glActiveTexture) \
+    X(glAttachShader) \
+    X(glBeginQuery) \
+    X(glBindBuffer) \
+    X(glBindFramebuffer) \
+    X(glBindRenderbuffer) \
+    X(glBindTexture) \
+    X(glBindVertexArray) \
+    X(glBlendFunc) \
+    X(glBlitFramebuffer) \
+    X(glBufferData) \
+    X(glBufferSubData) \
+    X(glCheckFramebufferStatus) \
+    X(glClear) \
+    X(glClearColor) \
+    X(glColorMask) \
+    X(glCompileShader) \
+    X(glCompressedTexImage2D) \
+    X(glCreateProgram) \
+    X(glCreateShader) \
+    X(glCullFace) \
+    X(glDeleteBuffers) \
+    X(glDeleteFramebuffers) \
+    X(glDeleteProgram) \
+    X(glDeleteQueries) \
+    X(glDeleteRenderbuffers) \
+    X(glDeleteShader) \
+    X(glDeleteTextures) \
+    X(glDeleteVertexArrays) \
+    X(glDepthFunc) \
+    X(glDepthMask) \
+    X(glDisable) \
+    X(glDrawArrays) \
+    X(glDrawArraysInstanced) \
+    X(glDrawBuffers) \
+    X(glDrawElements) \
+    X(glDrawElementsInstanced) \
+    X(glEnable) \
+    X(glEnableVertexAttribArray) \
+    X(glEndQuery) \
+    X(glFinish) \
+    X(glFlush) \
+    X(glFramebufferRenderbuffer) \
+    X(glFramebufferTexture2D) \
+    X(glGenBuffers) \
+    X(glGenFramebuffers) \
+    X(glGenQueries) \
+    X(glGenRenderbuffers) \
+    X(glGenTextures) \
+    X(glGenVertexArrays) \
+    X(glGenerateMipmap) \
+    X(glGetError) \
+    X(glGetIntegerv) \
+    X(glGetProgramInfoLog) \
+    X(glGetProgramiv) \
+    X(glGetQueryObjectui64v) \
+    X(glGetQueryObjectuiv) \
+    X(glGetQueryiv) \
+    X(glGetShaderInfoLog) \
+    X(glGetShaderiv) \
+    X(glGetString) \
+    X(glGetStringi) \
+    X(glGetUniformLocation) \
+    X(glLinkProgram) \
+    X(glPixelStorei) \
+    X(glPolygonMode) \
+    X(glQueryCounter) \
+    X(glReadPixels) \
+    X(glRenderbufferStorage) \
+    X(glScissor) \
+    X(glShaderSource) \
+    X(glStencilFunc) \
+    X(glStencilMask) \
+    X(glStencilOp) \
+    X(glTexBuffer) \
+    X(glTexImage2D) \
+    X(glTexImage3D) \
+    X(glTexParameterf) \
+    X(glTexParameteri) \
+    X(glTexParameteriv) \
+    X(glTexSubImage2D) \
+    X(glTexSubImage3D) \
+    X(glUniform1f) \
+    X(glUniform1i) \
+    X(glUniform2f) \
+    X(glUniform2fv) \
+    X(glUniform3f) \
+    X(glUniform3fv) \
+    X(glUniform4f) \
+    X(glUniform4fv) \
+    X(glUniformMatrix2fv) \
+    X(glUniformMatrix3fv) \
+    X(glUniformMatrix4fv) \
+    X(glUseProgram) \
+    X(glVertexAttribDivisor) \
+    X(glVertexAttribIPointer) \
+    X(glVertexAttribPointer) \
+    X(glViewport)
+
+enum GlFunction
+{
+#define GL_FUNCTION_ENUM(name) GL_FUNCTION_##name,
+    GL_INSTRUMENTED_FUNCTIONS(GL_FUNCTION_ENUM)
+#undef GL_FUNCTION_ENUM
+    GL_FUNCTION_COUNT
+};
+
+/// <summary>
+/// Calls per entry point and the CPU time spent inside them (in the driver), since the last
+/// resetGlCallCounters().
+/// </summary>
+struct GlCallCounters
+{
+    unsigned long long calls[GL_FUNCTION_COUNT] = {};
+    unsigned long long nanoseconds[GL_FUNCTION_COUNT] = {};
+};
+
+/// <summary>
+/// A driver message of the performance category (GL_KHR_debug) and how often it was reported.
+/// </summary>
+struct GlDebugMessage
+{
+    std::string text;
+    unsigned long long count;
+};
+
+/// <summary>
+/// Wraps the glad pointers of GL_INSTRUMENTED_FUNCTIONS in counting and timing wrappers and, when
+/// the context supports GL_KHR_debug (or OpenGL 4.3), collects its performance messages (implicit
+/// syncs, shader recompiles, ...). Drivers only report them reliably in debug contexts. Call after
+/// installRenderStatsHooks, whose hooks are then timed as part of the calls they forward.
+/// getProcAddress loads the debug output functions, which a 3.3 glad does not.
+/// </summary>
+void installGlInstrumentation(void* (*getProcAddress)(const char* name));
+bool glInstrumentationInstalled();
+bool glDebugOutputEnabled();
+
+const GlCallCounters& getGlCallCounters();
+void resetGlCallCounters();
+const char* glFunctionName(int function);
+
+/// <summary>
+/// Distinct performance messages received so far, most frequent first.
+/// </summary>
+std::vector<GlDebugMessage> getGlDebugMessages();
@@ -0,0 +1,465 @@
+#include "Headless.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+
+#ifdef _WIN32
+#include <GLFW/glfw3.h>
+#else
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+HeadlessOptions parseHeadlessOptions(int argc, char* argv[], int defaultWidth, int defaultHeight)
+{
+    HeadlessOptions options;
+    options.width = defaultWidth;
+    options.height = defaultHeight;
+    bool benchmark = false;
+    bool warmupSet = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--headless") == 0)
+        {
+            options.enabled = true;
+        }
+        else if (std::strcmp(argv[i], "--benchmark") == 0)
+        {
+            options.enabled = true;
+            benchmark = true;
+        }
+        else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            options.frames = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+        {
+            options.warmupFrames = std::max(0, std::atoi(argv[++i]));
+            warmupSet = true;
+        }
+        else if (std::strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+        {
+            int width, height;
+            if (std::sscanf(argv[++i], "%dx%d", &width, &height) == 2 && width > 0 && height > 0)
+            {
+                options.width = width;
+                options.height = height;
+            }
+        }
+        else if (std::strcmp(argv[i], "--screenshot") == 0 && i + 1 < argc)
+        {
+            options.screenshotPath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+        {
+            options.jsonPath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--camera-path") == 0 && i + 1 < argc)
+        {
+            options.cameraPath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--record-camera") == 0 && i + 1 < argc)
+        {
+            options.recordCameraPath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            options.tracePath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--gl-calls") == 0)
+        {
+            options.glCalls = true;
+        }
+    }
+    if (benchmark && !warmupSet)
+    {
+        options.warmupFrames = 60; // Shader compiles, first texture uses and driver caches settle in these
+    }
+    return options;
+}
+
+HeadlessContext::HeadlessContext()
+    : display(nullptr), context(nullptr), width(0), height(0), framebuffer(0), colorBuffer(0), depthStencilBuffer(0)
+{
+}
+
+HeadlessContext::~HeadlessContext()
+{
+    destroy();
+}
+
+bool HeadlessContext::create(int width, int height, bool debugContext)
+{
+    this->width = width;
+    this->height = height;
+
+#ifdef _WIN32
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, debugContext ? GLFW_TRUE : GLFW_FALSE);
+    GLFWwindow* window = glfwCreateWindow(width, height, "LearnOpenGL (headless)", NULL, NULL);
+    if (window == NULL)
+    {
+        std::cout << "Failed to create hidden GLFW window" << std::endl;
+        glfwTerminate();
+        return false;
+    }
+    glfwMakeContextCurrent(window);
+    this->context = window;
+
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        return false;
+    }
+#else
+    // Surfaceless display (Mesa), so no X/Wayland server is needed. Fall back to the default display.
+    EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay)
+    {
+        eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    if (eglDisplay == EGL_NO_DISPLAY)
+    {
+        eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, nullptr, nullptr))
+    {
+        std::cout << "Failed to initialize EGL" << std::endl;
+        return false;
+    }
+    this->display = eglDisplay;
+
+    const EGLint configAttributes[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_SURFACE_TYPE, 0,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglBindAPI(EGL_OPENGL_API) ||
+        !eglChooseConfig(eglDisplay, configAttributes, &config, 1, &configCount) || configCount == 0)
+    {
+        std::cout << "No EGL config supports desktop OpenGL" << std::endl;
+        return false;
+    }
+
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_CONTEXT_OPENGL_DEBUG, debugContext ? EGL_TRUE : EGL_FALSE,
+        EGL_NONE
+    };
+    EGLContext eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttributes);
+    if (eglContext == EGL_NO_CONTEXT || !eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext))
+    {
+        std::cout << "Failed to create a surfaceless OpenGL 3.3 core context" << std::endl;
+        return false;
+    }
+    this->context = eglContext;
+
+    if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+    {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        return false;
+    }
+#endif
+
+    // There is no default framebuffer to draw to, so the scene renders into this one instead
+    glGenFramebuffers(1, &this->framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+
+    glGenRenderbuffers(1, &this->colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, this->colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, this->colorBuffer);
+
+    glGenRenderbuffers(1, &this->depthStencilBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, this->depthStencilBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, this->depthStencilBuffer);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cout << "Offscreen framebuffer is incomplete" << std::endl;
+        return false;
+    }
+
+    glViewport(0, 0, width, height);
+    return true;
+}
+
+void HeadlessContext::destroy()
+{
+    if (!this->context)
+    {
+        return;
+    }
+
+    glDeleteRenderbuffers(1, &this->colorBuffer);
+    glDeleteRenderbuffers(1, &this->depthStencilBuffer);
+    glDeleteFramebuffers(1, &this->framebuffer);
+    this->framebuffer = 0;
+
+#ifdef _WIN32
+    glfwDestroyWindow(static_cast<GLFWwindow*>(this->context));
+    glfwTerminate();
+#else
+    eglMakeCurrent(this->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(this->display, this->context);
+    eglTerminate(this->display);
+#endif
+    this->context = nullptr;
+    this->display = nullptr;
+}
+
+void* HeadlessContext::getProcAddress(const char* name)
+{
+#ifdef _WIN32
+    return reinterpret_cast<void*>(glfwGetProcAddress(name));
+#else
+    return reinterpret_cast<void*>(eglGetProcAddress(name));
+#endif
+}
+
+bool HeadlessContext::saveScreenshot(const std::string& path) const
+{
+    std::vector<unsigned char> pixels(static_cast<size_t>(this->width) * this->height * 3);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, this->framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, this->width, this->height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+    std::ofstream file(path, std::ios::binary);
+    file << "P6\n" << this->width << " " << this->height << "\n255\n";
+    // OpenGL rows start at the bottom
+    for (int y = this->height - 1; y >= 0; y--)
+    {
+        file.write(reinterpret_cast<const char*>(&pixels[static_cast<size_t>(y) * this->width * 3]), this->width * 3);
+    }
+    return file.good();
+}
+
+void FrameStats::addFrame(double milliseconds, const RenderStats& renderStats)
+{
+    this->frameTimes.push_back(milliseconds);
+    this->totals.drawCalls += renderStats.drawCalls;
+    this->totals.triangles += renderStats.triangles;
+    this->totals.stateChanges += renderStats.stateChanges;
+}
+
+void FrameStats::addGlCalls(const GlCallCounters& counters)
+{
+    this->glCallFrames++;
+    for (int i = 0; i < GL_FUNCTION_COUNT; i++)
+    {
+        this->glCallTotals.calls[i] += counters.calls[i];
+        this->glCallTotals.nanoseconds[i] += counters.nanoseconds[i];
+    }
+}
+
+std::vector<int> FrameStats::calledGlFunctions() const
+{
+    std::vector<int> functions;
+    for (int i = 0; i < GL_FUNCTION_COUNT; i++)
+    {
+        if (this->glCallTotals.calls[i] > 0)
+        {
+            functions.push_back(i);
+        }
+    }
+    std::sort(functions.begin(), functions.end(), [this](int a, int b)
+        {
+            return this->glCallTotals.nanoseconds[a] > this->glCallTotals.nanoseconds[b];
+        });
+    return functions;
+}
+
+double FrameStats::percentile(double p) const
+{
+    if (this->frameTimes.empty())
+    {
+        return 0.0;
+    }
+    std::vector<double> sorted = this->frameTimes;
+    std::sort(sorted.begin(), sorted.end());
+    size_t index = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+    return sorted[std::min(sorted.size() - 1, index > 0 ? index - 1 : 0)];
+}
+
+void FrameStats::print(const std::string& name) const
+{
+    if (this->frameTimes.empty())
+    {
+        return;
+    }
+    double total = std::accumulate(this->frameTimes.begin(), this->frameTimes.end(), 0.0);
+    double average = total / this->frameTimes.size();
+    std::printf("%s: %zu frames, avg %.3f ms (%.1f fps), min %.3f ms, median %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+        name.c_str(), this->frameTimes.size(), average, 1000.0 / average, percentile(0.0), percentile(50.0),
+        percentile(95.0), percentile(99.0), percentile(100.0));
+
+    if (this->glCallFrames > 0)
+    {
+        unsigned long long calls = 0, nanoseconds = 0;
+        for (int i = 0; i < GL_FUNCTION_COUNT; i++)
+        {
+            calls += this->glCallTotals.calls[i];
+            nanoseconds += this->glCallTotals.nanoseconds[i];
+        }
+        std::printf("GL calls: %.1f per frame, %.3f ms per frame in the driver\n",
+            static_cast<double>(calls) / this->glCallFrames, nanoseconds / 1e6 / this->glCallFrames);
+        std::vector<int> functions = calledGlFunctions();
+        for (size_t i = 0; i < functions.size() && i < 5; i++)
+        {
+            int function = functions[i];
+            std::printf("  %s: %.1f calls, %.3f ms per frame\n", glFunctionName(function),
+                static_cast<double>(this->glCallTotals.calls[function]) / this->glCallFrames,
+                this->glCallTotals.nanoseconds[function] / 1e6 / this->glCallFrames);
+        }
+    }
+}
+
+static std::string jsonEscape(const std::string& text)
+{
+    std::string escaped;
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            escaped += '\\';
+        }
+        // Driver messages can span lines
+        escaped += static_cast<unsigned char>(c) < 0x20 ? ' ' : c;
+    }
+    return escaped;
+}
+
+bool FrameStats::writeJson(const std::string& path, const std::string& scene, const HeadlessOptions& options) const
+{
+    if (this->frameTimes.empty())
+    {
+        return false;
+    }
+    double frameCount = static_cast<double>(this->frameTimes.size());
+    double average = std::accumulate(this->frameTimes.begin(), this->frameTimes.end(), 0.0) / frameCount;
+    const char* renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+
+    FILE* file = std::fopen(path.c_str(), "w");
+    if (!file)
+    {
+        std::cout << "Failed to write benchmark results: " << path << std::endl;
+        return false;
+    }
+    std::fprintf(file, "{\n");
+    std::fprintf(file, "  \"scene\": \"%s\",\n", jsonEscape(scene).c_str());
+    std::fprintf(file, "  \"renderer\": \"%s\",\n", jsonEscape(renderer ? renderer : "unknown").c_str());
+    std::fprintf(file, "  \"width\": %d,\n  \"height\": %d,\n", options.width, options.height);
+    std::fprintf(file, "  \"warmupFrames\": %d,\n  \"frames\": %zu,\n", options.warmupFrames, this->frameTimes.size());
+    std::fprintf(file, "  \"cameraPath\": \"%s\",\n", jsonEscape(options.cameraPath.empty() ? "orbit" : options.cameraPath).c_str());
+    std::fprintf(file, "  \"cpuFrameMs\": { \"avg\": %.4f, \"min\": %.4f, \"median\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f },\n",
+        average, percentile(0.0), percentile(50.0), percentile(95.0), percentile(99.0), percentile(100.0));
+    std::fprintf(file, "  \"drawCallsPerFrame\": %.1f,\n", this->totals.drawCalls / frameCount);
+    std::fprintf(file, "  \"trianglesPerFrame\": %.1f,\n", this->totals.triangles / frameCount);
+    std::fprintf(file, "  \"stateChangesPerFrame\": %.1f%s\n", this->totals.stateChanges / frameCount,
+        this->glCallFrames > 0 ? "," : "");
+    if (this->glCallFrames > 0)
+    {
+        // Per frame averages of every entry point that was called, most driver time first
+        std::vector<int> functions = calledGlFunctions();
+        unsigned long long calls = 0, nanoseconds = 0;
+        for (int function : functions)
+        {
+            calls += this->glCallTotals.calls[function];
+            nanoseconds += this->glCallTotals.nanoseconds[function];
+        }
+        std::fprintf(file, "  \"glCallsPerFrame\": %.1f,\n", static_cast<double>(calls) / this->glCallFrames);
+        std::fprintf(file, "  \"glDriverMsPerFrame\": %.4f,\n", nanoseconds / 1e6 / this->glCallFrames);
+        std::fprintf(file, "  \"glFunctions\": [\n");
+        for (size_t i = 0; i < functions.size(); i++)
+        {
+            int function = functions[i];
+            std::fprintf(file, "    { \"name\": \"%s\", \"callsPerFrame\": %.2f, \"msPerFrame\": %.4f }%s\n",
+                glFunctionName(function), static_cast<double>(this->glCallTotals.calls[function]) / this->glCallFrames,
+                this->glCallTotals.nanoseconds[function] / 1e6 / this->glCallFrames, i + 1 < functions.size() ? "," : "");
+        }
+        std::fprintf(file, "  ],\n");
+        std::fprintf(file, "  \"glDebugOutput\": %s,\n", glDebugOutputEnabled() ? "true" : "false");
+        std::vector<GlDebugMessage> messages = getGlDebugMessages();
+        std::fprintf(file, "  \"glPerformanceMessages\": [\n");
+        for (size_t i = 0; i < messages.size(); i++)
+        {
+            std::fprintf(file, "    { \"count\": %llu, \"message\": \"%s\" }%s\n", messages[i].count,
+                jsonEscape(messages[i].text).c_str(), i + 1 < messages.size() ? "," : "");
+        }
+        std::fprintf(file, "  ]\n");
+    }
+    std::fprintf(file, "}\n");
+    return std::fclose(file) == 0;
+}
+
+CameraPath CameraPath::orbit(glm::vec3 target, float radius, float height, int frameCount)
+{
+    CameraPath path;
+    for (int frame = 0; frame < frameCount; frame++)
+    {
+        float angle = 2.0f * 3.14159265f * frame / frameCount;
+        glm::vec3 position = target + glm::vec3(radius * std::sin(angle), height, radius * std::cos(angle));
+        path.record(position, glm::normalize(target - position));
+    }
+    return path;
+}
+
+bool CameraPath::load(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        return false;
+    }
+
+    this->positions.clear();
+    this->fronts.clear();
+    glm::vec3 position, front;
+    while (file >> position.x >> position.y >> position.z >> front.x >> front.y >> front.z)
+    {
+        record(position, front);
+    }
+    return !empty();
+}
+
+bool CameraPath::save(const std::string& path) const
+{
+    std::ofstream file(path);
+    for (size_t i = 0; i < this->positions.size(); i++)
+    {
+        file << this->positions[i].x << " " << this->positions[i].y << " " << this->positions[i].z << " "
+            << this->fronts[i].x << " " << this->fronts[i].y << " " << this->fronts[i].z << "\n";
+    }
+    return file.good();
+}
+
+void CameraPath::record(glm::vec3 position, glm::vec3 front)
+{
+    this->positions.push_back(position);
+    this->fronts.push_back(front);
+}
+
+void CameraPath::sample(int frame, glm::vec3* position, glm::vec3* front) const
+{
+    size_t index = static_cast<size_t>(frame) % this->positions.size();
+    *position = this->positions[index];
+    *front = this->fronts[index];
+}
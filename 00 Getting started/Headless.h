@@ -0,0 +1,127 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "GLInstrumentation.h"
+#include "RenderStats.h"
+
+struct HeadlessOptions
+{
+    bool enabled = false;
+    int frames = 300;
+    int warmupFrames = 0; // Rendered before the measured frames and not included in the stats
+    int width = 0;
+    int height = 0;
+    std::string screenshotPath; // Last frame is written here as a PPM image when set
+    std::string jsonPath; // Benchmark results are written here as JSON when set
+    std::string cameraPath; // Recorded camera path to replay instead of the orbit
+    std::string recordCameraPath; // Windowed runs record the camera path here when set
+    std::string tracePath; // Profiler zones are written here as a Chrome trace on exit when set
+    bool glCalls = false; // Count GL calls per entry point and collect driver performance warnings
+};
+
+/// <summary>
+/// Parses the headless command line options: --headless, --frames N, --size WxH, --screenshot file.ppm,
+/// --warmup N, --json file.json, --camera-path file, --record-camera file, --trace file.json and
+/// --gl-calls. --benchmark is --headless with 60 warmup frames unless --warmup is given. Width and
+/// height default to the window size of the chapter.
+/// </summary>
+HeadlessOptions parseHeadlessOptions(int argc, char* argv[], int defaultWidth, int defaultHeight);
+
+/// <summary>
+/// OpenGL 3.3 core context without a window, for running the scenes on machines without a display or GPU
+/// (e.g. Mesa llvmpipe on CI). Uses a surfaceless EGL context on Linux and a hidden GLFW window on Windows.
+/// Everything is rendered into an offscreen framebuffer that stays bound for the whole run.
+/// </summary>
+class HeadlessContext
+{
+public:
+    HeadlessContext();
+    ~HeadlessContext();
+
+    /// <summary>
+    /// Creates the context, makes it current, loads the OpenGL functions and binds the offscreen framebuffer.
+    /// A debug context makes drivers report GL_KHR_debug messages, at some cost.
+    /// </summary>
+    bool create(int width, int height, bool debugContext = false);
+    void destroy();
+
+    unsigned int getFramebuffer() const { return this->framebuffer; }
+    bool saveScreenshot(const std::string& path) const;
+
+    /// <summary>
+    /// Address of an OpenGL function of the current context (eglGetProcAddress or glfwGetProcAddress).
+    /// </summary>
+    static void* getProcAddress(const char* name);
+
+private:
+    void* display;
+    void* context;
+    int width;
+    int height;
+    unsigned int framebuffer;
+    unsigned int colorBuffer;
+    unsigned int depthStencilBuffer;
+};
+
+/// <summary>
+/// CPU frame times and render stats of a run, reported as min/median/p95/p99/max and per frame averages.
+/// </summary>
+class FrameStats
+{
+public:
+    void addFrame(double milliseconds, const RenderStats& renderStats = RenderStats());
+
+    /// <summary>
+    /// Adds one frame of GL call counters, reported per frame and per entry point when any were added.
+    /// </summary>
+    void addGlCalls(const GlCallCounters& counters);
+    double percentile(double p) const;
+    void print(const std::string& name) const;
+
+    /// <summary>
+    /// Writes the results as one JSON object, see README.md for the fields.
+    /// </summary>
+    bool writeJson(const std::string& path, const std::string& scene, const HeadlessOptions& options) const;
+
+private:
+    std::vector<double> frameTimes;
+    RenderStats totals;
+    int glCallFrames = 0;
+    GlCallCounters glCallTotals;
+
+    /// <summary>
+    /// Entry points that were called, the ones with the most driver time first.
+    /// </summary>
+    std::vector<int> calledGlFunctions() const;
+};
+
+/// <summary>
+/// Camera poses replayed one per frame, so headless runs render the same frames on every machine.
+/// Paths are either generated (orbit) or recorded from a windowed run and stored as text, one
+/// "px py pz fx fy fz" pose per line.
+/// </summary>
+class CameraPath
+{
+public:
+    /// <summary>
+    /// One orbit around target over frameCount frames, looking at it.
+    /// </summary>
+    static CameraPath orbit(glm::vec3 target, float radius, float height, int frameCount);
+
+    bool load(const std::string& path);
+    bool save(const std::string& path) const;
+    void record(glm::vec3 position, glm::vec3 front);
+
+    /// <summary>
+    /// Sets the pose of the given frame, the path repeats when it is shorter than the run.
+    /// </summary>
+    void sample(int frame, glm::vec3* position, glm::vec3* front) const;
+    bool empty() const { return this->positions.empty(); }
+
+private:
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> fronts;
+};
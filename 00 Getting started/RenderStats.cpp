@@ -0,0 +1,121 @@
+#include "RenderStats.h"
+
+#include <glad/glad.h>
+
+static RenderStats stats;
+
+static unsigned long long triangleCount(GLenum mode, GLsizei count)
+{
+    switch (mode)
+    {
+    case GL_TRIANGLES:
+        return count / 3;
+    case GL_TRIANGLE_STRIP:
+    case GL_TRIANGLE_FAN:
+        return count > 2 ? count - 2 : 0;
+    default:
+        return 0; // Points and lines
+    }
+}
+
+static PFNGLDRAWARRAYSPROC realDrawArrays = nullptr;
+static PFNGLDRAWELEMENTSPROC realDrawElements = nullptr;
+static PFNGLDRAWARRAYSINSTANCEDPROC realDrawArraysInstanced = nullptr;
+static PFNGLDRAWELEMENTSINSTANCEDPROC realDrawElementsInstanced = nullptr;
+
+static void APIENTRY countedDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+    stats.drawCalls++;
+    stats.triangles += triangleCount(mode, count);
+    realDrawArrays(mode, first, count);
+}
+
+static void APIENTRY countedDrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices)
+{
+    stats.drawCalls++;
+    stats.triangles += triangleCount(mode, count);
+    realDrawElements(mode, count, type, indices);
+}
+
+static void APIENTRY countedDrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instanceCount)
+{
+    stats.drawCalls++;
+    stats.triangles += triangleCount(mode, count) * instanceCount;
+    realDrawArraysInstanced(mode, first, count, instanceCount);
+}
+
+static void APIENTRY countedDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void* indices,
+    GLsizei instanceCount)
+{
+    stats.drawCalls++;
+    stats.triangles += triangleCount(mode, count) * instanceCount;
+    realDrawElementsInstanced(mode, count, type, indices, instanceCount);
+}
+
+// Defines the real_<name> pointer and a counted_<name> wrapper that counts a state change and forwards
+#define COUNTED_STATE_CHANGE(name, type, params, args) \
+    static type real_##name = nullptr; \
+    static void APIENTRY counted_##name params \
+    { \
+        stats.stateChanges++; \
+        real_##name args; \
+    }
+
+COUNTED_STATE_CHANGE(glUseProgram, PFNGLUSEPROGRAMPROC, (GLuint program), (program))
+COUNTED_STATE_CHANGE(glBindVertexArray, PFNGLBINDVERTEXARRAYPROC, (GLuint array), (array))
+COUNTED_STATE_CHANGE(glBindTexture, PFNGLBINDTEXTUREPROC, (GLenum target, GLuint texture), (target, texture))
+COUNTED_STATE_CHANGE(glBindFramebuffer, PFNGLBINDFRAMEBUFFERPROC, (GLenum target, GLuint framebuffer), (target, framebuffer))
+COUNTED_STATE_CHANGE(glEnable, PFNGLENABLEPROC, (GLenum cap), (cap))
+COUNTED_STATE_CHANGE(glDisable, PFNGLDISABLEPROC, (GLenum cap), (cap))
+COUNTED_STATE_CHANGE(glDepthFunc, PFNGLDEPTHFUNCPROC, (GLenum func), (func))
+COUNTED_STATE_CHANGE(glDepthMask, PFNGLDEPTHMASKPROC, (GLboolean flag), (flag))
+COUNTED_STATE_CHANGE(glStencilFunc, PFNGLSTENCILFUNCPROC, (GLenum func, GLint ref, GLuint mask), (func, ref, mask))
+COUNTED_STATE_CHANGE(glStencilOp, PFNGLSTENCILOPPROC, (GLenum fail, GLenum zfail, GLenum zpass), (fail, zfail, zpass))
+COUNTED_STATE_CHANGE(glStencilMask, PFNGLSTENCILMASKPROC, (GLuint mask), (mask))
+COUNTED_STATE_CHANGE(glBlendFunc, PFNGLBLENDFUNCPROC, (GLenum sfactor, GLenum dfactor), (sfactor, dfactor))
+COUNTED_STATE_CHANGE(glCullFace, PFNGLCULLFACEPROC, (GLenum mode), (mode))
+
+#define INSTALL_STATE_CHANGE(name) \
+    real_##name = glad_##name; \
+    glad_##name = counted_##name
+
+void installRenderStatsHooks()
+{
+    if (realDrawArrays)
+    {
+        return; // Already installed
+    }
+
+    realDrawArrays = glad_glDrawArrays;
+    glad_glDrawArrays = countedDrawArrays;
+    realDrawElements = glad_glDrawElements;
+    glad_glDrawElements = countedDrawElements;
+    realDrawArraysInstanced = glad_glDrawArraysInstanced;
+    glad_glDrawArraysInstanced = countedDrawArraysInstanced;
+    realDrawElementsInstanced = glad_glDrawElementsInstanced;
+    glad_glDrawElementsInstanced = countedDrawElementsInstanced;
+
+    INSTALL_STATE_CHANGE(glUseProgram);
+    INSTALL_STATE_CHANGE(glBindVertexArray);
+    INSTALL_STATE_CHANGE(glBindTexture);
+    INSTALL_STATE_CHANGE(glBindFramebuffer);
+    INSTALL_STATE_CHANGE(glEnable);
+    INSTALL_STATE_CHANGE(glDisable);
+    INSTALL_STATE_CHANGE(glDepthFunc);
+    INSTALL_STATE_CHANGE(glDepthMask);
+    INSTALL_STATE_CHANGE(glStencilFunc);
+    INSTALL_STATE_CHANGE(glStencilOp);
+    INSTALL_STATE_CHANGE(glStencilMask);
+    INSTALL_STATE_CHANGE(glBlendFunc);
+    INSTALL_STATE_CHANGE(glCullFace);
+}
+
+const RenderStats& getRenderStats()
+{
+    return stats;
+}
+
+void resetRenderStats()
+{
+    stats = RenderStats();
+}
@@ -4,9 +4,11 @@
 #include <sstream>
 #include <iostream>
 #include <glm/gtc/type_ptr.hpp>
+#include "Profiler.h"
 
 Shader::Shader(const char* vertexPath, const char* fragmentPath)
 {
+    PROFILE_SCOPE("Shader::Shader");
     std::string vertexCode;
     std::string fragmentCode;
     std::ifstream vShaderFile;
@@ -78,6 +80,7 @@ void Shader::setMat4(const std::string& name, glm::mat4 value) const
 
 void Shader::compileAndLink(const char* vShaderCode, const char* fShaderCode)
 {
+    PROFILE_SCOPE("Shader::compileAndLink");
     unsigned int vertex, fragment;
     // vertex shader
     vertex = glCreateShader(GL_VERTEX_SHADER);
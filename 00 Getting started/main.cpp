@@ -1,3 +1,4 @@
+#include <chrono>
 #include <iostream>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -8,6 +9,8 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "Shader.h"
+#include "Headless.h"
+#include "Profiler.h"
 
 #define WINDOW_WIDTH 800
 #define WINDOW_HEIGHT 600
@@ -32,6 +35,7 @@ glm::mat4 getViewMatrix();
 glm::mat4 getProjectionMatrix();
 glm::mat4 transform();
 void deinitOpengl();
+int runHeadless(const HeadlessOptions& options);
 
 float vertices[] = {
     -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
@@ -122,8 +126,14 @@ bool isFirstMouse = true;
 float lastMouseX = WINDOW_WIDTH / 2;
 float lastMouseY = WINDOW_HEIGHT / 2;
 
-int main()
+int main(int argc, char* argv[])
 {
+    HeadlessOptions headless = parseHeadlessOptions(argc, argv, WINDOW_WIDTH, WINDOW_HEIGHT);
+    if (headless.enabled)
+    {
+        return runHeadless(headless);
+    }
+
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -155,28 +165,119 @@ int main()
 
     initOpengl();
 
+    // Records the camera once per frame for replaying with --camera-path
+    CameraPath recordedPath;
+
     while (!glfwWindowShouldClose(window))
     {
+        PROFILE_SCOPE("frame");
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
         processInput(window);
 
+        if (!headless.recordCameraPath.empty())
+        {
+            recordedPath.record(cameraPosition, cameraFront);
+        }
+
         renderLoop();
 
-        glfwSwapBuffers(window);
+        {
+            PROFILE_SCOPE("glfwSwapBuffers"); // Includes waiting for vsync
+            glfwSwapBuffers(window);
+        }
         glfwPollEvents();
     }
 
+    if (!headless.recordCameraPath.empty())
+    {
+        recordedPath.save(headless.recordCameraPath);
+    }
+    if (!headless.tracePath.empty())
+    {
+        Profiler::writeChromeTrace(headless.tracePath);
+    }
+
     deinitOpengl();
     glfwTerminate();
 
     return 0;
 }
 
+int runHeadless(const HeadlessOptions& options)
+{
+    HeadlessContext context;
+    if (!context.create(options.width, options.height, options.glCalls))
+    {
+        return -1;
+    }
+    installRenderStatsHooks();
+    if (options.glCalls)
+    {
+        installGlInstrumentation(HeadlessContext::getProcAddress);
+    }
+
+    CameraPath cameraPath = CameraPath::orbit(glm::vec3(0.0f, 0.0f, -5.0f), 12.0f, 2.0f, options.frames);
+    if (!options.cameraPath.empty() && !cameraPath.load(options.cameraPath))
+    {
+        std::cout << "Failed to load camera path: " << options.cameraPath << std::endl;
+        return -1;
+    }
+
+    initOpengl();
+
+    // Fixed timestep and camera path so runs on different machines render the same frames. Warmup
+    // frames replay the start of the path and are not measured.
+    FrameStats stats;
+    deltaTime = 1.0f / 60.0f;
+    for (int frame = -options.warmupFrames; frame < options.frames; frame++)
+    {
+        PROFILE_SCOPE("frame");
+        cameraPath.sample(frame < 0 ? frame + options.warmupFrames : frame, &cameraPosition, &cameraFront);
+
+        resetRenderStats();
+        resetGlCallCounters();
+        auto start = std::chrono::steady_clock::now();
+        renderLoop();
+        {
+            PROFILE_SCOPE("glFinish"); // There is no swap to wait for, so wait for the GPU here to include its time
+            glFinish();
+        }
+        double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (frame >= 0)
+        {
+            stats.addFrame(milliseconds, getRenderStats());
+            if (options.glCalls)
+            {
+                stats.addGlCalls(getGlCallCounters());
+            }
+        }
+    }
+    stats.print("00 Getting started (headless, " + std::to_string(options.width) + "x" + std::to_string(options.height) + ")");
+
+    if (!options.jsonPath.empty())
+    {
+        stats.writeJson(options.jsonPath, "00 Getting started", options);
+    }
+    if (!options.screenshotPath.empty())
+    {
+        context.saveScreenshot(options.screenshotPath);
+    }
+    if (!options.tracePath.empty())
+    {
+        Profiler::writeChromeTrace(options.tracePath);
+    }
+
+    deinitOpengl();
+    context.destroy();
+    return 0;
+}
+
 void initOpengl()
 {
+    PROFILE_SCOPE("initOpengl");
     glEnable(GL_DEPTH_TEST);
 
     ourShader = new Shader(V_SHADER_FILE_PATH, F_SHADER_FILE_PATH);
@@ -252,6 +353,7 @@ void initOpengl()
 
 void renderLoop()
 {
+    PROFILE_SCOPE("renderLoop");
     glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -0,0 +1,245 @@
+#include "DeferredRenderer.h"
+
+#include <glad/glad.h>
+#include <cmath>
+#include <iostream>
+#include "Profiler.h"
+
+#define V_GEOMETRY_SHADER_PATH "shaders/shader.vert"
+#define F_GEOMETRY_SHADER_PATH "shaders/gbuffer.frag"
+#define V_FULLSCREEN_SHADER_PATH "shaders/deferred_fullscreen.vert"
+#define F_FULLSCREEN_SHADER_PATH "shaders/deferred_fullscreen.frag"
+#define V_POINT_LIGHT_SHADER_PATH "shaders/deferred_point.vert"
+#define F_POINT_LIGHT_SHADER_PATH "shaders/deferred_point.frag"
+
+// Tessellation of the light volume sphere
+#define SPHERE_SLICES 16
+#define SPHERE_STACKS 8
+
+// G-buffer texture units, the units of the forward material are not used by the lighting passes
+#define ALBEDO_SPECULAR_UNIT 0
+#define NORMAL_SHININESS_UNIT 1
+#define DEPTH_UNIT 2
+
+DeferredRenderer::DeferredRenderer()
+    : geometryShader(V_GEOMETRY_SHADER_PATH, F_GEOMETRY_SHADER_PATH),
+    fullscreenShader(V_FULLSCREEN_SHADER_PATH, F_FULLSCREEN_SHADER_PATH),
+    pointLightShader(V_POINT_LIGHT_SHADER_PATH, F_POINT_LIGHT_SHADER_PATH), width(0), height(0), framebuffer(0),
+    albedoSpecular(0), normalShininess(0), depthStencil(0), emptyVao(0), sphereVao(0), sphereVertexBuffer(0),
+    sphereIndexBuffer(0), sphereIndexCount(0), instanceBuffer(0)
+{
+    glGenVertexArrays(1, &this->emptyVao);
+    createLightVolume();
+}
+
+DeferredRenderer::~DeferredRenderer()
+{
+    deleteGBuffer();
+    const unsigned int vertexArrays[] = { this->emptyVao, this->sphereVao };
+    const unsigned int buffers[] = { this->sphereVertexBuffer, this->sphereIndexBuffer, this->instanceBuffer };
+    glDeleteVertexArrays(2, vertexArrays);
+    glDeleteBuffers(3, buffers);
+}
+
+void DeferredRenderer::createGBuffer(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+    glGenFramebuffers(1, &this->framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+
+    // 8 bytes of colour per pixel next to the depth buffer every renderer needs anyway
+    struct Attachment
+    {
+        unsigned int* texture;
+        GLint internalFormat;
+        GLenum format;
+        GLenum type;
+        GLenum attachment;
+    };
+    const Attachment attachments[] = {
+        { &this->albedoSpecular, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, GL_COLOR_ATTACHMENT0 },
+        { &this->normalShininess, GL_RGB10_A2, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, GL_COLOR_ATTACHMENT1 },
+        { &this->depthStencil, GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, GL_DEPTH_STENCIL_ATTACHMENT },
+    };
+    for (const Attachment& attachment : attachments)
+    {
+        glGenTextures(1, attachment.texture);
+        glBindTexture(GL_TEXTURE_2D, *attachment.texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, attachment.internalFormat, width, height, 0, attachment.format, attachment.type, nullptr);
+        // Read with texelFetch, one texel per pixel
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, attachment.attachment, GL_TEXTURE_2D, *attachment.texture, 0);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, drawBuffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cout << "ERROR::DEFERRED::G-BUFFER_INCOMPLETE" << std::endl;
+    }
+}
+
+void DeferredRenderer::deleteGBuffer()
+{
+    if (this->framebuffer)
+    {
+        const unsigned int textures[] = { this->albedoSpecular, this->normalShininess, this->depthStencil };
+        glDeleteTextures(3, textures);
+        glDeleteFramebuffers(1, &this->framebuffer);
+        this->framebuffer = 0;
+    }
+}
+
+void DeferredRenderer::createLightVolume()
+{
+    // The faces of a tessellated unit sphere cut inside it, scale the vertices out so the faces
+    // enclose it and no lit pixel is missed at the edge of a light
+    const float pi = 3.14159265f;
+    const float scale = 1.0f / (std::cos(pi / SPHERE_SLICES) * std::cos(pi / (2 * SPHERE_STACKS)));
+
+    std::vector<glm::vec3> vertices;
+    for (int stack = 0; stack <= SPHERE_STACKS; stack++)
+    {
+        float phi = pi * stack / SPHERE_STACKS;
+        for (int slice = 0; slice <= SPHERE_SLICES; slice++)
+        {
+            float theta = 2.0f * pi * slice / SPHERE_SLICES;
+            vertices.push_back(scale * glm::vec3(std::sin(phi) * std::cos(theta), std::cos(phi), std::sin(phi) * std::sin(theta)));
+        }
+    }
+    // Counter clockwise seen from outside
+    std::vector<unsigned short> indices;
+    for (int stack = 0; stack < SPHERE_STACKS; stack++)
+    {
+        for (int slice = 0; slice < SPHERE_SLICES; slice++)
+        {
+            unsigned short a = static_cast<unsigned short>(stack * (SPHERE_SLICES + 1) + slice);
+            unsigned short b = static_cast<unsigned short>(a + SPHERE_SLICES + 1);
+            const unsigned short quad[] = { a, static_cast<unsigned short>(a + 1), b,
+                b, static_cast<unsigned short>(a + 1), static_cast<unsigned short>(b + 1) };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    }
+    this->sphereIndexCount = static_cast<unsigned int>(indices.size());
+
+    glGenVertexArrays(1, &this->sphereVao);
+    glGenBuffers(1, &this->sphereVertexBuffer);
+    glGenBuffers(1, &this->sphereIndexBuffer);
+    glGenBuffers(1, &this->instanceBuffer);
+
+    glBindVertexArray(this->sphereVao);
+    glBindBuffer(GL_ARRAY_BUFFER, this->sphereVertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->sphereIndexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), indices.data(), GL_STATIC_DRAW);
+
+    // One light per instance
+    glBindBuffer(GL_ARRAY_BUFFER, this->instanceBuffer);
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        glVertexAttribPointer(1 + i, 4, GL_FLOAT, GL_FALSE, 3 * sizeof(glm::vec4), (void*)(i * sizeof(glm::vec4)));
+        glEnableVertexAttribArray(1 + i);
+        glVertexAttribDivisor(1 + i, 1);
+    }
+    glBindVertexArray(0);
+}
+
+void DeferredRenderer::beginGeometryPass(int viewportWidth, int viewportHeight)
+{
+    PROFILE_SCOPE("DeferredRenderer::geometryPass");
+    if (viewportWidth != this->width || viewportHeight != this->height)
+    {
+        deleteGBuffer();
+        createGBuffer(viewportWidth, viewportHeight);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void DeferredRenderer::bindGBuffer(const Shader& shader, const glm::mat4& inverseViewProjection) const
+{
+    shader.setInt("gAlbedoSpecular", ALBEDO_SPECULAR_UNIT);
+    shader.setInt("gNormalShininess", NORMAL_SHININESS_UNIT);
+    shader.setInt("gDepth", DEPTH_UNIT);
+    shader.setMat4("inverseViewProjection", inverseViewProjection);
+    shader.setVec2("viewportSize", glm::vec2(this->width, this->height));
+}
+
+void DeferredRenderer::lightingPass(unsigned int targetFramebuffer, const std::vector<PointLight>& lights,
+    const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPos)
+{
+    PROFILE_SCOPE("DeferredRenderer::lightingPass");
+    const glm::mat4 viewProjection = projection * view;
+    const glm::mat4 inverseViewProjection = glm::inverse(viewProjection);
+
+    glActiveTexture(GL_TEXTURE0 + ALBEDO_SPECULAR_UNIT);
+    glBindTexture(GL_TEXTURE_2D, this->albedoSpecular);
+    glActiveTexture(GL_TEXTURE0 + NORMAL_SHININESS_UNIT);
+    glBindTexture(GL_TEXTURE_2D, this->normalShininess);
+    glActiveTexture(GL_TEXTURE0 + DEPTH_UNIT);
+    glBindTexture(GL_TEXTURE_2D, this->depthStencil);
+    glActiveTexture(GL_TEXTURE0);
+
+    // Directional and spot light, every pixel the scene covers
+    glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
+    glDisable(GL_DEPTH_TEST);
+    this->fullscreenShader.use();
+    bindGBuffer(this->fullscreenShader, inverseViewProjection);
+    this->fullscreenShader.setVec3("viewPos", viewPos);
+    glBindVertexArray(this->emptyVao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    // The scene's depth, for the light volumes below and the forward drawn objects after them
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, this->framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, targetFramebuffer);
+    glBlitFramebuffer(0, 0, this->width, this->height, 0, 0, this->width, this->height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
+
+    if (!lights.empty())
+    {
+        std::vector<glm::vec4> instances(lights.size() * 3);
+        for (size_t i = 0; i < lights.size(); i++)
+        {
+            const PointLight& light = lights[i];
+            instances[i * 3] = glm::vec4(light.position, light.radius);
+            instances[i * 3 + 1] = glm::vec4(light.color, light.constant);
+            instances[i * 3 + 2] = glm::vec4(light.linear, light.quadratic, static_cast<float>(light.shadowSlot), 0.0f);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, this->instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(glm::vec4), instances.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        // Back faces of the spheres that are behind the scene's surface: the pixel lies in front of the
+        // far side of the light, which also works with the camera inside it. Pixels of the background
+        // (depth 1) never pass. The lights add up.
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_GEQUAL);
+        glDepthMask(GL_FALSE);
+        glEnable(GL_CULL_FACE);
+        glCullFace(GL_FRONT);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+
+        this->pointLightShader.use();
+        bindGBuffer(this->pointLightShader, inverseViewProjection);
+        this->pointLightShader.setMat4("viewProjection", viewProjection);
+        this->pointLightShader.setVec3("viewPos", viewPos);
+        glBindVertexArray(this->sphereVao);
+        glDrawElementsInstanced(GL_TRIANGLES, this->sphereIndexCount, GL_UNSIGNED_SHORT, (void*)0,
+            static_cast<GLsizei>(lights.size()));
+
+        glDisable(GL_BLEND);
+        glCullFace(GL_BACK);
+        glDisable(GL_CULL_FACE);
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+    }
+    glEnable(GL_DEPTH_TEST);
+    glBindVertexArray(0);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "LightClusters.h"
+#include "Shader.h"
+
+/// <summary>
+/// Deferred shading. The geometry pass writes a compact G-buffer: albedo and specular intensity in
+/// RGBA8, an octahedral normal and the shininess in RGB10_A2, and depth, from which the lighting passes
+/// reconstruct the position. The directional and spot light are then applied in one full screen pass
+/// and every point light draws a sphere of its radius, adding its light to the pixels inside it. Each
+/// pixel reads its material once, however many lights reach it.
+/// </summary>
+class DeferredRenderer
+{
+public:
+    /// <summary>
+    /// Loads the shaders, the G-buffer is created by the first geometry pass.
+    /// </summary>
+    DeferredRenderer();
+    ~DeferredRenderer();
+    DeferredRenderer(const DeferredRenderer&) = delete;
+    DeferredRenderer& operator=(const DeferredRenderer&) = delete;
+
+    /// <summary>
+    /// Binds and clears the G-buffer, (re)creating it when the viewport size changed. Draw the scene with
+    /// the geometry shader after it.
+    /// </summary>
+    void beginGeometryPass(int viewportWidth, int viewportHeight);
+
+    /// <summary>
+    /// Lights the G-buffer into targetFramebuffer and copies its depth there, so forward drawn objects
+    /// (the light cubes) are hidden by the scene. The directional and spot light uniforms are set on the
+    /// lighting shader beforehand, the same way as for the forward shader.
+    /// </summary>
+    void lightingPass(unsigned int targetFramebuffer, const std::vector<PointLight>& lights, const glm::mat4& view,
+        const glm::mat4& projection, const glm::vec3& viewPos);
+
+    // Writes the G-buffer, uses the forward vertex shader and the same model, view, projection,
+    // normalMat and material uniforms
+    Shader& getGeometryShader() { return this->geometryShader; }
+    // Full screen pass of the directional and spot light
+    Shader& getLightingShader() { return this->fullscreenShader; }
+    // Light volumes of the point lights, set the point shadow uniforms on it before lightingPass
+    Shader& getPointLightShader() { return this->pointLightShader; }
+
+private:
+    void createGBuffer(int width, int height);
+    void deleteGBuffer();
+    void createLightVolume();
+    void bindGBuffer(const Shader& shader, const glm::mat4& inverseViewProjection) const;
+
+private:
+    Shader geometryShader;
+    Shader fullscreenShader;
+    Shader pointLightShader;
+
+    int width;
+    int height;
+    unsigned int framebuffer;
+    unsigned int albedoSpecular;
+    unsigned int normalShininess;
+    unsigned int depthStencil;
+
+    unsigned int emptyVao; // Core profile draws need a vertex array, the full screen triangle has no attributes
+    unsigned int sphereVao;
+    unsigned int sphereVertexBuffer;
+    unsigned int sphereIndexBuffer;
+    unsigned int sphereIndexCount;
+    unsigned int instanceBuffer; // Position and radius, colour and constant, linear, quadratic and shadow slot per light
+};
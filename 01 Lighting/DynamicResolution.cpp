@@ -0,0 +1,91 @@
+#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Smoothing of the frame times, the weight of the newest one
+#define FRAME_TIME_SMOOTHING 0.25
+
+GpuFrameTimer::GpuFrameTimer()
+    : ring(2), lastMilliseconds(0.0), framesRead(0)
+{
+}
+
+void GpuFrameTimer::begin()
+{
+    double milliseconds = 0.0;
+    if (this->ring.readMilliseconds(0, 1, &milliseconds))
+    {
+        this->lastMilliseconds = milliseconds;
+        this->framesRead++;
+    }
+    this->ring.timestamp(0);
+}
+
+void GpuFrameTimer::end()
+{
+    this->ring.timestamp(1);
+    this->ring.endFrame();
+}
+
+DynamicResolution::DynamicResolution(double targetMilliseconds)
+    : target(targetMilliseconds), scale(RESOLUTION_SCALE_MAX), average(0.0), settleFrames(RESOLUTION_SETTLE_FRAMES),
+    changes(0), scaleSum(0.0), frames(0)
+{
+}
+
+float DynamicResolution::update(double frameMilliseconds)
+{
+    this->scaleSum += this->scale;
+    this->frames++;
+
+    // The first frames at a new scale start the average over, the ones before measured the old scale
+    if (this->settleFrames == RESOLUTION_SETTLE_FRAMES)
+    {
+        this->average = frameMilliseconds;
+    }
+    else
+    {
+        this->average += (frameMilliseconds - this->average) * FRAME_TIME_SMOOTHING;
+    }
+    if (this->settleFrames > 1)
+    {
+        this->settleFrames--;
+        return this->scale;
+    }
+    if (this->average <= 0.0 || (this->average <= this->target && this->average >= 0.85 * this->target))
+    {
+        return this->scale;
+    }
+
+    // The scale that would take the target time if the time follows the pixels, at most 4 steps down or
+    // 1 step up at a time
+    float wanted = this->scale * static_cast<float>(std::sqrt(this->target / this->average));
+    wanted = std::min(std::max(wanted, this->scale - 4.0f * RESOLUTION_SCALE_STEP), this->scale + RESOLUTION_SCALE_STEP);
+    wanted = std::round(wanted / RESOLUTION_SCALE_STEP) * RESOLUTION_SCALE_STEP;
+    wanted = std::min(std::max(wanted, RESOLUTION_SCALE_MIN), RESOLUTION_SCALE_MAX);
+    if (std::abs(wanted - this->scale) > 0.5f * RESOLUTION_SCALE_STEP)
+    {
+        this->scale = wanted;
+        this->settleFrames = RESOLUTION_SETTLE_FRAMES;
+        this->changes++;
+    }
+    return this->scale;
+}
+
+int DynamicResolution::scaled(int size) const
+{
+    return std::max(1, static_cast<int>(std::lround(size * this->scale)));
+}
+
+float DynamicResolution::getAverageScale() const
+{
+    return this->frames > 0 ? static_cast<float>(this->scaleSum / this->frames) : this->scale;
+}
+
+void DynamicResolution::resetStats()
+{
+    this->changes = 0;
+    this->scaleSum = 0.0;
+    this->frames = 0;
+}
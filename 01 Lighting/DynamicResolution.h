@@ -0,0 +1,76 @@
+#pragma once
+
+#include "GpuQueryRing.h"
+
+// The scale of the render target's width and height stays within these, in steps of RESOLUTION_SCALE_STEP
+// so it settles instead of recreating the target every few frames
+#define RESOLUTION_SCALE_MIN 0.5f
+#define RESOLUTION_SCALE_MAX 1.0f
+#define RESOLUTION_SCALE_STEP 0.05f
+// Frames measured at a new scale before it can change again
+#define RESOLUTION_SETTLE_FRAMES 8
+
+/// <summary>
+/// GPU time of whole frames from timestamp queries around them. Results are read back from a
+/// GpuQueryRing, so they are a few frames old and reading never waits. Without timestamps (see
+/// isSupported()) there is never a result and the callers fall back to the CPU time.
+/// </summary>
+class GpuFrameTimer
+{
+public:
+    GpuFrameTimer();
+
+    bool isSupported() const { return this->ring.hasTimestamps(); }
+
+    // Once per frame around everything it renders
+    void begin();
+    void end();
+
+    // False until the first frame was read back
+    bool hasResult() const { return this->framesRead > 0; }
+    double getLastMilliseconds() const { return this->lastMilliseconds; }
+
+private:
+    GpuQueryRing ring; // The timestamps before and after each frame
+    double lastMilliseconds;
+    unsigned int framesRead;
+};
+
+/// <summary>
+/// Picks the resolution scale that holds a target frame time. The frame times are smoothed and, once the
+/// current scale has been measured for RESOLUTION_SETTLE_FRAMES, a frame over the target or well under
+/// it (below 85%) moves the scale towards the one that would hit it, assuming the cost follows the pixel
+/// count. Going down is allowed to be faster than going up, so a frame rate drop is fixed quickly and the
+/// resolution comes back carefully.
+/// </summary>
+class DynamicResolution
+{
+public:
+    DynamicResolution(double targetMilliseconds);
+
+    /// <summary>
+    /// Adds the time of the frame rendered at the current scale, returns the scale of the next one.
+    /// </summary>
+    float update(double frameMilliseconds);
+
+    float getScale() const { return this->scale; }
+    double getTarget() const { return this->target; }
+
+    // Width and height of a width x height output at the current scale, at least 1 pixel
+    int scaled(int size) const;
+
+    // Changes and average scale of the frames since the last resetStats()
+    unsigned int getChanges() const { return this->changes; }
+    float getAverageScale() const;
+    void resetStats();
+
+private:
+    double target;
+    float scale;
+    double average; // Smoothed frame time at the current scale
+    unsigned int settleFrames; // Left before the scale may change again
+
+    unsigned int changes;
+    double scaleSum;
+    unsigned int frames;
+};
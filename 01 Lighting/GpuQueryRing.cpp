@@ -0,0 +1,95 @@
+#include "GpuQueryRing.h"
+
+#include <glad/glad.h>
+
+static bool timestampsHaveBits()
+{
+    GLint bits = 0;
+    glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+    // Drivers without timer queries may reject the target
+    while (glGetError() != GL_NO_ERROR)
+    {
+    }
+    return bits > 0;
+}
+
+GpuQueryRing::GpuQueryRing(unsigned int queriesPerFrame)
+    : queriesPerFrame(queriesPerFrame), timestamps(timestampsHaveBits()), queries(QUERY_RING_FRAMES * queriesPerFrame),
+    issued(QUERY_RING_FRAMES * queriesPerFrame, false), frame(0), dropped(0)
+{
+    glGenQueries(static_cast<GLsizei>(this->queries.size()), this->queries.data());
+}
+
+GpuQueryRing::~GpuQueryRing()
+{
+    glDeleteQueries(static_cast<GLsizei>(this->queries.size()), this->queries.data());
+}
+
+void GpuQueryRing::timestamp(unsigned int index)
+{
+    if (!this->timestamps)
+    {
+        return;
+    }
+    unsigned int query = slotQuery(index);
+    glQueryCounter(this->queries[query], GL_TIMESTAMP);
+    this->issued[query] = true;
+}
+
+void GpuQueryRing::begin(unsigned int target, unsigned int index)
+{
+    unsigned int query = slotQuery(index);
+    glBeginQuery(target, this->queries[query]);
+    this->issued[query] = true;
+}
+
+void GpuQueryRing::end(unsigned int target)
+{
+    glEndQuery(target);
+}
+
+bool GpuQueryRing::readBack(unsigned int index, unsigned long long* result)
+{
+    unsigned int query = slotQuery(index);
+    if (!this->issued[query])
+    {
+        return false;
+    }
+    this->issued[query] = false;
+    GLuint available = 0;
+    glGetQueryObjectuiv(this->queries[query], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+    {
+        this->dropped++;
+        return false;
+    }
+    GLuint64 value = 0;
+    glGetQueryObjectui64v(this->queries[query], GL_QUERY_RESULT, &value);
+    *result = value;
+    return true;
+}
+
+bool GpuQueryRing::readMilliseconds(unsigned int start, unsigned int end, double* milliseconds)
+{
+    unsigned long long startTime = 0;
+    unsigned long long endTime = 0;
+    // Both are read so neither stays marked as issued
+    bool hasStart = readBack(start, &startTime);
+    bool hasEnd = readBack(end, &endTime);
+    if (!hasStart || !hasEnd)
+    {
+        return false;
+    }
+    *milliseconds = endTime > startTime ? (endTime - startTime) / 1e6 : 0.0;
+    return true;
+}
+
+void GpuQueryRing::endFrame()
+{
+    this->frame++;
+}
+
+unsigned int GpuQueryRing::slotQuery(unsigned int index) const
+{
+    return (this->frame % QUERY_RING_FRAMES) * this->queriesPerFrame + index;
+}
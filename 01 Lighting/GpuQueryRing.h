@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+
+// Frames of queries in flight. A frame's queries are read back when its slot comes round again, this many
+// frames later, by which time the GPU has normally finished them.
+#define QUERY_RING_FRAMES 3
+
+/// <summary>
+/// The queries of the last QUERY_RING_FRAMES frames, queriesPerFrame of them in each, for the GPU timers
+/// and counters. Every frame first reads back what its slot held and then issues the slot's queries
+/// again. A result is only read once the GPU reports it available, so reading never waits; one that is
+/// not done by then is dropped. When the driver's timestamps have no bits (some software rasterisers
+/// report 0), timestamp() does nothing and hasTimestamps() is false.
+/// </summary>
+class GpuQueryRing
+{
+public:
+    /// <summary>
+    /// Creates the queries, the OpenGL context must be current.
+    /// </summary>
+    GpuQueryRing(unsigned int queriesPerFrame);
+    ~GpuQueryRing();
+    GpuQueryRing(const GpuQueryRing&) = delete;
+    GpuQueryRing& operator=(const GpuQueryRing&) = delete;
+
+    bool hasTimestamps() const { return this->timestamps; }
+
+    // Issue query index of the current frame
+    void timestamp(unsigned int index);
+    void begin(unsigned int target, unsigned int index);
+    void end(unsigned int target);
+
+    // The result of query index from QUERY_RING_FRAMES frames ago, read before the current frame issues
+    // it again. False when it wasn't issued then or isn't available yet.
+    bool readBack(unsigned int index, unsigned long long* result);
+    // The time between two timestamps from QUERY_RING_FRAMES frames ago, false unless both were read back
+    bool readMilliseconds(unsigned int start, unsigned int end, double* milliseconds);
+
+    // Once per frame after its queries, the next frame uses the next slot
+    void endFrame();
+
+    // Results that weren't available when their slot came round again
+    unsigned int getDropped() const { return this->dropped; }
+
+private:
+    unsigned int queriesPerFrame;
+    bool timestamps;
+    std::vector<unsigned int> queries; // QUERY_RING_FRAMES slots one after the other
+    std::vector<bool> issued;
+    unsigned int frame;
+    unsigned int dropped;
+
+    unsigned int slotQuery(unsigned int index) const;
+};
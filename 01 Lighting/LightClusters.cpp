@@ -0,0 +1,316 @@
+#include "LightClusters.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "Profiler.h"
+
+// SSE2 is part of every x64 target and of x86 builds with /arch:SSE2 or -msse2
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LIGHT_CLUSTERS_SSE2 1
+#include <emmintrin.h>
+#else
+#define LIGHT_CLUSTERS_SSE2 0
+#endif
+
+// Texels per light in the light buffer texture: (position, radius), (color, constant), (linear, quadratic, shadow slot, 0)
+#define LIGHT_TEXELS 3
+
+float lightRadius(float constant, float linear, float quadratic)
+{
+    // Solve constant + linear * d + quadratic * d^2 = 256 for d
+    const float limit = 256.0f;
+    if (quadratic <= 0.0f)
+    {
+        return linear > 0.0f ? (limit - constant) / linear : 1e30f;
+    }
+    return (-linear + std::sqrt(linear * linear - 4.0f * quadratic * (constant - limit))) / (2.0f * quadratic);
+}
+
+LightClusters::LightClusters(JobSystem* jobs)
+    : jobs(jobs), fovDegrees(0.0f), aspect(0.0f), nearPlane(0.0f), farPlane(0.0f),
+    boundsMin(CLUSTER_COUNT), boundsMax(CLUSTER_COUNT), slots(CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER),
+    slotCounts(CLUSTER_COUNT, 0), grid(CLUSTER_COUNT * 2, 0), lightBuffer(0), gridBuffer(0), indexBuffer(0),
+    lightTexture(0), gridTexture(0), indexTexture(0)
+{
+}
+
+LightClusters::~LightClusters()
+{
+    if (this->lightBuffer)
+    {
+        const unsigned int buffers[] = { this->lightBuffer, this->gridBuffer, this->indexBuffer };
+        const unsigned int textures[] = { this->lightTexture, this->gridTexture, this->indexTexture };
+        glDeleteBuffers(3, buffers);
+        glDeleteTextures(3, textures);
+    }
+}
+
+void LightClusters::setProjection(float fovDegrees, float aspect, float nearPlane, float farPlane)
+{
+    if (fovDegrees == this->fovDegrees && aspect == this->aspect && nearPlane == this->nearPlane &&
+        farPlane == this->farPlane)
+    {
+        return;
+    }
+    this->fovDegrees = fovDegrees;
+    this->aspect = aspect;
+    this->nearPlane = nearPlane;
+    this->farPlane = farPlane;
+
+    // A cluster is the part of a tile's frustum between two slice depths, bounded by the box around
+    // its 8 corners
+    float tanY = std::tan(glm::radians(fovDegrees) * 0.5f);
+    float tanX = tanY * aspect;
+    for (unsigned int slice = 0; slice < CLUSTER_SLICES; slice++)
+    {
+        float depths[2] = {
+            nearPlane * std::pow(farPlane / nearPlane, static_cast<float>(slice) / CLUSTER_SLICES),
+            nearPlane * std::pow(farPlane / nearPlane, static_cast<float>(slice + 1) / CLUSTER_SLICES) };
+        for (unsigned int y = 0; y < CLUSTER_TILES_Y; y++)
+        {
+            float ndcY[2] = { -1.0f + 2.0f * y / CLUSTER_TILES_Y, -1.0f + 2.0f * (y + 1) / CLUSTER_TILES_Y };
+            for (unsigned int x = 0; x < CLUSTER_TILES_X; x++)
+            {
+                float ndcX[2] = { -1.0f + 2.0f * x / CLUSTER_TILES_X, -1.0f + 2.0f * (x + 1) / CLUSTER_TILES_X };
+                glm::vec3 min(1e30f);
+                glm::vec3 max(-1e30f);
+                for (float depth : depths)
+                {
+                    for (float cornerY : ndcY)
+                    {
+                        for (float cornerX : ndcX)
+                        {
+                            glm::vec3 corner(cornerX * depth * tanX, cornerY * depth * tanY, -depth);
+                            min = glm::min(min, corner);
+                            max = glm::max(max, corner);
+                        }
+                    }
+                }
+                unsigned int cluster = (slice * CLUSTER_TILES_Y + y) * CLUSTER_TILES_X + x;
+                this->boundsMin[cluster] = min;
+                this->boundsMax[cluster] = max;
+            }
+        }
+    }
+}
+
+void LightClusters::assign(const std::vector<PointLight>& lights, const glm::mat4& view, bool simd)
+{
+    PROFILE_SCOPE("LightClusters::assign");
+    size_t count = lights.size();
+    this->lightX.resize(count);
+    this->lightY.resize(count);
+    this->lightZ.resize(count);
+    this->lightR.resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::vec4 position = view * glm::vec4(lights[i].position, 1.0f);
+        this->lightX[i] = position.x;
+        this->lightY[i] = position.y;
+        this->lightZ[i] = position.z;
+        this->lightR[i] = lights[i].radius;
+    }
+
+    // Slices are independent of each other, one job each
+    if (this->jobs)
+    {
+        JobCounter assigned;
+        this->jobs->parallelFor(CLUSTER_SLICES, 1, [this, simd](size_t begin, size_t end)
+            {
+                for (size_t slice = begin; slice < end; slice++)
+                {
+                    assignSlice(static_cast<unsigned int>(slice), simd);
+                }
+            }, &assigned);
+        this->jobs->wait(assigned);
+    }
+    else
+    {
+        for (unsigned int slice = 0; slice < CLUSTER_SLICES; slice++)
+        {
+            assignSlice(slice, simd);
+        }
+    }
+
+    // Pack the slots into one list, the shader reads a cluster's lights from its offset on
+    this->indices.clear();
+    for (unsigned int cluster = 0; cluster < CLUSTER_COUNT; cluster++)
+    {
+        unsigned int used = std::min(this->slotCounts[cluster], static_cast<unsigned int>(MAX_LIGHTS_PER_CLUSTER));
+        this->grid[cluster * 2] = static_cast<unsigned int>(this->indices.size());
+        this->grid[cluster * 2 + 1] = used;
+        const unsigned int* slot = &this->slots[cluster * MAX_LIGHTS_PER_CLUSTER];
+        this->indices.insert(this->indices.end(), slot, slot + used);
+    }
+}
+
+void LightClusters::assignSlice(unsigned int slice, bool simd)
+{
+    PROFILE_SCOPE("LightClusters::assignSlice");
+    // Only the lights reaching into the slice's depth range are tested against its clusters. Their
+    // copy is padded to a multiple of 4 with lights that are too far away to touch anything.
+    unsigned int first = slice * CLUSTER_TILES_X * CLUSTER_TILES_Y;
+    float sliceNear = -this->boundsMax[first].z;
+    float sliceFar = -this->boundsMin[first].z;
+    std::vector<float> x, y, z, r;
+    std::vector<unsigned int> index;
+    for (size_t i = 0; i < this->lightX.size(); i++)
+    {
+        float depth = -this->lightZ[i];
+        if (depth + this->lightR[i] >= sliceNear && depth - this->lightR[i] <= sliceFar)
+        {
+            x.push_back(this->lightX[i]);
+            y.push_back(this->lightY[i]);
+            z.push_back(this->lightZ[i]);
+            r.push_back(this->lightR[i]);
+            index.push_back(static_cast<unsigned int>(i));
+        }
+    }
+    size_t sliceLights = index.size();
+    while (x.size() % 4 != 0)
+    {
+        x.push_back(1e18f);
+        y.push_back(1e18f);
+        z.push_back(1e18f);
+        r.push_back(0.0f);
+    }
+
+    for (unsigned int cluster = first; cluster < first + CLUSTER_TILES_X * CLUSTER_TILES_Y; cluster++)
+    {
+        const glm::vec3& min = this->boundsMin[cluster];
+        const glm::vec3& max = this->boundsMax[cluster];
+        unsigned int* slot = &this->slots[cluster * MAX_LIGHTS_PER_CLUSTER];
+        unsigned int found = 0;
+
+        // A sphere overlaps a box when the distance from its centre to the closest point of the box
+        // is at most its radius
+#if LIGHT_CLUSTERS_SSE2
+        if (simd)
+        {
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 minX = _mm_set1_ps(min.x), minY = _mm_set1_ps(min.y), minZ = _mm_set1_ps(min.z);
+            const __m128 maxX = _mm_set1_ps(max.x), maxY = _mm_set1_ps(max.y), maxZ = _mm_set1_ps(max.z);
+            for (size_t i = 0; i < x.size(); i += 4)
+            {
+                __m128 cx = _mm_loadu_ps(&x[i]);
+                __m128 cy = _mm_loadu_ps(&y[i]);
+                __m128 cz = _mm_loadu_ps(&z[i]);
+                __m128 radius = _mm_loadu_ps(&r[i]);
+                __m128 dx = _mm_add_ps(_mm_max_ps(_mm_sub_ps(minX, cx), zero), _mm_max_ps(_mm_sub_ps(cx, maxX), zero));
+                __m128 dy = _mm_add_ps(_mm_max_ps(_mm_sub_ps(minY, cy), zero), _mm_max_ps(_mm_sub_ps(cy, maxY), zero));
+                __m128 dz = _mm_add_ps(_mm_max_ps(_mm_sub_ps(minZ, cz), zero), _mm_max_ps(_mm_sub_ps(cz, maxZ), zero));
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                int mask = _mm_movemask_ps(_mm_cmple_ps(distance, _mm_mul_ps(radius, radius)));
+                for (int lane = 0; mask != 0; lane++, mask >>= 1)
+                {
+                    if (mask & 1)
+                    {
+                        if (found < MAX_LIGHTS_PER_CLUSTER)
+                        {
+                            slot[found] = index[i + lane];
+                        }
+                        found++;
+                    }
+                }
+            }
+            this->slotCounts[cluster] = found;
+            continue;
+        }
+#endif
+        for (size_t i = 0; i < sliceLights; i++)
+        {
+            float dx = std::max(min.x - x[i], 0.0f) + std::max(x[i] - max.x, 0.0f);
+            float dy = std::max(min.y - y[i], 0.0f) + std::max(y[i] - max.y, 0.0f);
+            float dz = std::max(min.z - z[i], 0.0f) + std::max(z[i] - max.z, 0.0f);
+            if (dx * dx + dy * dy + dz * dz <= r[i] * r[i])
+            {
+                if (found < MAX_LIGHTS_PER_CLUSTER)
+                {
+                    slot[found] = index[i];
+                }
+                found++;
+            }
+        }
+        this->slotCounts[cluster] = found;
+    }
+}
+
+void LightClusters::upload(const std::vector<PointLight>& lights)
+{
+    PROFILE_SCOPE("LightClusters::upload");
+    if (!this->lightBuffer)
+    {
+        glGenBuffers(1, &this->lightBuffer);
+        glGenBuffers(1, &this->gridBuffer);
+        glGenBuffers(1, &this->indexBuffer);
+        glGenTextures(1, &this->lightTexture);
+        glGenTextures(1, &this->gridTexture);
+        glGenTextures(1, &this->indexTexture);
+    }
+
+    std::vector<glm::vec4> lightTexels(std::max<size_t>(1, lights.size()) * LIGHT_TEXELS, glm::vec4(0.0f));
+    for (size_t i = 0; i < lights.size(); i++)
+    {
+        const PointLight& light = lights[i];
+        lightTexels[i * LIGHT_TEXELS] = glm::vec4(light.position, light.radius);
+        lightTexels[i * LIGHT_TEXELS + 1] = glm::vec4(light.color, light.constant);
+        lightTexels[i * LIGHT_TEXELS + 2] = glm::vec4(light.linear, light.quadratic, static_cast<float>(light.shadowSlot), 0.0f);
+    }
+    // An empty buffer texture can't be created, keep at least one index
+    if (this->indices.empty())
+    {
+        this->indices.push_back(0);
+    }
+
+    // glBufferData with the new contents every frame, so the driver can hand out fresh storage instead
+    // of waiting for the frame that still reads the old one
+    glBindBuffer(GL_TEXTURE_BUFFER, this->lightBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, lightTexels.size() * sizeof(glm::vec4), lightTexels.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, this->gridBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, this->grid.size() * sizeof(unsigned int), this->grid.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, this->indexBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, this->indices.size() * sizeof(unsigned int), this->indices.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glBindTexture(GL_TEXTURE_BUFFER, this->lightTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, this->lightBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, this->gridTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, this->gridBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, this->indexTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, this->indexBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightClusters::bind(const Shader& shader, int textureUnit, int viewportWidth, int viewportHeight) const
+{
+    glActiveTexture(GL_TEXTURE0 + textureUnit);
+    glBindTexture(GL_TEXTURE_BUFFER, this->lightTexture);
+    glActiveTexture(GL_TEXTURE0 + textureUnit + 1);
+    glBindTexture(GL_TEXTURE_BUFFER, this->gridTexture);
+    glActiveTexture(GL_TEXTURE0 + textureUnit + 2);
+    glBindTexture(GL_TEXTURE_BUFFER, this->indexTexture);
+    glActiveTexture(GL_TEXTURE0);
+
+    shader.setInt("clusterLights", textureUnit);
+    shader.setInt("clusterGrid", textureUnit + 1);
+    shader.setInt("clusterIndices", textureUnit + 2);
+    shader.setVec2("viewportSize", glm::vec2(viewportWidth, viewportHeight));
+    shader.setInt("clusterTilesX", CLUSTER_TILES_X);
+    shader.setInt("clusterTilesY", CLUSTER_TILES_Y);
+    shader.setInt("clusterSlices", CLUSTER_SLICES);
+    shader.setFloat("clusterNear", this->nearPlane);
+    shader.setFloat("clusterFar", this->farPlane);
+}
+
+unsigned int LightClusters::getMaxClusterLights() const
+{
+    return *std::max_element(this->slotCounts.begin(), this->slotCounts.end());
+}
+
+unsigned int LightClusters::getOverflowCount() const
+{
+    return static_cast<unsigned int>(std::count_if(this->slotCounts.begin(), this->slotCounts.end(),
+        [](unsigned int count) { return count > MAX_LIGHTS_PER_CLUSTER; }));
+}
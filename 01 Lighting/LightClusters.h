@@ -0,0 +1,111 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "JobSystem.h"
+#include "Shader.h"
+
+// The view frustum is split into CLUSTER_TILES_X x CLUSTER_TILES_Y screen tiles and CLUSTER_SLICES
+// depth slices, spaced exponentially so near and far clusters have a similar shape
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 9
+#define CLUSTER_SLICES 24
+#define CLUSTER_COUNT (CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES)
+
+// Lights a fragment evaluates at most. A cluster with more keeps the first ones and counts an overflow.
+#define MAX_LIGHTS_PER_CLUSTER 256
+
+struct PointLight
+{
+    glm::vec3 position;
+    glm::vec3 color;
+    float constant;
+    float linear;
+    float quadratic;
+    float radius; // Where the attenuation falls below 1/256 of full brightness, see lightRadius
+    int shadowSlot = -1; // Its tiles in the point shadow atlas, -1 without shadows (see PointShadowAtlas.h)
+};
+
+/// <summary>
+/// Distance at which a light with these attenuation terms contributes less than 1/256 of its full
+/// brightness. The shader fades the light out towards it, so it can be culled beyond.
+/// </summary>
+float lightRadius(float constant, float linear, float quadratic);
+
+/// <summary>
+/// Clustered forward shading. Every frame the point lights are assigned on the CPU to the clusters
+/// their sphere of influence overlaps, and the result is uploaded to three buffer textures: the
+/// lights, an (offset, count) pair per cluster and the light index lists the pairs point into. The
+/// fragment shader finds its cluster from gl_FragCoord and its view depth and only evaluates those lights.
+/// </summary>
+class LightClusters
+{
+public:
+    /// <summary>
+    /// Assigns on the workers of jobs when given, otherwise on the calling thread.
+    /// </summary>
+    LightClusters(JobSystem* jobs = nullptr);
+    ~LightClusters();
+    LightClusters(const LightClusters&) = delete;
+    LightClusters& operator=(const LightClusters&) = delete;
+
+    /// <summary>
+    /// Recomputes the view space bounds of the clusters, only when the projection changed.
+    /// </summary>
+    void setProjection(float fovDegrees, float aspect, float nearPlane, float farPlane);
+
+    /// <summary>
+    /// Assigns the lights to the clusters of the camera with this view matrix. CPU only, simd selects
+    /// the SSE2 sphere/box test over the scalar one where it is available.
+    /// </summary>
+    void assign(const std::vector<PointLight>& lights, const glm::mat4& view, bool simd = true);
+
+    /// <summary>
+    /// Uploads the lights and the last assignment, creating the buffers on first use.
+    /// </summary>
+    void upload(const std::vector<PointLight>& lights);
+
+    /// <summary>
+    /// Binds the buffer textures to textureUnit and the two units after it and sets the cluster uniforms
+    /// of the shader in use.
+    /// </summary>
+    void bind(const Shader& shader, int textureUnit, int viewportWidth, int viewportHeight) const;
+
+    unsigned int getIndexCount() const { return static_cast<unsigned int>(this->indices.size()); }
+    unsigned int getMaxClusterLights() const;
+    // Clusters that had more than MAX_LIGHTS_PER_CLUSTER lights in the last assignment
+    unsigned int getOverflowCount() const;
+
+private:
+    void assignSlice(unsigned int slice, bool simd);
+
+private:
+    JobSystem* jobs;
+
+    float fovDegrees;
+    float aspect;
+    float nearPlane;
+    float farPlane;
+    std::vector<glm::vec3> boundsMin; // View space bounds of every cluster
+    std::vector<glm::vec3> boundsMax;
+
+    // Lights in view space as a structure of arrays
+    std::vector<float> lightX;
+    std::vector<float> lightY;
+    std::vector<float> lightZ;
+    std::vector<float> lightR;
+
+    // Light indices of every cluster in fixed size slots, so clusters are assigned independently,
+    // then packed into indices
+    std::vector<unsigned int> slots;
+    std::vector<unsigned int> slotCounts; // Lights found per cluster, more than fit when it overflowed
+    std::vector<unsigned int> grid; // Offset and count per cluster
+    std::vector<unsigned int> indices;
+
+    unsigned int lightBuffer;
+    unsigned int gridBuffer;
+    unsigned int indexBuffer;
+    unsigned int lightTexture;
+    unsigned int gridTexture;
+    unsigned int indexTexture;
+};
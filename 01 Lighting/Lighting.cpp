@@ -1,5 +1,12 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <random>
 #include <sstream>
+#include <thread>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
@@ -9,6 +16,17 @@
 #include <stb_image.h>
 
 #include "Shader.h"
+#include "DeferredRenderer.h"
+#include "DynamicResolution.h"
+#include "Headless.h"
+#include "JobSystem.h"
+#include "LightClusters.h"
+#include "PointShadowAtlas.h"
+#include "Profiler.h"
+#include "QualityGovernor.h"
+#include "RenderTarget.h"
+#include "ShaderInvocationCounter.h"
+#include "ShadowCascades.h"
 
 #define WINDOW_WIDTH 1280
 #define WINDOW_HEIGHT 720
@@ -19,15 +37,34 @@
 #define V_LIGHT_SHADER_PATH "shaders/shader_light.vert"
 #define F_LIGHT_SHADER_PATH "shaders/shader_light.frag"
 
+#define V_DEPTH_SHADER_PATH "shaders/depth.vert"
+#define F_OVERDRAW_SHADER_PATH "shaders/overdraw.frag"
+
 #define MOUSE_SENSITIVITY 0.1f
 
+#define NEAR_PLANE 0.1f
+#define FAR_PLANE 100.0f
+
+// The 4 lights of the scene plus small coloured ones moving between the containers, --lights changes it
+#define DEFAULT_POINT_LIGHTS 1024
+
+// After the material (0, 1) and the light clusters (2 to 4)
+#define SHADOW_TEXTURE_UNIT 5
+// The point shadow atlas, its tile buffer on the unit after it
+#define POINT_SHADOW_TEXTURE_UNIT 6
+
 void framebufferSizeCallback(GLFWwindow* window, int width, int height);
 void mouseCallback(GLFWwindow* window, double xPos, double yPos);
 void scrollCallback(GLFWwindow* window, double xOffset, double yOffset);
 void processInput(GLFWwindow* window);
+bool keyPressed(GLFWwindow* window, int key, bool* down);
 void initOpengl();
 void renderLoop();
-void setLightParameters();
+void drawScene(unsigned int framebuffer, int width, int height);
+void drawContainers(Shader& shader, const glm::mat4& view, const glm::mat4& projection);
+glm::mat4 getContainerModelMatrix(unsigned int index);
+void setLightParameters(Shader& shader);
+std::string getSceneName();
 glm::mat4 myLookAt(glm::vec3 cameraPos, glm::vec3 target, glm::vec3 worldUp);
 glm::vec3 getCameraDirection(const float yaw, const float pitch);
 void cameraSetup(glm::vec3 position, glm::vec3* direction, glm::vec3* right, glm::vec3* up);
@@ -35,9 +72,20 @@ glm::mat4 getModelMatrix();
 glm::mat4 getModelMatrix(glm::vec3 position, float rotationDeg, glm::vec3 rotationAxis);
 glm::mat4 getViewMatrix();
 glm::mat4 getProjectionMatrix();
+float getAspectRatio();
 glm::mat4 transform();
 unsigned int loadTexture(const char* path);
 void deinitOpengl();
+int runHeadless(const HeadlessOptions& options);
+int runAssignBenchmark(int iterations);
+int runGovernorReplay(const std::string& tracePath);
+void createPointLights(unsigned int count);
+void printShadowStats();
+void printPointShadowStats();
+void updateFrameTimeControl(double cpuMilliseconds, double gpuMilliseconds);
+void applyQualitySettings(const QualitySettings& settings);
+void paceFrame(std::chrono::steady_clock::time_point frameStart);
+void updatePointLights(float time);
 
 float vertices[] = {
 // |-----positions-----| |-----normals------| |tex coords|
@@ -111,11 +159,50 @@ glm::vec3 pointLightColors[] = {
     glm::vec3(0.0f, 0.0f, 1.0f)
 };
 
+JobSystem* jobSystem;
+LightClusters* lightClusters;
+std::vector<PointLight> pointLights;
+std::vector<glm::vec3> pointLightOrbits; // Centre of the circle each of the small lights moves on
+unsigned int pointLightCount = DEFAULT_POINT_LIGHTS;
+DeferredRenderer* deferredRenderer;
+bool deferredShading = false; // --deferred or the G key, forward with the light clusters otherwise
+bool deferredKeyDown = false;
+bool depthPrepass = false; // --depth-prepass or the P key
+bool prepassKeyDown = false;
+bool sortContainers = true; // Front to back, --no-sort draws them in the order of cubePositions
+bool showOverdraw = false; // --overdraw or the O key
+bool overdrawKeyDown = false;
+ShaderInvocationCounter* invocationCounter; // Fragments shaded for the containers
+ShadowCascades* shadowCascades;
+std::vector<ShadowCaster> shadowCasters; // The containers, which don't move
+bool shadows = true; // --no-shadows or the H key
+bool staggeredShadows = true; // --shadows-every-frame renders every cascade every frame
+bool shadowsKeyDown = false;
+PointShadowAtlas* pointShadowAtlas;
+bool pointShadows = true; // --no-point-shadows, the H key turns them off with the other shadows
+unsigned int pointShadowBudget = POINT_SHADOW_DEFAULT_BUDGET; // Tiles per frame, --shadow-tile-budget changes it
+unsigned int targetFramebuffer = 0; // The window's, or the offscreen one in headless runs
+float sceneTime = 0.0f;
+int viewportWidth = WINDOW_WIDTH;
+int viewportHeight = WINDOW_HEIGHT;
+RenderTarget* renderTarget; // The scene goes through it with MSAA or a resolution scale, see renderLoop
+int msaaSamples = 1; // --msaa N
+float resolutionScale = 1.0f; // --resolution-scale S, a fixed scale of the render target's size
+double targetFrameMilliseconds = 0.0; // --target-frame-ms N scales the resolution to hold this frame time
+DynamicResolution* dynamicResolution; // Only with a target frame time and without the governor
+bool useGovernor = false; // --governor holds the target frame time with all quality knobs, not only the resolution
+QualityGovernor* governor;
+GpuFrameTimer* gpuFrameTimer;
+
 Shader* containerShader;
 Shader* lightShader;
+Shader* depthShader;
+Shader* overdrawShader;
 unsigned int containerVao; // Vertex array object
 unsigned int lightVao;
 unsigned int vbo; // Vertex buffer object
+unsigned int depthVao; // Positions only, for the depth pre-pass
+unsigned int depthVbo;
 
 unsigned int textureDiffuse; // Diffuse map texture object
 unsigned int textureSpecular;
@@ -140,10 +227,94 @@ float lastMouseX = WINDOW_WIDTH / 2;
 float lastMouseY = WINDOW_HEIGHT / 2;
 
 glm::vec3 lightPos(1.2f, 1.0f, 2.0f);
+const glm::vec3 dirLightDirection(-0.2f, -1.0f, -0.3f);
 glm::vec3 lightColor(1.0f, 1.0f, 1.0f);
 
-int main()
+int main(int argc, char* argv[])
 {
+    HeadlessOptions headless = parseHeadlessOptions(argc, argv, WINDOW_WIDTH, WINDOW_HEIGHT);
+    int assignBenchmarkIterations = 0;
+    std::string governorReplayPath;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--lights") == 0 && i + 1 < argc)
+        {
+            pointLightCount = std::max(4, std::atoi(argv[i + 1]));
+        }
+        else if (std::strcmp(argv[i], "--assign-benchmark") == 0 && i + 1 < argc)
+        {
+            assignBenchmarkIterations = std::max(1, std::atoi(argv[i + 1]));
+        }
+        else if (std::strcmp(argv[i], "--deferred") == 0)
+        {
+            deferredShading = true;
+        }
+        else if (std::strcmp(argv[i], "--depth-prepass") == 0)
+        {
+            depthPrepass = true;
+        }
+        else if (std::strcmp(argv[i], "--no-sort") == 0)
+        {
+            sortContainers = false;
+        }
+        else if (std::strcmp(argv[i], "--overdraw") == 0)
+        {
+            showOverdraw = true;
+        }
+        else if (std::strcmp(argv[i], "--no-shadows") == 0)
+        {
+            shadows = false;
+        }
+        else if (std::strcmp(argv[i], "--shadows-every-frame") == 0)
+        {
+            staggeredShadows = false;
+        }
+        else if (std::strcmp(argv[i], "--msaa") == 0 && i + 1 < argc)
+        {
+            msaaSamples = std::max(1, std::atoi(argv[i + 1]));
+        }
+        else if (std::strcmp(argv[i], "--resolution-scale") == 0 && i + 1 < argc)
+        {
+            resolutionScale = glm::clamp(static_cast<float>(std::atof(argv[i + 1])), 0.1f, 1.0f);
+        }
+        else if (std::strcmp(argv[i], "--target-frame-ms") == 0 && i + 1 < argc)
+        {
+            targetFrameMilliseconds = std::max(0.0, std::atof(argv[i + 1]));
+        }
+        else if (std::strcmp(argv[i], "--governor") == 0)
+        {
+            useGovernor = true;
+        }
+        else if (std::strcmp(argv[i], "--governor-replay") == 0 && i + 1 < argc)
+        {
+            governorReplayPath = argv[i + 1];
+        }
+        else if (std::strcmp(argv[i], "--no-point-shadows") == 0)
+        {
+            pointShadows = false;
+        }
+        else if (std::strcmp(argv[i], "--shadow-tile-budget") == 0 && i + 1 < argc)
+        {
+            pointShadowBudget = static_cast<unsigned int>(std::max(0, std::atoi(argv[i + 1])));
+        }
+    }
+    if ((useGovernor || !governorReplayPath.empty()) && targetFrameMilliseconds <= 0.0)
+    {
+        targetFrameMilliseconds = 1000.0 / 60.0;
+    }
+    if (assignBenchmarkIterations > 0)
+    {
+        return runAssignBenchmark(assignBenchmarkIterations);
+    }
+    if (!governorReplayPath.empty())
+    {
+        return runGovernorReplay(governorReplayPath);
+    }
+    if (headless.enabled)
+    {
+        return runHeadless(headless);
+    }
+
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -175,18 +346,46 @@ int main()
 
     initOpengl();
 
+    // Records the camera once per frame for replaying with --camera-path
+    CameraPath recordedPath;
+
     while (!glfwWindowShouldClose(window))
     {
+        PROFILE_SCOPE("frame");
+        auto frameStart = std::chrono::steady_clock::now();
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
         processInput(window);
 
+        if (!headless.recordCameraPath.empty())
+        {
+            recordedPath.record(cameraPosition, cameraFront);
+        }
+
+        // The CPU time up to the swap, which waits for vsync, and the GPU time of the frame
+        gpuFrameTimer->begin();
         renderLoop();
+        gpuFrameTimer->end();
+        double cpuMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+        updateFrameTimeControl(cpuMilliseconds, gpuFrameTimer->hasResult() ? gpuFrameTimer->getLastMilliseconds() : 0.0);
 
-        glfwSwapBuffers(window);
+        {
+            PROFILE_SCOPE("glfwSwapBuffers"); // Includes waiting for vsync
+            glfwSwapBuffers(window);
+        }
         glfwPollEvents();
+        paceFrame(frameStart);
+    }
+
+    if (!headless.recordCameraPath.empty())
+    {
+        recordedPath.save(headless.recordCameraPath);
+    }
+    if (!headless.tracePath.empty())
+    {
+        Profiler::writeChromeTrace(headless.tracePath);
     }
 
     deinitOpengl();
@@ -195,12 +394,454 @@ int main()
     return 0;
 }
 
+int runHeadless(const HeadlessOptions& options)
+{
+    HeadlessContext context;
+    if (!context.create(options.width, options.height, options.glCalls))
+    {
+        return -1;
+    }
+    viewportWidth = options.width;
+    viewportHeight = options.height;
+    targetFramebuffer = context.getFramebuffer();
+    installRenderStatsHooks();
+    if (options.glCalls)
+    {
+        installGlInstrumentation(HeadlessContext::getProcAddress);
+    }
+
+    CameraPath cameraPath = CameraPath::orbit(glm::vec3(0.0f, 0.0f, -5.0f), 12.0f, 2.0f, options.frames);
+    if (!options.cameraPath.empty() && !cameraPath.load(options.cameraPath))
+    {
+        std::cout << "Failed to load camera path: " << options.cameraPath << std::endl;
+        return -1;
+    }
+
+    initOpengl();
+
+    // Fixed timestep and camera path so runs on different machines render the same frames. Warmup
+    // frames replay the start of the path and are not measured.
+    FrameStats stats;
+    deltaTime = 1.0f / 60.0f;
+    for (int frame = -options.warmupFrames; frame < options.frames; frame++)
+    {
+        PROFILE_SCOPE("frame");
+        cameraPath.sample(frame < 0 ? frame + options.warmupFrames : frame, &cameraPosition, &cameraFront);
+        if (frame == 0)
+        {
+            invocationCounter->reset();
+            shadowCascades->resetStats();
+            pointShadowAtlas->resetStats();
+            if (dynamicResolution)
+            {
+                dynamicResolution->resetStats();
+            }
+            if (governor)
+            {
+                governor->resetStats();
+            }
+        }
+
+        resetRenderStats();
+        resetGlCallCounters();
+        auto start = std::chrono::steady_clock::now();
+        gpuFrameTimer->begin();
+        renderLoop();
+        gpuFrameTimer->end();
+        double cpuMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        {
+            PROFILE_SCOPE("glFinish"); // There is no swap to wait for, so wait for the GPU here to include its time
+            glFinish();
+        }
+        double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        // The GPU time like windowed runs, until the timer has a result (or without timestamps) the frame
+        // time up to glFinish, which the GPU's work can't be longer than
+        updateFrameTimeControl(cpuMilliseconds, gpuFrameTimer->hasResult() ? gpuFrameTimer->getLastMilliseconds() : milliseconds);
+        if (frame >= 0)
+        {
+            stats.addFrame(milliseconds, getRenderStats());
+            if (options.glCalls)
+            {
+                stats.addGlCalls(getGlCallCounters());
+            }
+        }
+    }
+    stats.print(getSceneName() + " (headless, " + std::to_string(options.width) + "x" + std::to_string(options.height) + ")");
+    if (invocationCounter->isSupported())
+    {
+        double invocations = invocationCounter->getAverageInvocations();
+        std::printf("Container fragment shader invocations: %.0f per frame, %.2f per pixel\n", invocations,
+            invocations / (static_cast<double>(options.width) * options.height));
+    }
+    if (shadows)
+    {
+        printShadowStats();
+        if (pointShadows)
+        {
+            printPointShadowStats();
+        }
+    }
+    if (dynamicResolution)
+    {
+        std::printf("Dynamic resolution: target %.2f ms, scale %.2f on average, %.2f at the end, %u changes\n",
+            dynamicResolution->getTarget(), dynamicResolution->getAverageScale(), dynamicResolution->getScale(),
+            dynamicResolution->getChanges());
+    }
+    if (governor)
+    {
+        const QualitySettings& settings = governor->getSettings();
+        std::printf("Governor: target %.2f ms, %u decisions, prediction off by %.2f ms on average, ending at "
+            "resolution scale %.2f, LOD bias %.1f, shadow tile budget %u, %u lights\n", governor->getTarget(),
+            governor->getDecisions(), governor->getMeanPredictionError(), settings.resolutionScale, settings.lodBias,
+            settings.shadowTileBudget, settings.lightCap);
+    }
+
+    if (!options.jsonPath.empty())
+    {
+        stats.writeJson(options.jsonPath, getSceneName(), options);
+    }
+    if (!options.screenshotPath.empty())
+    {
+        context.saveScreenshot(options.screenshotPath);
+    }
+    if (!options.tracePath.empty())
+    {
+        Profiler::writeChromeTrace(options.tracePath);
+    }
+
+    deinitOpengl();
+    context.destroy();
+    return 0;
+}
+
+// Times the light assignment alone, without OpenGL: scalar and SSE2 on one thread, then SSE2 on 2
+// threads up to every core, with the lights moving and the camera orbiting like in headless runs
+int runAssignBenchmark(int iterations)
+{
+    createPointLights(pointLightCount);
+    CameraPath cameraPath = CameraPath::orbit(glm::vec3(0.0f, 0.0f, -5.0f), 12.0f, 2.0f, iterations);
+
+    struct Run
+    {
+        std::string name;
+        unsigned int workers;
+        bool simd;
+    };
+    std::vector<Run> runs = { { "scalar, 1 thread", 0, false }, { "SSE2, 1 thread", 0, true } };
+    unsigned int threads = std::max(2u, std::thread::hardware_concurrency());
+    for (unsigned int t = 2; t <= threads; t++)
+    {
+        runs.push_back({ "SSE2, " + std::to_string(t) + " threads", t - 1, true });
+    }
+
+    std::cout << pointLightCount << " point lights, " << CLUSTER_TILES_X << "x" << CLUSTER_TILES_Y << "x"
+        << CLUSTER_SLICES << " clusters, " << iterations << " frames" << std::endl;
+    std::vector<unsigned int> reference;
+    bool mismatch = false;
+    for (const Run& run : runs)
+    {
+        std::unique_ptr<JobSystem> jobs(run.workers > 0 ? new JobSystem(run.workers) : nullptr);
+        LightClusters clusters(jobs.get());
+        clusters.setProjection(45.0f, (float)WINDOW_WIDTH / (float)WINDOW_HEIGHT, NEAR_PLANE, FAR_PLANE);
+
+        double total = 0.0;
+        double best = 1e30;
+        unsigned long long indices = 0;
+        unsigned int maxLights = 0;
+        unsigned int overflows = 0;
+        std::vector<unsigned int> counts;
+        for (int frame = 0; frame < iterations; frame++)
+        {
+            cameraPath.sample(frame, &cameraPosition, &cameraFront);
+            updatePointLights(frame / 60.0f);
+            glm::mat4 view = glm::lookAt(cameraPosition, cameraPosition + cameraFront, world_up);
+
+            auto start = std::chrono::steady_clock::now();
+            clusters.assign(pointLights, view, run.simd);
+            double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            total += milliseconds;
+            best = std::min(best, milliseconds);
+            indices += clusters.getIndexCount();
+            maxLights = std::max(maxLights, clusters.getMaxClusterLights());
+            overflows += clusters.getOverflowCount();
+            counts.push_back(clusters.getIndexCount());
+        }
+
+        // Every variant has to find the same lights
+        if (reference.empty())
+        {
+            reference = counts;
+        }
+        else if (counts != reference)
+        {
+            mismatch = true;
+        }
+        std::printf("%-20s avg %.3f ms, min %.3f ms, %.1f lights per cluster, max %u, %u overflowing clusters\n",
+            run.name.c_str(), total / iterations, best, static_cast<double>(indices) / iterations / CLUSTER_COUNT,
+            maxLights, overflows);
+    }
+    if (mismatch)
+    {
+        std::cout << "FAILED: the assignments differ between the variants" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Per cascade: its depth range, how often it was rendered, the casters drawn into it and the CPU and
+// GPU time of an update
+void printShadowStats()
+{
+    float sliceNear = NEAR_PLANE;
+    for (unsigned int cascade = 0; cascade < SHADOW_CASCADES; cascade++)
+    {
+        const ShadowCascadeStats& stats = shadowCascades->getStats(cascade);
+        unsigned int updates = std::max(1u, stats.updates);
+        std::printf("Shadow cascade %u (%.1f-%.1f): %u updates, %.1f casters, CPU %.3f ms, GPU %.3f ms per update\n",
+            cascade, sliceNear, shadowCascades->getSplit(cascade), stats.updates,
+            static_cast<double>(stats.casters) / updates, stats.cpuMilliseconds / updates,
+            stats.gpuFrames > 0 ? stats.gpuMilliseconds / stats.gpuFrames : 0.0);
+        sliceNear = shadowCascades->getSplit(cascade);
+    }
+}
+
+// How many lights had shadows and how the tile budget was spent, per frame
+void printPointShadowStats()
+{
+    const PointShadowStats& stats = pointShadowAtlas->getStats();
+    double frames = std::max(1u, stats.frames);
+    std::printf("Point shadows: %.1f lights, %.1f tiles rendered (budget %u), %.1f empty, %.1f waiting, "
+        "%.1f casters per frame\n", stats.shadowedLights / frames, stats.tilesRendered / frames, pointShadowBudget,
+        stats.tilesEmpty / frames, stats.tilesWaiting / frames, stats.casters / frames);
+}
+
+// Feeds the frame times to the governor or the dynamic resolution scale, whichever holds the target
+// frame time. A GPU time of 0 is unknown (the first windowed frames, drivers without timestamps), the scale then
+// goes by the CPU time.
+void updateFrameTimeControl(double cpuMilliseconds, double gpuMilliseconds)
+{
+    if (governor)
+    {
+        if (governor->update(cpuMilliseconds, gpuMilliseconds))
+        {
+            applyQualitySettings(governor->getSettings());
+        }
+    }
+    else if (dynamicResolution)
+    {
+        dynamicResolution->update(gpuMilliseconds > 0.0 ? gpuMilliseconds : cpuMilliseconds);
+    }
+}
+
+// The resolution scale is read by renderLoop every frame, the other knobs are set here
+void applyQualitySettings(const QualitySettings& settings)
+{
+    pointShadowAtlas->setBudget(settings.shadowTileBudget);
+    for (unsigned int texture : { textureDiffuse, textureSpecular })
+    {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_LOD_BIAS, settings.lodBias);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    // The lights are placed the same for every count, so a lower cap keeps the first ones
+    if (settings.lightCap != pointLights.size())
+    {
+        createPointLights(settings.lightCap);
+        updatePointLights(sceneTime);
+    }
+}
+
+// With the governor, waits out the rest of the target frame time, so frames come at an even pace
+// instead of as fast as the swap allows. Sleeps until shortly before and yields the rest, sleeping
+// is too coarse to hit the time.
+void paceFrame(std::chrono::steady_clock::time_point frameStart)
+{
+    if (!governor)
+    {
+        return;
+    }
+    PROFILE_SCOPE("paceFrame");
+    auto frameEnd = frameStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double, std::milli>(governor->getTarget()));
+    std::this_thread::sleep_until(frameEnd - std::chrono::milliseconds(1));
+    while (std::chrono::steady_clock::now() < frameEnd)
+    {
+        std::this_thread::yield();
+    }
+}
+
+// Runs the governor over a frame time trace (a file, or "synthetic" for syntheticFrameTimeTrace()),
+// without OpenGL. The trace holds the times at full quality, every frame they are scaled by a rough
+// cost of the current settings: the GPU time by the pixels and the mip level bias, the CPU time by the
+// shadow tile budget and the lights. So the governor sees its decisions take effect. Returns 1 when the
+// governor changes quality within its cooldown or, for the synthetic trace, misses the expected decisions.
+int runGovernorReplay(const std::string& tracePath)
+{
+    std::vector<FrameTimeSample> samples;
+    ReplayExpectations expectations;
+    if (tracePath == "synthetic")
+    {
+        samples = syntheticFrameTimeTrace();
+        expectations = syntheticTraceExpectations();
+    }
+    else if (!loadFrameTimeTrace(tracePath, &samples))
+    {
+        std::cout << "Failed to load frame time trace: " << tracePath << std::endl;
+        return 1;
+    }
+
+    QualitySettings best;
+    best.resolutionScale = resolutionScale;
+    best.shadowTileBudget = pointShadowBudget;
+    best.lightCap = pointLightCount;
+    QualityGovernor replayGovernor(targetFrameMilliseconds, best, &std::cout);
+    unsigned int overFrames = 0;
+    double total = 0.0;
+    bool failed = false;
+    int lastChange = -1;
+    std::vector<int> firstLowered(expectations.firstLowered.size(), -1); // The knob, -1 while none was
+    for (unsigned int frame = 0; frame < samples.size(); frame++)
+    {
+        const FrameTimeSample& sample = samples[frame];
+        const QualitySettings& settings = replayGovernor.getSettings();
+        double pixels = (settings.resolutionScale * settings.resolutionScale) / (best.resolutionScale * best.resolutionScale);
+        double gpu = sample.gpuMilliseconds * (0.2 + 0.8 * pixels) * (1.0 - 0.05 * settings.lodBias);
+        double shadows = best.shadowTileBudget > 0 ? static_cast<double>(settings.shadowTileBudget) / best.shadowTileBudget : 1.0;
+        double lights = static_cast<double>(settings.lightCap) / best.lightCap;
+        double cpu = sample.cpuMilliseconds * (0.4 + 0.3 * shadows + 0.3 * lights);
+        double frameMilliseconds = std::max(cpu, gpu);
+        total += frameMilliseconds;
+        if (frameMilliseconds > targetFrameMilliseconds * (1.0 + GOVERNOR_OVER_MARGIN))
+        {
+            overFrames++;
+        }
+        unsigned int stepsBefore[KNOB_COUNT];
+        for (unsigned int knob = 0; knob < KNOB_COUNT; knob++)
+        {
+            stepsBefore[knob] = replayGovernor.getStep(static_cast<QualityKnob>(knob));
+        }
+        if (!replayGovernor.update(cpu, gpu))
+        {
+            continue;
+        }
+
+        // Lowering two steps at once is one change, another one has to wait for the cooldown
+        if (lastChange >= 0 && frame - lastChange <= GOVERNOR_COOLDOWN_FRAMES)
+        {
+            std::printf("FAILED: quality changed at frame %u, %u frames after the last change\n", frame, frame - lastChange);
+            failed = true;
+        }
+        lastChange = frame;
+        for (unsigned int knob = 0; knob < KNOB_COUNT; knob++)
+        {
+            if (replayGovernor.getStep(static_cast<QualityKnob>(knob)) <= stepsBefore[knob])
+            {
+                continue;
+            }
+            for (size_t i = 0; i < expectations.firstLowered.size(); i++)
+            {
+                const KnobExpectation& expected = expectations.firstLowered[i];
+                if (firstLowered[i] < 0 && frame >= expected.firstFrame && frame <= expected.lastFrame)
+                {
+                    firstLowered[i] = knob;
+                }
+            }
+        }
+    }
+    std::printf("%zu frames, target %.2f ms: %.2f ms on average, %u frames over the target, %u decisions, "
+        "prediction off by %.2f ms on average\n", samples.size(), targetFrameMilliseconds,
+        samples.empty() ? 0.0 : total / samples.size(), overFrames, replayGovernor.getDecisions(),
+        replayGovernor.getMeanPredictionError());
+
+    for (size_t i = 0; i < expectations.firstLowered.size(); i++)
+    {
+        const KnobExpectation& expected = expectations.firstLowered[i];
+        if (firstLowered[i] != expected.knob)
+        {
+            std::printf("FAILED: frames %u to %u lowered %s first instead of %s\n", expected.firstFrame,
+                expected.lastFrame, firstLowered[i] < 0 ? "nothing" : getKnobName(static_cast<QualityKnob>(firstLowered[i])),
+                getKnobName(expected.knob));
+            failed = true;
+        }
+    }
+    if (expectations.recovers)
+    {
+        for (unsigned int knob = 0; knob < KNOB_COUNT; knob++)
+        {
+            unsigned int step = replayGovernor.getStep(static_cast<QualityKnob>(knob));
+            if (step > 0)
+            {
+                std::printf("FAILED: %s still %u steps down at the end\n", getKnobName(static_cast<QualityKnob>(knob)), step);
+                failed = true;
+            }
+        }
+    }
+    return failed ? 1 : 0;
+}
+
+void createPointLights(unsigned int count)
+{
+    pointLights.clear();
+    pointLightOrbits.clear();
+
+    // The 4 lights of the scene with its attenuation, they reach every container
+    int i = 0;
+    for (const glm::vec3& position : pointLightPositions)
+    {
+        // https://wiki.ogre3d.org/tiki-index.php?page=-Point+Light+Attenuation
+        PointLight light = { position, pointLightColors[i], 1.0f, 0.09f, 0.032f, 0.0f };
+        light.radius = lightRadius(light.constant, light.linear, light.quadratic);
+        pointLights.push_back(light);
+        pointLightOrbits.push_back(position);
+        i++;
+    }
+
+    // Small lights spread around the containers, each only reaching its neighbourhood. Seeded, so
+    // every run places them the same.
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> x(-6.0f, 5.0f), y(-4.0f, 6.0f), z(-16.0f, 2.0f), hue(0.0f, 6.0f);
+    for (unsigned int l = static_cast<unsigned int>(pointLights.size()); l < count; l++)
+    {
+        float h = hue(random);
+        glm::vec3 color = glm::clamp(glm::vec3(std::abs(h - 3.0f) - 1.0f, 2.0f - std::abs(h - 2.0f),
+            2.0f - std::abs(h - 4.0f)), 0.0f, 1.0f);
+        PointLight light = { glm::vec3(0.0f), color, 1.0f, 4.5f, 75.0f, 0.0f };
+        light.radius = lightRadius(light.constant, light.linear, light.quadratic);
+        pointLights.push_back(light);
+        pointLightOrbits.push_back(glm::vec3(x(random), y(random), z(random)));
+    }
+    updatePointLights(0.0f);
+}
+
+void updatePointLights(float time)
+{
+    PROFILE_SCOPE("updatePointLights");
+    // The first 4 stay where they are
+    for (size_t i = 4; i < pointLights.size(); i++)
+    {
+        float phase = static_cast<float>(i) * 2.399f; // Golden angle, so neighbours don't move in step
+        float speed = 0.5f + static_cast<float>(i % 7) * 0.1f;
+        pointLights[i].position = pointLightOrbits[i] +
+            glm::vec3(std::cos(time * speed + phase), 0.3f * std::sin(time * speed * 1.7f + phase), std::sin(time * speed + phase));
+    }
+}
+
 void initOpengl()
 {
+    PROFILE_SCOPE("initOpengl");
     glEnable(GL_DEPTH_TEST);
 
+    // The light assignment runs on one worker per remaining core
+    jobSystem = new JobSystem();
+    lightClusters = new LightClusters(jobSystem);
+    createPointLights(pointLightCount);
+
     containerShader = new Shader(V_CONTAINER_SHADER_PATH, F_CONTAINER_SHADER_PATH);
+    deferredRenderer = new DeferredRenderer();
     lightShader = new Shader(V_LIGHT_SHADER_PATH, F_LIGHT_SHADER_PATH);
+    depthShader = new Shader(V_DEPTH_SHADER_PATH);
+    overdrawShader = new Shader(V_CONTAINER_SHADER_PATH, F_OVERDRAW_SHADER_PATH);
+    invocationCounter = new ShaderInvocationCounter();
 
     glGenVertexArrays(1, &containerVao); // Generate vertex array object
     glGenVertexArrays(1, &lightVao);
@@ -237,51 +878,145 @@ void initOpengl()
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
+    // The depth pre-pass reads a tightly packed copy of the positions, fewer bytes per vertex than the
+    // interleaved buffer
+    std::vector<float> positions;
+    for (size_t v = 0; v < sizeof(vertices) / sizeof(float); v += 8)
+    {
+        positions.insert(positions.end(), vertices + v, vertices + v + 3);
+    }
+    glGenVertexArrays(1, &depthVao);
+    glGenBuffers(1, &depthVbo);
+    glBindVertexArray(depthVao);
+    glBindBuffer(GL_ARRAY_BUFFER, depthVbo);
+    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(float), positions.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    // The shadow maps are drawn from the same positions, every container casts a shadow. The unit cube
+    // fits in a sphere of half its diagonal.
+    shadowCascades = new ShadowCascades(depthVbo, 36);
+    shadowCascades->setStaggered(staggeredShadows);
+    shadowCasters.clear();
+    for (unsigned int i = 0; i < sizeof(cubePositions) / sizeof(cubePositions[0]); i++)
+    {
+        shadowCasters.push_back({ getContainerModelMatrix(i), cubePositions[i], 0.87f });
+    }
+    pointShadowAtlas = new PointShadowAtlas(depthVbo, 36);
+    pointShadowAtlas->setBudget(pointShadowBudget);
+
+    renderTarget = new RenderTarget(msaaSamples);
+    gpuFrameTimer = new GpuFrameTimer();
+    if (useGovernor)
+    {
+        QualitySettings best;
+        best.resolutionScale = resolutionScale;
+        best.shadowTileBudget = pointShadowBudget;
+        best.lightCap = pointLightCount;
+        governor = new QualityGovernor(targetFrameMilliseconds, best, &std::cout);
+    }
+    else if (targetFrameMilliseconds > 0.0)
+    {
+        dynamicResolution = new DynamicResolution(targetFrameMilliseconds);
+    }
+
     // Draw in wireframe mode
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 }
 
+// Draws the scene straight into targetFramebuffer, or with MSAA or a resolution scale into the render
+// target, which is then resolved into it
 void renderLoop()
 {
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    // Shader setup of the container/cube
-    containerShader->use();
+    PROFILE_SCOPE("renderLoop");
+    float scale = resolutionScale;
+    if (governor)
+    {
+        scale = governor->getSettings().resolutionScale;
+    }
+    else if (dynamicResolution)
+    {
+        scale = dynamicResolution->getScale();
+    }
+    // The deferred lighting pass blits the G-buffer's depth into the target, which can't be multisampled.
+    // The G-buffer itself has one sample, so MSAA wouldn't smooth anything there.
+    int samples = deferredShading ? 1 : msaaSamples;
+    if (samples == 1 && scale == 1.0f)
+    {
+        drawScene(targetFramebuffer, viewportWidth, viewportHeight);
+        return;
+    }
 
-    setLightParameters();
+    renderTarget->setSamples(samples);
+    renderTarget->resize(static_cast<int>(std::lround(viewportWidth * scale)),
+        static_cast<int>(std::lround(viewportHeight * scale)));
+    renderTarget->bind();
+    drawScene(renderTarget->getFramebuffer(), renderTarget->getWidth(), renderTarget->getHeight());
+    {
+        PROFILE_SCOPE("RenderTarget::resolve");
+        renderTarget->resolve(targetFramebuffer, viewportWidth, viewportHeight);
+    }
+}
 
-    containerShader->setInt("material.diffuse", 0); // GL_TEXTURE0
-    containerShader->setInt("material.specular", 1); // GL_TEXTURE1
-    containerShader->setFloat("material.shininess", 64.0f);
+// Renders a frame into framebuffer, which is bound with a width x height viewport
+void drawScene(unsigned int framebuffer, int width, int height)
+{
+    PROFILE_SCOPE("drawScene");
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     glm::mat4 view = glm::lookAt(cameraPosition, cameraPosition + cameraFront, world_up);
-    containerShader->setMat4("view", view);
-
     glm::mat4 projection = getProjectionMatrix();
-    containerShader->setMat4("projection", projection);
 
-    containerShader->setVec3("viewPos", cameraPosition);
+    sceneTime += deltaTime;
+    updatePointLights(sceneTime);
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, textureDiffuse);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, textureSpecular);
-
-    int i = 0;
-    for (const glm::vec3& cubePosition : cubePositions)
+    if (showOverdraw)
     {
-        glm::mat4 model = glm::mat4(1.0f);
-        model = getModelMatrix(cubePosition, 20.0f * i, glm::vec3(1.0f, 0.3f, 0.5f));
-        containerShader->setMat4("model", model);
+        // Every shaded fragment adds up, the lights are left out
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        drawContainers(*overdrawShader, view, projection);
+        glDisable(GL_BLEND);
+        return;
+    }
 
-        glm::mat3 normal = glm::mat3(glm::transpose(glm::inverse(model)));
-        containerShader->setMat3("normalMat", normal);
+    if (shadows)
+    {
+        shadowCascades->setProjection(fov, getAspectRatio(), NEAR_PLANE);
+        shadowCascades->render(shadowCasters, dirLightDirection, view, framebuffer, width, height);
+        if (pointShadows)
+        {
+            pointShadowAtlas->update(pointLights, shadowCasters, view, fov, getAspectRatio(),
+                NEAR_PLANE, framebuffer, width, height);
+        }
+    }
 
-        // Bind vertex data and draw the container
-        glBindVertexArray(containerVao);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        i++;
+    if (deferredShading)
+    {
+        deferredRenderer->beginGeometryPass(width, height);
+        drawContainers(deferredRenderer->getGeometryShader(), view, projection);
+
+        Shader& lightingShader = deferredRenderer->getLightingShader();
+        lightingShader.use();
+        setLightParameters(lightingShader);
+        Shader& pointLightShader = deferredRenderer->getPointLightShader();
+        pointLightShader.use();
+        pointShadowAtlas->bind(pointLightShader, POINT_SHADOW_TEXTURE_UNIT, shadows && pointShadows);
+        deferredRenderer->lightingPass(framebuffer, pointLights, view, projection, cameraPosition);
+    }
+    else
+    {
+        lightClusters->setProjection(fov, getAspectRatio(), NEAR_PLANE, FAR_PLANE);
+        lightClusters->assign(pointLights, view);
+        lightClusters->upload(pointLights);
+
+        // Shader setup of the container/cube
+        containerShader->use();
+        setLightParameters(*containerShader);
+        lightClusters->bind(*containerShader, 2, width, height); // GL_TEXTURE2 to GL_TEXTURE4
+        containerShader->setVec3("viewPos", cameraPosition);
+        drawContainers(*containerShader, view, projection);
     }
 
     // Shader setup of the light source
@@ -290,7 +1025,7 @@ void renderLoop()
     lightShader->setMat4("view", view);
     lightShader->setMat4("projection", projection);
 
-    i = 0;
+    int i = 0;
     for (const glm::vec3& lightPosition : pointLightPositions)
     {
         glm::mat4 model = glm::mat4(1.0f);
@@ -307,48 +1042,129 @@ void renderLoop()
     }
 }
 
-void setLightParameters()
+// Draws the containers with their material, the shader decides how they are lit. Front to back, so the
+// depth test rejects hidden fragments before they are shaded, and with the depth pre-pass after a depth
+// only pass, which leaves one shaded fragment per pixel.
+void drawContainers(Shader& shader, const glm::mat4& view, const glm::mat4& projection)
 {
+    PROFILE_SCOPE("drawContainers");
+    static std::vector<unsigned int> order;
+    static std::vector<float> viewDepths;
+    const unsigned int containerCount = sizeof(cubePositions) / sizeof(cubePositions[0]);
+    order.resize(containerCount);
+    viewDepths.resize(containerCount);
+    for (unsigned int i = 0; i < containerCount; i++)
+    {
+        order[i] = i;
+        viewDepths[i] = -(view * glm::vec4(cubePositions[i], 1.0f)).z;
+    }
+    if (sortContainers)
+    {
+        std::sort(order.begin(), order.end(), [](unsigned int a, unsigned int b) { return viewDepths[a] < viewDepths[b]; });
+    }
+
+    if (depthPrepass)
+    {
+        PROFILE_SCOPE("depthPrepass");
+        // No fragment shader, so only depth is written
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        depthShader->use();
+        depthShader->setMat4("view", view);
+        depthShader->setMat4("projection", projection);
+        glBindVertexArray(depthVao);
+        for (unsigned int index : order)
+        {
+            depthShader->setMat4("model", getContainerModelMatrix(index));
+            glDrawArrays(GL_TRIANGLES, 0, 36);
+        }
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+        // Only the nearest fragment of every pixel passes
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
+    }
+
+    shader.use();
+    shader.setInt("material.diffuse", 0); // GL_TEXTURE0
+    shader.setInt("material.specular", 1); // GL_TEXTURE1
+    shader.setFloat("material.shininess", 64.0f);
+
+    shader.setMat4("view", view);
+    shader.setMat4("projection", projection);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, textureDiffuse);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, textureSpecular);
+
+    invocationCounter->begin();
+    for (unsigned int index : order)
+    {
+        glm::mat4 model = getContainerModelMatrix(index);
+        shader.setMat4("model", model);
+
+        glm::mat3 normal = glm::mat3(glm::transpose(glm::inverse(model)));
+        shader.setMat3("normalMat", normal);
+
+        // Bind vertex data and draw the container
+        glBindVertexArray(containerVao);
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+    }
+    invocationCounter->end();
+
+    if (depthPrepass)
+    {
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+    }
+}
+
+glm::mat4 getContainerModelMatrix(unsigned int index)
+{
+    return getModelMatrix(cubePositions[index], 20.0f * index, glm::vec3(1.0f, 0.3f, 0.5f));
+}
+
+// Sets the directional light with its shadows, the point light shadows and the spot light of the shader in use
+void setLightParameters(Shader& shader)
+{
+    PROFILE_SCOPE("setLightParameters");
     glm::vec3 ambient(0.05);
     glm::vec3 diffuse(0.8f);
     glm::vec3 specular(1.0f);
 
     // Directional light
-    containerShader->setVec3("dirLight.direction", glm::vec3(-0.2f, -1.0f, -0.3f));
-    containerShader->setVec3("dirLight.ambient", ambient);
-    containerShader->setVec3("dirLight.diffuse", glm::vec3(0.5f));
-    containerShader->setVec3("dirLight.specular", specular);
+    shader.setVec3("dirLight.direction", dirLightDirection);
+    shader.setVec3("dirLight.ambient", ambient);
+    shader.setVec3("dirLight.diffuse", glm::vec3(0.5f));
+    shader.setVec3("dirLight.specular", specular);
+    shadowCascades->bind(shader, SHADOW_TEXTURE_UNIT, shadows);
 
-    // Point light
-    int i = 0;
-    for (const glm::vec3& position : pointLightPositions)
-    {
-        std::ostringstream oss;
-        oss << "pointLights[" << i << "]";
-        std::string pointLight = oss.str();
-
-        containerShader->setVec3(pointLight + ".position", position);
-        containerShader->setVec3(pointLight + ".ambient", ambient * pointLightColors[i]);
-        containerShader->setVec3(pointLight + ".diffuse", diffuse * pointLightColors[i]);
-        containerShader->setVec3(pointLight + ".specular", specular);
-        // https://wiki.ogre3d.org/tiki-index.php?page=-Point+Light+Attenuation
-        containerShader->setFloat(pointLight + ".constant", 1.0f);
-        containerShader->setFloat(pointLight + ".diffuse", 0.09f);
-        containerShader->setFloat(pointLight + ".quadratic", 0.032f);
-        i++;
-    }
+    // The point lights come from the light clusters, their shadows from the atlas
+    pointShadowAtlas->bind(shader, POINT_SHADOW_TEXTURE_UNIT, shadows && pointShadows);
 
     // Spot light
-    containerShader->setVec3("spotLight.position", glm::vec3(cameraPosition));
-    containerShader->setVec3("spotLight.direction", glm::vec3(cameraFront));
-    containerShader->setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-    containerShader->setFloat("spotLight.outerCutOff", glm::cos(glm::radians(18.5f)));
-    containerShader->setVec3("spotLight.ambient", glm::vec3(0.2f));
-    containerShader->setVec3("spotLight.diffuse", diffuse);
-    containerShader->setVec3("spotLight.specular", specular);
-    containerShader->setFloat("spotLight.constant", 1.0f);
-    containerShader->setFloat("spotLight.diffuse", 0.09f);
-    containerShader->setFloat("spotLight.quadratic", 0.032f);
+    shader.setVec3("spotLight.position", glm::vec3(cameraPosition));
+    shader.setVec3("spotLight.direction", glm::vec3(cameraFront));
+    shader.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
+    shader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(18.5f)));
+    shader.setVec3("spotLight.ambient", glm::vec3(0.2f));
+    shader.setVec3("spotLight.diffuse", diffuse);
+    shader.setVec3("spotLight.specular", specular);
+    shader.setFloat("spotLight.constant", 1.0f);
+    shader.setFloat("spotLight.diffuse", 0.09f);
+    shader.setFloat("spotLight.quadratic", 0.032f);
+}
+
+std::string getSceneName()
+{
+    // The original scene, forward shaded with 4 point lights, keeps its name so results stay comparable with
+    // earlier runs. Every other one, the 1024 light default included, has its shading and light count in it.
+    if (!deferredShading && pointLightCount == 4)
+    {
+        return "01 Lighting";
+    }
+    return std::string("01 Lighting (") + (deferredShading ? "deferred, " : "forward, ") +
+        std::to_string(pointLightCount) + " lights)";
 }
 
 glm::mat4 myLookAt(glm::vec3 cameraPos, glm::vec3 target, glm::vec3 worldUp)
@@ -426,11 +1242,17 @@ glm::mat4 getProjectionMatrix()
 {
     glm::mat4 projection;
     projection =
-        glm::perspective(glm::radians(fov), (float)WINDOW_WIDTH / (float)WINDOW_HEIGHT, 0.1f, 100.0f);
+        glm::perspective(glm::radians(fov), getAspectRatio(), NEAR_PLANE, FAR_PLANE);
 
     return projection;
 }
 
+// Of the window (or the headless size), the render target scales both sides alike
+float getAspectRatio()
+{
+    return (float)viewportWidth / (float)viewportHeight;
+}
+
 glm::mat4 transform()
 {
     glm::mat4 trans = glm::mat4(1.0f);
@@ -444,6 +1266,7 @@ glm::mat4 transform()
 
 unsigned int loadTexture(const char* path)
 {
+    PROFILE_SCOPE("loadTexture");
     unsigned int textureID;
     glGenTextures(1, &textureID);
 
@@ -493,6 +1316,32 @@ void deinitOpengl()
     containerShader = nullptr;
     delete(lightShader);
     lightShader = nullptr;
+    glDeleteVertexArrays(1, &depthVao);
+    glDeleteBuffers(1, &depthVbo);
+    delete(depthShader);
+    depthShader = nullptr;
+    delete(overdrawShader);
+    overdrawShader = nullptr;
+    delete(invocationCounter);
+    invocationCounter = nullptr;
+    delete(shadowCascades);
+    shadowCascades = nullptr;
+    delete(pointShadowAtlas);
+    pointShadowAtlas = nullptr;
+    delete(renderTarget);
+    renderTarget = nullptr;
+    delete(dynamicResolution);
+    dynamicResolution = nullptr;
+    delete(governor);
+    governor = nullptr;
+    delete(gpuFrameTimer);
+    gpuFrameTimer = nullptr;
+    delete(deferredRenderer);
+    deferredRenderer = nullptr;
+    delete(lightClusters);
+    lightClusters = nullptr;
+    delete(jobSystem);
+    jobSystem = nullptr;
 }
 
 void processInput(GLFWwindow* window)
@@ -502,6 +1351,27 @@ void processInput(GLFWwindow* window)
         glfwSetWindowShouldClose(window, true);
     }
 
+    // Switches between forward and deferred shading
+    if (keyPressed(window, GLFW_KEY_G, &deferredKeyDown))
+    {
+        deferredShading = !deferredShading;
+        std::cout << (deferredShading ? "Deferred" : "Forward") << " shading" << std::endl;
+    }
+    if (keyPressed(window, GLFW_KEY_P, &prepassKeyDown))
+    {
+        depthPrepass = !depthPrepass;
+        std::cout << "Depth pre-pass " << (depthPrepass ? "on" : "off") << std::endl;
+    }
+    if (keyPressed(window, GLFW_KEY_O, &overdrawKeyDown))
+    {
+        showOverdraw = !showOverdraw;
+    }
+    if (keyPressed(window, GLFW_KEY_H, &shadowsKeyDown))
+    {
+        shadows = !shadows;
+        std::cout << "Shadows " << (shadows ? "on" : "off") << std::endl;
+    }
+
     const float camera_speed = 2.5f * deltaTime;
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
     {
@@ -521,6 +1391,15 @@ void processInput(GLFWwindow* window)
     }
 }
 
+// True once per press of the key, down remembers whether it was held in the last frame
+bool keyPressed(GLFWwindow* window, int key, bool* down)
+{
+    bool pressed = glfwGetKey(window, key) == GLFW_PRESS;
+    bool wasDown = *down;
+    *down = pressed;
+    return pressed && !wasDown;
+}
+
 void mouseCallback(GLFWwindow* window, double xPos, double yPos)
 {
     if (isFirstMouse)
@@ -557,5 +1436,12 @@ void scrollCallback(GLFWwindow* window, double xOffset, double yOffset)
 
 void framebufferSizeCallback(GLFWwindow* window, int width, int height)
 {
+    // A minimized window has no size, keep the last one for the aspect ratio
+    if (width == 0 || height == 0)
+    {
+        return;
+    }
     glViewport(0, 0, width, height);
+    viewportWidth = width;
+    viewportHeight = height;
 }
@@ -0,0 +1,396 @@
+#include "PointShadowAtlas.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <glm/gtc/matrix_transform.hpp>
+#include "Profiler.h"
+
+#define V_SHADOW_SHADER_PATH "shaders/shadow_depth.vert"
+
+// First attribute of the instanced model matrix in shadow_depth.vert, a mat4 takes 4 locations
+#define MODEL_ATTRIBUTE 1
+
+// Share of the screen (0 to 1) covered by a sphere at this view space position, 0 outside the view frustum
+static float screenCoverage(const glm::vec3& position, float radius, float tanHalfFov, float aspect, float nearPlane)
+{
+    float depth = -position.z;
+    if (depth + radius < nearPlane)
+    {
+        return 0.0f;
+    }
+    // Distances to the side planes through the eye, positive outside
+    float tanHalfFovX = tanHalfFov * aspect;
+    if ((std::abs(position.x) - tanHalfFovX * depth) / std::sqrt(1.0f + tanHalfFovX * tanHalfFovX) > radius ||
+        (std::abs(position.y) - tanHalfFov * depth) / std::sqrt(1.0f + tanHalfFov * tanHalfFov) > radius)
+    {
+        return 0.0f;
+    }
+    float distanceSquared = glm::dot(position, position);
+    if (distanceSquared <= radius * radius)
+    {
+        return 1.0f;
+    }
+    // The silhouette is an ellipse of this height in normalized device coordinates, where the screen is 2 x 2
+    float projected = radius / (std::sqrt(distanceSquared - radius * radius) * tanHalfFov);
+    return std::min(1.0f, 3.14159265f * projected * projected / (4.0f * aspect));
+}
+
+PointShadowAtlas::PointShadowAtlas(unsigned int positionBuffer, unsigned int vertexCount)
+    : depthShader(V_SHADOW_SHADER_PATH), atlas(0), framebuffer(0), vao(0), instanceBuffer(0),
+    vertexCount(vertexCount), tileBuffer(0), tileTexture(0), faceRotations(), budget(POINT_SHADOW_DEFAULT_BUDGET),
+    slotLights(POINT_SHADOW_SLOTS, -1), slotCoverage(POINT_SHADOW_SLOTS, 0.0f),
+    tiles(POINT_SHADOW_SLOTS * 6, Tile{ glm::vec3(0.0f), 0.0f, false, true, 0 }),
+    tileTexels(POINT_SHADOW_SLOTS * 6, glm::vec4(0.0f))
+{
+    // Hardware PCF like the cascades. Lookups are clamped inside their tile, so filtering never
+    // reaches into the neighbours.
+    glGenTextures(1, &this->atlas);
+    glBindTexture(GL_TEXTURE_2D, this->atlas);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, POINT_SHADOW_ATLAS_SIZE, POINT_SHADOW_ATLAS_SIZE, 0,
+        GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GLint boundFramebuffer = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &boundFramebuffer);
+    glGenFramebuffers(1, &this->framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, this->atlas, 0);
+    const GLenum none = GL_NONE;
+    glDrawBuffers(1, &none);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cout << "Point shadow atlas framebuffer is not complete" << std::endl;
+    }
+    // Nothing has been rendered yet, a cleared atlas is unshadowed
+    glClear(GL_DEPTH_BUFFER_BIT);
+    glBindFramebuffer(GL_FRAMEBUFFER, boundFramebuffer);
+
+    glGenVertexArrays(1, &this->vao);
+    glGenBuffers(1, &this->instanceBuffer);
+    glBindVertexArray(this->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, this->instanceBuffer);
+    for (unsigned int column = 0; column < 4; column++)
+    {
+        glEnableVertexAttribArray(MODEL_ATTRIBUTE + column);
+        glVertexAttribDivisor(MODEL_ATTRIBUTE + column, 1);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &this->tileBuffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, this->tileBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, this->tileTexels.size() * sizeof(glm::vec4), this->tileTexels.data(), GL_STREAM_DRAW);
+    glGenTextures(1, &this->tileTexture);
+    glBindTexture(GL_TEXTURE_BUFFER, this->tileTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, this->tileBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    // The views of the cube faces, in the order of the major axes the shader picks them by
+    const glm::vec3 directions[6] = { glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+        glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f) };
+    const glm::vec3 ups[6] = { glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f),
+        glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f) };
+    for (unsigned int face = 0; face < 6; face++)
+    {
+        this->faceRotations[face] = glm::lookAt(glm::vec3(0.0f), directions[face], ups[face]);
+    }
+}
+
+PointShadowAtlas::~PointShadowAtlas()
+{
+    glDeleteTextures(1, &this->tileTexture);
+    glDeleteBuffers(1, &this->tileBuffer);
+    glDeleteVertexArrays(1, &this->vao);
+    glDeleteBuffers(1, &this->instanceBuffer);
+    glDeleteFramebuffers(1, &this->framebuffer);
+    glDeleteTextures(1, &this->atlas);
+}
+
+void PointShadowAtlas::update(std::vector<PointLight>& lights, const std::vector<ShadowCaster>& casters,
+    const glm::mat4& view, float fovDegrees, float aspect, float nearPlane, unsigned int targetFramebuffer,
+    int viewportWidth, int viewportHeight)
+{
+    PROFILE_SCOPE("PointShadowAtlas::update");
+    assignSlots(lights, view, fovDegrees, aspect, nearPlane);
+    markMovedCasters(casters);
+
+    // Cull the casters of every out of date tile. Tiles without any are up to date right away, the
+    // others wait for the budget.
+    this->culled.clear();
+    this->updates.clear();
+    for (unsigned int slot = 0; slot < POINT_SHADOW_SLOTS; slot++)
+    {
+        if (this->slotLights[slot] < 0)
+        {
+            continue;
+        }
+        const PointLight& light = lights[this->slotLights[slot]];
+        this->stats.shadowedLights++;
+        for (unsigned int face = 0; face < 6; face++)
+        {
+            unsigned int index = slot * 6 + face;
+            Tile& tile = this->tiles[index];
+            if (!tile.dirty && tile.position == light.position && tile.radius == light.radius)
+            {
+                continue;
+            }
+            tile.dirty = true;
+            size_t first = this->culled.size();
+            size_t count = cullFace(face, light.position, light.radius, casters);
+            if (count == 0)
+            {
+                tile = Tile{ light.position, light.radius, false, false, 0 };
+                this->stats.tilesEmpty++;
+                continue;
+            }
+            this->updates.push_back({ this->slotCoverage[slot] * (1.0f + tile.waiting), index, first, count });
+        }
+    }
+
+    // The budget goes to the tiles of the lights covering most of the screen, those waiting longest
+    // count as larger
+    size_t rendered = std::min(this->updates.size(), static_cast<size_t>(this->budget));
+    std::partial_sort(this->updates.begin(), this->updates.begin() + rendered, this->updates.end(),
+        [](const TileUpdate& a, const TileUpdate& b)
+        {
+            return a.priority != b.priority ? a.priority > b.priority : a.tile < b.tile;
+        });
+    for (size_t i = rendered; i < this->updates.size(); i++)
+    {
+        this->tiles[this->updates[i].tile].waiting++;
+    }
+    this->stats.tilesWaiting += this->updates.size() - rendered;
+
+    this->models.clear();
+    for (size_t i = 0; i < rendered; i++)
+    {
+        TileUpdate& update = this->updates[i];
+        size_t first = this->models.size();
+        this->models.insert(this->models.end(), this->culled.begin() + update.first,
+            this->culled.begin() + update.first + update.count);
+        update.first = first;
+    }
+
+    if (rendered > 0)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, this->instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, this->models.size() * sizeof(glm::mat4), this->models.data(), GL_STREAM_DRAW);
+
+        // All tiles share the framebuffer, the scissor keeps each clear to its own tile
+        this->depthShader.use();
+        glBindVertexArray(this->vao);
+        glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+        glEnable(GL_SCISSOR_TEST);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(1.5f, 2.0f);
+        for (size_t i = 0; i < rendered; i++)
+        {
+            const TileUpdate& update = this->updates[i];
+            const PointLight& light = lights[this->slotLights[update.tile / 6]];
+            int x = (update.tile % POINT_SHADOW_TILES_PER_ROW) * POINT_SHADOW_TILE_SIZE;
+            int y = (update.tile / POINT_SHADOW_TILES_PER_ROW) * POINT_SHADOW_TILE_SIZE;
+            glViewport(x, y, POINT_SHADOW_TILE_SIZE, POINT_SHADOW_TILE_SIZE);
+            glScissor(x, y, POINT_SHADOW_TILE_SIZE, POINT_SHADOW_TILE_SIZE);
+            glClear(GL_DEPTH_BUFFER_BIT);
+
+            // OpenGL 3.3 has no base instance, so the model matrix attributes are pointed at the tile's first caster
+            const char* base = reinterpret_cast<const char*>(update.first * sizeof(glm::mat4));
+            for (unsigned int column = 0; column < 4; column++)
+            {
+                glVertexAttribPointer(MODEL_ATTRIBUTE + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                    base + column * sizeof(glm::vec4));
+            }
+            glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, POINT_SHADOW_NEAR, light.radius);
+            glm::mat4 lightSpace = projection * this->faceRotations[update.tile % 6] *
+                glm::translate(glm::mat4(1.0f), -light.position);
+            this->depthShader.setMat4("lightSpace", lightSpace);
+            glDrawArraysInstanced(GL_TRIANGLES, 0, this->vertexCount, static_cast<GLsizei>(update.count));
+
+            this->tiles[update.tile] = Tile{ light.position, light.radius, true, false, 0 };
+            this->stats.casters += update.count;
+        }
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glDisable(GL_SCISSOR_TEST);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+        glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
+        glViewport(0, 0, viewportWidth, viewportHeight);
+    }
+    this->stats.tilesRendered += rendered;
+    this->stats.frames++;
+    Profiler::counter("point shadow tiles rendered", static_cast<long long>(rendered));
+    Profiler::counter("point shadow tiles waiting", static_cast<long long>(this->updates.size() - rendered));
+
+    // The shader gets the position each tile was rendered from, so waiting tiles stay consistent
+    for (size_t i = 0; i < this->tiles.size(); i++)
+    {
+        const Tile& tile = this->tiles[i];
+        this->tileTexels[i] = glm::vec4(tile.position, tile.hasShadow ? tile.radius : 0.0f);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, this->tileBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, this->tileTexels.size() * sizeof(glm::vec4), this->tileTexels.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void PointShadowAtlas::assignSlots(std::vector<PointLight>& lights, const glm::mat4& view, float fovDegrees,
+    float aspect, float nearPlane)
+{
+    // A different set of lights starts over
+    if (this->lightSlots.size() != lights.size())
+    {
+        this->lightSlots.assign(lights.size(), -1);
+        std::fill(this->slotLights.begin(), this->slotLights.end(), -1);
+    }
+
+    float tanHalfFov = std::tan(glm::radians(fovDegrees) * 0.5f);
+    this->ranking.clear();
+    for (size_t i = 0; i < lights.size(); i++)
+    {
+        lights[i].shadowSlot = -1;
+        glm::vec3 position = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+        float coverage = screenCoverage(position, lights[i].radius, tanHalfFov, aspect, nearPlane);
+        if (coverage > 0.0f)
+        {
+            this->ranking.push_back(std::make_pair(coverage, static_cast<int>(i)));
+        }
+    }
+    size_t top = std::min(this->ranking.size(), static_cast<size_t>(POINT_SHADOW_SLOTS));
+    std::partial_sort(this->ranking.begin(), this->ranking.begin() + top, this->ranking.end(),
+        [](const std::pair<float, int>& a, const std::pair<float, int>& b)
+        {
+            return a.first != b.first ? a.first > b.first : a.second < b.second;
+        });
+    this->ranked.assign(lights.size(), false);
+    for (size_t i = 0; i < top; i++)
+    {
+        this->ranked[this->ranking[i].second] = true;
+    }
+
+    // Lights that dropped out free their slot first, so the ones coming in can take it
+    for (unsigned int slot = 0; slot < POINT_SHADOW_SLOTS; slot++)
+    {
+        int light = this->slotLights[slot];
+        if (light >= 0 && !this->ranked[light])
+        {
+            this->lightSlots[light] = -1;
+            this->slotLights[slot] = -1;
+        }
+    }
+    unsigned int freeSlot = 0;
+    for (size_t i = 0; i < top; i++)
+    {
+        int light = this->ranking[i].second;
+        if (this->lightSlots[light] < 0)
+        {
+            while (this->slotLights[freeSlot] >= 0)
+            {
+                freeSlot++;
+            }
+            this->slotLights[freeSlot] = light;
+            this->lightSlots[light] = static_cast<int>(freeSlot);
+            // The tiles still hold the previous light's shadows
+            for (unsigned int face = 0; face < 6; face++)
+            {
+                this->tiles[freeSlot * 6 + face] = Tile{ glm::vec3(0.0f), 0.0f, false, true, 0 };
+            }
+        }
+        int slot = this->lightSlots[light];
+        lights[light].shadowSlot = slot;
+        this->slotCoverage[slot] = this->ranking[i].first;
+    }
+}
+
+// A moved caster makes the tiles of the lights it was or is in reach of out of date
+void PointShadowAtlas::markMovedCasters(const std::vector<ShadowCaster>& casters)
+{
+    bool sameCasters = casters.size() == this->previousCasters.size();
+    for (size_t i = 0; i < casters.size(); i++)
+    {
+        if (!sameCasters)
+        {
+            break;
+        }
+        const ShadowCaster& caster = casters[i];
+        const ShadowCaster& previous = this->previousCasters[i];
+        if (std::memcmp(&caster.model, &previous.model, sizeof(glm::mat4)) == 0)
+        {
+            continue;
+        }
+        for (Tile& tile : this->tiles)
+        {
+            if (glm::distance(tile.position, caster.center) < tile.radius + caster.radius ||
+                glm::distance(tile.position, previous.center) < tile.radius + previous.radius)
+            {
+                tile.dirty = true;
+            }
+        }
+    }
+    if (!sameCasters)
+    {
+        for (Tile& tile : this->tiles)
+        {
+            tile.dirty = true;
+        }
+    }
+    this->previousCasters = casters;
+}
+
+size_t PointShadowAtlas::cullFace(unsigned int face, const glm::vec3& position, float farPlane,
+    const std::vector<ShadowCaster>& casters)
+{
+    // The face's frustum is a 90 degree pyramid, its side planes have normals at 45 degrees to the view axis
+    const float inverseSqrt2 = 0.70710678f;
+    size_t count = 0;
+    for (const ShadowCaster& caster : casters)
+    {
+        glm::vec3 local = glm::vec3(this->faceRotations[face] * glm::vec4(caster.center - position, 0.0f));
+        float depth = -local.z;
+        if (depth + caster.radius < POINT_SHADOW_NEAR || depth - caster.radius > farPlane ||
+            (std::abs(local.x) - depth) * inverseSqrt2 > caster.radius ||
+            (std::abs(local.y) - depth) * inverseSqrt2 > caster.radius)
+        {
+            continue;
+        }
+        this->culled.push_back(caster.model);
+        count++;
+    }
+    return count;
+}
+
+void PointShadowAtlas::bind(const Shader& shader, int textureUnit, bool enabled) const
+{
+    glActiveTexture(GL_TEXTURE0 + textureUnit);
+    glBindTexture(GL_TEXTURE_2D, this->atlas);
+    glActiveTexture(GL_TEXTURE0 + textureUnit + 1);
+    glBindTexture(GL_TEXTURE_BUFFER, this->tileTexture);
+    glActiveTexture(GL_TEXTURE0);
+
+    shader.setInt("pointShadowAtlas", textureUnit);
+    shader.setInt("pointShadowTiles", textureUnit + 1);
+    shader.setBool("pointShadowsEnabled", enabled);
+    shader.setInt("pointShadowTilesPerRow", POINT_SHADOW_TILES_PER_ROW);
+    shader.setFloat("pointShadowNear", POINT_SHADOW_NEAR);
+    for (unsigned int face = 0; face < 6; face++)
+    {
+        shader.setMat4("pointShadowFaces[" + std::to_string(face) + "]", this->faceRotations[face]);
+    }
+}
+
+void PointShadowAtlas::resetStats()
+{
+    this->stats = PointShadowStats();
+}
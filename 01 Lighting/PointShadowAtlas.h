@@ -0,0 +1,123 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+#include "LightClusters.h"
+#include "Shader.h"
+#include "ShadowCascades.h"
+
+// One depth texture holds the cube faces of all shadowed point lights as square tiles
+#define POINT_SHADOW_ATLAS_SIZE 4096
+#define POINT_SHADOW_TILE_SIZE 256
+#define POINT_SHADOW_TILES_PER_ROW (POINT_SHADOW_ATLAS_SIZE / POINT_SHADOW_TILE_SIZE)
+// Lights with shadows at a time, 6 tiles each
+#define POINT_SHADOW_SLOTS (POINT_SHADOW_TILES_PER_ROW * POINT_SHADOW_TILES_PER_ROW / 6)
+// Tiles rendered per frame unless setBudget changes it
+#define POINT_SHADOW_DEFAULT_BUDGET 24
+#define POINT_SHADOW_NEAR 0.05f
+
+/// <summary>
+/// Tile work of the frames since the last resetStats().
+/// </summary>
+struct PointShadowStats
+{
+    unsigned int frames = 0;
+    unsigned long long shadowedLights = 0; // Lights that had a slot
+    unsigned long long tilesRendered = 0;
+    unsigned long long tilesEmpty = 0; // Faces without casters, updated without drawing
+    unsigned long long tilesWaiting = 0; // Out of date tiles left for later frames by the budget
+    unsigned long long casters = 0; // Caster draws over all rendered tiles
+};
+
+/// <summary>
+/// Omnidirectional shadows of point lights, packed into one shadow atlas. Every frame the lights are
+/// ranked by how much of the screen their radius covers and the top POINT_SHADOW_SLOTS get a slot of 6
+/// tiles, one per cube face. A light keeps its slot while it stays in the top ones. Tiles remember the
+/// light position they were rendered from and are only rendered again when the light or a caster near
+/// it moved. The out of date tiles are rendered in the order of their light's screen coverage (weighted
+/// by how long they have been waiting, so small lights get their turn), up to a budget of tiles per
+/// frame. The rest keep shadows from the old light position until their turn comes. Faces without any
+/// caster in their frustum are marked empty and cost nothing.
+/// </summary>
+class PointShadowAtlas
+{
+public:
+    /// <summary>
+    /// Creates the atlas and its tile buffer. The casters are drawn with vertexCount vertices of tightly
+    /// packed positions (3 floats) from positionBuffer, like ShadowCascades.
+    /// </summary>
+    PointShadowAtlas(unsigned int positionBuffer, unsigned int vertexCount);
+    ~PointShadowAtlas();
+    PointShadowAtlas(const PointShadowAtlas&) = delete;
+    PointShadowAtlas& operator=(const PointShadowAtlas&) = delete;
+
+    /// <summary>
+    /// Assigns the slots (setting shadowSlot of every light), renders the tiles the budget allows and
+    /// uploads the tile buffer. Leaves targetFramebuffer bound with the viewport restored.
+    /// </summary>
+    void update(std::vector<PointLight>& lights, const std::vector<ShadowCaster>& casters, const glm::mat4& view,
+        float fovDegrees, float aspect, float nearPlane, unsigned int targetFramebuffer, int viewportWidth,
+        int viewportHeight);
+
+    /// <summary>
+    /// Binds the atlas to textureUnit and the tile buffer to the unit after it and sets the point shadow
+    /// uniforms of the shader in use (see shaders/shader.frag). enabled false skips the lookups.
+    /// </summary>
+    void bind(const Shader& shader, int textureUnit, bool enabled) const;
+
+    void setBudget(unsigned int tiles) { this->budget = tiles; }
+    const PointShadowStats& getStats() const { return this->stats; }
+    // Forgets the stats so far, e.g. after warmup frames
+    void resetStats();
+
+private:
+    struct Tile
+    {
+        glm::vec3 position; // Of the light when it was last rendered, its radius is the far plane
+        float radius;
+        bool hasShadow; // False when empty or not rendered since the slot was assigned
+        bool dirty;
+        unsigned int waiting; // Frames it has been dirty
+    };
+
+    // A dirty tile with casters, rendered when the budget reaches it
+    struct TileUpdate
+    {
+        float priority;
+        unsigned int tile;
+        size_t first; // Its casters in culled
+        size_t count;
+    };
+
+    void assignSlots(std::vector<PointLight>& lights, const glm::mat4& view, float fovDegrees, float aspect,
+        float nearPlane);
+    void markMovedCasters(const std::vector<ShadowCaster>& casters);
+    // Appends the casters inside the face's frustum to culled, returns how many
+    size_t cullFace(unsigned int face, const glm::vec3& position, float farPlane, const std::vector<ShadowCaster>& casters);
+
+private:
+    Shader depthShader; // shaders/shadow_depth.vert
+    unsigned int atlas;
+    unsigned int framebuffer;
+    unsigned int vao;
+    unsigned int instanceBuffer;
+    unsigned int vertexCount;
+    unsigned int tileBuffer; // Light position and far plane per tile, 0 far plane without shadows
+    unsigned int tileTexture;
+    glm::mat4 faceRotations[6]; // +X, -X, +Y, -Y, +Z, -Z
+
+    unsigned int budget;
+    std::vector<int> slotLights; // Light of each slot, -1 when free
+    std::vector<int> lightSlots; // Slot of each light, -1 without
+    std::vector<float> slotCoverage; // Share of the screen the slot's light covers this frame
+    std::vector<Tile> tiles; // 6 per slot
+    std::vector<ShadowCaster> previousCasters;
+    std::vector<std::pair<float, int>> ranking; // Coverage and index of the lights in view
+    std::vector<bool> ranked; // Per light, in the top POINT_SHADOW_SLOTS of the ranking
+    std::vector<glm::mat4> culled; // Casters of the dirty tiles
+    std::vector<TileUpdate> updates;
+    std::vector<glm::mat4> models; // Casters of the tiles rendered this frame, one after the other
+    std::vector<glm::vec4> tileTexels;
+    PointShadowStats stats;
+};
@@ -0,0 +1,190 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+
+// Zones per thread kept before the oldest are overwritten (40 bytes each)
+#define PROFILER_RING_SIZE (1 << 16)
+
+struct ProfilerThreadBuffer
+{
+    unsigned int threadId = 0;
+    int depth = 0;
+    // Only the owning thread writes. written counts every zone ever recorded, the slot of zone
+    // i is i % PROFILER_RING_SIZE
+    std::atomic<unsigned long long> written{ 0 };
+    std::vector<ProfileEvent> events = std::vector<ProfileEvent>(PROFILER_RING_SIZE);
+};
+
+// Buffers are never freed, so zones of threads that have exited can still be exported
+static std::mutex buffersMutex;
+static std::vector<std::unique_ptr<ProfilerThreadBuffer>> buffers;
+
+static ProfilerThreadBuffer& threadBuffer()
+{
+    thread_local ProfilerThreadBuffer* buffer = nullptr;
+    if (!buffer)
+    {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        buffers.push_back(std::unique_ptr<ProfilerThreadBuffer>(new ProfilerThreadBuffer()));
+        buffer = buffers.back().get();
+        buffer->threadId = static_cast<unsigned int>(buffers.size());
+    }
+    return *buffer;
+}
+
+// Copies the zones of one buffer that were not overwritten while copying
+static void copyEvents(const ProfilerThreadBuffer& buffer, std::vector<ProfileEvent>* out)
+{
+    unsigned long long written = buffer.written.load(std::memory_order_acquire);
+    unsigned long long first = written > PROFILER_RING_SIZE ? written - PROFILER_RING_SIZE : 0;
+    size_t outStart = out->size();
+    for (unsigned long long i = first; i < written; i++)
+    {
+        out->push_back(buffer.events[i % PROFILER_RING_SIZE]);
+    }
+
+    // The owner kept writing meanwhile: drop the copies of slots it may have reused
+    unsigned long long writtenAfter = buffer.written.load(std::memory_order_acquire);
+    unsigned long long firstValid = writtenAfter > PROFILER_RING_SIZE ? writtenAfter - PROFILER_RING_SIZE : 0;
+    if (firstValid > first)
+    {
+        size_t stale = static_cast<size_t>(std::min(firstValid - first, written - first));
+        out->erase(out->begin() + outStart, out->begin() + outStart + stale);
+    }
+}
+
+static std::vector<ProfileEvent> allEvents()
+{
+    std::vector<ProfileEvent> events;
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    for (const std::unique_ptr<ProfilerThreadBuffer>& buffer : buffers)
+    {
+        copyEvents(*buffer, &events);
+    }
+    return events;
+}
+
+long long Profiler::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Profiler::record(const char* name, long long start, long long end, int depth)
+{
+    ProfilerThreadBuffer& buffer = threadBuffer();
+    unsigned long long index = buffer.written.load(std::memory_order_relaxed);
+    ProfileEvent& event = buffer.events[index % PROFILER_RING_SIZE];
+    event.name = name;
+    event.start = start;
+    event.end = end;
+    event.depth = depth;
+    event.threadId = buffer.threadId;
+    event.value = 0;
+    buffer.written.store(index + 1, std::memory_order_release);
+}
+
+void Profiler::counter(const char* name, long long value)
+{
+    ProfilerThreadBuffer& buffer = threadBuffer();
+    unsigned long long index = buffer.written.load(std::memory_order_relaxed);
+    ProfileEvent& event = buffer.events[index % PROFILER_RING_SIZE];
+    event.name = name;
+    event.start = now();
+    event.end = event.start;
+    event.depth = PROFILE_COUNTER_DEPTH;
+    event.threadId = buffer.threadId;
+    event.value = value;
+    buffer.written.store(index + 1, std::memory_order_release);
+}
+
+int Profiler::enterZone()
+{
+    return threadBuffer().depth++;
+}
+
+void Profiler::leaveZone()
+{
+    threadBuffer().depth--;
+}
+
+std::vector<ProfileEvent> Profiler::collect(long long begin, long long end)
+{
+    std::vector<ProfileEvent> events;
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    for (const std::unique_ptr<ProfilerThreadBuffer>& buffer : buffers)
+    {
+        // Zones are recorded when they end, so scanning back from the newest one can stop at the
+        // first that ended before begin
+        size_t bufferStart = events.size();
+        unsigned long long written = buffer->written.load(std::memory_order_acquire);
+        unsigned long long first = written > PROFILER_RING_SIZE ? written - PROFILER_RING_SIZE : 0;
+        unsigned long long i = written;
+        for (; i > first; i--)
+        {
+            const ProfileEvent& event = buffer->events[(i - 1) % PROFILER_RING_SIZE];
+            if (event.end < begin)
+            {
+                break;
+            }
+            if (event.start >= begin && event.end <= end)
+            {
+                events.push_back(event);
+            }
+        }
+
+        // The owner kept writing meanwhile: drop this buffer if the scanned slots may have been reused
+        unsigned long long writtenAfter = buffer->written.load(std::memory_order_acquire);
+        if (writtenAfter > PROFILER_RING_SIZE && writtenAfter - PROFILER_RING_SIZE > i)
+        {
+            events.resize(bufferStart);
+        }
+    }
+    std::sort(events.begin(), events.end(), [](const ProfileEvent& a, const ProfileEvent& b)
+        {
+            return a.start < b.start || (a.start == b.start && a.depth < b.depth);
+        });
+    return events;
+}
+
+bool Profiler::writeChromeTrace(const std::string& path)
+{
+    std::vector<ProfileEvent> events = allEvents();
+    long long origin = events.empty() ? 0 : events[0].start;
+    for (const ProfileEvent& event : events)
+    {
+        origin = std::min(origin, event.start);
+    }
+
+    FILE* file = std::fopen(path.c_str(), "w");
+    if (!file)
+    {
+        std::cout << "Failed to write trace: " << path << std::endl;
+        return false;
+    }
+    // Complete ("X") events in microseconds, the viewers nest them by time per thread. Counters are
+    // counter ("C") events, which are plotted per name.
+    std::fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        const ProfileEvent& event = events[i];
+        const char* separator = i + 1 < events.size() ? "," : "";
+        if (event.depth == PROFILE_COUNTER_DEPTH)
+        {
+            std::fprintf(file, "{\"name\": \"%s\", \"ph\": \"C\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"args\": {\"value\": %lld}}%s\n",
+                event.name, event.threadId, (event.start - origin) / 1000.0, event.value, separator);
+            continue;
+        }
+        std::fprintf(file, "{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}%s\n",
+            event.name, event.threadId, (event.start - origin) / 1000.0, (event.end - event.start) / 1000.0,
+            separator);
+    }
+    std::fprintf(file, "]}\n");
+    return std::fclose(file) == 0;
+}
@@ -0,0 +1,258 @@
+#include "QualityGovernor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+// Weights of the newest frame in the smoothed level and of the newest change in the trend
+#define PREDICTION_LEVEL_WEIGHT 0.3
+#define PREDICTION_TREND_WEIGHT 0.1
+// Weight of the newest frame in the CPU and GPU averages that tell which one is the bottleneck
+#define BOTTLENECK_WEIGHT 0.25
+
+// Steps of each knob below the best quality
+static const unsigned int knobSteps[KNOB_COUNT] = { 5, 3, 3, 3 };
+static const char* const knobNames[KNOB_COUNT] = { "resolution scale", "LOD bias", "shadow tile budget", "light cap" };
+// The order knobs are lowered in: the ones that take the load off the bottleneck first
+static const QualityKnob gpuBoundOrder[KNOB_COUNT] = { KNOB_RESOLUTION_SCALE, KNOB_LOD_BIAS, KNOB_SHADOW_TILE_BUDGET,
+    KNOB_LIGHT_CAP };
+static const QualityKnob cpuBoundOrder[KNOB_COUNT] = { KNOB_SHADOW_TILE_BUDGET, KNOB_LIGHT_CAP, KNOB_RESOLUTION_SCALE,
+    KNOB_LOD_BIAS };
+
+const char* getKnobName(QualityKnob knob)
+{
+    return knob < KNOB_COUNT ? knobNames[knob] : "?";
+}
+
+bool loadFrameTimeTrace(const std::string& path, std::vector<FrameTimeSample>* samples)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        return false;
+    }
+    samples->clear();
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        std::istringstream values(line);
+        FrameTimeSample sample = { 0.0, 0.0 };
+        if (values >> sample.cpuMilliseconds)
+        {
+            values >> sample.gpuMilliseconds;
+            samples->push_back(sample);
+        }
+    }
+    return !samples->empty();
+}
+
+std::vector<FrameTimeSample> syntheticFrameTimeTrace()
+{
+    std::vector<FrameTimeSample> samples;
+    samples.insert(samples.end(), 120, FrameTimeSample{ 4.0, 10.0 });
+    samples.insert(samples.end(), 120, FrameTimeSample{ 4.0, 30.0 });
+    samples.insert(samples.end(), 120, FrameTimeSample{ 24.0, 12.0 });
+    for (int i = 0; i < 240; i++)
+    {
+        samples.push_back({ 4.0, 10.0 + 16.0 * i / 239.0 });
+    }
+    samples.insert(samples.end(), 300, FrameTimeSample{ 3.0, 8.0 });
+    return samples;
+}
+
+ReplayExpectations syntheticTraceExpectations()
+{
+    // Frame ranges of the phases of syntheticFrameTimeTrace()
+    ReplayExpectations expectations;
+    expectations.firstLowered.push_back({ 120, 239, KNOB_RESOLUTION_SCALE });
+    expectations.firstLowered.push_back({ 240, 359, KNOB_SHADOW_TILE_BUDGET });
+    expectations.recovers = true;
+    return expectations;
+}
+
+QualityGovernor::QualityGovernor(double targetMilliseconds, const QualitySettings& best, std::ostream* log)
+    : target(targetMilliseconds), best(best), settings(best), log(log), steps(), level(0.0), trend(0.0),
+    started(false), cpuAverage(0.0), gpuAverage(0.0), overFrames(0), underFrames(0), cooldown(0), backoff(1),
+    sinceRaise(GOVERNOR_UNDER_FRAMES), frame(0), decisions(0), frames(0), predictionError(0.0)
+{
+}
+
+bool QualityGovernor::update(double cpuMilliseconds, double gpuMilliseconds)
+{
+    // CPU and GPU work on different frames at the same time, the slower one sets the pace. Without a
+    // GPU time the CPU time is all there is.
+    double frameMilliseconds = std::max(cpuMilliseconds, gpuMilliseconds);
+    if (!this->started)
+    {
+        this->level = frameMilliseconds;
+        this->cpuAverage = cpuMilliseconds;
+        this->gpuAverage = gpuMilliseconds;
+        this->started = true;
+    }
+    else
+    {
+        this->predictionError += std::abs(frameMilliseconds - getPrediction());
+        this->frames++;
+        double previousLevel = this->level;
+        this->level += PREDICTION_LEVEL_WEIGHT * (frameMilliseconds - getPrediction()) + this->trend;
+        this->trend += PREDICTION_TREND_WEIGHT * (this->level - previousLevel - this->trend);
+        this->cpuAverage += BOTTLENECK_WEIGHT * (cpuMilliseconds - this->cpuAverage);
+        this->gpuAverage += BOTTLENECK_WEIGHT * (gpuMilliseconds - this->gpuAverage);
+    }
+    this->frame++;
+    this->sinceRaise++;
+
+    double prediction = getPrediction();
+    if (prediction > this->target * (1.0 + GOVERNOR_OVER_MARGIN))
+    {
+        this->overFrames++;
+        this->underFrames = 0;
+    }
+    else if (prediction < this->target * GOVERNOR_UNDER_RATIO)
+    {
+        this->underFrames++;
+        this->overFrames = 0;
+    }
+    else
+    {
+        this->overFrames = 0;
+        this->underFrames = 0;
+    }
+    if (this->cooldown > 0)
+    {
+        this->cooldown--;
+        return false;
+    }
+
+    bool changed = false;
+    if (this->overFrames >= GOVERNOR_OVER_FRAMES)
+    {
+        // Lowering right after a raise means the raise didn't fit, so the next one waits longer
+        if (this->sinceRaise < GOVERNOR_UNDER_FRAMES)
+        {
+            this->backoff = std::min(this->backoff * 2, static_cast<unsigned int>(GOVERNOR_MAX_BACKOFF));
+        }
+        bool gpuBound = this->gpuAverage >= this->cpuAverage;
+        changed = lower(gpuBound, frameMilliseconds);
+        // Far over the target one step won't do, take two rather than drop frames through another cooldown
+        if (changed && prediction > this->target * GOVERNOR_FAR_OVER_RATIO)
+        {
+            lower(gpuBound, frameMilliseconds);
+        }
+    }
+    else if (this->underFrames >= GOVERNOR_UNDER_FRAMES * this->backoff)
+    {
+        changed = raise(frameMilliseconds);
+        if (changed)
+        {
+            this->sinceRaise = 0;
+        }
+    }
+    else if (this->sinceRaise == GOVERNOR_UNDER_FRAMES * GOVERNOR_MAX_BACKOFF && this->backoff > 1)
+    {
+        // A long stretch without trouble earns the patience back
+        this->backoff /= 2;
+    }
+    if (changed)
+    {
+        this->overFrames = 0;
+        this->underFrames = 0;
+        this->cooldown = GOVERNOR_COOLDOWN_FRAMES;
+    }
+    return changed;
+}
+
+bool QualityGovernor::lower(bool gpuBound, double frameMilliseconds)
+{
+    const QualityKnob* order = gpuBound ? gpuBoundOrder : cpuBoundOrder;
+    for (unsigned int i = 0; i < KNOB_COUNT; i++)
+    {
+        QualityKnob knob = order[i];
+        if (this->steps[knob] < knobSteps[knob])
+        {
+            QualitySettings before = this->settings;
+            this->steps[knob]++;
+            this->lowered.push_back(knob);
+            apply();
+            this->decisions++;
+            logDecision(gpuBound ? "over and GPU bound" : "over and CPU bound", knob, before,
+                frameMilliseconds);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool QualityGovernor::raise(double frameMilliseconds)
+{
+    if (this->lowered.empty())
+    {
+        return false;
+    }
+    QualityKnob knob = this->lowered.back();
+    this->lowered.pop_back();
+    QualitySettings before = this->settings;
+    this->steps[knob]--;
+    apply();
+    this->decisions++;
+    logDecision("well under", knob, before, frameMilliseconds);
+    return true;
+}
+
+void QualityGovernor::apply()
+{
+    this->settings.resolutionScale = this->best.resolutionScale * (1.0f - 0.1f * this->steps[KNOB_RESOLUTION_SCALE]);
+    this->settings.lodBias = this->best.lodBias + 0.5f * this->steps[KNOB_LOD_BIAS];
+    this->settings.shadowTileBudget = std::max(std::min(1u, this->best.shadowTileBudget),
+        this->best.shadowTileBudget >> this->steps[KNOB_SHADOW_TILE_BUDGET]);
+    this->settings.lightCap = std::max(std::min(4u, this->best.lightCap),
+        this->best.lightCap >> this->steps[KNOB_LIGHT_CAP]);
+}
+
+void QualityGovernor::logDecision(const char* reason, QualityKnob knob, const QualitySettings& before,
+    double frameMilliseconds) const
+{
+    if (!this->log)
+    {
+        return;
+    }
+    char values[64];
+    switch (knob)
+    {
+    case KNOB_RESOLUTION_SCALE:
+        std::snprintf(values, sizeof(values), "%.2f -> %.2f", before.resolutionScale, this->settings.resolutionScale);
+        break;
+    case KNOB_LOD_BIAS:
+        std::snprintf(values, sizeof(values), "%.1f -> %.1f", before.lodBias, this->settings.lodBias);
+        break;
+    case KNOB_SHADOW_TILE_BUDGET:
+        std::snprintf(values, sizeof(values), "%u -> %u", before.shadowTileBudget, this->settings.shadowTileBudget);
+        break;
+    default:
+        std::snprintf(values, sizeof(values), "%u -> %u", before.lightCap, this->settings.lightCap);
+        break;
+    }
+    char line[256];
+    std::snprintf(line, sizeof(line), "Governor frame %u: %.2f ms, predicted %.2f ms (CPU %.2f, GPU %.2f), target "
+        "%.2f ms, %s: %s %s", this->frame, frameMilliseconds, getPrediction(), this->cpuAverage, this->gpuAverage,
+        this->target, reason, knobNames[knob], values);
+    *this->log << line << std::endl;
+}
+
+double QualityGovernor::getMeanPredictionError() const
+{
+    return this->frames > 0 ? this->predictionError / this->frames : 0.0;
+}
+
+void QualityGovernor::resetStats()
+{
+    this->decisions = 0;
+    this->frames = 0;
+    this->predictionError = 0.0;
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+// A prediction above target * (1 + GOVERNOR_OVER_MARGIN) is over budget, one below target *
+// GOVERNOR_UNDER_RATIO leaves room for more quality. In between nothing changes.
+#define GOVERNOR_OVER_MARGIN 0.05
+#define GOVERNOR_UNDER_RATIO 0.75
+// Frames in a row the prediction has to stay over (under) before quality goes down (up). Going up
+// waits longer, a dropped frame is worse than a frame of lower quality.
+#define GOVERNOR_OVER_FRAMES 3
+// A prediction over target * GOVERNOR_FAR_OVER_RATIO lowers two steps at once
+#define GOVERNOR_FAR_OVER_RATIO 1.3
+#define GOVERNOR_UNDER_FRAMES 45
+// Frames after a change before the next one, so the change shows in the prediction first
+#define GOVERNOR_COOLDOWN_FRAMES 10
+// Raising the quality again right after lowering it doubles the frames the next raise waits, up to this
+#define GOVERNOR_MAX_BACKOFF 8
+
+/// <summary>
+/// The knobs the governor turns, in the order it lowers them when the GPU is the bottleneck.
+/// </summary>
+enum QualityKnob
+{
+    KNOB_RESOLUTION_SCALE,
+    KNOB_LOD_BIAS,
+    KNOB_SHADOW_TILE_BUDGET,
+    KNOB_LIGHT_CAP,
+    KNOB_COUNT
+};
+
+const char* getKnobName(QualityKnob knob);
+
+struct QualitySettings
+{
+    float resolutionScale = 1.0f;
+    float lodBias = 0.0f; // Of the material textures, higher samples smaller mip levels
+    unsigned int shadowTileBudget = 0; // Point shadow tiles rendered per frame
+    unsigned int lightCap = 0; // Point lights in the scene
+};
+
+/// <summary>
+/// Measured times of a frame, 0 where a time is unknown.
+/// </summary>
+struct FrameTimeSample
+{
+    double cpuMilliseconds;
+    double gpuMilliseconds;
+};
+
+/// <summary>
+/// Loads a frame time trace: one "cpu_ms gpu_ms" line per frame, lines starting with # are comments.
+/// </summary>
+bool loadFrameTimeTrace(const std::string& path, std::vector<FrameTimeSample>* samples);
+
+/// <summary>
+/// Frame times at full quality through the phases a governor with a 16.7 ms target has to handle:
+/// 120 steady frames of 10 ms (CPU 4 ms), a GPU spike to 30 ms for 120 frames, 120 CPU bound frames
+/// of 24 ms (GPU 12 ms), a slow GPU ramp from 10 to 26 ms over 240 frames and 300 light frames of 8 ms.
+/// </summary>
+std::vector<FrameTimeSample> syntheticFrameTimeTrace();
+
+/// <summary>
+/// Frames of a trace in which quality has to go down, starting with knob.
+/// </summary>
+struct KnobExpectation
+{
+    unsigned int firstFrame;
+    unsigned int lastFrame;
+    QualityKnob knob;
+};
+
+/// <summary>
+/// What a governor replay of a trace has to show besides never changing twice within
+/// GOVERNOR_COOLDOWN_FRAMES: the knob lowered first in stretches of frames over the target, and whether
+/// the quality is back at its best when the trace ends.
+/// </summary>
+struct ReplayExpectations
+{
+    std::vector<KnobExpectation> firstLowered;
+    bool recovers = false;
+};
+
+/// <summary>
+/// For syntheticFrameTimeTrace(): the resolution scale goes down first in the GPU spike, the shadow tile
+/// budget first in the CPU bound frames, and the light frames at the end bring back full quality.
+/// </summary>
+ReplayExpectations syntheticTraceExpectations();
+
+/// <summary>
+/// Holds a target frame time by turning quality knobs. Every frame the frame time, the slower of the
+/// CPU and the GPU time as they overlap, goes into a double exponential smoothing (level and trend)
+/// that predicts the next one. When the prediction stays over the target for GOVERNOR_OVER_FRAMES
+/// one knob goes one step down (two far over the target): resolution scale first when the GPU is
+/// slower, shadow tile budget first when the CPU is. When it stays well under the target for GOVERNOR_UNDER_FRAMES the knob
+/// lowered last goes back up, so raising undoes the decisions in reverse. Every decision is written
+/// to the log.
+/// </summary>
+class QualityGovernor
+{
+public:
+    /// <summary>
+    /// best is the quality without any knob lowered. log may be null.
+    /// </summary>
+    QualityGovernor(double targetMilliseconds, const QualitySettings& best, std::ostream* log);
+
+    /// <summary>
+    /// Adds the times of the frame just rendered and decides. Returns true when the settings changed.
+    /// </summary>
+    bool update(double cpuMilliseconds, double gpuMilliseconds);
+
+    const QualitySettings& getSettings() const { return this->settings; }
+    double getTarget() const { return this->target; }
+    // Predicted time of the next frame
+    double getPrediction() const { return this->level + this->trend; }
+    unsigned int getStep(QualityKnob knob) const { return this->steps[knob]; }
+
+    // Decisions, frames and the mean prediction error since the last resetStats()
+    unsigned int getDecisions() const { return this->decisions; }
+    unsigned int getFrames() const { return this->frames; }
+    double getMeanPredictionError() const;
+    void resetStats();
+
+private:
+    bool lower(bool gpuBound, double frameMilliseconds);
+    bool raise(double frameMilliseconds);
+    void apply();
+    void logDecision(const char* reason, QualityKnob knob, const QualitySettings& before, double frameMilliseconds) const;
+
+private:
+    double target;
+    QualitySettings best;
+    QualitySettings settings;
+    std::ostream* log;
+
+    unsigned int steps[KNOB_COUNT]; // 0 is the best quality
+    std::vector<QualityKnob> lowered; // Knobs in the order they were lowered, raised from the back
+
+    // Double exponential smoothing of the frame time
+    double level;
+    double trend;
+    bool started;
+    double cpuAverage;
+    double gpuAverage;
+
+    unsigned int overFrames;
+    unsigned int underFrames;
+    unsigned int cooldown;
+    unsigned int backoff; // Multiplies GOVERNOR_UNDER_FRAMES
+    unsigned int sinceRaise; // Frames since quality last went up
+    unsigned int frame;
+
+    unsigned int decisions;
+    unsigned int frames;
+    double predictionError;
+};
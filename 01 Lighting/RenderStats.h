@@ -0,0 +1,21 @@
+#pragma once
+
+/// <summary>
+/// Draw calls, triangles and state changes counted since the last resetRenderStats().
+/// </summary>
+struct RenderStats
+{
+    unsigned long long drawCalls = 0;
+    unsigned long long triangles = 0;
+    // Program, vertex array, texture and framebuffer binds plus fixed function state (enable/disable,
+    // depth, stencil, blend, cull)
+    unsigned long long stateChanges = 0;
+};
+
+/// <summary>
+/// Routes the glad draw and state change entry points through counting wrappers, so the render code
+/// is measured without changing it. Call once after glad has loaded the OpenGL functions.
+/// </summary>
+void installRenderStatsHooks();
+const RenderStats& getRenderStats();
+void resetRenderStats();
@@ -0,0 +1,131 @@
+#include "RenderTarget.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <iostream>
+
+RenderTarget::RenderTarget(int samples)
+    : samples(1), requestedSamples(samples), maxSamples(1), width(0), height(0), framebuffer(0), colorBuffer(0),
+    depthStencilBuffer(0), resolveFramebuffer(0), resolveColorBuffer(0)
+{
+    glGetIntegerv(GL_MAX_SAMPLES, &this->maxSamples);
+    this->maxSamples = std::max(1, this->maxSamples);
+}
+
+RenderTarget::~RenderTarget()
+{
+    deleteAttachments();
+}
+
+void RenderTarget::setSamples(int samples)
+{
+    this->requestedSamples = samples;
+}
+
+void RenderTarget::resize(int width, int height)
+{
+    width = std::max(1, width);
+    height = std::max(1, height);
+    int samples = std::min(std::max(1, this->requestedSamples), this->maxSamples);
+    if (width == this->width && height == this->height && samples == this->samples && this->framebuffer)
+    {
+        return;
+    }
+    deleteAttachments();
+    this->width = width;
+    this->height = height;
+    this->samples = samples;
+    createAttachments();
+}
+
+void RenderTarget::bind() const
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+    glViewport(0, 0, this->width, this->height);
+}
+
+void RenderTarget::resolve(unsigned int framebuffer, int targetWidth, int targetHeight)
+{
+    bool scaled = targetWidth != this->width || targetHeight != this->height;
+    unsigned int source = this->framebuffer;
+    if (this->samples > 1 && scaled)
+    {
+        if (!this->resolveFramebuffer)
+        {
+            glGenFramebuffers(1, &this->resolveFramebuffer);
+            glGenRenderbuffers(1, &this->resolveColorBuffer);
+            glBindRenderbuffer(GL_RENDERBUFFER, this->resolveColorBuffer);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, this->width, this->height);
+            glBindRenderbuffer(GL_RENDERBUFFER, 0);
+            glBindFramebuffer(GL_FRAMEBUFFER, this->resolveFramebuffer);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, this->resolveColorBuffer);
+        }
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, this->framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, this->resolveFramebuffer);
+        glBlitFramebuffer(0, 0, this->width, this->height, 0, 0, this->width, this->height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        source = this->resolveFramebuffer;
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, source);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+    if (scaled)
+    {
+        glBlitFramebuffer(0, 0, this->width, this->height, 0, 0, targetWidth, targetHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    }
+    else
+    {
+        GLbitfield mask = GL_COLOR_BUFFER_BIT;
+        if (this->samples == 1)
+        {
+            mask |= GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT;
+        }
+        glBlitFramebuffer(0, 0, this->width, this->height, 0, 0, targetWidth, targetHeight, mask, GL_NEAREST);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, targetWidth, targetHeight);
+}
+
+void RenderTarget::createAttachments()
+{
+    glGenFramebuffers(1, &this->framebuffer);
+    glGenRenderbuffers(1, &this->colorBuffer);
+    glGenRenderbuffers(1, &this->depthStencilBuffer);
+
+    // Renderbuffers, the target is only ever blitted from and never sampled
+    glBindRenderbuffer(GL_RENDERBUFFER, this->colorBuffer);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, this->samples > 1 ? this->samples : 0, GL_RGBA8,
+        this->width, this->height);
+    glBindRenderbuffer(GL_RENDERBUFFER, this->depthStencilBuffer);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, this->samples > 1 ? this->samples : 0, GL_DEPTH24_STENCIL8,
+        this->width, this->height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, this->colorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, this->depthStencilBuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cout << "Render target framebuffer is not complete" << std::endl;
+    }
+}
+
+void RenderTarget::deleteAttachments()
+{
+    if (!this->framebuffer)
+    {
+        return;
+    }
+    glDeleteFramebuffers(1, &this->framebuffer);
+    glDeleteRenderbuffers(1, &this->colorBuffer);
+    glDeleteRenderbuffers(1, &this->depthStencilBuffer);
+    this->framebuffer = 0;
+    this->colorBuffer = 0;
+    this->depthStencilBuffer = 0;
+    if (this->resolveFramebuffer)
+    {
+        glDeleteFramebuffers(1, &this->resolveFramebuffer);
+        glDeleteRenderbuffers(1, &this->resolveColorBuffer);
+        this->resolveFramebuffer = 0;
+        this->resolveColorBuffer = 0;
+    }
+}
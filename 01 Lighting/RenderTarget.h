@@ -0,0 +1,56 @@
+#pragma once
+
+/// <summary>
+/// Offscreen framebuffer the scene is rendered into before it reaches the window (or the headless
+/// framebuffer): a colour and a depth/stencil renderbuffer, multisampled when samples > 1. resolve()
+/// copies it to the real framebuffer with glBlitFramebuffer. A multisampled blit can't scale, so when
+/// the sizes differ the samples are first resolved into a single sampled copy of the same size, which
+/// is then scaled with linear filtering. The attachments are only recreated when the size or the sample
+/// count changed, so a dynamic resolution scale that settles costs nothing.
+/// </summary>
+class RenderTarget
+{
+public:
+    /// <summary>
+    /// No attachments until the first resize(). samples is clamped to GL_MAX_SAMPLES, 1 turns MSAA off.
+    /// </summary>
+    RenderTarget(int samples);
+    ~RenderTarget();
+    RenderTarget(const RenderTarget&) = delete;
+    RenderTarget& operator=(const RenderTarget&) = delete;
+
+    // Takes effect at the next resize()
+    void setSamples(int samples);
+    void resize(int width, int height);
+
+    // Binds the framebuffer with a viewport over all of it
+    void bind() const;
+
+    /// <summary>
+    /// Copies the colour to framebuffer at targetWidth x targetHeight, which becomes the bound framebuffer.
+    /// Depth and stencil are only copied at the same size without MSAA, as the blit can't do otherwise.
+    /// </summary>
+    void resolve(unsigned int framebuffer, int targetWidth, int targetHeight);
+
+    unsigned int getFramebuffer() const { return this->framebuffer; }
+    int getWidth() const { return this->width; }
+    int getHeight() const { return this->height; }
+    int getSamples() const { return this->samples; }
+
+private:
+    void createAttachments();
+    void deleteAttachments();
+
+private:
+    int samples;
+    int requestedSamples;
+    int maxSamples;
+    int width;
+    int height;
+    unsigned int framebuffer;
+    unsigned int colorBuffer;
+    unsigned int depthStencilBuffer;
+    // Single sampled copy for resolving multisampled targets before scaling, created when first needed
+    unsigned int resolveFramebuffer;
+    unsigned int resolveColorBuffer;
+};
@@ -4,42 +4,43 @@
 #include <sstream>
 #include <iostream>
 #include <glm/gtc/type_ptr.hpp>
+#include "Profiler.h"
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath)
+static std::string readShaderFile(const char* path)
 {
-    std::string vertexCode;
-    std::string fragmentCode;
-    std::ifstream vShaderFile;
-    std::ifstream fShaderFile;
-
+    std::ifstream file;
     // Ensure ifstream objects can throw exceptions:
-    vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-
+    file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
     try
     {
-        // open files
-        vShaderFile.open(vertexPath);
-        fShaderFile.open(fragmentPath);
-        std::stringstream vShaderStream, fShaderStream;
-        // read file's buffer contents into streams
-        vShaderStream << vShaderFile.rdbuf();
-        fShaderStream << fShaderFile.rdbuf();
-        // close file handlers
-        vShaderFile.close();
-        fShaderFile.close();
-        // convert stream into string
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
+        file.open(path);
+        std::stringstream stream;
+        stream << file.rdbuf();
+        file.close();
+        return stream.str();
     }
     catch (std::ifstream::failure e)
     {
         std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << e.what() << std::endl;
     }
+    return std::string();
+}
 
+Shader::Shader(const char* vertexPath, const char* fragmentPath)
+{
+    PROFILE_SCOPE("Shader::Shader");
+    std::string vertexCode = readShaderFile(vertexPath);
+    std::string fragmentCode = readShaderFile(fragmentPath);
     compileAndLink(vertexCode.c_str(), fragmentCode.c_str());
 }
 
+Shader::Shader(const char* vertexPath)
+{
+    PROFILE_SCOPE("Shader::Shader");
+    std::string vertexCode = readShaderFile(vertexPath);
+    compileAndLink(vertexCode.c_str(), nullptr);
+}
+
 Shader::~Shader()
 {
     glDeleteProgram(programID);
@@ -82,6 +83,12 @@ void Shader::setMat4(const std::string& name, glm::mat4 value) const
     glUniformMatrix4fv(uniformLoc, 1, GL_FALSE, glm::value_ptr(value));
 }
 
+void Shader::setVec2(const std::string& name, glm::vec2 value) const
+{
+    unsigned int uniformLoc = glGetUniformLocation(programID, name.c_str());
+    glUniform2fv(uniformLoc, 1, glm::value_ptr(value));
+}
+
 void Shader::setVec3(const std::string& name, glm::vec3 value) const
 {
     unsigned int uniformLoc = glGetUniformLocation(programID, name.c_str());
@@ -96,26 +103,37 @@ void Shader::setVec4(const std::string& name, glm::vec4 value) const
 
 void Shader::compileAndLink(const char* vShaderCode, const char* fShaderCode)
 {
+    PROFILE_SCOPE("Shader::compileAndLink");
     unsigned int vertex, fragment;
     // vertex shader
     vertex = glCreateShader(GL_VERTEX_SHADER);
     glShaderSource(vertex, 1, &vShaderCode, NULL);
     glCompileShader(vertex);
     checkCompileErrors(vertex, "VERTEX");
-    // fragment Shader
-    fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &fShaderCode, NULL);
-    glCompileShader(fragment);
-    checkCompileErrors(fragment, "FRAGMENT");
+    // fragment Shader, none for depth only programs
+    fragment = 0;
+    if (fShaderCode)
+    {
+        fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragment, 1, &fShaderCode, NULL);
+        glCompileShader(fragment);
+        checkCompileErrors(fragment, "FRAGMENT");
+    }
     // shader Program
     programID = glCreateProgram();
     glAttachShader(programID, vertex);
-    glAttachShader(programID, fragment);
+    if (fragment)
+    {
+        glAttachShader(programID, fragment);
+    }
     glLinkProgram(programID);
     checkCompileErrors(programID, "PROGRAM");
     // delete the shaders as they're linked into our program now and no longer necessary
     glDeleteShader(vertex);
-    glDeleteShader(fragment);
+    if (fragment)
+    {
+        glDeleteShader(fragment);
+    }
 }
 
 void Shader::checkCompileErrors(unsigned int shader, std::string type)
@@ -8,6 +8,11 @@ class Shader
 {
 public:
     Shader(const char* vertexPath, const char* fragmentPath);
+
+    /// <summary>
+    /// Program without a fragment shader, for depth only passes
+    /// </summary>
+    explicit Shader(const char* vertexPath);
     ~Shader();
 
     /// <summary>
@@ -23,6 +28,7 @@ public:
     void setFloat(const std::string &name, float value) const;
     void setMat3(const std::string& name, glm::mat3 value) const;
     void setMat4(const std::string& name, glm::mat4 value) const;
+    void setVec2(const std::string& name, glm::vec2 value) const;
     void setVec3(const std::string& name, glm::vec3 value) const;
     void setVec4(const std::string& name, glm::vec4 value) const;
 
@@ -0,0 +1,70 @@
+#include "ShaderInvocationCounter.h"
+
+#include <glad/glad.h>
+#include <cstring>
+
+// GL_ARB_pipeline_statistics_query, not part of the OpenGL 3.3 headers
+#ifndef GL_FRAGMENT_SHADER_INVOCATIONS_ARB
+#define GL_FRAGMENT_SHADER_INVOCATIONS_ARB 0x82F4
+#endif
+
+static bool pipelineStatisticsSupported()
+{
+    GLint extensionCount = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+    for (GLint i = 0; i < extensionCount; i++)
+    {
+        const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (extension && std::strcmp(extension, "GL_ARB_pipeline_statistics_query") == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+ShaderInvocationCounter::ShaderInvocationCounter()
+    : supported(pipelineStatisticsSupported()), lastInvocations(0), totalInvocations(0), framesRead(0)
+{
+    if (this->supported)
+    {
+        this->ring.reset(new GpuQueryRing(1));
+    }
+}
+
+void ShaderInvocationCounter::begin()
+{
+    if (!this->supported)
+    {
+        return;
+    }
+    unsigned long long invocations = 0;
+    if (this->ring->readBack(0, &invocations))
+    {
+        this->lastInvocations = invocations;
+        this->totalInvocations += invocations;
+        this->framesRead++;
+    }
+    this->ring->begin(GL_FRAGMENT_SHADER_INVOCATIONS_ARB, 0);
+}
+
+void ShaderInvocationCounter::end()
+{
+    if (!this->supported)
+    {
+        return;
+    }
+    this->ring->end(GL_FRAGMENT_SHADER_INVOCATIONS_ARB);
+    this->ring->endFrame();
+}
+
+double ShaderInvocationCounter::getAverageInvocations() const
+{
+    return this->framesRead > 0 ? static_cast<double>(this->totalInvocations) / this->framesRead : 0.0;
+}
+
+void ShaderInvocationCounter::reset()
+{
+    this->totalInvocations = 0;
+    this->framesRead = 0;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <memory>
+#include "GpuQueryRing.h"
+
+/// <summary>
+/// Counts the fragment shader invocations of one pass per frame with GL_ARB_pipeline_statistics_query,
+/// i.e. the fragments that were shaded, overdraw included. Without the extension every call does nothing
+/// and isSupported() is false.
+/// </summary>
+class ShaderInvocationCounter
+{
+public:
+    /// <summary>
+    /// Checks for the extension and creates the queries, the OpenGL context must be current.
+    /// </summary>
+    ShaderInvocationCounter();
+    ShaderInvocationCounter(const ShaderInvocationCounter&) = delete;
+    ShaderInvocationCounter& operator=(const ShaderInvocationCounter&) = delete;
+
+    bool isSupported() const { return this->supported; }
+
+    // Once per frame around the counted pass
+    void begin();
+    void end();
+
+    // Invocations of the newest frame read back, and the average over all frames read back so far
+    unsigned long long getLastInvocations() const { return this->lastInvocations; }
+    double getAverageInvocations() const;
+
+    // Forgets the frames read back so far, e.g. after warmup frames
+    void reset();
+
+private:
+    bool supported;
+    std::unique_ptr<GpuQueryRing> ring; // Only with the extension
+    unsigned long long lastInvocations;
+    unsigned long long totalInvocations;
+    unsigned int framesRead;
+};
@@ -0,0 +1,297 @@
+#include "ShadowCascades.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <glm/gtc/matrix_transform.hpp>
+#include "Profiler.h"
+
+#define V_SHADOW_SHADER_PATH "shaders/shadow_depth.vert"
+
+// First attribute of the instanced model matrix in shadow_depth.vert, a mat4 takes 4 locations
+#define MODEL_ATTRIBUTE 1
+
+// Zone and counter names have to outlive the profiler, so they are literals
+static const char* const cascadeZones[] = { "shadow cascade 0", "shadow cascade 1", "shadow cascade 2", "shadow cascade 3" };
+static const char* const casterCounters[] = { "shadow cascade 0 casters", "shadow cascade 1 casters",
+    "shadow cascade 2 casters", "shadow cascade 3 casters" };
+static_assert(SHADOW_CASCADES <= sizeof(cascadeZones) / sizeof(cascadeZones[0]), "Name the zones of the new cascades");
+
+ShadowCascades::ShadowCascades(unsigned int positionBuffer, unsigned int vertexCount)
+    : depthShader(V_SHADOW_SHADER_PATH), depthMap(0), framebuffers(), vao(0), instanceBuffer(0),
+    vertexCount(vertexCount), fovDegrees(0.0f), aspect(0.0f), nearPlane(0.0f), splits(), sphereCenters(),
+    sphereRadii(), staggered(true), frame(0), valid(), lightDirection(0.0f), shadowMatrices(), texelSizes(),
+    viewForward(0.0f, 0.0f, -1.0f), queries(SHADOW_CASCADES * 2), stats()
+{
+    // Hardware PCF: with a compare mode and linear filtering every lookup compares the 4 nearest texels
+    // and blends the results
+    glGenTextures(1, &this->depthMap);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, this->depthMap);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, SHADOW_CASCADES, 0,
+        GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    // One depth only framebuffer per layer. Headless runs keep their offscreen framebuffer bound, so the
+    // binding is restored afterwards.
+    GLint boundFramebuffer = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &boundFramebuffer);
+    glGenFramebuffers(SHADOW_CASCADES, this->framebuffers);
+    const GLenum none = GL_NONE;
+    for (unsigned int cascade = 0; cascade < SHADOW_CASCADES; cascade++)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffers[cascade]);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, this->depthMap, 0, cascade);
+        glDrawBuffers(1, &none);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cout << "Shadow map framebuffer is not complete" << std::endl;
+        }
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, boundFramebuffer);
+
+    // Positions from the caster mesh, a model matrix per instance from the instance buffer
+    glGenVertexArrays(1, &this->vao);
+    glGenBuffers(1, &this->instanceBuffer);
+    glBindVertexArray(this->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, this->instanceBuffer);
+    for (unsigned int column = 0; column < 4; column++)
+    {
+        glEnableVertexAttribArray(MODEL_ATTRIBUTE + column);
+        glVertexAttribDivisor(MODEL_ATTRIBUTE + column, 1);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+ShadowCascades::~ShadowCascades()
+{
+    glDeleteVertexArrays(1, &this->vao);
+    glDeleteBuffers(1, &this->instanceBuffer);
+    glDeleteFramebuffers(SHADOW_CASCADES, this->framebuffers);
+    glDeleteTextures(1, &this->depthMap);
+}
+
+void ShadowCascades::setProjection(float fovDegrees, float aspect, float nearPlane)
+{
+    if (fovDegrees == this->fovDegrees && aspect == this->aspect && nearPlane == this->nearPlane)
+    {
+        return;
+    }
+    this->fovDegrees = fovDegrees;
+    this->aspect = aspect;
+    this->nearPlane = nearPlane;
+
+    // The corners of a slice at view depth d are sqrt(k2) * d from the view axis
+    float tanHalfFov = std::tan(glm::radians(fovDegrees) * 0.5f);
+    float k2 = tanHalfFov * tanHalfFov * (1.0f + aspect * aspect);
+    float sliceNear = nearPlane;
+    for (unsigned int cascade = 0; cascade < SHADOW_CASCADES; cascade++)
+    {
+        float t = static_cast<float>(cascade + 1) / SHADOW_CASCADES;
+        float uniformSplit = nearPlane + (SHADOW_DISTANCE - nearPlane) * t;
+        float logSplit = nearPlane * std::pow(SHADOW_DISTANCE / nearPlane, t);
+        float sliceFar = SHADOW_SPLIT_LAMBDA * logSplit + (1.0f - SHADOW_SPLIT_LAMBDA) * uniformSplit;
+        this->splits[cascade] = sliceFar;
+
+        // The centre on the view axis that is as far from the near corners as from the far ones, or the
+        // centre of the far end when the slice is so wide that this lies beyond it
+        float center = std::min(0.5f * (sliceNear + sliceFar) * (1.0f + k2), sliceFar);
+        float nearDistance = std::sqrt(k2 * sliceNear * sliceNear + (center - sliceNear) * (center - sliceNear));
+        float farDistance = std::sqrt(k2 * sliceFar * sliceFar + (sliceFar - center) * (sliceFar - center));
+        this->sphereCenters[cascade] = glm::vec3(0.0f, 0.0f, -center);
+        this->sphereRadii[cascade] = std::max(nearDistance, farDistance);
+        this->valid[cascade] = false;
+        sliceNear = sliceFar;
+    }
+}
+
+void ShadowCascades::render(const std::vector<ShadowCaster>& casters, const glm::vec3& lightDirection,
+    const glm::mat4& view, unsigned int targetFramebuffer, int viewportWidth, int viewportHeight)
+{
+    PROFILE_SCOPE("ShadowCascades::render");
+    if (lightDirection != this->lightDirection)
+    {
+        std::fill(this->valid, this->valid + SHADOW_CASCADES, false);
+        this->lightDirection = lightDirection;
+    }
+    glm::mat4 inverseView = glm::inverse(view);
+    this->viewForward = -glm::vec3(inverseView[2]);
+
+    // The light's view only rotates, so a texel stays a texel as the cascades move. Any up vector
+    // not parallel to the light will do.
+    glm::vec3 direction = glm::normalize(lightDirection);
+    glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), direction, up);
+
+    readQueries();
+
+    // Cull the casters of every cascade due this frame, so they go up in one buffer
+    bool due[SHADOW_CASCADES];
+    glm::mat4 lightSpaces[SHADOW_CASCADES];
+    size_t first[SHADOW_CASCADES + 1];
+    this->models.clear();
+    for (unsigned int cascade = 0; cascade < SHADOW_CASCADES; cascade++)
+    {
+        long long start = Profiler::now();
+        first[cascade] = this->models.size();
+        due[cascade] = !this->staggered || !this->valid[cascade] || isDue(cascade);
+        if (due[cascade])
+        {
+            lightSpaces[cascade] = fitCascade(cascade, lightView, inverseView, casters);
+        }
+        this->stats[cascade].cpuMilliseconds += (Profiler::now() - start) / 1e6;
+    }
+    first[SHADOW_CASCADES] = this->models.size();
+    if (!this->models.empty())
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, this->instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, this->models.size() * sizeof(glm::mat4), this->models.data(), GL_STREAM_DRAW);
+    }
+
+    // Casters between the light and a cascade still shadow it, depth clamping keeps them from being
+    // clipped by the near plane, which can then hug the slice for better depth precision
+    this->depthShader.use();
+    glBindVertexArray(this->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, this->instanceBuffer);
+    glViewport(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+    glEnable(GL_DEPTH_CLAMP);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(1.5f, 2.0f);
+    for (unsigned int cascade = 0; cascade < SHADOW_CASCADES; cascade++)
+    {
+        if (!due[cascade])
+        {
+            continue;
+        }
+        PROFILE_SCOPE(cascadeZones[cascade]);
+        long long start = Profiler::now();
+        this->queries.timestamp(2 * cascade);
+        glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffers[cascade]);
+        glClear(GL_DEPTH_BUFFER_BIT);
+
+        // OpenGL 3.3 has no base instance, so the model matrix attributes are pointed at the cascade's first caster
+        size_t count = first[cascade + 1] - first[cascade];
+        if (count > 0)
+        {
+            const char* base = reinterpret_cast<const char*>(first[cascade] * sizeof(glm::mat4));
+            for (unsigned int column = 0; column < 4; column++)
+            {
+                glVertexAttribPointer(MODEL_ATTRIBUTE + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                    base + column * sizeof(glm::vec4));
+            }
+            this->depthShader.setMat4("lightSpace", lightSpaces[cascade]);
+            glDrawArraysInstanced(GL_TRIANGLES, 0, this->vertexCount, static_cast<GLsizei>(count));
+        }
+        this->queries.timestamp(2 * cascade + 1);
+
+        ShadowCascadeStats& cascadeStats = this->stats[cascade];
+        cascadeStats.updates++;
+        cascadeStats.casters += count;
+        cascadeStats.cpuMilliseconds += (Profiler::now() - start) / 1e6;
+        Profiler::counter(casterCounters[cascade], static_cast<long long>(count));
+        this->valid[cascade] = true;
+    }
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glDisable(GL_DEPTH_CLAMP);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
+    glViewport(0, 0, viewportWidth, viewportHeight);
+    this->queries.endFrame();
+    this->frame++;
+}
+
+// The first cascade every frame, the second every other frame and the rest take turns in the remaining
+// frames, so at most two cascades are rendered per frame
+bool ShadowCascades::isDue(unsigned int cascade) const
+{
+    if (cascade == 0)
+    {
+        return true;
+    }
+    if (this->frame % 2 == 1)
+    {
+        return cascade == 1;
+    }
+    return SHADOW_CASCADES > 2 && cascade == 2 + (this->frame / 2) % (SHADOW_CASCADES - 2);
+}
+
+glm::mat4 ShadowCascades::fitCascade(unsigned int cascade, const glm::mat4& lightView, const glm::mat4& inverseView,
+    const std::vector<ShadowCaster>& casters)
+{
+    float radius = this->sphereRadii[cascade];
+    float texelSize = 2.0f * radius / SHADOW_MAP_SIZE;
+    glm::vec3 center = glm::vec3(lightView * inverseView * glm::vec4(this->sphereCenters[cascade], 1.0f));
+    center.x = std::floor(center.x / texelSize) * texelSize;
+    center.y = std::floor(center.y / texelSize) * texelSize;
+
+    // Light space looks down -z, so the sphere spans the depths -center.z -+ radius
+    glm::mat4 projection = glm::ortho(center.x - radius, center.x + radius, center.y - radius, center.y + radius,
+        -center.z - radius, -center.z + radius);
+    glm::mat4 lightSpace = projection * lightView;
+    glm::mat4 bias = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)), glm::vec3(0.5f));
+    this->shadowMatrices[cascade] = bias * lightSpace;
+    this->texelSizes[cascade] = texelSize;
+
+    // Casters overlapping the cascade across the light, at any depth up to the far side of the slice
+    for (const ShadowCaster& caster : casters)
+    {
+        glm::vec3 position = glm::vec3(lightView * glm::vec4(caster.center, 1.0f));
+        float reach = radius + caster.radius;
+        if (std::abs(position.x - center.x) > reach || std::abs(position.y - center.y) > reach ||
+            position.z + caster.radius < center.z - radius)
+        {
+            continue;
+        }
+        this->models.push_back(caster.model);
+    }
+    return lightSpace;
+}
+
+void ShadowCascades::readQueries()
+{
+    for (unsigned int cascade = 0; cascade < SHADOW_CASCADES; cascade++)
+    {
+        double milliseconds = 0.0;
+        if (this->queries.readMilliseconds(2 * cascade, 2 * cascade + 1, &milliseconds))
+        {
+            this->stats[cascade].gpuMilliseconds += milliseconds;
+            this->stats[cascade].gpuFrames++;
+        }
+    }
+}
+
+void ShadowCascades::bind(const Shader& shader, int textureUnit, bool enabled) const
+{
+    glActiveTexture(GL_TEXTURE0 + textureUnit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, this->depthMap);
+    glActiveTexture(GL_TEXTURE0);
+
+    shader.setInt("shadowMap", textureUnit);
+    shader.setBool("shadowsEnabled", enabled);
+    shader.setVec3("shadowViewForward", this->viewForward);
+    for (unsigned int cascade = 0; cascade < SHADOW_CASCADES; cascade++)
+    {
+        std::string index = "[" + std::to_string(cascade) + "]";
+        shader.setMat4("shadowMatrices" + index, this->shadowMatrices[cascade]);
+        shader.setFloat("shadowSplits" + index, this->splits[cascade]);
+        shader.setFloat("shadowTexelSizes" + index, this->texelSizes[cascade]);
+    }
+}
+
+void ShadowCascades::resetStats()
+{
+    std::fill(this->stats, this->stats + SHADOW_CASCADES, ShadowCascadeStats());
+}
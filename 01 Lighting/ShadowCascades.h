@@ -0,0 +1,126 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "GpuQueryRing.h"
+#include "Shader.h"
+
+// Cascades of the directional light's shadow map, layers of one depth texture array
+#define SHADOW_CASCADES 4
+#define SHADOW_MAP_SIZE 1024
+// Shadows end this far along the view direction, the cascades split the range up to it
+#define SHADOW_DISTANCE 40.0f
+// Blend between uniform (0) and logarithmic (1) split distances
+#define SHADOW_SPLIT_LAMBDA 0.8f
+
+/// <summary>
+/// A shadow caster, drawn with the caster mesh and bounded by a sphere for culling.
+/// </summary>
+struct ShadowCaster
+{
+    glm::mat4 model;
+    glm::vec3 center;
+    float radius;
+};
+
+/// <summary>
+/// Per cascade results since the last resetStats(): the frames it was rendered in, the casters drawn
+/// into it, the CPU time of culling and submitting them and the GPU time of drawing them.
+/// </summary>
+struct ShadowCascadeStats
+{
+    unsigned int updates = 0;
+    unsigned long long casters = 0;
+    double cpuMilliseconds = 0.0;
+    double gpuMilliseconds = 0.0;
+    unsigned int gpuFrames = 0; // Updates whose timestamps were read back
+};
+
+/// <summary>
+/// Cascaded shadow maps of the directional light. The view frustum up to SHADOW_DISTANCE is split into
+/// SHADOW_CASCADES slices and each one is covered by an orthographic projection along the light. The
+/// projection fits the bounding sphere of the slice, so its size doesn't change as the camera turns, and
+/// its centre is snapped to whole texels, so moving the camera doesn't make the shadow edges shimmer.
+/// The casters are culled against every cascade on the CPU, the model matrices of all of them are
+/// uploaded into one instance buffer and each cascade draws its share with one instanced call.
+/// The far cascades cover more of the scene with fewer texels per unit and change less between frames,
+/// so they are rendered less often: the first every frame, the second every other frame and the last two
+/// every fourth, taking turns. Fragments outside a cascade rendered from an older camera position fall
+/// through to the next one.
+/// </summary>
+class ShadowCascades
+{
+public:
+    /// <summary>
+    /// Creates the shadow map, the depth shader and the timestamp queries. The casters are drawn with
+    /// vertexCount vertices of tightly packed positions (3 floats) from positionBuffer.
+    /// </summary>
+    ShadowCascades(unsigned int positionBuffer, unsigned int vertexCount);
+    ~ShadowCascades();
+    ShadowCascades(const ShadowCascades&) = delete;
+    ShadowCascades& operator=(const ShadowCascades&) = delete;
+
+    /// <summary>
+    /// Recomputes the split distances and the bounding spheres of the slices, only when the projection changed.
+    /// </summary>
+    void setProjection(float fovDegrees, float aspect, float nearPlane);
+
+    /// <summary>
+    /// Renders the cascades that are due this frame (all of them with staggered off or after a light
+    /// change) and leaves targetFramebuffer bound with the viewport restored.
+    /// </summary>
+    void render(const std::vector<ShadowCaster>& casters, const glm::vec3& lightDirection, const glm::mat4& view,
+        unsigned int targetFramebuffer, int viewportWidth, int viewportHeight);
+
+    /// <summary>
+    /// Binds the shadow map to textureUnit and sets the shadow uniforms of the shader in use
+    /// (see shaders/shader.frag). enabled false makes the shader skip the shadow lookups.
+    /// </summary>
+    void bind(const Shader& shader, int textureUnit, bool enabled) const;
+
+    // Renders every cascade every frame when false
+    void setStaggered(bool staggered) { this->staggered = staggered; }
+
+    // Far end of each cascade along the view direction
+    float getSplit(unsigned int cascade) const { return this->splits[cascade]; }
+    const ShadowCascadeStats& getStats(unsigned int cascade) const { return this->stats[cascade]; }
+    // Forgets the stats so far, e.g. after warmup frames
+    void resetStats();
+
+private:
+    bool isDue(unsigned int cascade) const;
+    // Fits the cascade's projection around its slice, appends the casters inside it to models and
+    // returns the light space matrix to render them with
+    glm::mat4 fitCascade(unsigned int cascade, const glm::mat4& lightView, const glm::mat4& inverseView,
+        const std::vector<ShadowCaster>& casters);
+    void readQueries();
+
+private:
+    Shader depthShader;
+    unsigned int depthMap;
+    unsigned int framebuffers[SHADOW_CASCADES];
+    unsigned int vao;
+    unsigned int instanceBuffer;
+    unsigned int vertexCount;
+
+    float fovDegrees;
+    float aspect;
+    float nearPlane;
+    float splits[SHADOW_CASCADES];
+    // Smallest sphere around each slice in view space, the same for every camera orientation
+    glm::vec3 sphereCenters[SHADOW_CASCADES];
+    float sphereRadii[SHADOW_CASCADES];
+
+    bool staggered;
+    unsigned int frame;
+    bool valid[SHADOW_CASCADES]; // Rendered at least once for the current light direction and projection
+    glm::vec3 lightDirection;
+    // Light space (with the bias to texture coordinates) each cascade was last rendered with
+    glm::mat4 shadowMatrices[SHADOW_CASCADES];
+    float texelSizes[SHADOW_CASCADES]; // World units per texel
+    glm::vec3 viewForward; // Of the last render, the deferred lighting pass finds the view depth with it
+    std::vector<glm::mat4> models; // Casters of the cascades rendered this frame, one after the other
+
+    GpuQueryRing queries; // Timestamps before and after each cascade, 2 * cascade and 2 * cascade + 1
+    ShadowCascadeStats stats[SHADOW_CASCADES];
+};
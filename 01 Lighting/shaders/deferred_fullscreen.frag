@@ -0,0 +1,181 @@
+#version 330 core
+out vec4 FragColor;
+
+uniform vec3 viewPos;
+
+struct DirLight
+{
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct SpotLight
+{
+    vec3 position;
+    vec3 direction;
+    float cutOff;
+    float outerCutOff;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+// What the geometry pass wrote for the surface of a pixel, see gbuffer.frag
+struct Surface
+{
+    vec3 position;
+    vec3 normal;
+    vec3 albedo;
+    float specular;
+    float shininess;
+};
+
+uniform DirLight dirLight;
+uniform SpotLight spotLight;
+
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormalShininess;
+uniform sampler2D gDepth;
+uniform mat4 inverseViewProjection;
+uniform vec2 viewportSize;
+
+// Cascaded shadow map of the directional light, see shader.frag. The view depth of a pixel is its
+// distance along shadowViewForward.
+const int SHADOW_CASCADES = 4; // Must match ShadowCascades.h
+uniform sampler2DArrayShadow shadowMap;
+uniform bool shadowsEnabled;
+uniform mat4 shadowMatrices[SHADOW_CASCADES];
+uniform float shadowSplits[SHADOW_CASCADES];
+uniform float shadowTexelSizes[SHADOW_CASCADES];
+uniform vec3 shadowViewForward;
+
+const float MAX_SHININESS = 256.0;
+
+vec3 decodeNormal(vec2 encoded)
+{
+    encoded = encoded * 2.0 - 1.0;
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if (n.z < 0.0)
+    {
+        vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+        n.xy = (1.0 - abs(n.yx)) * signs;
+    }
+    return normalize(n);
+}
+
+// Share of the directional light reaching the surface, the same lookups as in shader.frag
+float calcShadow(vec3 fragPos, vec3 normal, float viewDepth)
+{
+    if (!shadowsEnabled)
+    {
+        return 1.0;
+    }
+    int cascade = 0;
+    while (cascade < SHADOW_CASCADES && viewDepth > shadowSplits[cascade])
+    {
+        cascade++;
+    }
+
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float grazing = 1.0 - max(dot(normal, normalize(-dirLight.direction)), 0.0);
+    for (; cascade < SHADOW_CASCADES; cascade++)
+    {
+        // Looked up a little off the surface, further where the light grazes it, against shadow acne
+        vec3 offset = normal * shadowTexelSizes[cascade] * (0.5 + 1.5 * grazing);
+        vec3 coords = (shadowMatrices[cascade] * vec4(fragPos + offset, 1.0)).xyz;
+        if (any(lessThan(coords.xy, 2.0 * texel)) || any(greaterThan(coords.xy, 1.0 - 2.0 * texel)) || coords.z > 1.0)
+        {
+            continue;
+        }
+        float lit = 0.0;
+        for (int x = -1; x <= 1; x++)
+        {
+            for (int y = -1; y <= 1; y++)
+            {
+                lit += texture(shadowMap, vec4(coords.xy + vec2(x, y) * texel, float(cascade), coords.z));
+            }
+        }
+        float shadowEnd = shadowSplits[SHADOW_CASCADES - 1];
+        return mix(lit / 9.0, 1.0, clamp((viewDepth - 0.9 * shadowEnd) / (0.1 * shadowEnd), 0.0, 1.0));
+    }
+    return 1.0;
+}
+
+vec3 calcDirLight(DirLight light, Surface surface, vec3 viewDir, float shadow)
+{
+    vec3 lightDir = normalize(-light.direction);
+
+    vec3 ambient = surface.albedo * light.ambient;
+
+    float diff = max(dot(surface.normal, lightDir), 0.0);
+    vec3 diffuse = diff * surface.albedo * light.diffuse;
+
+    vec3 reflectDir = reflect(-lightDir, surface.normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), surface.shininess);
+    vec3 specular = spec * surface.specular * light.specular;
+
+    return (ambient + shadow * (diffuse + specular));
+}
+
+vec3 calcSpotLight(SpotLight light, Surface surface, vec3 viewDir)
+{
+    vec3 lightDir = normalize(light.position - surface.position);
+
+    vec3 ambient = surface.albedo * light.ambient;
+
+    float diff = max(dot(surface.normal, lightDir), 0.0);
+    vec3 diffuse = diff * surface.albedo * light.diffuse;
+
+    vec3 reflectDir = reflect(-lightDir, surface.normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), surface.shininess);
+    vec3 specular = spec * surface.specular * light.specular;
+
+    // Spotlight with soft edges
+    float theta = dot(lightDir, normalize(-light.direction));
+    float epsilon = light.cutOff - light.outerCutOff;
+    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+    diffuse *= intensity;
+    specular *= intensity;
+
+    float distance = length(light.position - surface.position);
+    float attenuation = 1.0 / (light.constant + light.linear * distance +
+                            light.quadratic * (distance * distance));
+
+    return (ambient + diffuse + specular) * attenuation;
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    // Background
+    if (depth == 1.0)
+    {
+        discard;
+    }
+
+    // Back from the depth buffer to world space
+    vec4 position = inverseViewProjection * vec4(vec3(gl_FragCoord.xy / viewportSize, depth) * 2.0 - 1.0, 1.0);
+    vec4 albedoSpecular = texelFetch(gAlbedoSpecular, pixel, 0);
+    vec4 normalShininess = texelFetch(gNormalShininess, pixel, 0);
+
+    Surface surface;
+    surface.position = position.xyz / position.w;
+    surface.normal = decodeNormal(normalShininess.xy);
+    surface.albedo = albedoSpecular.rgb;
+    surface.specular = albedoSpecular.a;
+    surface.shininess = normalShininess.z * MAX_SHININESS;
+
+    vec3 viewDir = normalize(viewPos - surface.position);
+    float shadow = calcShadow(surface.position, surface.normal, dot(surface.position - viewPos, shadowViewForward));
+    vec3 result = calcDirLight(dirLight, surface, viewDir, shadow) + calcSpotLight(spotLight, surface, viewDir);
+    FragColor = vec4(result, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,124 @@
+#version 330 core
+out vec4 FragColor;
+
+flat in vec4 PositionRadius;
+flat in vec4 ColorConstant;
+flat in vec2 LinearQuadratic;
+flat in int ShadowSlot;
+
+uniform vec3 viewPos;
+
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormalShininess;
+uniform sampler2D gDepth;
+uniform mat4 inverseViewProjection;
+uniform vec2 viewportSize;
+
+const float MAX_SHININESS = 256.0;
+
+// The point shadow atlas of shader.frag
+uniform sampler2DShadow pointShadowAtlas;
+uniform samplerBuffer pointShadowTiles;
+uniform bool pointShadowsEnabled;
+uniform mat4 pointShadowFaces[6];
+uniform int pointShadowTilesPerRow;
+uniform float pointShadowNear;
+
+vec3 decodeNormal(vec2 encoded)
+{
+    encoded = encoded * 2.0 - 1.0;
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if (n.z < 0.0)
+    {
+        vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+        n.xy = (1.0 - abs(n.yx)) * signs;
+    }
+    return normalize(n);
+}
+
+// calcPointShadow of shader.frag
+float calcPointShadow(vec3 lightPos, vec3 fragPos, vec3 normal)
+{
+    if (!pointShadowsEnabled || ShadowSlot < 0)
+    {
+        return 1.0;
+    }
+    vec3 direction = fragPos - lightPos;
+    vec3 absDirection = abs(direction);
+    int face;
+    if (absDirection.x >= absDirection.y && absDirection.x >= absDirection.z)
+    {
+        face = direction.x > 0.0 ? 0 : 1;
+    }
+    else if (absDirection.y >= absDirection.z)
+    {
+        face = direction.y > 0.0 ? 2 : 3;
+    }
+    else
+    {
+        face = direction.z > 0.0 ? 4 : 5;
+    }
+    int tile = ShadowSlot * 6 + face;
+    vec4 positionFar = texelFetch(pointShadowTiles, tile);
+    if (positionFar.w == 0.0)
+    {
+        return 1.0;
+    }
+
+    float tileTexels = float(textureSize(pointShadowAtlas, 0).x) / float(pointShadowTilesPerRow);
+    vec3 offset = normal * 2.0 * length(fragPos - positionFar.xyz) / tileTexels;
+    vec3 local = (pointShadowFaces[face] * vec4(fragPos + offset - positionFar.xyz, 0.0)).xyz;
+    float depth = -local.z;
+    if (depth <= pointShadowNear)
+    {
+        return 1.0;
+    }
+    vec2 uv = clamp(local.xy / depth * 0.5 + 0.5, vec2(1.0 / tileTexels), vec2(1.0 - 1.0 / tileTexels));
+    vec2 tileCorner = vec2(tile % pointShadowTilesPerRow, tile / pointShadowTilesPerRow);
+    float n = pointShadowNear;
+    float f = positionFar.w;
+    float reference = 0.5 * ((f + n) / (f - n) - 2.0 * f * n / ((f - n) * depth)) + 0.5;
+    return texture(pointShadowAtlas, vec3((tileCorner + uv) / float(pointShadowTilesPerRow), reference));
+}
+
+// The point light of shader.frag, evaluated for the pixel's surface
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    vec4 position = inverseViewProjection * vec4(vec3(gl_FragCoord.xy / viewportSize, depth) * 2.0 - 1.0, 1.0);
+    vec3 fragPos = position.xyz / position.w;
+
+    vec3 lightPos = PositionRadius.xyz;
+    float distance = length(lightPos - fragPos);
+    if (distance >= PositionRadius.w)
+    {
+        discard;
+    }
+
+    vec4 albedoSpecular = texelFetch(gAlbedoSpecular, pixel, 0);
+    vec4 normalShininess = texelFetch(gNormalShininess, pixel, 0);
+    vec3 normal = decodeNormal(normalShininess.xy);
+    vec3 viewDir = normalize(viewPos - fragPos);
+    vec3 lightDir = (lightPos - fragPos) / distance;
+    vec3 color = ColorConstant.rgb;
+
+    vec3 ambient = 0.05 * color * albedoSpecular.rgb;
+
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 diffuse = diff * 0.8 * color * albedoSpecular.rgb;
+
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), normalShininess.z * MAX_SHININESS);
+    vec3 specular = vec3(spec * albedoSpecular.a);
+
+    float attenuation = 1.0 / (ColorConstant.w + LinearQuadratic.x * distance +
+                            LinearQuadratic.y * (distance * distance));
+    // Fade out smoothly towards the radius, the light is cut off there
+    float falloff = clamp(1.0 - pow(distance / PositionRadius.w, 4.0), 0.0, 1.0);
+    attenuation *= falloff * falloff;
+
+    float shadow = calcPointShadow(lightPos, fragPos, normal);
+
+    FragColor = vec4((ambient + shadow * (diffuse + specular)) * attenuation, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,21 @@
+#version 330 core
+layout (location = 0) in vec3 aPos; // Unit sphere
+layout (location = 1) in vec4 aPositionRadius;
+layout (location = 2) in vec4 aColorConstant;
+layout (location = 3) in vec4 aLinearQuadratic;
+
+flat out vec4 PositionRadius;
+flat out vec4 ColorConstant;
+flat out vec2 LinearQuadratic;
+flat out int ShadowSlot;
+
+uniform mat4 viewProjection;
+
+void main()
+{
+    gl_Position = viewProjection * vec4(aPositionRadius.xyz + aPos * aPositionRadius.w, 1.0);
+    PositionRadius = aPositionRadius;
+    ColorConstant = aColorConstant;
+    LinearQuadratic = aLinearQuadratic.xy;
+    ShadowSlot = int(aLinearQuadratic.z);
+}
\ No newline at end of file
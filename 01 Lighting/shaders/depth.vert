@@ -0,0 +1,15 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+// Must match shader.vert, the shading pass tests its depth for equality with this one
+invariant gl_Position;
+
+void main()
+{
+    vec4 viewPos = view * model * vec4(aPos, 1.0);
+    gl_Position = projection * viewPos;
+}
\ No newline at end of file
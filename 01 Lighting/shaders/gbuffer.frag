@@ -0,0 +1,35 @@
+#version 330 core
+layout (location = 0) out vec4 AlbedoSpecular;
+layout (location = 1) out vec4 NormalShininess;
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+
+struct Material
+{
+    sampler2D diffuse;
+    sampler2D specular;
+    float     shininess;
+};
+
+uniform Material material;
+
+// Shininess up to this fits the 10 bit channel
+const float MAX_SHININESS = 256.0;
+
+// Folds the unit sphere onto an octahedron and its lower half over the upper one, so a normal fits in
+// two [0, 1] values with an even precision in every direction
+vec2 encodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    vec2 folded = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * signs;
+    return folded * 0.5 + 0.5;
+}
+
+void main()
+{
+    // The specular map is grey, one channel of it is enough
+    AlbedoSpecular = vec4(texture(material.diffuse, TexCoords).rgb, texture(material.specular, TexCoords).g);
+    NormalShininess = vec4(encodeNormal(normalize(Normal)), material.shininess / MAX_SHININESS, 0.0);
+}
\ No newline at end of file
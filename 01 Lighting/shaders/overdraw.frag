@@ -0,0 +1,8 @@
+#version 330 core
+out vec4 FragColor;
+
+// Added up with additive blending for every fragment shaded, white is 8 or more layers
+void main()
+{
+    FragColor = vec4(vec3(1.0 / 8.0), 1.0);
+}
\ No newline at end of file
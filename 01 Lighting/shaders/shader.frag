@@ -3,6 +3,7 @@ out vec4 FragColor;
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
+in float ViewDepth;
 
 uniform vec3 viewPos;
 
@@ -26,8 +27,9 @@ struct PointLight
     float constant;
     float linear;
     float quadratic;
+    float radius; // The light fades out towards it and is culled beyond
+    int shadowSlot; // Its tiles in the point shadow atlas, -1 without shadows
 };
-#define NR_POINT_LIGHTS 4
 
 struct SpotLight
 {
@@ -52,25 +54,103 @@ struct Material
     float     shininess;
 };
 
+// The material of this fragment, sampled once in main for every light
+vec3 albedo;
+vec3 specularColor;
+
 uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
 uniform SpotLight spotLight;
 uniform Material material;
 
-vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewDir);
-vec3 calcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+// Clustered point lights (see LightClusters.h). clusterGrid holds the offset into clusterIndices and
+// the light count of every cluster, clusterLights 3 texels per light.
+uniform samplerBuffer clusterLights;
+uniform usamplerBuffer clusterGrid;
+uniform usamplerBuffer clusterIndices;
+uniform vec2 viewportSize;
+uniform int clusterTilesX;
+uniform int clusterTilesY;
+uniform int clusterSlices;
+uniform float clusterNear;
+uniform float clusterFar;
+
+// Cascaded shadow map of the directional light (see ShadowCascades.h). Each cascade covers the view
+// depths up to its split with its own light space matrix.
+const int SHADOW_CASCADES = 4; // Must match ShadowCascades.h
+uniform sampler2DArrayShadow shadowMap;
+uniform bool shadowsEnabled;
+uniform mat4 shadowMatrices[SHADOW_CASCADES];
+uniform float shadowSplits[SHADOW_CASCADES];
+uniform float shadowTexelSizes[SHADOW_CASCADES];
+
+// Omnidirectional shadows of the point lights with a slot (see PointShadowAtlas.h). Tile slot * 6 + face
+// of the atlas holds a cube face, pointShadowTiles the light position it was rendered from and its far
+// plane, 0 when the face has no shadows.
+uniform sampler2DShadow pointShadowAtlas;
+uniform samplerBuffer pointShadowTiles;
+uniform bool pointShadowsEnabled;
+uniform mat4 pointShadowFaces[6]; // Rotations to the views of the faces: +X, -X, +Y, -Y, +Z, -Z
+uniform int pointShadowTilesPerRow;
+uniform float pointShadowNear;
+
+float calcShadow(vec3 fragPos, vec3 normal, float viewDepth);
+float calcPointShadow(PointLight light, vec3 fragPos, vec3 normal);
+vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewDir, float shadow);
+vec3 calcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, float shadow);
+PointLight fetchPointLight(int index);
 vec3 calcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 
-vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewDir)
+// Share of the directional light reaching the fragment: 3x3 lookups of the cascade its view depth falls in,
+// each comparing and blending 4 texels. A cascade rendered from an older camera position may not cover the
+// fragment, then the next one is used. The shadows fade out towards the end of the last cascade.
+float calcShadow(vec3 fragPos, vec3 normal, float viewDepth)
+{
+    if (!shadowsEnabled)
+    {
+        return 1.0;
+    }
+    int cascade = 0;
+    while (cascade < SHADOW_CASCADES && viewDepth > shadowSplits[cascade])
+    {
+        cascade++;
+    }
+
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float grazing = 1.0 - max(dot(normal, normalize(-dirLight.direction)), 0.0);
+    for (; cascade < SHADOW_CASCADES; cascade++)
+    {
+        // Looked up a little off the surface, further where the light grazes it, against shadow acne
+        vec3 offset = normal * shadowTexelSizes[cascade] * (0.5 + 1.5 * grazing);
+        vec3 coords = (shadowMatrices[cascade] * vec4(fragPos + offset, 1.0)).xyz;
+        if (any(lessThan(coords.xy, 2.0 * texel)) || any(greaterThan(coords.xy, 1.0 - 2.0 * texel)) || coords.z > 1.0)
+        {
+            continue;
+        }
+        float lit = 0.0;
+        for (int x = -1; x <= 1; x++)
+        {
+            for (int y = -1; y <= 1; y++)
+            {
+                lit += texture(shadowMap, vec4(coords.xy + vec2(x, y) * texel, float(cascade), coords.z));
+            }
+        }
+        float shadowEnd = shadowSplits[SHADOW_CASCADES - 1];
+        return mix(lit / 9.0, 1.0, clamp((viewDepth - 0.9 * shadowEnd) / (0.1 * shadowEnd), 0.0, 1.0));
+    }
+    return 1.0;
+}
+
+// shadow is the share of the light reaching the fragment, the ambient part isn't shadowed
+vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewDir, float shadow)
 {
     vec3 lightDir = normalize(-light.direction);
 
     // Ambient
-    vec3 ambient = texture(material.diffuse, TexCoords).rgb * light.ambient;
+    vec3 ambient = albedo * light.ambient;
 
     // Diffuse
     float diff = max(dot(normal, lightDir), 0.0);
-    vec3 diffuse = diff * texture(material.diffuse, TexCoords).rgb * light.diffuse;
+    vec3 diffuse = diff * albedo * light.diffuse;
 
     // Specular
     // The reflect function expects the first vector to point
@@ -78,55 +158,126 @@ vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewDir)
     // we are getting the negative value.
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-    vec3 specular = spec * texture(material.specular, TexCoords).rgb * light.specular;
+    vec3 specular = spec * specularColor * light.specular;
 
-    return (ambient + diffuse + specular);
+    return (ambient + shadow * (diffuse + specular));
 }
 
-vec3 calcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+// The face the fragment is seen through is the one on the major axis of its direction from the light.
+// Its depth is compared with hardware PCF, the lookup stays a texel inside the tile.
+float calcPointShadow(PointLight light, vec3 fragPos, vec3 normal)
+{
+    if (!pointShadowsEnabled || light.shadowSlot < 0)
+    {
+        return 1.0;
+    }
+    vec3 direction = fragPos - light.position;
+    vec3 absDirection = abs(direction);
+    int face;
+    if (absDirection.x >= absDirection.y && absDirection.x >= absDirection.z)
+    {
+        face = direction.x > 0.0 ? 0 : 1;
+    }
+    else if (absDirection.y >= absDirection.z)
+    {
+        face = direction.y > 0.0 ? 2 : 3;
+    }
+    else
+    {
+        face = direction.z > 0.0 ? 4 : 5;
+    }
+    int tile = light.shadowSlot * 6 + face;
+    vec4 positionFar = texelFetch(pointShadowTiles, tile);
+    if (positionFar.w == 0.0)
+    {
+        return 1.0;
+    }
+
+    // Looked up about a texel (at the fragment's distance) off the surface, against shadow acne
+    float tileTexels = float(textureSize(pointShadowAtlas, 0).x) / float(pointShadowTilesPerRow);
+    vec3 offset = normal * 2.0 * length(fragPos - positionFar.xyz) / tileTexels;
+    vec3 local = (pointShadowFaces[face] * vec4(fragPos + offset - positionFar.xyz, 0.0)).xyz;
+    float depth = -local.z;
+    if (depth <= pointShadowNear)
+    {
+        return 1.0;
+    }
+    vec2 uv = clamp(local.xy / depth * 0.5 + 0.5, vec2(1.0 / tileTexels), vec2(1.0 - 1.0 / tileTexels));
+    vec2 tileCorner = vec2(tile % pointShadowTilesPerRow, tile / pointShadowTilesPerRow);
+    // The depth the 90 degree perspective projection of the tile stores at this distance
+    float n = pointShadowNear;
+    float f = positionFar.w;
+    float reference = 0.5 * ((f + n) / (f - n) - 2.0 * f * n / ((f - n) * depth)) + 0.5;
+    return texture(pointShadowAtlas, vec3((tileCorner + uv) / float(pointShadowTilesPerRow), reference));
+}
+
+// shadow is the share of the light reaching the fragment, the ambient part isn't shadowed
+vec3 calcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, float shadow)
 {
     // Light direction from fragment to light
     vec3 lightDir = normalize(light.position - fragPos);
 
     // Ambient
-    vec3 ambient = texture(material.diffuse, TexCoords).rgb * light.ambient;
+    vec3 ambient = albedo * light.ambient;
 
     // Diffuse
     float diff = max(dot(normal, lightDir), 0.0);
-    vec3 diffuse = diff * texture(material.diffuse, TexCoords).rgb * light.diffuse;
+    vec3 diffuse = diff * albedo * light.diffuse;
 
     // Specular
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-    vec3 specular = spec * texture(material.specular, TexCoords).rgb * light.specular;
+    vec3 specular = spec * specularColor * light.specular;
 
     // Attenuation
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + 
                             light.quadratic * (distance * distance));
+    // Fade out smoothly towards the radius, the light is cut off there
+    float falloff = clamp(1.0 - pow(distance / light.radius, 4.0), 0.0, 1.0);
+    attenuation *= falloff * falloff;
     ambient *= attenuation;
-    diffuse *= attenuation;
-    specular *= attenuation;
+    diffuse *= attenuation * shadow;
+    specular *= attenuation * shadow;
 
     return (ambient + diffuse + specular);
 }
 
+PointLight fetchPointLight(int index)
+{
+    vec4 positionRadius = texelFetch(clusterLights, index * 3);
+    vec4 colorConstant = texelFetch(clusterLights, index * 3 + 1);
+    vec4 attenuation = texelFetch(clusterLights, index * 3 + 2);
+
+    PointLight light;
+    light.position = positionRadius.xyz;
+    light.radius = positionRadius.w;
+    light.ambient = 0.05 * colorConstant.rgb;
+    light.diffuse = 0.8 * colorConstant.rgb;
+    light.specular = vec3(1.0);
+    light.constant = colorConstant.w;
+    light.linear = attenuation.x;
+    light.quadratic = attenuation.y;
+    light.shadowSlot = int(attenuation.z);
+    return light;
+}
+
 vec3 calcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
     // Light direction from fragment to light
     vec3 lightDir = normalize(light.position - fragPos);
 
     // Ambient
-    vec3 ambient = texture(material.diffuse, TexCoords).rgb * light.ambient;
+    vec3 ambient = albedo * light.ambient;
 
     // Diffuse
     float diff = max(dot(normal, lightDir), 0.0);
-    vec3 diffuse = diff * texture(material.diffuse, TexCoords).rgb * light.diffuse;
+    vec3 diffuse = diff * albedo * light.diffuse;
 
     // Specular
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-    vec3 specular = spec * texture(material.specular, TexCoords).rgb * light.specular;
+    vec3 specular = spec * specularColor * light.specular;
 
     // Spotlight with soft edges
     float theta = dot(lightDir, normalize(-light.direction));
@@ -149,18 +300,27 @@ vec3 calcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 void main()
 {
     vec3 norm = normalize(Normal);
+    albedo = texture(material.diffuse, TexCoords).rgb;
+    specularColor = texture(material.specular, TexCoords).rgb;
 
     // Light reflection from fragment to camera/eye
     vec3 viewDir = normalize(viewPos - FragPos);
 
-    vec3 result;
+    vec3 result = vec3(0.0);
 
     // Phase 1: Directional lighting
-    result += calcDirLight(dirLight, norm, viewDir);
-    // Phase 2: Point lights
-    for (int i = 0; i < NR_POINT_LIGHTS; i++)
+    result += calcDirLight(dirLight, norm, viewDir, calcShadow(FragPos, norm, ViewDepth));
+    // Phase 2: Point lights, only the ones reaching this fragment's cluster
+    ivec2 tile = ivec2(gl_FragCoord.xy / viewportSize * vec2(clusterTilesX, clusterTilesY));
+    tile = clamp(tile, ivec2(0), ivec2(clusterTilesX - 1, clusterTilesY - 1));
+    int slice = int(log(ViewDepth / clusterNear) / log(clusterFar / clusterNear) * float(clusterSlices));
+    slice = clamp(slice, 0, clusterSlices - 1);
+    uvec2 lights = texelFetch(clusterGrid, (slice * clusterTilesY + tile.y) * clusterTilesX + tile.x).xy;
+    for (uint i = 0u; i < lights.y; i++)
     {
-        result += calcPointLight(pointLights[i], norm, FragPos, viewDir);
+        int index = int(texelFetch(clusterIndices, int(lights.x + i)).r);
+        PointLight light = fetchPointLight(index);
+        result += calcPointLight(light, norm, FragPos, viewDir, calcPointShadow(light, FragPos, norm));
     }
     // Phase 3: Spot light
     result += calcSpotLight(spotLight, norm, FragPos, viewDir);
@@ -6,6 +6,10 @@ layout (location = 2) in vec2 aTexCoords;
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+out float ViewDepth; // Distance along the view direction, picks the cluster's depth slice
+
+// Computed exactly like in depth.vert, so the depth pre-pass and the GL_EQUAL shading pass agree
+invariant gl_Position;
 
 uniform mat4 model;
 uniform mat4 view;
@@ -14,7 +18,9 @@ uniform mat3 normalMat;
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    vec4 viewPos = view * model * vec4(aPos, 1.0);
+    gl_Position = projection * viewPos;
+    ViewDepth = -viewPos.z;
     FragPos = vec3(model * vec4(aPos, 1.0));
     Normal = normalMat * aNormal;
     TexCoords = aTexCoords;
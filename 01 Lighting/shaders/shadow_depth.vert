@@ -0,0 +1,11 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in mat4 aModel; // Per caster, locations 1 to 4
+
+// Light space of the cascade being rendered, see ShadowCascades.cpp
+uniform mat4 lightSpace;
+
+void main()
+{
+    gl_Position = lightSpace * aModel * vec4(aPos, 1.0);
+}
\ No newline at end of file
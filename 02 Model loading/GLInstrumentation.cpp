@@ -0,0 +1,214 @@
+#include "GLInstrumentation.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <type_traits>
+
+// GL_KHR_debug / OpenGL 4.3 names, which a glad generated for 3.3 core does not have
+#define INSTRUMENTATION_GL_DEBUG_OUTPUT_SYNCHRONOUS 0x8242
+#define INSTRUMENTATION_GL_DEBUG_TYPE_PERFORMANCE 0x8250
+#define INSTRUMENTATION_GL_DEBUG_OUTPUT 0x92E0
+#define INSTRUMENTATION_GL_CONTEXT_FLAGS 0x821E
+#define INSTRUMENTATION_GL_CONTEXT_FLAG_DEBUG_BIT 0x00000002
+#define INSTRUMENTATION_GL_DONT_CARE 0x1100
+
+typedef void (APIENTRY* DebugMessageProc)(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length,
+    const GLchar* message, const void* userParam);
+typedef void (APIENTRY* DebugMessageCallbackProc)(DebugMessageProc callback, const void* userParam);
+typedef void (APIENTRY* DebugMessageControlProc)(GLenum source, GLenum type, GLenum severity, GLsizei count,
+    const GLuint* ids, GLboolean enabled);
+
+static GlCallCounters counters;
+static bool installed = false;
+static bool debugOutput = false;
+
+static const char* functionNames[] = {
+#define GL_FUNCTION_NAME(name) #name,
+    GL_INSTRUMENTED_FUNCTIONS(GL_FUNCTION_NAME)
+#undef GL_FUNCTION_NAME
+};
+
+// Distinct messages and their counts. The driver may call back from its own threads when the
+// context is not a debug context, so the map is locked.
+static std::mutex debugMessagesMutex;
+static std::map<std::string, unsigned long long> debugMessages;
+
+/// <summary>
+/// Adds the time between its construction and destruction to one entry point. A scope rather than two
+/// statements around the call so the wrapper below can return the call's result directly.
+/// </summary>
+class DriverTimer
+{
+public:
+    DriverTimer(int function)
+        : function(function), start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~DriverTimer()
+    {
+        counters.calls[this->function]++;
+        counters.nanoseconds[this->function] += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - this->start).count();
+    }
+
+private:
+    int function;
+    std::chrono::steady_clock::time_point start;
+};
+
+// One wrapper per entry point, generated from the glad pointer type: the real pointer it replaced
+// and a call with the same signature that times and forwards to it
+template <int Function, typename Proc>
+struct InstrumentedCall;
+
+template <int Function, typename Result, typename... Args>
+struct InstrumentedCall<Function, Result (APIENTRY*)(Args...)>
+{
+    static Result (APIENTRY* real)(Args...);
+
+    static Result APIENTRY call(Args... args)
+    {
+        DriverTimer timer(Function);
+        return real(args...);
+    }
+};
+
+template <int Function, typename Result, typename... Args>
+Result (APIENTRY* InstrumentedCall<Function, Result (APIENTRY*)(Args...)>::real)(Args...) = nullptr;
+
+// name is only pasted or stringized, never passed on, so glad's gl<Name> macros don't expand it
+#define GL_INSTALL_WRAPPER(name) \
+    { \
+        typedef InstrumentedCall<GL_FUNCTION_##name, std::remove_reference<decltype(glad_##name)>::type> Wrapper; \
+        if (glad_##name) \
+        { \
+            Wrapper::real = glad_##name; \
+            glad_##name = Wrapper::call; \
+        } \
+    }
+
+static void APIENTRY debugMessageCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length,
+    const GLchar* message, const void* userParam)
+{
+    if (type != INSTRUMENTATION_GL_DEBUG_TYPE_PERFORMANCE)
+    {
+        return;
+    }
+    std::string text = length >= 0 ? std::string(message, length) : std::string(message);
+    std::lock_guard<std::mutex> lock(debugMessagesMutex);
+    if (debugMessages[text]++ == 0)
+    {
+        std::cout << "GL performance warning: " << text << std::endl;
+    }
+}
+
+static bool debugOutputSupported()
+{
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if (major > 4 || (major == 4 && minor >= 3))
+    {
+        return true;
+    }
+    GLint extensionCount = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+    for (GLint i = 0; i < extensionCount; i++)
+    {
+        const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (extension && std::strcmp(extension, "GL_KHR_debug") == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void installGlInstrumentation(void* (*getProcAddress)(const char* name))
+{
+    if (installed)
+    {
+        return;
+    }
+    installed = true;
+
+    if (debugOutputSupported())
+    {
+        DebugMessageCallbackProc debugMessageCallbackProc =
+            reinterpret_cast<DebugMessageCallbackProc>(getProcAddress("glDebugMessageCallback"));
+        DebugMessageControlProc debugMessageControlProc =
+            reinterpret_cast<DebugMessageControlProc>(getProcAddress("glDebugMessageControl"));
+        if (debugMessageCallbackProc && debugMessageControlProc)
+        {
+            GLint flags = 0;
+            glGetIntegerv(INSTRUMENTATION_GL_CONTEXT_FLAGS, &flags);
+            if (!(flags & INSTRUMENTATION_GL_CONTEXT_FLAG_DEBUG_BIT))
+            {
+                std::cout << "Not a debug context, the driver may not report performance warnings" << std::endl;
+            }
+            glEnable(INSTRUMENTATION_GL_DEBUG_OUTPUT);
+            // Messages arrive on the thread and inside the call that caused them
+            glEnable(INSTRUMENTATION_GL_DEBUG_OUTPUT_SYNCHRONOUS);
+            debugMessageControlProc(INSTRUMENTATION_GL_DONT_CARE, INSTRUMENTATION_GL_DONT_CARE,
+                INSTRUMENTATION_GL_DONT_CARE, 0, nullptr, GL_FALSE);
+            debugMessageControlProc(INSTRUMENTATION_GL_DONT_CARE, INSTRUMENTATION_GL_DEBUG_TYPE_PERFORMANCE,
+                INSTRUMENTATION_GL_DONT_CARE, 0, nullptr, GL_TRUE);
+            debugMessageCallbackProc(debugMessageCallback, nullptr);
+            debugOutput = true;
+        }
+    }
+    if (!debugOutput)
+    {
+        std::cout << "GL_KHR_debug is not available, driver performance warnings are not collected" << std::endl;
+    }
+
+    GL_INSTRUMENTED_FUNCTIONS(GL_INSTALL_WRAPPER)
+}
+
+bool glInstrumentationInstalled()
+{
+    return installed;
+}
+
+bool glDebugOutputEnabled()
+{
+    return debugOutput;
+}
+
+const GlCallCounters& getGlCallCounters()
+{
+    return counters;
+}
+
+void resetGlCallCounters()
+{
+    counters = GlCallCounters();
+}
+
+const char* glFunctionName(int function)
+{
+    return function >= 0 && function < GL_FUNCTION_COUNT ? functionNames[function] : "unknown";
+}
+
+std::vector<GlDebugMessage> getGlDebugMessages()
+{
+    std::vector<GlDebugMessage> messages;
+    {
+        std::lock_guard<std::mutex> lock(debugMessagesMutex);
+        for (const std::pair<const std::string, unsigned long long>& message : debugMessages)
+        {
+            messages.push_back({ message.first, message.second });
+        }
+    }
+    std::sort(messages.begin(), messages.end(), [](const GlDebugMessage& a, const GlDebugMessage& b)
+        {
+            return a.count > b.count;
+        });
+    return messages;
+}
@@ -0,0 +1,386 @@
+#include "JobSystem.h"
+
+#include <chrono>
+
+struct Job
+{
+    std::function<void()> work;
+    JobCounter* counter;
+    bool mainThread;
+};
+
+// Deque of the worker thread this is running on, -1 on every other thread
+static thread_local const JobSystem* currentSystem = nullptr;
+static thread_local int currentQueueIndex = -1;
+
+static uint32_t nextRandom()
+{
+    thread_local uint32_t state = static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id())) | 1;
+    // xorshift32, only picks the first deque to steal from
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+JobCounter::JobCounter()
+    : pending(0), finishing(0)
+{
+}
+
+bool JobCounter::done() const
+{
+    // A job that brought pending to zero may still be releasing the waiting jobs, the counter must
+    // stay alive until it is through
+    return this->pending.load() == 0 && this->finishing.load() == 0;
+}
+
+WorkStealingQueue::WorkStealingQueue()
+    : top(0), bottom(0), buffer(new std::atomic<Job*>[JOB_QUEUE_CAPACITY])
+{
+}
+
+bool WorkStealingQueue::push(Job* job)
+{
+    int64_t b = this->bottom.load(std::memory_order_relaxed);
+    int64_t t = this->top.load(std::memory_order_acquire);
+    if (b - t >= JOB_QUEUE_CAPACITY)
+    {
+        return false;
+    }
+    this->buffer[b & (JOB_QUEUE_CAPACITY - 1)].store(job, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    this->bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+}
+
+Job* WorkStealingQueue::pop()
+{
+    int64_t b = this->bottom.load(std::memory_order_relaxed) - 1;
+    this->bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = this->top.load(std::memory_order_relaxed);
+    if (t > b)
+    {
+        // Empty
+        this->bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Job* job = this->buffer[b & (JOB_QUEUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (t == b)
+    {
+        // The last job, a thief may be taking it at the same time
+        if (!this->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            job = nullptr;
+        }
+        this->bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+Job* WorkStealingQueue::steal()
+{
+    int64_t t = this->top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = this->bottom.load(std::memory_order_acquire);
+    if (t >= b)
+    {
+        return nullptr;
+    }
+
+    Job* job = this->buffer[t & (JOB_QUEUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (!this->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+    {
+        return nullptr;
+    }
+    return job;
+}
+
+JobSystem::JobSystem(unsigned int workerCount)
+    : mainThread(std::this_thread::get_id()), queuedJobs(0), sleepingWorkers(0), stopping(false)
+{
+    if (workerCount == 0)
+    {
+        unsigned int cores = std::thread::hardware_concurrency();
+        workerCount = cores > 1 ? cores - 1 : 1;
+    }
+
+    for (unsigned int i = 0; i <= workerCount; i++)
+    {
+        this->queues.emplace_back(new WorkStealingQueue());
+    }
+    for (unsigned int i = 1; i <= workerCount; i++)
+    {
+        this->workers.emplace_back(&JobSystem::workerLoop, this, i);
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    this->stopping.store(true);
+    {
+        std::lock_guard<std::mutex> lock(this->sleepMutex);
+        this->wakeUp.notify_all();
+    }
+    for (std::thread& worker : this->workers)
+    {
+        worker.join();
+    }
+
+    // The workers are gone, so the deques can be emptied from here
+    for (std::unique_ptr<WorkStealingQueue>& queue : this->queues)
+    {
+        while (Job* job = queue->steal())
+        {
+            delete job;
+        }
+    }
+    for (Job* job : this->sharedJobs)
+    {
+        delete job;
+    }
+    for (Job* job : this->mainThreadJobs)
+    {
+        delete job;
+    }
+}
+
+void JobSystem::run(std::function<void()> work, JobCounter* counter, JobCounter* after)
+{
+    submit(new Job{ std::move(work), counter, false }, after);
+}
+
+void JobSystem::runOnMainThread(std::function<void()> work, JobCounter* counter, JobCounter* after)
+{
+    submit(new Job{ std::move(work), counter, true }, after);
+}
+
+void JobSystem::parallelFor(size_t count, size_t batchSize, std::function<void(size_t begin, size_t end)> work,
+    JobCounter* counter)
+{
+    if (batchSize == 0)
+    {
+        batchSize = 1;
+    }
+    // Shared rather than copied into every batch
+    std::shared_ptr<std::function<void(size_t, size_t)>> shared =
+        std::make_shared<std::function<void(size_t, size_t)>>(std::move(work));
+    for (size_t begin = 0; begin < count; begin += batchSize)
+    {
+        size_t end = begin + batchSize < count ? begin + batchSize : count;
+        run([shared, begin, end]() { (*shared)(begin, end); }, counter);
+    }
+}
+
+void JobSystem::wait(const JobCounter& counter)
+{
+    int queue = currentQueue();
+    while (!counter.done())
+    {
+        // Only this thread can run the main thread jobs, so they go first
+        Job* job = queue == 0 ? takeMainThreadJob() : nullptr;
+        if (!job)
+        {
+            job = findJob(queue);
+        }
+        if (job)
+        {
+            execute(job);
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+unsigned int JobSystem::runMainThreadJobs(double budgetMilliseconds)
+{
+    auto start = std::chrono::steady_clock::now();
+    unsigned int count = 0;
+    while (Job* job = takeMainThreadJob())
+    {
+        execute(job);
+        count++;
+        if (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() >= budgetMilliseconds)
+        {
+            break;
+        }
+    }
+    return count;
+}
+
+bool JobSystem::isMainThread() const
+{
+    return std::this_thread::get_id() == this->mainThread;
+}
+
+void JobSystem::workerLoop(unsigned int queueIndex)
+{
+    currentSystem = this;
+    currentQueueIndex = static_cast<int>(queueIndex);
+
+    int idleRounds = 0;
+    while (!this->stopping.load())
+    {
+        Job* job = findJob(static_cast<int>(queueIndex));
+        if (job)
+        {
+            execute(job);
+            idleRounds = 0;
+            continue;
+        }
+
+        // Spin a little before sleeping, fine grained jobs usually arrive in bursts
+        if (++idleRounds < 64)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(this->sleepMutex);
+        this->sleepingWorkers.fetch_add(1);
+        this->wakeUp.wait(lock, [this]() { return this->queuedJobs.load() > 0 || this->stopping.load(); });
+        this->sleepingWorkers.fetch_sub(1);
+        idleRounds = 0;
+    }
+}
+
+void JobSystem::submit(Job* job, JobCounter* after)
+{
+    if (job->counter)
+    {
+        job->counter->pending.fetch_add(1);
+    }
+    if (after)
+    {
+        // finish() takes the waiting jobs under the same lock after pending reached zero, so the job is
+        // either seen there or pending is already zero here
+        std::lock_guard<std::mutex> lock(after->waitingMutex);
+        if (after->pending.load() > 0)
+        {
+            after->waiting.push_back(job);
+            return;
+        }
+    }
+    enqueue(job);
+}
+
+void JobSystem::enqueue(Job* job)
+{
+    if (job->mainThread)
+    {
+        std::lock_guard<std::mutex> lock(this->mainThreadMutex);
+        this->mainThreadJobs.push_back(job);
+        return;
+    }
+
+    int queue = currentQueue();
+    if (queue >= 0)
+    {
+        if (!this->queues[queue]->push(job))
+        {
+            execute(job);
+            return;
+        }
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(this->sharedMutex);
+        this->sharedJobs.push_back(job);
+    }
+
+    this->queuedJobs.fetch_add(1);
+    if (this->sleepingWorkers.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(this->sleepMutex);
+        this->wakeUp.notify_one();
+    }
+}
+
+Job* JobSystem::findJob(int queueIndex)
+{
+    Job* job = queueIndex >= 0 ? this->queues[queueIndex]->pop() : nullptr;
+    if (!job)
+    {
+        // Steal the oldest job of another deque, starting at a random one so thieves spread out
+        size_t count = this->queues.size();
+        size_t first = nextRandom() % count;
+        for (size_t i = 0; i < count && !job; i++)
+        {
+            size_t victim = (first + i) % count;
+            if (static_cast<int>(victim) != queueIndex)
+            {
+                job = this->queues[victim]->steal();
+            }
+        }
+    }
+    if (!job)
+    {
+        std::lock_guard<std::mutex> lock(this->sharedMutex);
+        if (!this->sharedJobs.empty())
+        {
+            job = this->sharedJobs.front();
+            this->sharedJobs.pop_front();
+        }
+    }
+    if (job)
+    {
+        this->queuedJobs.fetch_sub(1);
+    }
+    return job;
+}
+
+Job* JobSystem::takeMainThreadJob()
+{
+    std::lock_guard<std::mutex> lock(this->mainThreadMutex);
+    if (this->mainThreadJobs.empty())
+    {
+        return nullptr;
+    }
+    Job* job = this->mainThreadJobs.front();
+    this->mainThreadJobs.pop_front();
+    return job;
+}
+
+void JobSystem::execute(Job* job)
+{
+    job->work();
+    finish(job->counter);
+    delete job;
+}
+
+void JobSystem::finish(JobCounter* counter)
+{
+    if (!counter)
+    {
+        return;
+    }
+
+    // finishing keeps done() false until this function no longer touches the counter, as the waiting
+    // thread may destroy it as soon as it returns. The jobs that waited for it are released only after
+    // that, so whoever waits on them may destroy this counter too.
+    std::vector<Job*> ready;
+    counter->finishing.fetch_add(1);
+    if (counter->pending.fetch_sub(1) == 1)
+    {
+        std::lock_guard<std::mutex> lock(counter->waitingMutex);
+        ready.swap(counter->waiting);
+    }
+    counter->finishing.fetch_sub(1);
+
+    for (Job* job : ready)
+    {
+        enqueue(job);
+    }
+}
+
+int JobSystem::currentQueue() const
+{
+    if (isMainThread())
+    {
+        return 0;
+    }
+    return currentSystem == this ? currentQueueIndex : -1;
+}
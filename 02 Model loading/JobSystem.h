@@ -0,0 +1,145 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Jobs a worker can hold in its own deque. When it is full the owner runs new jobs inline instead.
+#define JOB_QUEUE_CAPACITY 4096
+
+struct Job;
+
+/// <summary>
+/// Counts the unfinished jobs that were submitted with it. wait() returns once it reaches zero, and
+/// jobs submitted to run after it start then. A counter can be reused once it is done. It must outlive
+/// the jobs that count on it, which waiting on it guarantees.
+/// </summary>
+class JobCounter
+{
+public:
+    JobCounter();
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator=(const JobCounter&) = delete;
+
+    bool done() const;
+
+private:
+    friend class JobSystem;
+
+    std::atomic<int> pending;
+    // Finishing jobs that may still touch the counter after decrementing pending (see JobSystem::finish)
+    std::atomic<int> finishing;
+    std::mutex waitingMutex;
+    std::vector<Job*> waiting; // Jobs that start once pending reaches zero
+};
+
+/// <summary>
+/// Chase-Lev work stealing deque of a fixed capacity. Only the owning thread pushes and pops, at the
+/// bottom, while any thread may steal the oldest job from the top.
+/// </summary>
+class WorkStealingQueue
+{
+public:
+    WorkStealingQueue();
+
+    // Owner only. Returns false when the queue is full.
+    bool push(Job* job);
+    // Owner only, newest job first.
+    Job* pop();
+    // Any thread, oldest job first. Returns nullptr when empty or when another thread won the race.
+    Job* steal();
+
+private:
+    std::atomic<int64_t> top;
+    std::atomic<int64_t> bottom;
+    std::unique_ptr<std::atomic<Job*>[]> buffer;
+};
+
+/// <summary>
+/// Work stealing job system. Every worker thread and the thread that created the system (the main
+/// thread) own a deque; they run their newest jobs first and steal the oldest jobs of the others when
+/// theirs is empty. Jobs that touch OpenGL are submitted with runOnMainThread and only ever run on the
+/// main thread, from runMainThreadJobs or while it waits. Threads that are neither submit through a
+/// shared locked queue.
+/// </summary>
+class JobSystem
+{
+public:
+    /// <summary>
+    /// Starts workerCount threads next to the main thread, one per remaining core when it is 0.
+    /// </summary>
+    JobSystem(unsigned int workerCount = 0);
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    /// <summary>
+    /// Stops the workers. Wait for the counters of outstanding jobs first, jobs still queued are dropped.
+    /// </summary>
+    ~JobSystem();
+
+    /// <summary>
+    /// Queues work on any thread. counter (optional) counts it until it has finished, after (optional)
+    /// holds it back until that counter is done.
+    /// </summary>
+    void run(std::function<void()> work, JobCounter* counter = nullptr, JobCounter* after = nullptr);
+
+    /// <summary>
+    /// Like run, but the job only runs on the main thread (OpenGL calls).
+    /// </summary>
+    void runOnMainThread(std::function<void()> work, JobCounter* counter = nullptr, JobCounter* after = nullptr);
+
+    /// <summary>
+    /// Splits [0, count) into ranges of up to batchSize and runs work on each as a job counted by counter.
+    /// </summary>
+    void parallelFor(size_t count, size_t batchSize, std::function<void(size_t begin, size_t end)> work,
+        JobCounter* counter);
+
+    /// <summary>
+    /// Runs other jobs until counter is done, main thread jobs included when called on the main thread.
+    /// </summary>
+    void wait(const JobCounter& counter);
+
+    /// <summary>
+    /// Main thread only: runs queued main thread jobs until none are left or budgetMilliseconds has passed
+    /// (at least one job runs). Returns the number of jobs run.
+    /// </summary>
+    unsigned int runMainThreadJobs(double budgetMilliseconds);
+
+    unsigned int getWorkerCount() const { return static_cast<unsigned int>(this->workers.size()); }
+    bool isMainThread() const;
+
+private:
+    void workerLoop(unsigned int queueIndex);
+    void submit(Job* job, JobCounter* after);
+    void enqueue(Job* job);
+    Job* findJob(int queueIndex);
+    Job* takeMainThreadJob();
+    void execute(Job* job);
+    void finish(JobCounter* counter);
+    int currentQueue() const;
+
+private:
+    // Index 0 belongs to the main thread, 1..n to the workers
+    std::vector<std::unique_ptr<WorkStealingQueue>> queues;
+    std::vector<std::thread> workers;
+    std::thread::id mainThread;
+
+    std::mutex sharedMutex;
+    std::deque<Job*> sharedJobs; // Submitted from threads without a deque
+    std::mutex mainThreadMutex;
+    std::deque<Job*> mainThreadJobs;
+
+    // Jobs in the deques and the shared queue, so idle workers know when to sleep
+    std::atomic<int> queuedJobs;
+    std::atomic<int> sleepingWorkers;
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    std::atomic<bool> stopping;
+};
@@ -0,0 +1,278 @@
+#include "Ktx2.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace
+{
+    const unsigned char KTX2_IDENTIFIER[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+    const size_t HEADER_SIZE = 12 + 9 * 4 + 4 * 4 + 2 * 8; // Identifier, header, index
+    const size_t LEVEL_INDEX_ENTRY_SIZE = 3 * 8;
+
+    // VkFormat values of the block compressed formats
+    const uint32_t VK_FORMAT_BC1_RGB_UNORM_BLOCK = 131;
+    const uint32_t VK_FORMAT_BC1_RGB_SRGB_BLOCK = 132;
+    const uint32_t VK_FORMAT_BC3_UNORM_BLOCK = 137;
+    const uint32_t VK_FORMAT_BC3_SRGB_BLOCK = 138;
+    const uint32_t VK_FORMAT_BC4_UNORM_BLOCK = 139;
+    const uint32_t VK_FORMAT_BC5_UNORM_BLOCK = 141;
+    const uint32_t VK_FORMAT_BC7_UNORM_BLOCK = 145;
+    const uint32_t VK_FORMAT_BC7_SRGB_BLOCK = 146;
+
+    // Khronos data format descriptor values
+    const uint32_t KHR_DF_MODEL_BC1A = 128;
+    const uint32_t KHR_DF_MODEL_BC3 = 130;
+    const uint32_t KHR_DF_MODEL_BC4 = 131;
+    const uint32_t KHR_DF_MODEL_BC5 = 132;
+    const uint32_t KHR_DF_MODEL_BC7 = 134;
+    const uint32_t KHR_DF_PRIMARIES_BT709 = 1;
+    const uint32_t KHR_DF_TRANSFER_LINEAR = 1;
+    const uint32_t KHR_DF_TRANSFER_SRGB = 2;
+    const uint32_t KHR_DF_CHANNEL_ALPHA_BC3 = 15;
+
+    struct FormatInfo
+    {
+        BlockFormat format;
+        bool srgb;
+        uint32_t vkFormat;
+    };
+
+    const FormatInfo FORMATS[] = {
+        { BlockFormat::BC1, false, VK_FORMAT_BC1_RGB_UNORM_BLOCK },
+        { BlockFormat::BC1, true, VK_FORMAT_BC1_RGB_SRGB_BLOCK },
+        { BlockFormat::BC3, false, VK_FORMAT_BC3_UNORM_BLOCK },
+        { BlockFormat::BC3, true, VK_FORMAT_BC3_SRGB_BLOCK },
+        { BlockFormat::BC4, false, VK_FORMAT_BC4_UNORM_BLOCK },
+        { BlockFormat::BC5, false, VK_FORMAT_BC5_UNORM_BLOCK },
+        { BlockFormat::BC7, false, VK_FORMAT_BC7_UNORM_BLOCK },
+        { BlockFormat::BC7, true, VK_FORMAT_BC7_SRGB_BLOCK },
+    };
+
+    void putU32(std::vector<unsigned char>& out, uint32_t value)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            out.push_back((value >> (8 * i)) & 0xFF);
+        }
+    }
+
+    void putU64(std::vector<unsigned char>& out, uint64_t value)
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            out.push_back((value >> (8 * i)) & 0xFF);
+        }
+    }
+
+    void setU64(std::vector<unsigned char>& out, size_t offset, uint64_t value)
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            out[offset + i] = (value >> (8 * i)) & 0xFF;
+        }
+    }
+
+    uint32_t getU32(const unsigned char* in)
+    {
+        return in[0] | (in[1] << 8) | (in[2] << 16) | (static_cast<uint32_t>(in[3]) << 24);
+    }
+
+    uint64_t getU64(const unsigned char* in)
+    {
+        return getU32(in) | (static_cast<uint64_t>(getU32(in + 4)) << 32);
+    }
+
+    // Levels of a full mip chain down to 1x1
+    uint32_t maxLevelCount(uint32_t width, uint32_t height)
+    {
+        uint32_t levels = 1;
+        for (uint32_t size = std::max(width, height); size > 1; size /= 2)
+        {
+            levels++;
+        }
+        return levels;
+    }
+
+    // Bytes of a level, every started 4x4 block is stored whole
+    uint64_t levelSize(BlockFormat format, uint32_t width, uint32_t height, uint32_t level)
+    {
+        uint64_t levelWidth = std::max(1u, width >> level);
+        uint64_t levelHeight = std::max(1u, height >> level);
+        return ((levelWidth + 3) / 4) * ((levelHeight + 3) / 4) * blockSize(format);
+    }
+
+    // Basic data format descriptor: one sample per 64-bit half of the block
+    std::vector<unsigned char> buildDfd(BlockFormat format, bool srgb)
+    {
+        struct Sample { uint32_t bitOffset; uint32_t bitLength; uint32_t channel; };
+        uint32_t colorModel = 0;
+        Sample samples[2] = {};
+        uint32_t sampleCount = 1;
+        switch (format)
+        {
+        case BlockFormat::BC1:
+            colorModel = KHR_DF_MODEL_BC1A;
+            samples[0] = { 0, 64, 0 };
+            break;
+        case BlockFormat::BC3:
+            colorModel = KHR_DF_MODEL_BC3;
+            samples[0] = { 0, 64, KHR_DF_CHANNEL_ALPHA_BC3 };
+            samples[1] = { 64, 64, 0 };
+            sampleCount = 2;
+            break;
+        case BlockFormat::BC4:
+            colorModel = KHR_DF_MODEL_BC4;
+            samples[0] = { 0, 64, 0 };
+            break;
+        case BlockFormat::BC5:
+            colorModel = KHR_DF_MODEL_BC5;
+            samples[0] = { 0, 64, 0 };
+            samples[1] = { 64, 64, 1 };
+            sampleCount = 2;
+            break;
+        case BlockFormat::BC7:
+            colorModel = KHR_DF_MODEL_BC7;
+            samples[0] = { 0, 128, 0 };
+            break;
+        }
+
+        uint32_t blockBytes = 24 + 16 * sampleCount;
+        std::vector<unsigned char> dfd;
+        putU32(dfd, 4 + blockBytes); // dfdTotalSize
+        putU32(dfd, 0); // vendorId = Khronos, descriptorType = basic
+        putU32(dfd, 2 | (blockBytes << 16)); // versionNumber, descriptorBlockSize
+        putU32(dfd, colorModel | (KHR_DF_PRIMARIES_BT709 << 8) | ((srgb ? KHR_DF_TRANSFER_SRGB : KHR_DF_TRANSFER_LINEAR) << 16));
+        putU32(dfd, 3 | (3 << 8)); // texelBlockDimension (size - 1): 4x4x1x1
+        putU32(dfd, blockSize(format)); // bytesPlane0
+        putU32(dfd, 0);
+        for (uint32_t i = 0; i < sampleCount; i++)
+        {
+            const Sample& sample = samples[i];
+            putU32(dfd, sample.bitOffset | ((sample.bitLength - 1) << 16) | (sample.channel << 24));
+            putU32(dfd, 0); // samplePosition
+            putU32(dfd, 0); // sampleLower
+            putU32(dfd, 0xFFFFFFFF); // sampleUpper
+        }
+        return dfd;
+    }
+}
+
+bool writeKtx2(const std::string& path, const Ktx2Texture& texture)
+{
+    // BC4/BC5 have no sRGB variant
+    bool srgb = texture.srgb && texture.format != BlockFormat::BC4 && texture.format != BlockFormat::BC5;
+    uint32_t vkFormat = 0;
+    for (const FormatInfo& info : FORMATS)
+    {
+        if (info.format == texture.format && info.srgb == srgb)
+        {
+            vkFormat = info.vkFormat;
+        }
+    }
+
+    uint32_t levelCount = static_cast<uint32_t>(texture.levels.size());
+    std::vector<unsigned char> dfd = buildDfd(texture.format, srgb);
+    size_t dfdOffset = HEADER_SIZE + levelCount * LEVEL_INDEX_ENTRY_SIZE;
+
+    std::vector<unsigned char> out(KTX2_IDENTIFIER, KTX2_IDENTIFIER + 12);
+    putU32(out, vkFormat);
+    putU32(out, 1); // typeSize
+    putU32(out, texture.width);
+    putU32(out, texture.height);
+    putU32(out, 0); // pixelDepth
+    putU32(out, 0); // layerCount
+    putU32(out, 1); // faceCount
+    putU32(out, levelCount);
+    putU32(out, 0); // supercompressionScheme
+    putU32(out, static_cast<uint32_t>(dfdOffset));
+    putU32(out, static_cast<uint32_t>(dfd.size()));
+    putU32(out, 0); // kvdByteOffset
+    putU32(out, 0); // kvdByteLength
+    putU64(out, 0); // sgdByteOffset
+    putU64(out, 0); // sgdByteLength
+
+    size_t levelIndexOffset = out.size();
+    out.resize(out.size() + levelCount * LEVEL_INDEX_ENTRY_SIZE, 0);
+    out.insert(out.end(), dfd.begin(), dfd.end());
+
+    // Mip levels are stored smallest first, each aligned to lcm(block size, 4)
+    size_t alignment = blockSize(texture.format);
+    for (uint32_t level = levelCount; level-- > 0;)
+    {
+        out.resize((out.size() + alignment - 1) / alignment * alignment, 0);
+        const std::vector<unsigned char>& data = texture.levels[level];
+        size_t entry = levelIndexOffset + level * LEVEL_INDEX_ENTRY_SIZE;
+        setU64(out, entry, out.size());
+        setU64(out, entry + 8, data.size());
+        setU64(out, entry + 16, data.size());
+        out.insert(out.end(), data.begin(), data.end());
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(out.data()), out.size());
+    return file.good();
+}
+
+bool readKtx2(const std::string& path, Ktx2Texture* texture)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    std::vector<unsigned char> in((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (in.size() < HEADER_SIZE || std::memcmp(in.data(), KTX2_IDENTIFIER, 12) != 0)
+    {
+        return false;
+    }
+
+    uint32_t vkFormat = getU32(&in[12]);
+    uint32_t width = getU32(&in[20]);
+    uint32_t height = getU32(&in[24]);
+    uint32_t depth = getU32(&in[28]);
+    uint32_t layerCount = getU32(&in[32]);
+    uint32_t faceCount = getU32(&in[36]);
+    uint32_t levelCount = std::max(1u, getU32(&in[40]));
+    uint32_t supercompression = getU32(&in[44]);
+    if (width == 0 || height == 0 || depth != 0 || layerCount > 1 || faceCount != 1 || supercompression != 0 ||
+        levelCount > maxLevelCount(width, height))
+    {
+        return false;
+    }
+
+    const FormatInfo* formatInfo = nullptr;
+    for (const FormatInfo& info : FORMATS)
+    {
+        if (info.vkFormat == vkFormat)
+        {
+            formatInfo = &info;
+        }
+    }
+    // levelCount is at most 32 here, so the level index size can't overflow
+    if (!formatInfo || in.size() < HEADER_SIZE + static_cast<size_t>(levelCount) * LEVEL_INDEX_ENTRY_SIZE)
+    {
+        return false;
+    }
+
+    texture->format = formatInfo->format;
+    texture->srgb = formatInfo->srgb;
+    texture->width = width;
+    texture->height = height;
+    texture->levels.assign(levelCount, {});
+    for (uint32_t level = 0; level < levelCount; level++)
+    {
+        const unsigned char* entry = &in[HEADER_SIZE + level * LEVEL_INDEX_ENTRY_SIZE];
+        uint64_t offset = getU64(entry);
+        uint64_t length = getU64(entry + 8);
+        // Written so that neither side can overflow
+        if (offset > in.size() || length > in.size() - offset ||
+            length != levelSize(formatInfo->format, width, height, level))
+        {
+            return false;
+        }
+        texture->levels[level].assign(in.begin() + offset, in.begin() + offset + length);
+    }
+    return true;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "TextureCompression.h"
+
+// A 2D block compressed texture as stored in a KTX2 container (no supercompression, no arrays/cube maps)
+struct Ktx2Texture
+{
+    BlockFormat format;
+    bool srgb;
+    uint32_t width;
+    uint32_t height;
+    std::vector<std::vector<unsigned char>> levels; // Level 0 (full size) first
+};
+
+/// <summary>
+/// Writes the texture as a KTX2 file (vkFormat + basic data format descriptor, levels stored
+/// smallest first as the specification requires).
+/// </summary>
+bool writeKtx2(const std::string& path, const Ktx2Texture& texture);
+
+/// <summary>
+/// Reads a KTX2 file written by writeKtx2. Returns false if the file is missing, malformed or
+/// uses a format/feature that isn't supported.
+/// </summary>
+bool readKtx2(const std::string& path, Ktx2Texture* texture);
@@ -0,0 +1,131 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile()
+    : bytes(nullptr), length(0), fileHandle(INVALID_HANDLE_VALUE), mappingHandle(nullptr)
+{
+}
+
+bool MappedFile::open(const std::string& path)
+{
+    close();
+
+    this->fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (this->fileHandle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(this->fileHandle, &fileSize) || fileSize.QuadPart == 0)
+    {
+        close();
+        return false;
+    }
+
+    this->mappingHandle = CreateFileMappingA(this->fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!this->mappingHandle)
+    {
+        close();
+        return false;
+    }
+
+    this->bytes = static_cast<const unsigned char*>(MapViewOfFile(this->mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (!this->bytes)
+    {
+        close();
+        return false;
+    }
+    this->length = static_cast<size_t>(fileSize.QuadPart);
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (this->bytes)
+    {
+        UnmapViewOfFile(this->bytes);
+    }
+    if (this->mappingHandle)
+    {
+        CloseHandle(this->mappingHandle);
+    }
+    if (this->fileHandle != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(this->fileHandle);
+    }
+    this->bytes = nullptr;
+    this->length = 0;
+    this->mappingHandle = nullptr;
+    this->fileHandle = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+MappedFile::MappedFile()
+    : bytes(nullptr), length(0), fileDescriptor(-1)
+{
+}
+
+bool MappedFile::open(const std::string& path)
+{
+    close();
+
+    this->fileDescriptor = ::open(path.c_str(), O_RDONLY);
+    if (this->fileDescriptor < 0)
+    {
+        return false;
+    }
+
+    struct stat status;
+    if (fstat(this->fileDescriptor, &status) != 0 || status.st_size == 0)
+    {
+        close();
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, this->fileDescriptor, 0);
+    if (mapping == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+    this->bytes = static_cast<const unsigned char*>(mapping);
+    this->length = static_cast<size_t>(status.st_size);
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (this->bytes)
+    {
+        munmap(const_cast<unsigned char*>(this->bytes), this->length);
+    }
+    if (this->fileDescriptor >= 0)
+    {
+        ::close(this->fileDescriptor);
+    }
+    this->bytes = nullptr;
+    this->length = 0;
+    this->fileDescriptor = -1;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+    close();
+}
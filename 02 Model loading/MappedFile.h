@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/// <summary>
+/// Read-only memory mapping of a whole file. Pages are loaded on first access straight from the
+/// OS page cache, so reading a warm file doesn't copy it into our own buffers.
+/// </summary>
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    const unsigned char* data() const { return this->bytes; }
+    size_t size() const { return this->length; }
+    bool isOpen() const { return this->bytes != nullptr; }
+
+private:
+    const unsigned char* bytes;
+    size_t length;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#else
+    int fileDescriptor;
+#endif
+};
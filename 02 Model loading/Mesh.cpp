@@ -1,13 +1,23 @@
 #include "Mesh.h"
 
 #include <glad/glad.h>
+#include <utility>
+#include "Profiler.h"
 
 Mesh::Mesh(std::vector<Vertex> verticies, std::vector<unsigned int> indices, std::vector<Texture> textures)
-    : verticies(verticies), indices(indices), textures(textures)
+    : verticies(std::move(verticies)), indices(std::move(indices)), textures(std::move(textures))
 {
     setupMesh();
 }
 
+void Mesh::release()
+{
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &vbo);
+    glDeleteBuffers(1, &ebo);
+    vao = vbo = ebo = 0;
+}
+
 void Mesh::setupMesh()
 {
     glGenVertexArrays(1, &vao);
@@ -40,6 +50,7 @@ void Mesh::setupMesh()
 
 void Mesh::Draw(Shader& shader)
 {
+    PROFILE_SCOPE("Mesh::Draw");
     unsigned int diffuseNr = 1;
     unsigned int specularNr = 1;
 
@@ -25,6 +25,9 @@ public:
     Mesh(std::vector<Vertex> verticies, std::vector<unsigned int> indices, std::vector<Texture> textures);
     void Draw(Shader& shader);
 
+    // Deletes the vertex array and buffers. Meshes are copied around by value, so this isn't a destructor.
+    void release();
+
 public:
     // Mesh data
     std::vector<Vertex>         verticies;
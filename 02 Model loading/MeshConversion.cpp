@@ -0,0 +1,95 @@
+#include "MeshConversion.h"
+
+#include "Profiler.h"
+
+void convertMesh(const aiMesh* mesh, MeshData* data)
+{
+    PROFILE_SCOPE("convertMesh");
+    const unsigned int vertexCount = mesh->mNumVertices;
+    data->verticies.resize(vertexCount);
+    Vertex* vertices = data->verticies.data();
+
+    // One tight loop per attribute instead of a branch per attribute and a push_back per vertex, so
+    // the compiler can keep the copies in registers and vectorise them
+    const aiVector3D* positions = mesh->mVertices;
+    for (unsigned int i = 0; i < vertexCount; i++)
+    {
+        vertices[i].position = glm::vec3(positions[i].x, positions[i].y, positions[i].z);
+    }
+
+    const aiVector3D* normals = mesh->mNormals;
+    if (normals)
+    {
+        for (unsigned int i = 0; i < vertexCount; i++)
+        {
+            vertices[i].normal = glm::vec3(normals[i].x, normals[i].y, normals[i].z);
+        }
+    }
+    else
+    {
+        for (unsigned int i = 0; i < vertexCount; i++)
+        {
+            vertices[i].normal = glm::vec3(0.0f);
+        }
+    }
+
+    // Assimp allows a model to have up to 8 different texture coordinates per vertex.
+    // We are only going to use the first set and ignore the rest.
+    const aiVector3D* texCoords = mesh->mTextureCoords[0];
+    if (texCoords)
+    {
+        for (unsigned int i = 0; i < vertexCount; i++)
+        {
+            vertices[i].texCoords = glm::vec2(texCoords[i].x, texCoords[i].y);
+        }
+    }
+    else
+    {
+        for (unsigned int i = 0; i < vertexCount; i++)
+        {
+            vertices[i].texCoords = glm::vec2(0.0f, 0.0f);
+        }
+    }
+
+    // Count first so the indices are written straight into place
+    size_t indexCount = 0;
+    for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+    {
+        indexCount += mesh->mFaces[i].mNumIndices;
+    }
+    data->indices.resize(indexCount);
+    unsigned int* indices = data->indices.data();
+    for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+    {
+        const aiFace& face = mesh->mFaces[i];
+        for (unsigned int j = 0; j < face.mNumIndices; j++)
+        {
+            *indices++ = face.mIndices[j];
+        }
+    }
+}
+
+void convertMeshes(const std::vector<const aiMesh*>& meshes, std::vector<MeshData>* data, JobSystem* jobs)
+{
+    PROFILE_SCOPE("convertMeshes");
+    data->resize(meshes.size());
+    if (!jobs)
+    {
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            convertMesh(meshes[i], &(*data)[i]);
+        }
+        return;
+    }
+
+    // One mesh per job: mesh sizes vary a lot, stealing evens that out better than fixed ranges would
+    JobCounter converted;
+    jobs->parallelFor(meshes.size(), 1, [&meshes, data](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                convertMesh(meshes[i], &(*data)[i]);
+            }
+        }, &converted);
+    jobs->wait(converted);
+}
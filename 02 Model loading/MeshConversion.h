@@ -0,0 +1,27 @@
+#pragma once
+
+#include <vector>
+#include <assimp/scene.h>
+#include "JobSystem.h"
+#include "Mesh.h"
+
+/// <summary>
+/// Vertices and indices of one aiMesh in the layout Mesh uploads. Filling it doesn't touch OpenGL, so
+/// it can happen on any thread.
+/// </summary>
+struct MeshData
+{
+    std::vector<Vertex> verticies;
+    std::vector<unsigned int> indices;
+};
+
+/// <summary>
+/// Converts one mesh. The outputs are sized once and every attribute is copied in its own loop.
+/// </summary>
+void convertMesh(const aiMesh* mesh, MeshData* data);
+
+/// <summary>
+/// Converts meshes[i] into (*data)[i], one job per mesh when jobs is given and serially otherwise.
+/// Returns once all of them are done.
+/// </summary>
+void convertMeshes(const std::vector<const aiMesh*>& meshes, std::vector<MeshData>* data, JobSystem* jobs);
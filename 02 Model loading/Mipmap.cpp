@@ -0,0 +1,357 @@
+#include "Mipmap.h"
+
+#include <algorithm>
+#include <cmath>
+
+// SSE2 is part of every x64 target, so the filters only fall back to scalar code on 32-bit/ARM builds
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIPMAP_USE_SSE2
+#endif
+
+namespace
+{
+    const int SRGB_ENCODE_TABLE_SIZE = 4096; // Enough buckets to round-trip every byte value exactly
+    const int KAISER_RADIUS = 3; // In destination texels
+    const double KAISER_ALPHA = 4.0;
+    const int KAISER_TAPS = 4 * KAISER_RADIUS; // Source taps per output texel along one axis
+
+    // Float RGBA working copy of a level, linear and alpha premultiplied. Every texel is 4 floats (also
+    // for 1-3 channel sources) so a texel maps to one SSE register.
+    struct FloatImage
+    {
+        int width = 0;
+        int height = 0;
+        std::vector<float> texels;
+
+        float* at(int x, int y) { return &this->texels[4 * (static_cast<size_t>(y) * this->width + x)]; }
+        const float* at(int x, int y) const { return &this->texels[4 * (static_cast<size_t>(y) * this->width + x)]; }
+    };
+
+    float srgbToLinear(float c)
+    {
+        return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    float linearToSrgb(float c)
+    {
+        return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+    }
+
+    // 8-bit sRGB -> linear float, one entry per byte value. Function statics, so the one-time
+    // initialization is thread safe when several workers build chains at once.
+    const float* srgbDecodeTable()
+    {
+        static const std::vector<float> table = [] {
+            std::vector<float> values(256);
+            for (int i = 0; i < 256; i++)
+            {
+                values[i] = srgbToLinear(i / 255.0f);
+            }
+            return values;
+        }();
+        return table.data();
+    }
+
+    // Linear float -> 8-bit sRGB
+    const unsigned char* srgbEncodeTable()
+    {
+        static const std::vector<unsigned char> table = [] {
+            std::vector<unsigned char> values(SRGB_ENCODE_TABLE_SIZE);
+            for (int i = 0; i < SRGB_ENCODE_TABLE_SIZE; i++)
+            {
+                float linear = (i + 0.5f) / SRGB_ENCODE_TABLE_SIZE;
+                values[i] = static_cast<unsigned char>(linearToSrgb(linear) * 255.0f + 0.5f);
+            }
+            return values;
+        }();
+        return table.data();
+    }
+
+    int wrapCoord(int i, int size, bool wrap)
+    {
+        if (wrap)
+        {
+            i %= size;
+            return i < 0 ? i + size : i;
+        }
+        return std::min(std::max(i, 0), size - 1);
+    }
+
+    FloatImage decode(const unsigned char* data, int width, int height, int channels, bool srgb)
+    {
+        const float* decodeTable = srgbDecodeTable();
+        FloatImage image;
+        image.width = width;
+        image.height = height;
+        image.texels.assign(4 * static_cast<size_t>(width) * height, 0.0f);
+        int colorChannels = channels == 4 ? 3 : channels;
+        for (size_t i = 0; i < static_cast<size_t>(width) * height; i++)
+        {
+            const unsigned char* src = data + i * channels;
+            float* dst = &image.texels[4 * i];
+            float alpha = channels == 4 ? src[3] / 255.0f : 1.0f;
+            for (int c = 0; c < colorChannels; c++)
+            {
+                dst[c] = (srgb ? decodeTable[src[c]] : src[c] / 255.0f) * alpha;
+            }
+            dst[3] = alpha;
+        }
+        return image;
+    }
+
+    // 2x2 average. Odd sized levels clamp the second tap so the last row/column isn't lost.
+    FloatImage downsampleBox(const FloatImage& src)
+    {
+        FloatImage dst;
+        dst.width = std::max(1, src.width / 2);
+        dst.height = std::max(1, src.height / 2);
+        dst.texels.resize(4 * static_cast<size_t>(dst.width) * dst.height);
+        for (int y = 0; y < dst.height; y++)
+        {
+            int y0 = std::min(2 * y, src.height - 1);
+            int y1 = std::min(2 * y + 1, src.height - 1);
+            for (int x = 0; x < dst.width; x++)
+            {
+                int x0 = std::min(2 * x, src.width - 1);
+                int x1 = std::min(2 * x + 1, src.width - 1);
+#ifdef MIPMAP_USE_SSE2
+                __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(src.at(x0, y0)), _mm_loadu_ps(src.at(x1, y0))),
+                    _mm_add_ps(_mm_loadu_ps(src.at(x0, y1)), _mm_loadu_ps(src.at(x1, y1))));
+                _mm_storeu_ps(dst.at(x, y), _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+                for (int c = 0; c < 4; c++)
+                {
+                    dst.at(x, y)[c] = 0.25f * (src.at(x0, y0)[c] + src.at(x1, y0)[c] + src.at(x0, y1)[c] + src.at(x1, y1)[c]);
+                }
+#endif
+            }
+        }
+        return dst;
+    }
+
+    // Power series of the zeroth order modified Bessel function, converges quickly for the small x used
+    double besselI0(double x)
+    {
+        double sum = 1.0;
+        double term = 1.0;
+        for (int k = 1; k < 32; k++)
+        {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+            if (term < 1e-12 * sum)
+            {
+                break;
+            }
+        }
+        return sum;
+    }
+
+    // Weights of a 2:1 Kaiser windowed sinc. Every destination texel sits between two source texels, so
+    // the tap offsets (and the weights) are the same for every output texel and only computed once.
+    const float* kaiserWeights()
+    {
+        static const std::vector<float> weights = [] {
+            const double pi = 3.14159265358979323846;
+            std::vector<double> values(KAISER_TAPS);
+            double total = 0.0;
+            for (int i = 0; i < KAISER_TAPS; i++)
+            {
+                // Distance between the source and the destination texel centre, in source texels
+                double d = (i - KAISER_TAPS / 2) + 0.5;
+                double t = d / 2.0; // In destination texels
+                double sinc = std::sin(pi * t) / (pi * t);
+                double r = t / KAISER_RADIUS;
+                double window = std::fabs(r) >= 1.0 ? 0.0 : besselI0(KAISER_ALPHA * std::sqrt(1.0 - r * r)) / besselI0(KAISER_ALPHA);
+                values[i] = sinc * window;
+                total += values[i];
+            }
+            std::vector<float> normalized(KAISER_TAPS);
+            for (int i = 0; i < KAISER_TAPS; i++)
+            {
+                normalized[i] = static_cast<float>(values[i] / total);
+            }
+            return normalized;
+        }();
+        return weights.data();
+    }
+
+    // Separable Kaiser filter: a horizontal pass into a half-width temporary, then a vertical pass
+    FloatImage downsampleKaiser(const FloatImage& src, bool wrap)
+    {
+        const float* weights = kaiserWeights();
+
+        FloatImage tmp;
+        tmp.width = std::max(1, src.width / 2);
+        tmp.height = src.height;
+        tmp.texels.resize(4 * static_cast<size_t>(tmp.width) * tmp.height);
+        for (int y = 0; y < tmp.height; y++)
+        {
+            for (int x = 0; x < tmp.width; x++)
+            {
+                int first = 2 * x - KAISER_TAPS / 2 + 1;
+#ifdef MIPMAP_USE_SSE2
+                __m128 sum = _mm_setzero_ps();
+                for (int i = 0; i < KAISER_TAPS; i++)
+                {
+                    int sx = wrapCoord(first + i, src.width, wrap);
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(src.at(sx, y)), _mm_set1_ps(weights[i])));
+                }
+                _mm_storeu_ps(tmp.at(x, y), sum);
+#else
+                float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+                for (int i = 0; i < KAISER_TAPS; i++)
+                {
+                    const float* texel = src.at(wrapCoord(first + i, src.width, wrap), y);
+                    for (int c = 0; c < 4; c++)
+                    {
+                        sum[c] += texel[c] * weights[i];
+                    }
+                }
+                std::copy(sum, sum + 4, tmp.at(x, y));
+#endif
+            }
+        }
+
+        FloatImage dst;
+        dst.width = tmp.width;
+        dst.height = std::max(1, src.height / 2);
+        dst.texels.resize(4 * static_cast<size_t>(dst.width) * dst.height);
+        for (int y = 0; y < dst.height; y++)
+        {
+            int first = 2 * y - KAISER_TAPS / 2 + 1;
+            for (int x = 0; x < dst.width; x++)
+            {
+#ifdef MIPMAP_USE_SSE2
+                __m128 sum = _mm_setzero_ps();
+                for (int i = 0; i < KAISER_TAPS; i++)
+                {
+                    int sy = wrapCoord(first + i, tmp.height, wrap);
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(tmp.at(x, sy)), _mm_set1_ps(weights[i])));
+                }
+                // The negative lobes of the sinc can overshoot, keep the result in range
+                sum = _mm_min_ps(_mm_max_ps(sum, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+                _mm_storeu_ps(dst.at(x, y), sum);
+#else
+                float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+                for (int i = 0; i < KAISER_TAPS; i++)
+                {
+                    const float* texel = tmp.at(x, wrapCoord(first + i, tmp.height, wrap));
+                    for (int c = 0; c < 4; c++)
+                    {
+                        sum[c] += texel[c] * weights[i];
+                    }
+                }
+                for (int c = 0; c < 4; c++)
+                {
+                    dst.at(x, y)[c] = std::min(std::max(sum[c], 0.0f), 1.0f);
+                }
+#endif
+            }
+        }
+        return dst;
+    }
+
+    // Fraction of texels that pass the alpha test after scaling alpha by scale
+    float alphaCoverage(const FloatImage& image, float reference, float scale)
+    {
+        size_t texelCount = static_cast<size_t>(image.width) * image.height;
+        size_t covered = 0;
+        for (size_t i = 0; i < texelCount; i++)
+        {
+            if (image.texels[4 * i + 3] * scale > reference)
+            {
+                covered++;
+            }
+        }
+        return static_cast<float>(covered) / texelCount;
+    }
+
+    // Binary search for the alpha scale that gives the coverage of level 0. Coverage is a step function
+    // of the scale, so an exact match isn't always possible and the closest one is kept.
+    float coveragePreservingScale(const FloatImage& image, float reference, float targetCoverage)
+    {
+        float low = 0.0f;
+        float high = 4.0f;
+        float scale = 1.0f;
+        float bestScale = 1.0f;
+        float bestError = 2.0f;
+        for (int i = 0; i < 10; i++)
+        {
+            float coverage = alphaCoverage(image, reference, scale);
+            float error = std::fabs(coverage - targetCoverage);
+            if (error < bestError)
+            {
+                bestError = error;
+                bestScale = scale;
+            }
+            if (coverage < targetCoverage)
+            {
+                low = scale;
+            }
+            else if (coverage > targetCoverage)
+            {
+                high = scale;
+            }
+            else
+            {
+                break;
+            }
+            scale = 0.5f * (low + high);
+        }
+        return bestScale;
+    }
+
+    // Back to 8-bit, undoing the premultiplication and the sRGB decode
+    MipLevel encode(const FloatImage& image, int channels, bool srgb, float alphaScale)
+    {
+        const unsigned char* encodeTable = srgbEncodeTable();
+        MipLevel level{ image.width, image.height, {} };
+        level.pixels.resize(static_cast<size_t>(image.width) * image.height * channels);
+        int colorChannels = channels == 4 ? 3 : channels;
+        for (size_t i = 0; i < static_cast<size_t>(image.width) * image.height; i++)
+        {
+            const float* src = &image.texels[4 * i];
+            unsigned char* dst = &level.pixels[i * channels];
+            float alpha = src[3];
+            float invAlpha = alpha > 0.0f ? 1.0f / alpha : 0.0f;
+            for (int c = 0; c < colorChannels; c++)
+            {
+                float value = std::min(std::max(src[c] * invAlpha, 0.0f), 1.0f);
+                if (srgb)
+                {
+                    dst[c] = encodeTable[std::min(static_cast<int>(value * SRGB_ENCODE_TABLE_SIZE), SRGB_ENCODE_TABLE_SIZE - 1)];
+                }
+                else
+                {
+                    dst[c] = static_cast<unsigned char>(value * 255.0f + 0.5f);
+                }
+            }
+            if (channels == 4)
+            {
+                dst[3] = static_cast<unsigned char>(std::min(alpha * alphaScale, 1.0f) * 255.0f + 0.5f);
+            }
+        }
+        return level;
+    }
+}
+
+std::vector<MipLevel> generateMipChain(const unsigned char* data, int width, int height, int channels,
+    const MipChainOptions& options)
+{
+    std::vector<MipLevel> levels;
+    levels.push_back({ width, height, std::vector<unsigned char>(data, data + static_cast<size_t>(width) * height * channels) });
+
+    bool preserveCoverage = options.preserveAlphaCoverage && channels == 4;
+    FloatImage current = decode(data, width, height, channels, options.srgb);
+    float targetCoverage = preserveCoverage ? alphaCoverage(current, options.alphaReference, 1.0f) : 0.0f;
+    while (current.width > 1 || current.height > 1)
+    {
+        // Every level is filtered from the previous unscaled one, the coverage scale only applies when encoding
+        current = options.filter == MipFilter::Kaiser ? downsampleKaiser(current, options.wrap) : downsampleBox(current);
+        float alphaScale = preserveCoverage ?
+            coveragePreservingScale(current, options.alphaReference, targetCoverage) : 1.0f;
+        levels.push_back(encode(current, channels, options.srgb, alphaScale));
+    }
+    return levels;
+}
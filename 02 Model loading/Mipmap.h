@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+
+// Filters for building the mip chain on the CPU instead of relying on glGenerateMipmap
+enum class MipFilter
+{
+    Box,   // 2x2 average, cheap and what most drivers do
+    Kaiser // Windowed sinc, sharper minification with less blurring
+};
+
+struct MipChainOptions
+{
+    MipFilter filter = MipFilter::Box;
+    // Colour channels hold sRGB encoded values, so filter them in linear space (alpha is always linear)
+    bool srgb = false;
+    // Sample neighbours across the edges (GL_REPEAT) instead of clamping (GL_CLAMP_TO_EDGE)
+    bool wrap = true;
+    // Rescale alpha on every level so the fraction of texels passing the alpha test stays the same as
+    // on level 0. Without this cutout textures fade out and disappear in the distance.
+    bool preserveAlphaCoverage = false;
+    // Must match the discard threshold of the fragment shader
+    float alphaReference = 0.1f;
+};
+
+struct MipLevel
+{
+    int width;
+    int height;
+    std::vector<unsigned char> pixels; // Tightly packed, same channel count as the source image
+};
+
+/// <summary>
+/// Builds the full mip chain (level 0 included) of an 8-bit image. Texels are filtered as linear,
+/// alpha premultiplied floats with SSE2 where available, so sRGB colour doesn't darken and
+/// transparent texels don't bleed into their neighbours. Doesn't touch OpenGL, so it can run on a
+/// worker thread or offline. The same filters as mipmap.h in 03 Advanced OpenGL.
+/// </summary>
+std::vector<MipLevel> generateMipChain(const unsigned char* data, int width, int height, int channels,
+    const MipChainOptions& options = MipChainOptions());
@@ -1,13 +1,77 @@
 #include "Model.h"
 
 #include <glad/glad.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <iostream>
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
+#include "MeshConversion.h"
+#include "Profiler.h"
 
-Model::Model(std::string path)
+// Block compression formats aren't part of the core profile we load through glad, so define them
+// here if the glad build doesn't include the extensions
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
+namespace
+{
+    bool isExtensionSupported(const char* name)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+            if (extension && std::strcmp(extension, name) == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Maps a baked format to its OpenGL internal format. Returns false if the driver can't sample it,
+    // in which case the source image is loaded instead. This chapter renders without gamma correction
+    // and uploads its images as GL_RGB/GL_RGBA, so colour maps use the UNORM formats as well (even when
+    // the file is marked sRGB) and look the same compressed or not.
+    bool compressedInternalFormat(BlockFormat format, GLenum* internalFormat)
+    {
+        static const bool s3tc = isExtensionSupported("GL_EXT_texture_compression_s3tc");
+        static const bool bptc = isExtensionSupported("GL_ARB_texture_compression_bptc");
+
+        switch (format)
+        {
+        case BlockFormat::BC1:
+            *internalFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+            return s3tc;
+        case BlockFormat::BC3:
+            *internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            return s3tc;
+        case BlockFormat::BC4: // RGTC is core since OpenGL 3.0
+            *internalFormat = GL_COMPRESSED_RED_RGTC1;
+            return true;
+        case BlockFormat::BC5:
+            *internalFormat = GL_COMPRESSED_RG_RGTC2;
+            return true;
+        case BlockFormat::BC7:
+            *internalFormat = GL_COMPRESSED_RGBA_BPTC_UNORM;
+            return bptc;
+        }
+        return false;
+    }
+}
+
+Model::Model(std::string path, TextureCache* textureCache, JobSystem* jobs)
+    : textureCache(textureCache), jobs(jobs), textureLoadSeconds(0.0), meshConvertSeconds(0.0)
 {
     // Tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
     // TODO NOTE: This was the recommended way in the tutorial but I commented it because
@@ -18,16 +82,39 @@ Model::Model(std::string path)
     loadModel(path);
 }
 
+Model::Model(TextureCache* textureCache, JobSystem* jobs)
+    : textureCache(textureCache), jobs(jobs), textureLoadSeconds(0.0), meshConvertSeconds(0.0)
+{
+}
+
 void Model::Draw(Shader& shader)
 {
+    PROFILE_SCOPE("Model::Draw");
     for (unsigned int i = 0; i < this->meshes.size(); i++)
     {
         this->meshes[i].Draw(shader);
     }
 }
 
+void Model::release()
+{
+    for (Mesh& mesh : this->meshes)
+    {
+        mesh.release();
+    }
+    // Every texture is in texturesLoaded once, the meshes only refer to them. Failed ones are 0, which
+    // glDeleteTextures ignores.
+    for (const Texture& texture : this->texturesLoaded)
+    {
+        glDeleteTextures(1, &texture.id);
+    }
+    this->meshes.clear();
+    this->texturesLoaded.clear();
+}
+
 void Model::loadModel(std::string path)
 {
+    PROFILE_SCOPE("Model::loadModel");
     Assimp::Importer importer;
     const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate);
 
@@ -38,91 +125,152 @@ void Model::loadModel(std::string path)
     }
 
     this->directory = path.substr(0, path.find_last_of('/'));
-    processNode(scene->mRootNode, scene);
+    if (this->jobs)
+    {
+        // Fills texturesLoaded, so processMeshes finds every texture already uploaded
+        loadTexturesInParallel(scene);
+    }
+    processMeshes(scene);
 }
 
-void Model::processNode(aiNode* node, const aiScene* scene)
+void Model::loadTexturesInParallel(const aiScene* scene)
 {
-    for (unsigned int i = 0; i < node->mNumMeshes; i++)
+    PROFILE_SCOPE("Model::loadTexturesInParallel");
+    auto start = std::chrono::steady_clock::now();
+
+    struct TextureRequest
     {
-        aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-        this->meshes.push_back(processMesh(mesh, scene));
-    }
+        std::string name;
+        std::string type;
+        DecodedTexture decoded;
+        bool ok;
+        Texture texture;
+    };
 
-    for (unsigned int i = 0; i < node->mNumChildren; i++)
+    // Every texture the materials reference, once, in the order loadMaterialTextures would meet them
+    std::vector<TextureRequest> requests;
+    const std::pair<aiTextureType, const char*> types[] = {
+        { aiTextureType_DIFFUSE, "texture_diffuse" }, { aiTextureType_SPECULAR, "texture_specular" } };
+    for (unsigned int m = 0; m < scene->mNumMaterials; m++)
     {
-        processNode(node->mChildren[i], scene);
+        for (const std::pair<aiTextureType, const char*>& type : types)
+        {
+            for (unsigned int i = 0; i < scene->mMaterials[m]->GetTextureCount(type.first); i++)
+            {
+                aiString str;
+                scene->mMaterials[m]->GetTexture(type.first, i, &str);
+                bool known = std::any_of(requests.begin(), requests.end(),
+                    [&str](const TextureRequest& request) { return request.name == str.C_Str(); });
+                if (!known)
+                {
+                    requests.push_back({ str.C_Str(), type.second, DecodedTexture(), false, Texture() });
+                }
+            }
+        }
     }
-}
 
-Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
-{
-    std::vector<Vertex> verticies;
-    std::vector<unsigned int> indices;
-    std::vector<Texture> textures;
+    initTextureFormats();
 
-    for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+    // Decode on the workers, each finished texture queues its upload for the main thread. Waiting
+    // runs those uploads while the remaining textures are still being decoded.
+    JobCounter decoded;
+    JobCounter uploaded;
+    for (TextureRequest& request : requests)
     {
-        Vertex vertex;
+        this->jobs->run([this, &request, &uploaded]()
+            {
+                std::string path = this->directory + '/' + request.name;
+                request.ok = decodeTexture(path, request.type == "texture_diffuse", &request.decoded);
+                this->jobs->runOnMainThread([this, &request, path]()
+                    {
+                        request.texture.id = 0;
+                        if (request.ok)
+                        {
+                            request.texture.id = uploadTexture(request.decoded);
+                        }
+                        else
+                        {
+                            std::cout << "Texture failed to load at path: " << path << std::endl;
+                        }
+                    }, &uploaded);
+            }, &decoded);
+    }
+    this->jobs->wait(decoded);
+    this->jobs->wait(uploaded);
 
-        // Process vertex position
-        glm::vec3 vector;
-        vector.x = mesh->mVertices[i].x;
-        vector.y = mesh->mVertices[i].y;
-        vector.z = mesh->mVertices[i].z;
-        vertex.position = vector;
+    for (TextureRequest& request : requests)
+    {
+        request.texture.type = request.type;
+        request.texture.name = request.name;
+        this->texturesLoaded.push_back(request.texture);
+    }
+    this->textureLoadSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
 
-        // Process vertex normal
-        if (mesh->HasNormals())
-        {
-            vector.x = mesh->mNormals[i].x;
-            vector.y = mesh->mNormals[i].y;
-            vector.z = mesh->mNormals[i].z;
-            vertex.normal = vector;
-        }
+void Model::initTextureFormats()
+{
+    // The extension checks behind compressedInternalFormat call OpenGL, make them here before the
+    // workers use their cached results
+    GLenum unusedFormat;
+    compressedInternalFormat(BlockFormat::BC1, &unusedFormat);
+}
 
-        // Process texture coordinates
-        // Assimp allows a model to have up to 8 different texture coordinates per vertex.
-        // We are only going to use the first set and ignore the rest.
-        if (mesh->mTextureCoords[0]) // Does the mesh contain texture coords?
-        {
-            glm::vec2 vec;
-            vec.x = mesh->mTextureCoords[0][i].x;
-            vec.y = mesh->mTextureCoords[0][i].y;
-            vertex.texCoords = vec;
-        }
-        else
-        {
-            vertex.texCoords = glm::vec2(0.0f, 0.0f);
-        }
+void Model::collectMeshes(const aiNode* node, const aiScene* scene, std::vector<const aiMesh*>* meshes)
+{
+    for (unsigned int i = 0; i < node->mNumMeshes; i++)
+    {
+        meshes->push_back(scene->mMeshes[node->mMeshes[i]]);
+    }
 
-        verticies.push_back(vertex);
+    for (unsigned int i = 0; i < node->mNumChildren; i++)
+    {
+        collectMeshes(node->mChildren[i], scene, meshes);
     }
+}
+
+void Model::processMeshes(const aiScene* scene)
+{
+    PROFILE_SCOPE("Model::processMeshes");
+    // Gather the meshes in node order first, so they can be converted independently of each other
+    std::vector<const aiMesh*> sceneMeshes;
+    collectMeshes(scene->mRootNode, scene, &sceneMeshes);
 
-    // Process indices
-    for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+    // Textures upload to OpenGL, so they're resolved here, once per material the meshes use
+    std::vector<std::vector<Texture>> materialTextures(scene->mNumMaterials);
+    std::vector<bool> materialResolved(scene->mNumMaterials, false);
+    for (const aiMesh* mesh : sceneMeshes)
     {
-        aiFace face = mesh->mFaces[i];
-        for (unsigned int j = 0; j < face.mNumIndices; j++)
+        unsigned int index = mesh->mMaterialIndex;
+        if (index >= scene->mNumMaterials || materialResolved[index])
         {
-            indices.push_back(face.mIndices[j]);
+            continue;
         }
-    }
+        materialResolved[index] = true;
 
-    // Process materials
-    if (mesh->mMaterialIndex >= 0)
-    {
-        aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+        aiMaterial* material = scene->mMaterials[index];
         std::vector<Texture> diffuseMaps =
             loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+        materialTextures[index].insert(materialTextures[index].end(), diffuseMaps.begin(), diffuseMaps.end());
 
         std::vector<Texture> specularMaps =
             loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+        materialTextures[index].insert(materialTextures[index].end(), specularMaps.begin(), specularMaps.end());
     }
 
-    return Mesh(verticies, indices, textures);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<MeshData> converted;
+    convertMeshes(sceneMeshes, &converted, this->jobs);
+    this->meshConvertSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Only the buffer creation is left, which has to happen on this thread
+    this->meshes.reserve(this->meshes.size() + sceneMeshes.size());
+    for (size_t i = 0; i < sceneMeshes.size(); i++)
+    {
+        unsigned int index = sceneMeshes[i]->mMaterialIndex;
+        std::vector<Texture> textures = index < scene->mNumMaterials ? materialTextures[index] : std::vector<Texture>();
+        this->meshes.push_back(Mesh(std::move(converted[i].verticies), std::move(converted[i].indices),
+            std::move(textures)));
+    }
 }
 
 std::vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName)
@@ -145,7 +293,9 @@ std::vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType
         if (skip) { continue; }
 
         Texture texture;
-        texture.id = textureFromFile(str.C_Str(), this->directory);
+        auto start = std::chrono::steady_clock::now();
+        texture.id = textureFromFile(str.C_Str(), this->directory, typeName == "texture_diffuse");
+        this->textureLoadSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
         texture.type = typeName;
         texture.name = str.C_Str();
         textures.push_back(texture);
@@ -154,47 +304,162 @@ std::vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType
     return textures;
 }
 
-unsigned int Model::textureFromFile(std::string fileName, const std::string& directory)
+unsigned int Model::textureFromFile(std::string fileName, const std::string& directory, bool srgb)
 {
+    PROFILE_SCOPE("Model::textureFromFile");
     std::string path = directory + '/' + fileName;
-    unsigned int textureID;
+    DecodedTexture decoded;
+    if (!decodeTexture(path, srgb, &decoded))
+    {
+        std::cout << "Texture failed to load at path: " << path << std::endl;
+        return 0;
+    }
+    return uploadTexture(decoded);
+}
 
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(path.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
+bool Model::decodeTexture(const std::string& path, bool srgb, DecodedTexture* decoded)
+{
+    PROFILE_SCOPE("Model::decodeTexture");
+    // Prefer the output of the texture baker (block compressed, mips included) next to the source image
+    GLenum internalFormat;
+    if (readKtx2(path.substr(0, path.find_last_of('.')) + ".ktx2", &decoded->ktx) &&
+        compressedInternalFormat(decoded->ktx.format, &internalFormat))
     {
-        GLenum format{};
-        switch (nrComponents)
+        decoded->source = DecodedTexture::KTX2;
+        decoded->internalFormat = internalFormat;
+        return true;
+    }
+
+    if (this->textureCache)
+    {
+        TextureLoadOptions options;
+        options.srgb = srgb;
+        if (this->textureCache->load(path, options, &decoded->cached))
         {
-        case 1:
-            format = GL_RED;
-            break;
-        case 3:
-            format = GL_RGB;
-            break;
-        case 4:
-            format = GL_RGBA;
-            break;
+            decoded->source = DecodedTexture::CACHE;
+            return true;
         }
+        return false;
+    }
 
-        glGenTextures(1, &textureID);
+    decoded->pixels = stbi_load(path.c_str(), &decoded->width, &decoded->height, &decoded->channels, 0);
+    if (decoded->pixels)
+    {
+        decoded->source = DecodedTexture::IMAGE;
+        return true;
+    }
+    return false;
+}
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+unsigned int Model::uploadTexture(DecodedTexture& decoded)
+{
+    if (decoded.source == DecodedTexture::KTX2)
+    {
+        return compressedTextureFromKtx2(decoded.ktx, decoded.internalFormat);
+    }
+    if (decoded.source == DecodedTexture::CACHE)
+    {
+        return cachedTextureFromFile(decoded.cached);
+    }
+    if (decoded.source != DecodedTexture::IMAGE)
+    {
+        return 0;
+    }
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    GLenum format{};
+    switch (decoded.channels)
+    {
+    case 1:
+        format = GL_RED;
+        break;
+    case 3:
+        format = GL_RGB;
+        break;
+    case 4:
+        format = GL_RGBA;
+        break;
+    }
+
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, decoded.width, decoded.height, 0, format, GL_UNSIGNED_BYTE, decoded.pixels);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    stbi_image_free(decoded.pixels);
+    decoded.pixels = nullptr;
+    return textureID;
+}
 
-        stbi_image_free(data);
+unsigned int Model::compressedTextureFromKtx2(const Ktx2Texture& ktx, unsigned int internalFormat)
+{
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    for (unsigned int level = 0; level < ktx.levels.size(); level++)
+    {
+        GLsizei width = std::max(1u, ktx.width >> level);
+        GLsizei height = std::max(1u, ktx.height >> level);
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, internalFormat, width, height, 0,
+            static_cast<GLsizei>(ktx.levels[level].size()), ktx.levels[level].data());
     }
-    else
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(ktx.levels.size()) - 1);
+
+    // BC4 only stores red, replicate it so single channel maps sample like the grey RGB images they replace
+    if (ktx.format == BlockFormat::BC4)
     {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
     }
 
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    return textureID;
+}
+
+unsigned int Model::cachedTextureFromFile(const CachedTexture& cached)
+{
+    GLenum format{};
+    switch (cached.channels)
+    {
+    case 1:
+        format = GL_RED;
+        break;
+    case 3:
+        format = GL_RGB;
+        break;
+    case 4:
+        format = GL_RGBA;
+        break;
+    }
+
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+
+    // Rows of odd sized RGB levels aren't 4 byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (unsigned int level = 0; level < cached.levels.size(); level++)
+    {
+        const CachedLevel& mip = cached.levels[level];
+        glTexImage2D(GL_TEXTURE_2D, level, format, mip.width, mip.height, 0, format, GL_UNSIGNED_BYTE, mip.pixels);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(cached.levels.size()) - 1);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
     return textureID;
 }
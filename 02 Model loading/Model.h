@@ -4,23 +4,70 @@
 #include <vector>
 #include <assimp/scene.h>
 #include "Shader.h"
+#include "JobSystem.h"
+#include "Ktx2.h"
 #include "Mesh.h"
+#include "TextureCache.h"
 
 class Model
 {
 public:
-    Model(std::string path);
+    /// <summary>
+    /// Loads the model and its textures. Decoded images go through textureCache when one is given,
+    /// the caller saves it once all models are loaded. With jobs the textures are decoded and the meshes
+    /// converted on its workers while the main (calling) thread uploads the finished textures.
+    /// </summary>
+    Model(std::string path, TextureCache* textureCache = nullptr, JobSystem* jobs = nullptr);
     void Draw(Shader& shader);
 
+    /// <summary>
+    /// Deletes the OpenGL objects of the meshes and textures. Main thread only.
+    /// </summary>
+    void release();
+
+    // Time spent loading the model's textures (decode or cache lookup + upload), wall clock when parallel
+    double getTextureLoadSeconds() const { return this->textureLoadSeconds; }
+    // Time spent converting the meshes into vertices and indices, wall clock when parallel
+    double getMeshConvertSeconds() const { return this->meshConvertSeconds; }
+
 private:
+    friend class ModelHandle;
+
+    // Loads nothing, ModelHandle fills it in the background
+    Model(TextureCache* textureCache, JobSystem* jobs);
+
+    // A texture read from disk but not uploaded yet, one of the three sources textureFromFile tries
+    struct DecodedTexture
+    {
+        enum Source { NONE, KTX2, CACHE, IMAGE } source = NONE;
+        Ktx2Texture ktx;
+        unsigned int internalFormat = 0; // Of the KTX2 texture
+        CachedTexture cached;
+        unsigned char* pixels = nullptr; // From stb_image
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+    };
+
     void loadModel(std::string path);
-    void processNode(aiNode* node, const aiScene* scene);
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene);
+    // Runs the OpenGL queries decodeTexture depends on, call it on the main thread before decoding elsewhere
+    static void initTextureFormats();
+    void loadTexturesInParallel(const aiScene* scene);
+    void collectMeshes(const aiNode* node, const aiScene* scene, std::vector<const aiMesh*>* meshes);
+    void processMeshes(const aiScene* scene);
     std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName);
-    unsigned int textureFromFile(std::string fileName, const std::string& directory);
+    unsigned int textureFromFile(std::string fileName, const std::string& directory, bool srgb);
+    bool decodeTexture(const std::string& path, bool srgb, DecodedTexture* decoded);
+    unsigned int uploadTexture(DecodedTexture& decoded);
+    unsigned int compressedTextureFromKtx2(const Ktx2Texture& ktx, unsigned int internalFormat);
+    unsigned int cachedTextureFromFile(const CachedTexture& cached);
 
 private:
     std::vector<Mesh> meshes;
     std::string directory;
     std::vector<Texture> texturesLoaded;
+    TextureCache* textureCache;
+    JobSystem* jobs;
+    double textureLoadSeconds;
+    double meshConvertSeconds;
 };
@@ -0,0 +1,356 @@
+#include "ModelHandle.h"
+
+#include <glad/glad.h>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <iostream>
+#include <glm/gtc/matrix_transform.hpp>
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <stb_image.h>
+#include "MeshConversion.h"
+#include "Profiler.h"
+
+struct ModelHandle::Stream : std::enable_shared_from_this<ModelHandle::Stream>
+{
+    enum State { LOADING, RESIDENT, FAILED };
+
+    struct StreamedTexture
+    {
+        std::string name;
+        std::string type;
+        Model::DecodedTexture decoded;
+        bool ok = false;
+        unsigned int id = 0;
+        JobCounter decodedCounter; // Its upload starts once this is done
+    };
+
+    Stream(const std::string& path, JobSystem& jobs, TextureCache* textureCache)
+        : path(path), jobs(jobs), model(new Model(textureCache, &jobs)), state(LOADING), abandoned(false),
+        boundsKnown(false), boundsMin(0.0f), boundsMax(0.0f), start(std::chrono::steady_clock::now()), loadSeconds(0.0)
+    {
+    }
+
+    // Worker: reads the file and queues the jobs for the rest of the load
+    void parse();
+    // Worker
+    void decode(StreamedTexture& texture);
+    // Main thread
+    void upload(StreamedTexture& texture);
+    // Worker, after the meshes were converted: queues the buffer creation
+    void createMeshes();
+    // Main thread, after every texture was uploaded
+    void createMesh(size_t index);
+    // Main thread, the last job of the load
+    void finish();
+    void setState(State state);
+
+    std::string path;
+    JobSystem& jobs;
+    std::unique_ptr<Model> model;
+    std::unique_ptr<Assimp::Importer> importer; // Owns the scene until the meshes are converted
+    std::vector<const aiMesh*> meshes;
+    std::vector<unsigned int> meshMaterials;
+    std::vector<MeshData> meshData;
+    std::vector<std::unique_ptr<StreamedTexture>> textures;
+    std::vector<std::vector<StreamedTexture*>> materialTextures; // Per material, diffuse maps first
+
+    // Counts the parse job, then the job queueing the buffer creation and then the last job, so it is
+    // only done once the load is
+    JobCounter loading;
+    JobCounter converted;
+    JobCounter uploaded;
+    JobCounter created;
+
+    std::atomic<int> state;
+    std::atomic<bool> abandoned;
+    std::atomic<bool> boundsKnown;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    std::chrono::steady_clock::time_point start;
+    double loadSeconds; // Written before state leaves LOADING
+};
+
+// Grey unit cube drawn in place of models that are still loading, with the model shader
+static Mesh& placeholderBox()
+{
+    static Mesh* box = nullptr;
+    if (box)
+    {
+        return *box;
+    }
+
+    unsigned int texture;
+    const unsigned char grey[4] = { 96, 96, 96, 255 };
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    // Corner i has x, y and z in bits 0, 1 and 2
+    std::vector<Vertex> vertices(8);
+    for (unsigned int i = 0; i < 8; i++)
+    {
+        vertices[i].position = glm::vec3(i & 1 ? 0.5f : -0.5f, i & 2 ? 0.5f : -0.5f, i & 4 ? 0.5f : -0.5f);
+        vertices[i].normal = glm::normalize(vertices[i].position);
+        vertices[i].texCoords = glm::vec2(0.0f);
+    }
+    std::vector<unsigned int> indices = {
+        0, 2, 6, 0, 6, 4,   1, 5, 7, 1, 7, 3, // -x, +x
+        0, 4, 5, 0, 5, 1,   2, 3, 7, 2, 7, 6, // -y, +y
+        0, 1, 3, 0, 3, 2,   4, 6, 7, 4, 7, 5, // -z, +z
+    };
+    box = new Mesh(vertices, indices, { { texture, "texture_diffuse", "placeholder" } });
+    return *box;
+}
+
+ModelHandle::ModelHandle(const std::string& path, JobSystem& jobs, TextureCache* textureCache)
+    : stream(std::make_shared<Stream>(path, jobs, textureCache)), jobs(jobs)
+{
+    Model::initTextureFormats();
+    std::shared_ptr<Stream> stream = this->stream;
+    jobs.run([stream]() { stream->parse(); }, &stream->loading);
+}
+
+ModelHandle::~ModelHandle()
+{
+    this->stream->abandoned.store(true);
+}
+
+bool ModelHandle::isResident() const
+{
+    return this->stream->state.load() == Stream::RESIDENT;
+}
+
+bool ModelHandle::hasFailed() const
+{
+    return this->stream->state.load() == Stream::FAILED;
+}
+
+Model* ModelHandle::getModel() const
+{
+    return isResident() ? this->stream->model.get() : nullptr;
+}
+
+bool ModelHandle::getBounds(glm::vec3* min, glm::vec3* max) const
+{
+    if (!this->stream->boundsKnown.load())
+    {
+        return false;
+    }
+    *min = this->stream->boundsMin;
+    *max = this->stream->boundsMax;
+    return true;
+}
+
+double ModelHandle::getLoadSeconds() const
+{
+    return this->stream->state.load() == Stream::LOADING ? 0.0 : this->stream->loadSeconds;
+}
+
+void ModelHandle::wait()
+{
+    this->jobs.wait(this->stream->loading);
+}
+
+void ModelHandle::Draw(Shader& shader, const glm::mat4& model)
+{
+    if (Model* loaded = getModel())
+    {
+        shader.setMat4("model", model);
+        loaded->Draw(shader);
+        return;
+    }
+
+    PROFILE_SCOPE("ModelHandle::Draw placeholder");
+    glm::vec3 min(-0.5f);
+    glm::vec3 max(0.5f);
+    getBounds(&min, &max);
+    glm::mat4 box = glm::translate(model, (min + max) * 0.5f);
+    box = glm::scale(box, glm::max(max - min, glm::vec3(0.001f)));
+    shader.setMat4("model", box);
+    placeholderBox().Draw(shader);
+}
+
+void ModelHandle::Stream::parse()
+{
+    PROFILE_SCOPE("ModelHandle::parse");
+    this->importer.reset(new Assimp::Importer());
+    const aiScene* scene = this->importer->ReadFile(this->path, aiProcess_Triangulate);
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    {
+        std::cout << "ERROR::ASSIMP::" << this->importer->GetErrorString() << std::endl;
+        this->importer.reset();
+        setState(FAILED);
+        return;
+    }
+    this->model->directory = this->path.substr(0, this->path.find_last_of('/'));
+
+    this->model->collectMeshes(scene->mRootNode, scene, &this->meshes);
+    glm::vec3 min(FLT_MAX);
+    glm::vec3 max(-FLT_MAX);
+    for (const aiMesh* mesh : this->meshes)
+    {
+        this->meshMaterials.push_back(mesh->mMaterialIndex);
+        for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+        {
+            glm::vec3 position(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+            min = glm::min(min, position);
+            max = glm::max(max, position);
+        }
+    }
+    if (min.x <= max.x)
+    {
+        this->boundsMin = min;
+        this->boundsMax = max;
+        this->boundsKnown.store(true);
+    }
+
+    // Every texture the materials reference, once, in the order Model::loadMaterialTextures meets them
+    const std::pair<aiTextureType, const char*> types[] = {
+        { aiTextureType_DIFFUSE, "texture_diffuse" }, { aiTextureType_SPECULAR, "texture_specular" } };
+    this->materialTextures.resize(scene->mNumMaterials);
+    for (unsigned int m = 0; m < scene->mNumMaterials; m++)
+    {
+        for (const std::pair<aiTextureType, const char*>& type : types)
+        {
+            for (unsigned int i = 0; i < scene->mMaterials[m]->GetTextureCount(type.first); i++)
+            {
+                aiString str;
+                scene->mMaterials[m]->GetTexture(type.first, i, &str);
+                StreamedTexture* texture = nullptr;
+                for (std::unique_ptr<StreamedTexture>& known : this->textures)
+                {
+                    if (known->name == str.C_Str())
+                    {
+                        texture = known.get();
+                        break;
+                    }
+                }
+                if (!texture)
+                {
+                    this->textures.emplace_back(new StreamedTexture());
+                    texture = this->textures.back().get();
+                    texture->name = str.C_Str();
+                    texture->type = type.second;
+                }
+                this->materialTextures[m].push_back(texture);
+            }
+        }
+    }
+
+    // Every texture uploads as soon as it is decoded, the meshes convert meanwhile. Everything is
+    // queued before this job ends, so the counters can't reach zero early.
+    std::shared_ptr<Stream> self = shared_from_this();
+    for (std::unique_ptr<StreamedTexture>& texture : this->textures)
+    {
+        StreamedTexture* streamed = texture.get();
+        this->jobs.run([self, streamed]() { self->decode(*streamed); }, &streamed->decodedCounter);
+        this->jobs.runOnMainThread([self, streamed]() { self->upload(*streamed); }, &this->uploaded,
+            &streamed->decodedCounter);
+    }
+    this->meshData.resize(this->meshes.size());
+    this->jobs.parallelFor(this->meshes.size(), 1, [self](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                convertMesh(self->meshes[i], &self->meshData[i]);
+            }
+        }, &this->converted);
+    this->jobs.run([self]() { self->createMeshes(); }, &this->loading, &this->converted);
+}
+
+void ModelHandle::Stream::decode(StreamedTexture& texture)
+{
+    if (this->abandoned.load())
+    {
+        return;
+    }
+    std::string path = this->model->directory + '/' + texture.name;
+    texture.ok = this->model->decodeTexture(path, texture.type == "texture_diffuse", &texture.decoded);
+}
+
+void ModelHandle::Stream::upload(StreamedTexture& texture)
+{
+    PROFILE_SCOPE("ModelHandle::upload");
+    if (!texture.ok)
+    {
+        if (!this->abandoned.load())
+        {
+            std::cout << "Texture failed to load at path: " << this->model->directory + '/' + texture.name << std::endl;
+        }
+        return;
+    }
+    if (this->abandoned.load())
+    {
+        stbi_image_free(texture.decoded.pixels);
+        texture.decoded.pixels = nullptr;
+        return;
+    }
+    texture.id = this->model->uploadTexture(texture.decoded);
+}
+
+void ModelHandle::Stream::createMeshes()
+{
+    // The meshes were copied out of the scene, which isn't needed anymore
+    this->importer.reset();
+    this->meshes.clear();
+
+    // One job per mesh, so the render loop can stop between any two of them
+    std::shared_ptr<Stream> self = shared_from_this();
+    this->model->meshes.reserve(this->meshData.size());
+    for (size_t i = 0; i < this->meshData.size(); i++)
+    {
+        this->jobs.runOnMainThread([self, i]() { self->createMesh(i); }, &this->created, &this->uploaded);
+    }
+    this->jobs.runOnMainThread([self]() { self->finish(); }, &this->loading, &this->created);
+}
+
+void ModelHandle::Stream::createMesh(size_t index)
+{
+    PROFILE_SCOPE("ModelHandle::createMesh");
+    if (this->abandoned.load())
+    {
+        return;
+    }
+    std::vector<Texture> textures;
+    unsigned int material = this->meshMaterials[index];
+    if (material < this->materialTextures.size())
+    {
+        for (StreamedTexture* texture : this->materialTextures[material])
+        {
+            textures.push_back({ texture->id, texture->type, texture->name });
+        }
+    }
+    MeshData& data = this->meshData[index];
+    this->model->meshes.push_back(Mesh(std::move(data.verticies), std::move(data.indices), std::move(textures)));
+}
+
+void ModelHandle::Stream::finish()
+{
+    for (std::unique_ptr<StreamedTexture>& texture : this->textures)
+    {
+        this->model->texturesLoaded.push_back({ texture->id, texture->type, texture->name });
+    }
+    this->textures.clear();
+    this->materialTextures.clear();
+    this->meshData.clear();
+
+    if (this->abandoned.load())
+    {
+        // Textures decoded and meshes created before the handle went away were uploaded all the same
+        this->model->release();
+        this->model.reset();
+        setState(FAILED);
+        return;
+    }
+    setState(RESIDENT);
+}
+
+void ModelHandle::Stream::setState(State state)
+{
+    this->loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - this->start).count();
+    this->state.store(state);
+}
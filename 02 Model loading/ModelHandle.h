@@ -0,0 +1,61 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <glm/glm.hpp>
+#include "JobSystem.h"
+#include "Model.h"
+#include "Shader.h"
+#include "TextureCache.h"
+
+/// <summary>
+/// A model that loads in the background. The file is parsed, its meshes converted and its textures
+/// decoded on the workers of the job system, while the OpenGL objects are created by main thread jobs,
+/// a few per frame as the render loop calls JobSystem::runMainThreadJobs with its time budget. Until
+/// then Draw renders a grey box the size of the model's bounds (a unit cube before it was parsed).
+/// </summary>
+class ModelHandle
+{
+public:
+    /// <summary>
+    /// Starts loading and returns right away. The job system and texture cache must outlive the load.
+    /// </summary>
+    ModelHandle(const std::string& path, JobSystem& jobs, TextureCache* textureCache = nullptr);
+    ModelHandle(const ModelHandle&) = delete;
+    ModelHandle& operator=(const ModelHandle&) = delete;
+
+    /// <summary>
+    /// An unfinished load keeps running and deletes what it created once it is done.
+    /// </summary>
+    ~ModelHandle();
+
+    bool isResident() const;
+    bool hasFailed() const;
+
+    // The loaded model, nullptr until it is resident
+    Model* getModel() const;
+
+    // Bounds of the model's vertices. Returns false until the file was parsed.
+    bool getBounds(glm::vec3* min, glm::vec3* max) const;
+
+    // Wall clock time from the constructor until the model was resident or failed
+    double getLoadSeconds() const;
+
+    /// <summary>
+    /// Main thread only: runs jobs, main thread jobs included, until the model is resident or failed.
+    /// </summary>
+    void wait();
+
+    /// <summary>
+    /// Draws the model, or its placeholder while it is loading, with the shader in use. Sets the shader's
+    /// model matrix.
+    /// </summary>
+    void Draw(Shader& shader, const glm::mat4& model);
+
+private:
+    // Loading state shared with the jobs, which keep it alive until the last one has run
+    struct Stream;
+
+    std::shared_ptr<Stream> stream;
+    JobSystem& jobs;
+};
@@ -1,4 +1,10 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -6,8 +12,12 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "JobSystem.h"
 #include "Model.h"
+#include "ModelHandle.h"
 #include "Shader.h"
+#include "Headless.h"
+#include "Profiler.h"
 
 #define WINDOW_WIDTH 1280
 #define WINDOW_HEIGHT 720
@@ -15,6 +25,12 @@
 #define V_SHADER_PATH "shaders/shader.vert"
 #define F_SHADER_PATH "shaders/shader.frag"
 
+// Decoded textures + mips, written next to the executable on the first (cold) run
+#define TEXTURE_CACHE_PATH "texture_cache.pack"
+
+// Time per frame the render loop spends creating the GL objects of models that are still loading
+#define STREAMING_BUDGET_MS 2.0
+
 #define MOUSE_SENSITIVITY 0.1f
 
 void framebufferSizeCallback(GLFWwindow* window, int width, int height);
@@ -28,9 +44,15 @@ void cameraSetup(glm::vec3 position, glm::vec3* direction, glm::vec3* right, glm
 glm::mat4 getModelMatrix(glm::vec3 position, float rotationDeg, glm::vec3 rotationAxis);
 glm::mat4 getProjectionMatrix();
 void deinitOpengl();
+int runHeadless(const HeadlessOptions& options);
+int runStreamTest(const HeadlessOptions& options, int modelCount);
+void reportModelLoad();
 
+JobSystem* jobSystem;
+TextureCache* textureCache;
 Shader* backpackShader;
-Model* guitarBackpackModel;
+ModelHandle* guitarBackpackModel;
+bool modelLoadReported = false;
 
 const glm::vec3 world_front(0.0f, 0.0f, -1.0f);
 const glm::vec3 world_up(0.0f, 1.0f, 0.0f);
@@ -44,6 +66,10 @@ float lastFrame = 0.0f;
 
 float fov = 45.0f;
 
+// Size of what we render into, the projection takes its aspect ratio from it
+int framebufferWidth = WINDOW_WIDTH;
+int framebufferHeight = WINDOW_HEIGHT;
+
 float yaw = -90.0f; // Rotation around Y axis
 float pitch = 0.0f; // Rotation around X axis
 
@@ -54,8 +80,21 @@ float lastMouseY = WINDOW_HEIGHT / 2;
 glm::vec3 lightPos(1.2f, 1.0f, 2.0f);
 glm::vec3 lightColor(1.0f, 1.0f, 1.0f);
 
-int main()
+int main(int argc, char* argv[])
 {
+    HeadlessOptions headless = parseHeadlessOptions(argc, argv, WINDOW_WIDTH, WINDOW_HEIGHT);
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--stream-test") == 0)
+        {
+            return runStreamTest(headless, std::max(1, std::atoi(argv[i + 1])));
+        }
+    }
+    if (headless.enabled)
+    {
+        return runHeadless(headless);
+    }
+
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -76,7 +115,9 @@ int main()
         return -1;
     }
 
-    glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+    // The framebuffer can be larger than the window on high DPI displays
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    glViewport(0, 0, framebufferWidth, framebufferHeight);
 
     glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
 
@@ -87,39 +128,285 @@ int main()
 
     initOpengl();
 
+    // Records the camera once per frame for replaying with --camera-path
+    CameraPath recordedPath;
+
     while (!glfwWindowShouldClose(window))
     {
+        PROFILE_SCOPE("frame");
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
         processInput(window);
 
+        if (!headless.recordCameraPath.empty())
+        {
+            recordedPath.record(cameraPosition, cameraFront);
+        }
+
         renderLoop();
 
-        glfwSwapBuffers(window);
+        {
+            PROFILE_SCOPE("glfwSwapBuffers"); // Includes waiting for vsync
+            glfwSwapBuffers(window);
+        }
         glfwPollEvents();
     }
 
+    if (!headless.recordCameraPath.empty())
+    {
+        recordedPath.save(headless.recordCameraPath);
+    }
+    if (!headless.tracePath.empty())
+    {
+        Profiler::writeChromeTrace(headless.tracePath);
+    }
+
     deinitOpengl();
     glfwTerminate();
 
     return 0;
 }
 
+int runHeadless(const HeadlessOptions& options)
+{
+    HeadlessContext context;
+    if (!context.create(options.width, options.height, options.glCalls))
+    {
+        return -1;
+    }
+    framebufferWidth = options.width;
+    framebufferHeight = options.height;
+    installRenderStatsHooks();
+    if (options.glCalls)
+    {
+        installGlInstrumentation(HeadlessContext::getProcAddress);
+    }
+
+    CameraPath cameraPath = CameraPath::orbit(glm::vec3(0.0f), 4.0f, 0.5f, options.frames);
+    if (!options.cameraPath.empty() && !cameraPath.load(options.cameraPath))
+    {
+        std::cout << "Failed to load camera path: " << options.cameraPath << std::endl;
+        return -1;
+    }
+
+    initOpengl();
+    // Measure the loaded scene, not the placeholder
+    guitarBackpackModel->wait();
+    reportModelLoad();
+    modelLoadReported = true;
+
+    // Fixed timestep and camera path so runs on different machines render the same frames. Warmup
+    // frames replay the start of the path and are not measured.
+    FrameStats stats;
+    deltaTime = 1.0f / 60.0f;
+    for (int frame = -options.warmupFrames; frame < options.frames; frame++)
+    {
+        PROFILE_SCOPE("frame");
+        cameraPath.sample(frame < 0 ? frame + options.warmupFrames : frame, &cameraPosition, &cameraFront);
+
+        resetRenderStats();
+        resetGlCallCounters();
+        auto start = std::chrono::steady_clock::now();
+        renderLoop();
+        {
+            PROFILE_SCOPE("glFinish"); // There is no swap to wait for, so wait for the GPU here to include its time
+            glFinish();
+        }
+        double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (frame >= 0)
+        {
+            stats.addFrame(milliseconds, getRenderStats());
+            if (options.glCalls)
+            {
+                stats.addGlCalls(getGlCallCounters());
+            }
+        }
+    }
+    stats.print("02 Model loading (headless, " + std::to_string(options.width) + "x" + std::to_string(options.height) + ")");
+
+    if (!options.jsonPath.empty())
+    {
+        stats.writeJson(options.jsonPath, "02 Model loading", options);
+    }
+    if (!options.screenshotPath.empty())
+    {
+        context.saveScreenshot(options.screenshotPath);
+    }
+    if (!options.tracePath.empty())
+    {
+        Profiler::writeChromeTrace(options.tracePath);
+    }
+
+    deinitOpengl();
+    context.destroy();
+    return 0;
+}
+
+// Starts loading modelCount models at once and renders until all of them are resident, measuring the
+// frames in between. Every frame creates GL objects for STREAMING_BUDGET_MS, so the worst frame shows
+// how well the loading stays off the render thread.
+int runStreamTest(const HeadlessOptions& options, int modelCount)
+{
+    HeadlessContext context;
+    if (!context.create(options.width, options.height, options.glCalls))
+    {
+        return -1;
+    }
+    framebufferWidth = options.width;
+    framebufferHeight = options.height;
+    installRenderStatsHooks();
+    if (options.glCalls)
+    {
+        installGlInstrumentation(HeadlessContext::getProcAddress);
+    }
+
+    glEnable(GL_DEPTH_TEST);
+    jobSystem = new JobSystem();
+    textureCache = new TextureCache(TEXTURE_CACHE_PATH);
+    backpackShader = new Shader(V_SHADER_PATH, F_SHADER_PATH);
+
+    // A grid of models in front of the camera
+    int columns = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(modelCount))));
+    const float spacing = 3.0f;
+    float extent = (columns - 1) * spacing;
+    cameraPosition = glm::vec3(0.0f, 0.0f, extent * 1.2f + 4.0f);
+    cameraFront = world_front;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::unique_ptr<ModelHandle>> models;
+    std::vector<glm::mat4> transforms;
+    for (int i = 0; i < modelCount; i++)
+    {
+        models.emplace_back(new ModelHandle("models/backpack.obj", *jobSystem, textureCache));
+        glm::vec3 position((i % columns) * spacing - extent * 0.5f, (i / columns) * spacing - extent * 0.5f, 0.0f);
+        transforms.push_back(glm::translate(glm::mat4(1.0f), position));
+    }
+
+    // Returns the models that are still loading
+    auto renderFrame = [&models, &transforms, &options](FrameStats* stats)
+    {
+        PROFILE_SCOPE("frame");
+        resetRenderStats();
+        resetGlCallCounters();
+        auto frameStart = std::chrono::steady_clock::now();
+        int loading = 0;
+        {
+            PROFILE_SCOPE("renderLoop");
+            jobSystem->runMainThreadJobs(STREAMING_BUDGET_MS);
+            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            backpackShader->use();
+            backpackShader->setMat4("view", glm::lookAt(cameraPosition, cameraPosition + cameraFront, world_up));
+            backpackShader->setMat4("projection", getProjectionMatrix());
+            for (size_t i = 0; i < models.size(); i++)
+            {
+                models[i]->Draw(*backpackShader, transforms[i]);
+                loading += models[i]->isResident() || models[i]->hasFailed() ? 0 : 1;
+            }
+        }
+        {
+            PROFILE_SCOPE("glFinish");
+            glFinish();
+        }
+        stats->addFrame(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count(),
+            getRenderStats());
+        if (options.glCalls)
+        {
+            stats->addGlCalls(getGlCallCounters());
+        }
+        return loading;
+    };
+
+    FrameStats stats;
+    while (renderFrame(&stats) > 0)
+    {
+    }
+    double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // The same scene once everything is resident, what the loading frames compare against
+    FrameStats residentStats;
+    for (int frame = 0; frame < 60; frame++)
+    {
+        renderFrame(&residentStats);
+    }
+
+    int failed = 0;
+    for (const std::unique_ptr<ModelHandle>& model : models)
+    {
+        failed += model->hasFailed() ? 1 : 0;
+    }
+    stats.print("02 Model loading (streaming " + std::to_string(modelCount) + " models, " +
+        std::to_string(jobSystem->getWorkerCount()) + " workers)");
+    residentStats.print("02 Model loading (" + std::to_string(modelCount) + " models resident)");
+    std::cout << "All models resident after " << totalMs << " ms, worst frame while loading " << stats.percentile(100.0)
+        << " ms (" << residentStats.percentile(100.0) << " ms once resident) with a " << STREAMING_BUDGET_MS
+        << " ms budget, " << failed << " failed" << std::endl;
+
+    if (!options.jsonPath.empty())
+    {
+        stats.writeJson(options.jsonPath, "02 Model loading (streaming)", options);
+    }
+    if (!options.screenshotPath.empty())
+    {
+        context.saveScreenshot(options.screenshotPath);
+    }
+    if (!options.tracePath.empty())
+    {
+        Profiler::writeChromeTrace(options.tracePath);
+    }
+
+    textureCache->save();
+    models.clear();
+    delete(backpackShader);
+    backpackShader = nullptr;
+    delete(jobSystem);
+    jobSystem = nullptr;
+    delete(textureCache);
+    textureCache = nullptr;
+    context.destroy();
+    return failed > 0 ? 1 : 0;
+}
+
 void initOpengl()
 {
+    PROFILE_SCOPE("initOpengl");
     glEnable(GL_DEPTH_TEST);
 
-    guitarBackpackModel = new Model("models/backpack.obj");
+    // One worker per remaining core. The model loads on them in the background while the render
+    // loop draws its placeholder and creates its GL objects within STREAMING_BUDGET_MS per frame.
+    jobSystem = new JobSystem();
+    textureCache = new TextureCache(TEXTURE_CACHE_PATH);
+    guitarBackpackModel = new ModelHandle("models/backpack.obj", *jobSystem, textureCache);
     backpackShader = new Shader(V_SHADER_PATH, F_SHADER_PATH);
 
     // Draw in wireframe mode
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 }
 
+// Compare the load of a cold run (decode, mip generation, cache write) against a warm run (hash +
+// upload from the mapped pack)
+void reportModelLoad()
+{
+    bool cold = textureCache->getMissCount() > 0;
+    textureCache->save();
+    std::cout << "Model " << (guitarBackpackModel->isResident() ? "loaded" : "failed to load") << " in the background ("
+        << (cold ? "cold" : "warm") << ", " << jobSystem->getWorkerCount() << " workers): "
+        << guitarBackpackModel->getLoadSeconds() * 1000.0 << " ms, " << textureCache->getHitCount()
+        << " cache hits, " << textureCache->getMissCount() << " misses" << std::endl;
+}
+
 void renderLoop()
 {
+    PROFILE_SCOPE("renderLoop");
+    jobSystem->runMainThreadJobs(STREAMING_BUDGET_MS);
+    if (!modelLoadReported && (guitarBackpackModel->isResident() || guitarBackpackModel->hasFailed()))
+    {
+        reportModelLoad();
+        modelLoadReported = true;
+    }
+
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -134,9 +421,7 @@ void renderLoop()
     glm::mat4 model = glm::mat4(1.0f);
     model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f)); // translate it down so it's at the center of the scene
     model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));	// it's a bit too big for our scene, so scale it down
-    backpackShader->setMat4("model", model);
-
-    guitarBackpackModel->Draw(*backpackShader);
+    guitarBackpackModel->Draw(*backpackShader, model);
 }
 
 glm::vec3 getCameraDirection(const float yaw, const float pitch)
@@ -178,7 +463,7 @@ glm::mat4 getProjectionMatrix()
 {
     glm::mat4 projection;
     projection =
-        glm::perspective(glm::radians(fov), (float)WINDOW_WIDTH / (float)WINDOW_HEIGHT, 0.1f, 100.0f);
+        glm::perspective(glm::radians(fov), (float)framebufferWidth / (float)framebufferHeight, 0.1f, 100.0f);
 
     return projection;
 }
@@ -189,6 +474,11 @@ void deinitOpengl()
     backpackShader = nullptr;
     delete(guitarBackpackModel);
     guitarBackpackModel = nullptr;
+    // The workers may still be decoding into the texture cache
+    delete(jobSystem);
+    jobSystem = nullptr;
+    delete(textureCache);
+    textureCache = nullptr;
 }
 
 void processInput(GLFWwindow* window)
@@ -254,4 +544,10 @@ void scrollCallback(GLFWwindow* window, double xOffset, double yOffset)
 void framebufferSizeCallback(GLFWwindow* window, int width, int height)
 {
     glViewport(0, 0, width, height);
+    // A minimized window has an empty framebuffer, keep the last aspect ratio
+    if (width > 0 && height > 0)
+    {
+        framebufferWidth = width;
+        framebufferHeight = height;
+    }
 }
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Scoped zones compile to nothing when this is 0 (e.g. /D PROFILER_ENABLED=0)
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+/// <summary>
+/// One finished zone. Times are steady clock nanoseconds, depth is the number of zones that were
+/// open on the same thread when it started.
+/// </summary>
+struct ProfileEvent
+{
+    const char* name;
+    long long start;
+    long long end;
+    int depth;
+    unsigned int threadId;
+};
+
+/// <summary>
+/// Hierarchical CPU profiler. Every thread records its zones into its own fixed size ring buffer,
+/// which only that thread writes, so recording takes no lock. The oldest zones are overwritten once
+/// a buffer is full. Readers copy the buffers (collect, writeChromeTrace) while threads keep running.
+/// </summary>
+class Profiler
+{
+public:
+    static long long now();
+
+    /// <summary>
+    /// Adds a finished zone to the calling thread's buffer. name must outlive the profiler (a string literal).
+    /// </summary>
+    static void record(const char* name, long long start, long long end, int depth);
+
+    /// <summary>
+    /// Zones of all threads that started at or after begin and ended at or before end, in start order.
+    /// Only the zones newer than begin are visited, so collecting the last frame is cheap.
+    /// </summary>
+    static std::vector<ProfileEvent> collect(long long begin, long long end);
+
+    /// <summary>
+    /// Writes everything still in the buffers in the Chrome trace event format, which chrome://tracing,
+    /// Perfetto (ui.perfetto.dev) and Speedscope open.
+    /// </summary>
+    static bool writeChromeTrace(const std::string& path);
+
+    /// <summary>
+    /// Nesting depth bookkeeping for ProfileScope.
+    /// </summary>
+    static int enterZone();
+    static void leaveZone();
+};
+
+/// <summary>
+/// Records the time between its construction and destruction as a zone.
+/// </summary>
+class ProfileScope
+{
+public:
+    ProfileScope(const char* name)
+        : name(name), depth(Profiler::enterZone()), start(Profiler::now())
+    {
+    }
+
+    ~ProfileScope()
+    {
+        Profiler::record(this->name, this->start, Profiler::now(), this->depth);
+        Profiler::leaveZone();
+    }
+
+private:
+    const char* name;
+    int depth;
+    long long start;
+};
+
+#if PROFILER_ENABLED
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_FUNCTION()
+#endif
@@ -5,9 +5,11 @@
 #include <iostream>
 #include <glm/gtc/type_ptr.hpp>
 #include <glad/glad.h>
+#include "Profiler.h"
 
 Shader::Shader(const char* vertexPath, const char* fragmentPath)
 {
+    PROFILE_SCOPE("Shader::Shader");
     std::string vertexCode;
     std::string fragmentCode;
     std::ifstream vShaderFile;
@@ -97,6 +99,7 @@ void Shader::setVec4(const std::string& name, glm::vec4 value) const
 
 void Shader::compileAndLink(const char* vShaderCode, const char* fShaderCode)
 {
+    PROFILE_SCOPE("Shader::compileAndLink");
     unsigned int vertex, fragment;
     // vertex shader
     vertex = glCreateShader(GL_VERTEX_SHADER);
@@ -0,0 +1,375 @@
+#include "TextureCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stb_image.h>
+#include "Profiler.h"
+
+namespace
+{
+    const unsigned char PACK_MAGIC[4] = { 'T', 'X', 'C', 'P' };
+    const uint32_t PACK_VERSION = 1;
+    const size_t HEADER_SIZE = 4 + 3 * 4 + 2 * 8; // Magic, version, entry count, reserved, table offset, table size
+    const size_t ENTRY_SIZE = 4 * 8 + 6 * 4; // Followed by the path
+    const size_t DATA_ALIGNMENT = 16;
+    // Pack entries outside these limits are ignored, whatever they claim about their data
+    const int MAX_TEXTURE_SIZE = 16384;
+    const int MAX_LEVEL_COUNT = 15; // Of a MAX_TEXTURE_SIZE image
+
+    const uint32_t FLAG_FLIP = 1;
+    const uint32_t FLAG_SRGB = 2;
+    const uint32_t FLAG_KAISER = 4;
+    const uint32_t FLAG_ALPHA_COVERAGE = 8;
+
+    const uint64_t FNV_OFFSET = 14695981039346656037ull;
+    const uint64_t FNV_PRIME = 1099511628211ull;
+
+    uint64_t fnv1a(const unsigned char* data, size_t size, uint64_t hash = FNV_OFFSET)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            hash = (hash ^ data[i]) * FNV_PRIME;
+        }
+        return hash;
+    }
+
+    uint32_t optionFlags(const TextureLoadOptions& options)
+    {
+        return (options.flipVertically ? FLAG_FLIP : 0) | (options.srgb ? FLAG_SRGB : 0) |
+            (options.mipFilter == MipFilter::Kaiser ? FLAG_KAISER : 0) |
+            (options.preserveAlphaCoverage ? FLAG_ALPHA_COVERAGE : 0) |
+            (static_cast<uint32_t>(options.desiredChannels) << 8);
+    }
+
+    uint64_t keyHash(const std::string& path, uint32_t flags)
+    {
+        unsigned char flagBytes[4] = { static_cast<unsigned char>(flags), static_cast<unsigned char>(flags >> 8),
+            static_cast<unsigned char>(flags >> 16), static_cast<unsigned char>(flags >> 24) };
+        uint64_t hash = fnv1a(reinterpret_cast<const unsigned char*>(path.data()), path.size());
+        return fnv1a(flagBytes, 4, hash);
+    }
+
+    void putU32(std::vector<unsigned char>& out, uint32_t value)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            out.push_back((value >> (8 * i)) & 0xFF);
+        }
+    }
+
+    void putU64(std::vector<unsigned char>& out, uint64_t value)
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            out.push_back((value >> (8 * i)) & 0xFF);
+        }
+    }
+
+    uint32_t getU32(const unsigned char* in)
+    {
+        return in[0] | (in[1] << 8) | (in[2] << 16) | (static_cast<uint32_t>(in[3]) << 24);
+    }
+
+    uint64_t getU64(const unsigned char* in)
+    {
+        return getU32(in) | (static_cast<uint64_t>(getU32(in + 4)) << 32);
+    }
+
+    size_t levelSize(int width, int height, int channels, int level)
+    {
+        return static_cast<size_t>(std::max(1, width >> level)) * std::max(1, height >> level) * channels;
+    }
+}
+
+bool TextureCache::isValidEntry(const Entry& entry, size_t packSize)
+{
+    // The table comes from a file that may be corrupt or edited by hand, and fillTexture walks the
+    // whole chain from dataOffset, so the sizes are checked and the chain has to fit into dataSize
+    if (entry.width < 1 || entry.width > MAX_TEXTURE_SIZE || entry.height < 1 || entry.height > MAX_TEXTURE_SIZE ||
+        entry.channels < 1 || entry.channels > 4 || entry.levelCount < 1 || entry.levelCount > MAX_LEVEL_COUNT)
+    {
+        return false;
+    }
+    if (entry.dataOffset > packSize || entry.dataSize > packSize - entry.dataOffset)
+    {
+        return false;
+    }
+    uint64_t chainSize = 0;
+    for (int level = 0; level < entry.levelCount; level++)
+    {
+        chainSize += levelSize(entry.width, entry.height, entry.channels, level);
+    }
+    return chainSize <= entry.dataSize;
+}
+
+TextureCache::TextureCache(const std::string& packPath)
+    : packPath(packPath), hitCount(0), missCount(0)
+{
+    openPack();
+}
+
+void TextureCache::openPack()
+{
+    this->entries.clear();
+    if (!this->mapping.open(this->packPath))
+    {
+        return; // No cache yet, everything misses
+    }
+
+    const unsigned char* data = this->mapping.data();
+    size_t size = this->mapping.size();
+    if (size < HEADER_SIZE || std::memcmp(data, PACK_MAGIC, 4) != 0 || getU32(data + 4) != PACK_VERSION)
+    {
+        std::cout << "Ignoring texture cache with unknown format: " << this->packPath << std::endl;
+        this->mapping.close();
+        return;
+    }
+
+    uint32_t entryCount = getU32(data + 8);
+    uint64_t tableOffset = getU64(data + 16);
+    uint64_t tableSize = getU64(data + 24);
+    if (tableOffset > size || tableSize > size - tableOffset)
+    {
+        this->mapping.close();
+        return;
+    }
+
+    const unsigned char* cursor = data + tableOffset;
+    const unsigned char* tableEnd = cursor + tableSize;
+    for (uint32_t i = 0; i < entryCount && static_cast<size_t>(tableEnd - cursor) >= ENTRY_SIZE; i++)
+    {
+        uint64_t key = getU64(cursor);
+        Entry entry;
+        entry.sourceHash = getU64(cursor + 8);
+        entry.dataOffset = getU64(cursor + 16);
+        entry.dataSize = getU64(cursor + 24);
+        entry.flags = getU32(cursor + 32);
+        entry.width = static_cast<int>(getU32(cursor + 36));
+        entry.height = static_cast<int>(getU32(cursor + 40));
+        entry.channels = static_cast<int>(getU32(cursor + 44));
+        entry.levelCount = static_cast<int>(getU32(cursor + 48));
+        uint32_t pathLength = getU32(cursor + 52);
+        cursor += ENTRY_SIZE;
+        if (pathLength > static_cast<size_t>(tableEnd - cursor))
+        {
+            break;
+        }
+        entry.path.assign(reinterpret_cast<const char*>(cursor), pathLength);
+        cursor += pathLength;
+        // A broken entry only costs its own image a decode
+        if (isValidEntry(entry, size))
+        {
+            this->entries[key] = entry;
+        }
+    }
+}
+
+void TextureCache::fillTexture(const Entry& entry, const unsigned char* data, CachedTexture* texture)
+{
+    texture->channels = entry.channels;
+    texture->levels.clear();
+    for (int level = 0; level < entry.levelCount; level++)
+    {
+        texture->levels.push_back({ std::max(1, entry.width >> level), std::max(1, entry.height >> level), data });
+        data += levelSize(entry.width, entry.height, entry.channels, level);
+    }
+}
+
+void TextureCache::fillPending(const PendingTexture& pending, CachedTexture* texture)
+{
+    texture->channels = pending.entry.channels;
+    texture->levels.clear();
+    for (const MipLevel& level : pending.levels)
+    {
+        texture->levels.push_back({ level.width, level.height, level.pixels.data() });
+    }
+}
+
+bool TextureCache::load(const std::string& path, const TextureLoadOptions& options, CachedTexture* texture)
+{
+    PROFILE_SCOPE("TextureCache::load");
+    // The source is mapped rather than read so hashing a warm file costs no copy, and a miss can
+    // decode from the same bytes
+    MappedFile source;
+    if (!source.open(path))
+    {
+        return false;
+    }
+    uint64_t sourceHash = fnv1a(source.data(), source.size());
+    uint32_t flags = optionFlags(options);
+    uint64_t key = keyHash(path, flags);
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        auto found = this->entries.find(key);
+        if (found != this->entries.end() && found->second.path == path && found->second.flags == flags &&
+            found->second.sourceHash == sourceHash)
+        {
+            fillTexture(found->second, this->mapping.data() + found->second.dataOffset, texture);
+            this->hitCount++;
+            return true;
+        }
+
+        auto decoded = this->pending.find(key);
+        if (decoded != this->pending.end() && decoded->second->entry.sourceHash == sourceHash)
+        {
+            fillPending(*decoded->second, texture);
+            this->hitCount++;
+            return true;
+        }
+    }
+
+    // Decoding and mip generation run without the lock, so loads on other threads proceed meanwhile
+    int width, height, nrComponents;
+    stbi_set_flip_vertically_on_load_thread(options.flipVertically);
+    unsigned char* data = stbi_load_from_memory(source.data(), static_cast<int>(source.size()),
+        &width, &height, &nrComponents, options.desiredChannels);
+    stbi_set_flip_vertically_on_load_thread(false);
+    if (!data)
+    {
+        return false;
+    }
+
+    std::unique_ptr<PendingTexture> entry(new PendingTexture());
+    entry->entry.path = path;
+    entry->entry.sourceHash = sourceHash;
+    entry->entry.flags = flags;
+    entry->entry.width = width;
+    entry->entry.height = height;
+    entry->entry.channels = options.desiredChannels != 0 ? options.desiredChannels : nrComponents;
+    MipChainOptions mipOptions;
+    mipOptions.filter = options.mipFilter;
+    mipOptions.srgb = options.srgb;
+    mipOptions.preserveAlphaCoverage = options.preserveAlphaCoverage;
+    entry->levels = generateMipChain(data, width, height, entry->entry.channels, mipOptions);
+    entry->entry.levelCount = static_cast<int>(entry->levels.size());
+    stbi_image_free(data);
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    std::unique_ptr<PendingTexture>& slot = this->pending[key];
+    // Another thread may have decoded the same image meanwhile. Its levels are already handed out, so
+    // they are kept and this copy is dropped. A different version of the image (edited since) is replaced,
+    // but its levels are handed out too and stay alive until save().
+    if (!slot || slot->entry.sourceHash != sourceHash)
+    {
+        if (slot)
+        {
+            this->retired.push_back(std::move(slot));
+        }
+        slot = std::move(entry);
+    }
+    fillPending(*slot, texture);
+    this->missCount++;
+    return true;
+}
+
+bool TextureCache::save()
+{
+    PROFILE_SCOPE("TextureCache::save");
+    if (this->pending.empty())
+    {
+        return true;
+    }
+
+    std::string tempPath = this->packPath + ".tmp";
+    std::ofstream file(tempPath, std::ios::binary);
+    if (!file)
+    {
+        std::cout << "Failed to write texture cache: " << tempPath << std::endl;
+        return false;
+    }
+
+    std::vector<unsigned char> table;
+    uint32_t entryCount = 0;
+    uint64_t offset = HEADER_SIZE;
+    file.write(std::string(HEADER_SIZE, '\0').data(), HEADER_SIZE);
+
+    auto writeEntry = [&](uint64_t key, const Entry& entry, const std::vector<const unsigned char*>& levels)
+    {
+        uint64_t padding = (DATA_ALIGNMENT - offset % DATA_ALIGNMENT) % DATA_ALIGNMENT;
+        file.write(std::string(padding, '\0').data(), padding);
+        offset += padding;
+
+        uint64_t dataSize = 0;
+        for (int level = 0; level < entry.levelCount; level++)
+        {
+            size_t size = levelSize(entry.width, entry.height, entry.channels, level);
+            file.write(reinterpret_cast<const char*>(levels[level]), size);
+            dataSize += size;
+        }
+
+        putU64(table, key);
+        putU64(table, entry.sourceHash);
+        putU64(table, offset);
+        putU64(table, dataSize);
+        putU32(table, entry.flags);
+        putU32(table, entry.width);
+        putU32(table, entry.height);
+        putU32(table, entry.channels);
+        putU32(table, entry.levelCount);
+        putU32(table, static_cast<uint32_t>(entry.path.size()));
+        table.insert(table.end(), entry.path.begin(), entry.path.end());
+        offset += dataSize;
+        entryCount++;
+    };
+
+    // Keep the mapped entries that weren't replaced, then append the newly decoded ones
+    std::vector<const unsigned char*> levels;
+    for (const auto& mapped : this->entries)
+    {
+        if (this->pending.count(mapped.first) != 0)
+        {
+            continue;
+        }
+        levels.clear();
+        const unsigned char* data = this->mapping.data() + mapped.second.dataOffset;
+        for (int level = 0; level < mapped.second.levelCount; level++)
+        {
+            levels.push_back(data);
+            data += levelSize(mapped.second.width, mapped.second.height, mapped.second.channels, level);
+        }
+        writeEntry(mapped.first, mapped.second, levels);
+    }
+    for (const auto& decoded : this->pending)
+    {
+        levels.clear();
+        for (const MipLevel& level : decoded.second->levels)
+        {
+            levels.push_back(level.pixels.data());
+        }
+        writeEntry(decoded.first, decoded.second->entry, levels);
+    }
+
+    file.write(reinterpret_cast<const char*>(table.data()), table.size());
+
+    std::vector<unsigned char> header(PACK_MAGIC, PACK_MAGIC + 4);
+    putU32(header, PACK_VERSION);
+    putU32(header, entryCount);
+    putU32(header, 0);
+    putU64(header, offset);
+    putU64(header, table.size());
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(header.data()), header.size());
+    file.close();
+    if (!file)
+    {
+        std::cout << "Failed to write texture cache: " << tempPath << std::endl;
+        std::remove(tempPath.c_str());
+        return false;
+    }
+
+    // The old pack has to be unmapped before it can be replaced on Windows
+    this->mapping.close();
+    std::remove(this->packPath.c_str());
+    if (std::rename(tempPath.c_str(), this->packPath.c_str()) != 0)
+    {
+        std::cout << "Failed to replace texture cache: " << this->packPath << std::endl;
+    }
+    this->pending.clear();
+    this->retired.clear();
+    openPack();
+    return true;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "MappedFile.h"
+#include "Mipmap.h"
+
+// Everything that changes the decoded pixels is part of the cache key
+struct TextureLoadOptions
+{
+    bool flipVertically = false;
+    int desiredChannels = 0; // 0 keeps the channel count of the source image
+    // Only affect how the mips are filtered (see MipChainOptions). The chain is built once and cached, so
+    // the sharper filter costs nothing on warm loads.
+    bool srgb = false;
+    MipFilter mipFilter = MipFilter::Kaiser;
+    bool preserveAlphaCoverage = false;
+};
+
+struct CachedLevel
+{
+    int width;
+    int height;
+    const unsigned char* pixels; // Tightly packed
+};
+
+struct CachedTexture
+{
+    int channels;
+    std::vector<CachedLevel> levels; // Level 0 (full size) first
+};
+
+/// <summary>
+/// Keeps decoded images and their mip chains in a single pack file that is memory mapped at
+/// startup, so warm loads skip JPEG/PNG decoding and mip generation and upload straight from the
+/// mapping. Entries are keyed by the source path, a hash of the source file and the load options;
+/// an edited source image simply misses and replaces its old entry on the next save. load() may be
+/// called from several threads at once (decoding runs unlocked), save() only when no load is running.
+/// </summary>
+class TextureCache
+{
+public:
+    TextureCache(const std::string& packPath);
+
+    /// <summary>
+    /// Fills texture with the pixels of the image at path, decoding it (and queuing it for the
+    /// next save) on a miss. The level pointers stay valid until save() is called or the cache
+    /// is destroyed. Returns false if the image can't be loaded.
+    /// </summary>
+    bool load(const std::string& path, const TextureLoadOptions& options, CachedTexture* texture);
+
+    /// <summary>
+    /// Rewrites the pack file with the entries decoded since it was mapped and maps it again.
+    /// Does nothing if every load was a hit.
+    /// </summary>
+    bool save();
+
+    unsigned int getHitCount() const { return this->hitCount; }
+    unsigned int getMissCount() const { return this->missCount; }
+
+private:
+    struct Entry
+    {
+        std::string path;
+        uint64_t sourceHash;
+        uint32_t flags;
+        int width;
+        int height;
+        int channels;
+        int levelCount;
+        uint64_t dataOffset; // Relative to the start of the pack file
+        uint64_t dataSize;
+    };
+
+    struct PendingTexture
+    {
+        Entry entry;
+        std::vector<MipLevel> levels;
+    };
+
+    void openPack();
+    static bool isValidEntry(const Entry& entry, size_t packSize);
+    static void fillTexture(const Entry& entry, const unsigned char* data, CachedTexture* texture);
+    static void fillPending(const PendingTexture& pending, CachedTexture* texture);
+
+private:
+    std::string packPath;
+    MappedFile mapping;
+    std::unordered_map<uint64_t, Entry> entries; // Key hash -> entry in the mapped pack
+    std::unordered_map<uint64_t, std::unique_ptr<PendingTexture>> pending; // Key hash -> decoded on a miss
+    std::vector<std::unique_ptr<PendingTexture>> retired; // Replaced in pending, their levels may still be in use
+    std::mutex mutex; // Guards entries, pending, retired and the counts
+    unsigned int hitCount;
+    unsigned int missCount;
+};
@@ -0,0 +1,754 @@
+#include "TextureCompression.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <thread>
+
+namespace
+{
+    // 4x4 texels of RGBA8 in row-major order
+    typedef unsigned char Block[16][4];
+
+    // Weights of the 16 interpolated colours of a BC7 block with 4-bit indices (out of 64)
+    const int BC7_WEIGHTS_4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    void fetchBlock(const unsigned char* rgba, int width, int height, int blockX, int blockY, Block block)
+    {
+        for (int y = 0; y < 4; y++)
+        {
+            int srcY = std::min(blockY * 4 + y, height - 1);
+            for (int x = 0; x < 4; x++)
+            {
+                int srcX = std::min(blockX * 4 + x, width - 1);
+                const unsigned char* texel = rgba + 4 * (static_cast<size_t>(srcY) * width + srcX);
+                std::copy(texel, texel + 4, block[y * 4 + x]);
+            }
+        }
+    }
+
+    // Principal axis of the points through power iteration on the covariance matrix.
+    // Used to place the two endpoints along the direction with the most variance.
+    template <int N>
+    void principalAxis(const float points[16][N], float mean[N], float axis[N])
+    {
+        for (int c = 0; c < N; c++)
+        {
+            mean[c] = 0.0f;
+            for (int i = 0; i < 16; i++)
+            {
+                mean[c] += points[i][c];
+            }
+            mean[c] /= 16.0f;
+        }
+
+        float covariance[N][N] = {};
+        for (int i = 0; i < 16; i++)
+        {
+            for (int a = 0; a < N; a++)
+            {
+                for (int b = 0; b < N; b++)
+                {
+                    covariance[a][b] += (points[i][a] - mean[a]) * (points[i][b] - mean[b]);
+                }
+            }
+        }
+
+        for (int c = 0; c < N; c++)
+        {
+            axis[c] = 1.0f;
+        }
+        for (int iteration = 0; iteration < 8; iteration++)
+        {
+            float next[N] = {};
+            float length = 0.0f;
+            for (int a = 0; a < N; a++)
+            {
+                for (int b = 0; b < N; b++)
+                {
+                    next[a] += covariance[a][b] * axis[b];
+                }
+                length = std::max(length, std::fabs(next[a]));
+            }
+            if (length < 1e-6f)
+            {
+                break; // (Nearly) flat block, any axis will do
+            }
+            for (int c = 0; c < N; c++)
+            {
+                axis[c] = next[c] / length;
+            }
+        }
+    }
+
+    // Endpoints at the extremes of the points projected onto the principal axis
+    template <int N>
+    void fitEndpoints(const float points[16][N], float endpoint0[N], float endpoint1[N])
+    {
+        float mean[N];
+        float axis[N];
+        principalAxis<N>(points, mean, axis);
+
+        float minT = std::numeric_limits<float>::max();
+        float maxT = -std::numeric_limits<float>::max();
+        for (int i = 0; i < 16; i++)
+        {
+            float t = 0.0f;
+            for (int c = 0; c < N; c++)
+            {
+                t += (points[i][c] - mean[c]) * axis[c];
+            }
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+        for (int c = 0; c < N; c++)
+        {
+            endpoint0[c] = std::min(std::max(mean[c] + maxT * axis[c], 0.0f), 255.0f);
+            endpoint1[c] = std::min(std::max(mean[c] + minT * axis[c], 0.0f), 255.0f);
+        }
+    }
+
+    // Least squares endpoints for a fixed assignment of points to palette entries.
+    // weights[i] is the contribution of endpoint 0 to point i's palette entry.
+    template <int N>
+    bool refineEndpoints(const float points[16][N], const float weights[16], float endpoint0[N], float endpoint1[N])
+    {
+        float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+        float ax[N] = {}, bx[N] = {};
+        for (int i = 0; i < 16; i++)
+        {
+            float a = weights[i];
+            float b = 1.0f - a;
+            aa += a * a;
+            bb += b * b;
+            ab += a * b;
+            for (int c = 0; c < N; c++)
+            {
+                ax[c] += a * points[i][c];
+                bx[c] += b * points[i][c];
+            }
+        }
+        float determinant = aa * bb - ab * ab;
+        if (std::fabs(determinant) < 1e-6f)
+        {
+            return false;
+        }
+        for (int c = 0; c < N; c++)
+        {
+            endpoint0[c] = std::min(std::max((ax[c] * bb - bx[c] * ab) / determinant, 0.0f), 255.0f);
+            endpoint1[c] = std::min(std::max((bx[c] * aa - ax[c] * ab) / determinant, 0.0f), 255.0f);
+        }
+        return true;
+    }
+
+    // -- BC1 ------------------------------------------------------------------------------------
+
+    uint16_t packRgb565(const float color[3])
+    {
+        int r = static_cast<int>(color[0] * 31.0f / 255.0f + 0.5f);
+        int g = static_cast<int>(color[1] * 63.0f / 255.0f + 0.5f);
+        int b = static_cast<int>(color[2] * 31.0f / 255.0f + 0.5f);
+        return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+    }
+
+    void unpackRgb565(uint16_t packed, int color[3])
+    {
+        int r = (packed >> 11) & 31;
+        int g = (packed >> 5) & 63;
+        int b = packed & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    }
+
+    // Four colour palette (c0 > c1): c0, c1, 2/3 c0 + 1/3 c1, 1/3 c0 + 2/3 c1
+    void bc1Palette(uint16_t c0, uint16_t c1, int palette[4][3])
+    {
+        unpackRgb565(c0, palette[0]);
+        unpackRgb565(c1, palette[1]);
+        for (int c = 0; c < 3; c++)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+    }
+
+    float bc1Indices(const float points[16][3], uint16_t c0, uint16_t c1, unsigned int indices[16])
+    {
+        int palette[4][3];
+        bc1Palette(c0, c1, palette);
+        // Equal endpoints would select the three colour mode, where index 3 is transparent black
+        unsigned int paletteSize = c0 == c1 ? 1 : 4;
+        float totalError = 0.0f;
+        for (int i = 0; i < 16; i++)
+        {
+            float bestError = std::numeric_limits<float>::max();
+            for (unsigned int p = 0; p < paletteSize; p++)
+            {
+                float error = 0.0f;
+                for (int c = 0; c < 3; c++)
+                {
+                    float d = points[i][c] - palette[p][c];
+                    error += d * d;
+                }
+                if (error < bestError)
+                {
+                    bestError = error;
+                    indices[i] = p;
+                }
+            }
+            totalError += bestError;
+        }
+        return totalError;
+    }
+
+    void encodeBc1(const Block block, unsigned char* out)
+    {
+        float points[16][3];
+        for (int i = 0; i < 16; i++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                points[i][c] = block[i][c];
+            }
+        }
+
+        float endpoint0[3], endpoint1[3];
+        fitEndpoints<3>(points, endpoint0, endpoint1);
+
+        uint16_t bestC0 = 0, bestC1 = 0;
+        unsigned int bestIndices[16] = {};
+        float bestError = std::numeric_limits<float>::max();
+        for (int iteration = 0; iteration < 3; iteration++)
+        {
+            uint16_t c0 = packRgb565(endpoint0);
+            uint16_t c1 = packRgb565(endpoint1);
+            if (c0 < c1)
+            {
+                std::swap(c0, c1);
+                std::swap(endpoint0, endpoint1);
+            }
+
+            unsigned int indices[16] = {};
+            float error = bc1Indices(points, c0, c1, indices);
+            if (error < bestError)
+            {
+                bestError = error;
+                bestC0 = c0;
+                bestC1 = c1;
+                std::copy(indices, indices + 16, bestIndices);
+            }
+            if (c0 == c1)
+            {
+                break;
+            }
+
+            const float indexWeights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+            float weights[16];
+            for (int i = 0; i < 16; i++)
+            {
+                weights[i] = indexWeights[indices[i]];
+            }
+            if (!refineEndpoints<3>(points, weights, endpoint0, endpoint1))
+            {
+                break;
+            }
+        }
+
+        uint32_t packedIndices = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            packedIndices |= bestIndices[i] << (2 * i);
+        }
+        out[0] = bestC0 & 0xFF;
+        out[1] = bestC0 >> 8;
+        out[2] = bestC1 & 0xFF;
+        out[3] = bestC1 >> 8;
+        for (int i = 0; i < 4; i++)
+        {
+            out[4 + i] = (packedIndices >> (8 * i)) & 0xFF;
+        }
+    }
+
+    void decodeBc1(const unsigned char* in, Block block)
+    {
+        uint16_t c0 = in[0] | (in[1] << 8);
+        uint16_t c1 = in[2] | (in[3] << 8);
+        int palette[4][3];
+        bc1Palette(c0, c1, palette);
+        if (c0 <= c1)
+        {
+            // Three colour mode, never produced by the encoder but valid in the format
+            for (int c = 0; c < 3; c++)
+            {
+                palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+                palette[3][c] = 0;
+            }
+        }
+        uint32_t packedIndices = in[4] | (in[5] << 8) | (in[6] << 16) | (static_cast<uint32_t>(in[7]) << 24);
+        for (int i = 0; i < 16; i++)
+        {
+            unsigned int index = (packedIndices >> (2 * i)) & 3;
+            for (int c = 0; c < 3; c++)
+            {
+                block[i][c] = static_cast<unsigned char>(palette[index][c]);
+            }
+            block[i][3] = (c0 <= c1 && index == 3) ? 0 : 255;
+        }
+    }
+
+    // -- BC4 ------------------------------------------------------------------------------------
+
+    // Eight value palette (a0 > a1): a0, a1 and six values interpolated between them
+    void bc4Palette(int a0, int a1, int palette[8])
+    {
+        palette[0] = a0;
+        palette[1] = a1;
+        if (a0 > a1)
+        {
+            for (int i = 2; i < 8; i++)
+            {
+                palette[i] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+            }
+        }
+        else
+        {
+            for (int i = 2; i < 6; i++)
+            {
+                palette[i] = ((6 - i) * a0 + (i - 1) * a1) / 5;
+            }
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+    }
+
+    void encodeBc4(const Block block, int channel, unsigned char* out)
+    {
+        int a0 = 0, a1 = 255;
+        for (int i = 0; i < 16; i++)
+        {
+            a0 = std::max(a0, static_cast<int>(block[i][channel]));
+            a1 = std::min(a1, static_cast<int>(block[i][channel]));
+        }
+
+        uint64_t packedIndices = 0;
+        if (a0 > a1)
+        {
+            int palette[8];
+            bc4Palette(a0, a1, palette);
+            for (int i = 0; i < 16; i++)
+            {
+                int bestError = std::numeric_limits<int>::max();
+                uint64_t bestIndex = 0;
+                for (int p = 0; p < 8; p++)
+                {
+                    int error = std::abs(palette[p] - block[i][channel]);
+                    if (error < bestError)
+                    {
+                        bestError = error;
+                        bestIndex = p;
+                    }
+                }
+                packedIndices |= bestIndex << (3 * i);
+            }
+        }
+
+        out[0] = static_cast<unsigned char>(a0);
+        out[1] = static_cast<unsigned char>(a1);
+        for (int i = 0; i < 6; i++)
+        {
+            out[2 + i] = (packedIndices >> (8 * i)) & 0xFF;
+        }
+    }
+
+    void decodeBc4(const unsigned char* in, int channel, Block block)
+    {
+        int palette[8];
+        bc4Palette(in[0], in[1], palette);
+        uint64_t packedIndices = 0;
+        for (int i = 0; i < 6; i++)
+        {
+            packedIndices |= static_cast<uint64_t>(in[2 + i]) << (8 * i);
+        }
+        for (int i = 0; i < 16; i++)
+        {
+            block[i][channel] = static_cast<unsigned char>(palette[(packedIndices >> (3 * i)) & 7]);
+        }
+    }
+
+    // -- BC7 (mode 6) ---------------------------------------------------------------------------
+
+    // Mode 6 stores 7 bits per channel plus one p-bit shared by all channels of an endpoint.
+    // Picks the p-bit that reproduces the endpoint with the smallest error.
+    void quantizeBc7Endpoint(const float endpoint[4], int quantized[4], int* pBit)
+    {
+        float bestError = std::numeric_limits<float>::max();
+        for (int p = 0; p < 2; p++)
+        {
+            int candidate[4];
+            float error = 0.0f;
+            for (int c = 0; c < 4; c++)
+            {
+                candidate[c] = std::min(std::max(static_cast<int>(std::floor((endpoint[c] - p) / 2.0f + 0.5f)), 0), 127);
+                float d = (candidate[c] * 2 + p) - endpoint[c];
+                error += d * d;
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                *pBit = p;
+                std::copy(candidate, candidate + 4, quantized);
+            }
+        }
+    }
+
+    void bc7Palette(const int quantized0[4], int pBit0, const int quantized1[4], int pBit1, int palette[16][4])
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            int e0 = quantized0[c] * 2 + pBit0;
+            int e1 = quantized1[c] * 2 + pBit1;
+            for (int i = 0; i < 16; i++)
+            {
+                palette[i][c] = ((64 - BC7_WEIGHTS_4[i]) * e0 + BC7_WEIGHTS_4[i] * e1 + 32) >> 6;
+            }
+        }
+    }
+
+    // Writes 'count' bits of 'value' at bit 'offset' of a 128-bit block (LSB first)
+    void writeBits(unsigned char* out, int* offset, unsigned int value, int count)
+    {
+        for (int i = 0; i < count; i++, (*offset)++)
+        {
+            if ((value >> i) & 1)
+            {
+                out[*offset / 8] |= 1 << (*offset % 8);
+            }
+        }
+    }
+
+    unsigned int readBits(const unsigned char* in, int* offset, int count)
+    {
+        unsigned int value = 0;
+        for (int i = 0; i < count; i++, (*offset)++)
+        {
+            value |= ((in[*offset / 8] >> (*offset % 8)) & 1u) << i;
+        }
+        return value;
+    }
+
+    void encodeBc7(const Block block, unsigned char* out)
+    {
+        float points[16][4];
+        for (int i = 0; i < 16; i++)
+        {
+            for (int c = 0; c < 4; c++)
+            {
+                points[i][c] = block[i][c];
+            }
+        }
+
+        float endpoint0[4], endpoint1[4];
+        fitEndpoints<4>(points, endpoint0, endpoint1);
+
+        int bestQuantized[2][4] = {};
+        int bestPBits[2] = {};
+        unsigned int bestIndices[16] = {};
+        float bestError = std::numeric_limits<float>::max();
+        for (int iteration = 0; iteration < 3; iteration++)
+        {
+            int quantized[2][4];
+            int pBits[2];
+            quantizeBc7Endpoint(endpoint0, quantized[0], &pBits[0]);
+            quantizeBc7Endpoint(endpoint1, quantized[1], &pBits[1]);
+
+            int palette[16][4];
+            bc7Palette(quantized[0], pBits[0], quantized[1], pBits[1], palette);
+
+            unsigned int indices[16];
+            float error = 0.0f;
+            for (int i = 0; i < 16; i++)
+            {
+                float bestTexelError = std::numeric_limits<float>::max();
+                for (unsigned int p = 0; p < 16; p++)
+                {
+                    float texelError = 0.0f;
+                    for (int c = 0; c < 4; c++)
+                    {
+                        float d = points[i][c] - palette[p][c];
+                        texelError += d * d;
+                    }
+                    if (texelError < bestTexelError)
+                    {
+                        bestTexelError = texelError;
+                        indices[i] = p;
+                    }
+                }
+                error += bestTexelError;
+            }
+
+            if (error < bestError)
+            {
+                bestError = error;
+                std::copy(&quantized[0][0], &quantized[0][0] + 8, &bestQuantized[0][0]);
+                std::copy(pBits, pBits + 2, bestPBits);
+                std::copy(indices, indices + 16, bestIndices);
+            }
+
+            float weights[16];
+            for (int i = 0; i < 16; i++)
+            {
+                weights[i] = 1.0f - BC7_WEIGHTS_4[indices[i]] / 64.0f;
+            }
+            if (!refineEndpoints<4>(points, weights, endpoint0, endpoint1))
+            {
+                break;
+            }
+        }
+
+        // The most significant bit of the first (anchor) index is implicit 0, swap the endpoints if needed
+        if (bestIndices[0] & 8)
+        {
+            std::swap(bestQuantized[0], bestQuantized[1]);
+            std::swap(bestPBits[0], bestPBits[1]);
+            for (int i = 0; i < 16; i++)
+            {
+                bestIndices[i] = 15 - bestIndices[i];
+            }
+        }
+
+        std::fill(out, out + 16, 0);
+        int offset = 0;
+        writeBits(out, &offset, 1 << 6, 7); // Mode 6
+        for (int c = 0; c < 4; c++)
+        {
+            writeBits(out, &offset, bestQuantized[0][c], 7);
+            writeBits(out, &offset, bestQuantized[1][c], 7);
+        }
+        writeBits(out, &offset, bestPBits[0], 1);
+        writeBits(out, &offset, bestPBits[1], 1);
+        writeBits(out, &offset, bestIndices[0], 3);
+        for (int i = 1; i < 16; i++)
+        {
+            writeBits(out, &offset, bestIndices[i], 4);
+        }
+    }
+
+    // Only decodes mode 6 blocks (what the encoder writes), other modes decode to magenta
+    void decodeBc7(const unsigned char* in, Block block)
+    {
+        int offset = 0;
+        if (readBits(in, &offset, 7) != (1 << 6))
+        {
+            for (int i = 0; i < 16; i++)
+            {
+                block[i][0] = 255;
+                block[i][1] = 0;
+                block[i][2] = 255;
+                block[i][3] = 255;
+            }
+            return;
+        }
+
+        int quantized[2][4];
+        for (int c = 0; c < 4; c++)
+        {
+            quantized[0][c] = readBits(in, &offset, 7);
+            quantized[1][c] = readBits(in, &offset, 7);
+        }
+        int pBit0 = readBits(in, &offset, 1);
+        int pBit1 = readBits(in, &offset, 1);
+
+        int palette[16][4];
+        bc7Palette(quantized[0], pBit0, quantized[1], pBit1, palette);
+        for (int i = 0; i < 16; i++)
+        {
+            unsigned int index = readBits(in, &offset, i == 0 ? 3 : 4);
+            for (int c = 0; c < 4; c++)
+            {
+                block[i][c] = static_cast<unsigned char>(palette[index][c]);
+            }
+        }
+    }
+
+    // -------------------------------------------------------------------------------------------
+
+    void encodeBlock(const Block block, BlockFormat format, unsigned char* out)
+    {
+        switch (format)
+        {
+        case BlockFormat::BC1:
+            encodeBc1(block, out);
+            break;
+        case BlockFormat::BC3:
+            encodeBc4(block, 3, out);
+            encodeBc1(block, out + 8);
+            break;
+        case BlockFormat::BC4:
+            encodeBc4(block, 0, out);
+            break;
+        case BlockFormat::BC5:
+            encodeBc4(block, 0, out);
+            encodeBc4(block, 1, out + 8);
+            break;
+        case BlockFormat::BC7:
+            encodeBc7(block, out);
+            break;
+        }
+    }
+
+    void decodeBlock(const unsigned char* in, BlockFormat format, Block block)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            block[i][0] = block[i][1] = block[i][2] = 0;
+            block[i][3] = 255;
+        }
+        switch (format)
+        {
+        case BlockFormat::BC1:
+            decodeBc1(in, block);
+            break;
+        case BlockFormat::BC3:
+            decodeBc1(in + 8, block);
+            decodeBc4(in, 3, block);
+            break;
+        case BlockFormat::BC4:
+            decodeBc4(in, 0, block);
+            break;
+        case BlockFormat::BC5:
+            decodeBc4(in, 0, block);
+            decodeBc4(in + 8, 1, block);
+            break;
+        case BlockFormat::BC7:
+            decodeBc7(in, block);
+            break;
+        }
+    }
+}
+
+unsigned int blockSize(BlockFormat format)
+{
+    return (format == BlockFormat::BC1 || format == BlockFormat::BC4) ? 8 : 16;
+}
+
+const char* blockFormatName(BlockFormat format)
+{
+    switch (format)
+    {
+    case BlockFormat::BC1: return "BC1";
+    case BlockFormat::BC3: return "BC3";
+    case BlockFormat::BC4: return "BC4";
+    case BlockFormat::BC5: return "BC5";
+    case BlockFormat::BC7: return "BC7";
+    }
+    return "?";
+}
+
+bool parseBlockFormat(const std::string& name, BlockFormat* format)
+{
+    const BlockFormat formats[] = { BlockFormat::BC1, BlockFormat::BC3, BlockFormat::BC4, BlockFormat::BC5, BlockFormat::BC7 };
+    for (BlockFormat candidate : formats)
+    {
+        std::string candidateName = blockFormatName(candidate);
+        std::string lowerName = candidateName;
+        std::transform(lowerName.begin(), lowerName.end(), lowerName.begin(), ::tolower);
+        if (name == candidateName || name == lowerName)
+        {
+            *format = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<unsigned char> compressImage(const unsigned char* rgba, int width, int height, BlockFormat format,
+    unsigned int threadCount)
+{
+    int blocksX = (width + 3) / 4;
+    int blocksY = (height + 3) / 4;
+    unsigned int size = blockSize(format);
+    std::vector<unsigned char> blocks(static_cast<size_t>(blocksX) * blocksY * size);
+
+    if (threadCount == 0)
+    {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threadCount = std::min(threadCount, static_cast<unsigned int>(blocksY));
+
+    // Every thread encodes an interleaved set of block rows, so the work stays balanced even when
+    // one part of the image is much more expensive to encode than another
+    auto encodeRows = [&](unsigned int first)
+    {
+        Block block;
+        for (int blockY = first; blockY < blocksY; blockY += threadCount)
+        {
+            for (int blockX = 0; blockX < blocksX; blockX++)
+            {
+                fetchBlock(rgba, width, height, blockX, blockY, block);
+                encodeBlock(block, format, &blocks[(static_cast<size_t>(blockY) * blocksX + blockX) * size]);
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < threadCount; i++)
+    {
+        workers.emplace_back(encodeRows, i);
+    }
+    encodeRows(0);
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+
+    return blocks;
+}
+
+std::vector<unsigned char> decompressImage(const unsigned char* blocks, int width, int height, BlockFormat format)
+{
+    int blocksX = (width + 3) / 4;
+    int blocksY = (height + 3) / 4;
+    unsigned int size = blockSize(format);
+    std::vector<unsigned char> rgba(4 * static_cast<size_t>(width) * height);
+
+    Block block;
+    for (int blockY = 0; blockY < blocksY; blockY++)
+    {
+        for (int blockX = 0; blockX < blocksX; blockX++)
+        {
+            decodeBlock(&blocks[(static_cast<size_t>(blockY) * blocksX + blockX) * size], format, block);
+            for (int y = 0; y < 4 && blockY * 4 + y < height; y++)
+            {
+                for (int x = 0; x < 4 && blockX * 4 + x < width; x++)
+                {
+                    size_t dst = 4 * (static_cast<size_t>(blockY * 4 + y) * width + blockX * 4 + x);
+                    std::copy(block[y * 4 + x], block[y * 4 + x] + 4, &rgba[dst]);
+                }
+            }
+        }
+    }
+    return rgba;
+}
+
+double computePsnr(const unsigned char* reference, const unsigned char* test, int width, int height, int channels)
+{
+    double squaredError = 0.0;
+    size_t texelCount = static_cast<size_t>(width) * height;
+    for (size_t i = 0; i < texelCount; i++)
+    {
+        for (int c = 0; c < channels; c++)
+        {
+            double d = static_cast<double>(reference[4 * i + c]) - test[4 * i + c];
+            squaredError += d * d;
+        }
+    }
+    double mse = squaredError / (static_cast<double>(texelCount) * channels);
+    if (mse == 0.0)
+    {
+        return std::numeric_limits<double>::infinity();
+    }
+    return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Block compressed formats produced by the texture baker. All of them encode 4x4 texel blocks.
+enum class BlockFormat
+{
+    BC1, // RGB, 8 bytes per block. Colour/data maps without alpha
+    BC3, // RGBA, 16 bytes per block. BC4 alpha block followed by a BC1 colour block
+    BC4, // R, 8 bytes per block. Single channel maps (roughness, ao)
+    BC5, // RG, 16 bytes per block. Tangent space normal maps, z has to be reconstructed in the shader
+    BC7  // RGBA, 16 bytes per block. High quality colour maps (only mode 6 is used by the encoder)
+};
+
+unsigned int blockSize(BlockFormat format);
+const char* blockFormatName(BlockFormat format);
+bool parseBlockFormat(const std::string& name, BlockFormat* format);
+
+/// <summary>
+/// Compresses RGBA8 pixels into blocks of the given format. Sizes that aren't a multiple of 4 are
+/// padded by repeating the edge texels. Rows of blocks are split across threadCount threads
+/// (0 uses all hardware threads).
+/// </summary>
+std::vector<unsigned char> compressImage(const unsigned char* rgba, int width, int height, BlockFormat format,
+    unsigned int threadCount = 0);
+
+/// <summary>
+/// Decodes blocks back into RGBA8 pixels (channels the format doesn't store are 0, alpha 255).
+/// Used to measure the encoding error.
+/// </summary>
+std::vector<unsigned char> decompressImage(const unsigned char* blocks, int width, int height, BlockFormat format);
+
+/// <summary>
+/// Peak signal-to-noise ratio in dB over the first 'channels' channels of two RGBA8 images.
+/// Returns infinity for identical images.
+/// </summary>
+double computePsnr(const unsigned char* reference, const unsigned char* test, int width, int height, int channels);
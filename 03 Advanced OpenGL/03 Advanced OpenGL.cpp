@@ -13,16 +13,54 @@
 
 #include "shader.h"
 #include "camera.h"
+#include "foliage.h"
+#include "frame_graph.h"
+#include "frustum.h"
+#include "gl_frame_graph_backend.h"
+#include "gl_instrumentation.h"
+#include "gpu_profiler.h"
+#include "headless.h"
+#include "mipmap.h"
+#include "outline.h"
+#include "perf_overlay.h"
+#include "profiler.h"
+#include "texture.h"
+#include "texture_array.h"
+#include "texture_cache.h"
+#include "transparency.h"
 //#include "model.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <random>
 #include <vector>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow* window);
-unsigned int loadTexture(const char* path);
+GLFWwindow* createWindow(bool debugContext);
+unsigned int loadTexture(TextureCache& cache, const char* path, TextureImportDesc desc = ColorTextureDesc());
+int addPackedTexture(TextureCache& cache, TexturePacker& packer, const char* path, TextureImportDesc desc = ColorTextureDesc());
+bool importDescForFile(const char* path, TextureImportDesc* desc);
+void benchmarkMipmapGeneration(const char* path);
+void benchmarkTransparentSort(size_t count);
+void benchmarkOutlines(unsigned int cubeVAO, Shader& shader, Shader& shaderSingleColor, OutlineRenderer& outline, unsigned int targetFramebuffer, int width, int height);
+
+// a glass pane as the instanced attributes of shaders/transparent.vert
+struct PaneInstance {
+    glm::vec4 CenterSize; // xyz centre, w size
+    glm::vec4 Color; // linear rgb, a opacity
+};
+
+// decoded textures with their mips, built on the first run and memory mapped on the later ones
+#define TEXTURE_CACHE_PATH "texture_cache.pack"
 
 // settings
 const unsigned int SCR_WIDTH = 800;
@@ -38,42 +76,48 @@ bool firstMouse = true;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
-int main()
-{
-    // glfw: initialize and configure
-    // ------------------------------
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+// overlay: F1 shows/hides it, Tab frees the mouse to click it (the camera stops looking around meanwhile)
+bool overlayVisible = true;
+bool cursorCaptured = true;
 
-#ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-#endif
-
-    // glfw window creation
-    // --------------------
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
-    if (window == NULL)
+int main(int argc, char* argv[])
+{
+    // time the transparent sort on the CPU and exit, no window needed (run with --bench-transparency [count])
+    // ---------------------------------------------------------------------------------------------------
+    for (int i = 1; i < argc; i++)
     {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
+        if (std::strcmp(argv[i], "--bench-transparency") == 0)
+        {
+            benchmarkTransparentSort(i + 1 < argc ? std::strtoul(argv[i + 1], nullptr, 10) : 0);
+            return 0;
+        }
     }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-
-    // tell GLFW to capture our mouse
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-    // glad: load all OpenGL function pointers
-    // ---------------------------------------
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    // run without a window (EGL surfaceless / hidden window) for a fixed number of frames when --headless is passed
+    // ------------------------------------------------------------------------------------------------------------
+    HeadlessOptions headless = ParseHeadlessOptions(argc, argv, SCR_WIDTH, SCR_HEIGHT);
+    HeadlessContext headlessContext;
+    GLFWwindow* window = NULL;
+    if (headless.Enabled)
     {
-        std::cout << "Failed to initialize GLAD" << std::endl;
-        return -1;
+        if (!headlessContext.Create(headless.Width, headless.Height, headless.GlCalls))
+            return -1;
+    }
+    else
+    {
+        window = createWindow(headless.GlCalls);
+        if (window == NULL)
+            return -1;
+    }
+    // counts draws and state changes per frame and tracks the memory of the buffers and textures created below
+    InstallRenderStatsHooks();
+    // --gl-calls: counts and times every GL call and collects the driver's performance warnings
+    if (headless.GlCalls)
+    {
+        if (headless.Enabled)
+            InstallGlInstrumentation(HeadlessContext::GetProcAddress);
+        else
+            InstallGlInstrumentation([](const char* name) { return reinterpret_cast<void*>(glfwGetProcAddress(name)); });
     }
 
     // configure global opengl state
@@ -90,6 +134,11 @@ int main()
     // -------------------------
     Shader shader("shaders/1.1.depth_testing.vert", "shaders/1.1.depth_testing.frag");
     Shader shaderSingleColor("shaders/1.1.depth_testing.vert", "shaders/shader_single_color.frag");
+    Shader shaderTextureArray("shaders/1.1.depth_testing.vert", "shaders/texture_array.frag");
+    Shader shaderFoliage("shaders/foliage.vert", "shaders/foliage.frag");
+    Shader shaderTransparent("shaders/transparent.vert", "shaders/transparent.frag");
+    Shader shaderOitAccumulate("shaders/transparent.vert", "shaders/oit_accumulate.frag");
+    Shader shaderOitComposite("shaders/fullscreen.vert", "shaders/oit_composite.frag");
 
     // set up vertex data (and buffer(s)) and configure vertex attributes
     // ------------------------------------------------------------------
@@ -160,6 +209,17 @@ int main()
         1.0f,  0.5f,  0.0f,  1.0f,  0.0f
     };
 
+    float paneVertices[] = {
+        // positions, a unit quad around the pane's centre
+        -0.5f, -0.5f,  0.0f,
+         0.5f, -0.5f,  0.0f,
+         0.5f,  0.5f,  0.0f,
+
+         0.5f,  0.5f,  0.0f,
+        -0.5f,  0.5f,  0.0f,
+        -0.5f, -0.5f,  0.0f
+    };
+
     // cube VAO
     unsigned int cubeVAO, cubeVBO;
     glGenVertexArrays(1, &cubeVAO);
@@ -192,6 +252,62 @@ int main()
     vegetation.push_back(glm::vec3(-0.3f, 0.0f, -2.3f));
     vegetation.push_back(glm::vec3(0.5f, 0.0f, -0.6f));
 
+    // tinted glass panes overlapping in front of the scene, --transparent-panes N adds N more at random spots
+    std::vector<PaneInstance> panes;
+    panes.push_back({ glm::vec4(-0.4f, 0.0f, 1.6f, 0.8f), glm::vec4(0.8f, 0.05f, 0.05f, 0.4f) });
+    panes.push_back({ glm::vec4(0.0f, 0.1f, 1.3f, 0.8f), glm::vec4(0.05f, 0.6f, 0.05f, 0.4f) });
+    panes.push_back({ glm::vec4(0.4f, 0.2f, 1.0f, 0.8f), glm::vec4(0.05f, 0.1f, 0.8f, 0.4f) });
+    panes.push_back({ glm::vec4(1.2f, 0.3f, -1.5f, 1.2f), glm::vec4(0.7f, 0.6f, 0.1f, 0.5f) });
+    bool weightedOit = false;
+    bool sortTransparent = true;
+    unsigned int grassBlades = 1000000;
+    bool stencilOutline = false;
+    const char* frameGraphPath = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--transparent-panes") == 0 && i + 1 < argc)
+        {
+            // seeded, so runs compare the same scene
+            std::mt19937 random(43);
+            std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+            unsigned long count = std::strtoul(argv[++i], nullptr, 10);
+            for (unsigned long pane = 0; pane < count; pane++)
+            {
+                glm::vec4 centerSize(unit(random) * 9.0f - 4.5f, unit(random) * 1.5f - 0.2f, unit(random) * 9.0f - 4.5f, 0.3f + unit(random) * 0.7f);
+                glm::vec4 color(unit(random), unit(random), unit(random), 0.2f + unit(random) * 0.4f);
+                panes.push_back({ centerSize, color });
+            }
+        }
+        else if (std::strcmp(argv[i], "--oit") == 0)
+            weightedOit = true;
+        else if (std::strcmp(argv[i], "--no-transparent-sort") == 0)
+            sortTransparent = false;
+        else if (std::strcmp(argv[i], "--grass-blades") == 0 && i + 1 < argc)
+            grassBlades = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        else if (std::strcmp(argv[i], "--stencil-outline") == 0)
+            stencilOutline = true;
+        else if (std::strcmp(argv[i], "--frame-graph") == 0 && i + 1 < argc)
+            frameGraphPath = argv[++i];
+    }
+
+    // both sorted back to front every frame. The grass is alpha tested and still writes depth, it only blends
+    // its soft edges, so it is drawn before the panes, which don't write depth.
+    TransparentBucket grassBucket;
+    for (glm::vec3 grassPos : vegetation)
+        grassBucket.Add(grassPos + glm::vec3(0.5f, 0.0f, 0.0f)); // the quad spans x 0..1 from its position
+    TransparentBucket paneBucket;
+    for (const PaneInstance& pane : panes)
+        paneBucket.Add(glm::vec3(pane.CenterSize));
+
+    glm::vec3 cubePositions[] = {
+        glm::vec3(-1.0f, 0.0f, -1.0f),
+        glm::vec3(2.0f, 0.0f, 0.0f)
+    };
+    // the outlined cubes, by index into cubePositions
+    SelectionSet selection;
+    selection.Select(0);
+    selection.Select(1);
+
     unsigned int grassVAO, grassVBO;
     glGenVertexArrays(1, &grassVAO);
     glGenBuffers(1, &grassVBO);
@@ -204,11 +320,88 @@ int main()
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
     glBindVertexArray(0);
 
-    // load textures
-    // -------------
-    unsigned int cubeTexture = loadTexture("textures/marble.jpg");
-    unsigned int floorTexture = loadTexture("textures/metal.png");
-    unsigned int grassTexture = loadTexture("textures/grass.png");
+    // pane VAO: the quad per vertex, the instances' centre, size and colour per instance from a buffer that is
+    // rewritten in sorted order every frame
+    unsigned int paneVAO, paneVBO, paneInstanceVBO;
+    glGenVertexArrays(1, &paneVAO);
+    glGenBuffers(1, &paneVBO);
+    glGenBuffers(1, &paneInstanceVBO);
+    glBindVertexArray(paneVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, paneVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(paneVertices), paneVertices, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glBindBuffer(GL_ARRAY_BUFFER, paneInstanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, panes.size() * sizeof(PaneInstance), panes.data(), GL_STREAM_DRAW);
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(PaneInstance), (void*)offsetof(PaneInstance, CenterSize));
+    glVertexAttribDivisor(2, 1);
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(PaneInstance), (void*)offsetof(PaneInstance, Color));
+    glVertexAttribDivisor(3, 1);
+    glBindVertexArray(0);
+    std::vector<PaneInstance> sortedPanes(panes.size());
+    bool panesUploadedSorted = false;
+    WeightedBlendedOit oit;
+    oit.Init();
+
+    // a field of grass blades over the floor (--grass-blades N, 1M by default), seeded so every run scatters the
+    // same field
+    Foliage foliage;
+    foliage.Init(grassBlades, glm::vec2(-5.0f), glm::vec2(5.0f), -0.5f, 44);
+
+    // the post-process outline, the stencil one draws every selected object a second time instead
+    OutlineRenderer outline;
+    outline.Init();
+    unsigned int targetFramebuffer = headless.Enabled ? headlessContext.Framebuffer() : 0;
+
+    // benchmarks that run instead of the render loop and exit: --bench-outline times the stencil outline against
+    // the post-process one, --bench-mipmaps compares the CPU mip chain against the driver's glGenerateMipmap
+    // ------------------------------------------------------------------------------------------------------------
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--bench-outline") == 0)
+        {
+            benchmarkOutlines(cubeVAO, shader, shaderSingleColor, outline, targetFramebuffer, headless.Width, headless.Height);
+            outline.Release();
+            if (headless.Enabled)
+                headlessContext.Destroy();
+            else
+                glfwTerminate();
+            return 0;
+        }
+        if (std::strcmp(argv[i], "--bench-mipmaps") == 0)
+        {
+            benchmarkMipmapGeneration("textures/marble.jpg");
+            benchmarkMipmapGeneration("textures/metal.png");
+            benchmarkMipmapGeneration("textures/grass.png");
+            if (headless.Enabled)
+                headlessContext.Destroy();
+            else
+                glfwTerminate();
+            return 0;
+        }
+    }
+
+    // load textures. The first run decodes them and builds their mips on the CPU, later runs upload from the cache
+    // --------------------------------------------------------------------------------------------------------------
+    auto texturesStart = std::chrono::steady_clock::now();
+    TextureCache textureCache(TEXTURE_CACHE_PATH);
+    unsigned int cubeTexture = loadTexture(textureCache, "textures/marble.jpg");
+    unsigned int floorTexture = loadTexture(textureCache, "textures/metal.png");
+    unsigned int grassTexture = loadTexture(textureCache, "textures/grass.png");
+
+    // the same textures packed into texture arrays, bound once per frame instead of once per material
+    TexturePacker texturePacker;
+    int cubePacked = addPackedTexture(textureCache, texturePacker, "textures/marble.jpg");
+    int floorPacked = addPackedTexture(textureCache, texturePacker, "textures/metal.png");
+    int grassPacked = addPackedTexture(textureCache, texturePacker, "textures/grass.png");
+    texturePacker.Build();
+    bool texturesCold = textureCache.MissCount() > 0;
+    textureCache.Save();
+    std::cout << "Textures loaded (" << (texturesCold ? "cold" : "warm") << "): "
+        << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - texturesStart).count() << " ms, "
+        << textureCache.HitCount() << " cache hits, " << textureCache.MissCount() << " misses" << std::endl;
 
     // shader configuration
     // --------------------
@@ -219,137 +412,511 @@ int main()
     ImGui::CreateContext();
     ImGuiIO& io = ImGui::GetIO();
     ImGui::StyleColorsDark();
-    ImGui_ImplGlfw_InitForOpenGL(window, true);
+    if (window)
+        ImGui_ImplGlfw_InitForOpenGL(window, true);
+    else
+        io.DisplaySize = ImVec2((float)headless.Width, (float)headless.Height);
     ImGui_ImplOpenGL3_Init("#version 330");
 
-    // render loop
-    // -----------
-    while (!glfwWindowShouldClose(window))
+    // headless runs replay a camera path (recorded with --record-camera or an orbit around the scene), windowed runs
+    // can record one
+    FrameStats headlessStats;
+    CameraPath cameraPath = CameraPath::Orbit(glm::vec3(0.5f, 0.0f, -0.5f), 4.0f, 1.0f, headless.Frames);
+    if (!headless.CameraPathFile.empty() && !cameraPath.Load(headless.CameraPathFile))
     {
+        std::cout << "Failed to load camera path: " << headless.CameraPathFile << std::endl;
+        return -1;
+    }
+    CameraPath recordedPath;
+
+    // the overlay shows the zones of the previous frame and GPU pass times read back a few frames later
+    std::vector<ProfileEvent> lastFrameZones;
+    long long lastFrameBegin = 0;
+    GpuProfiler gpuProfiler;
+    gpuProfiler.Init();
+    // the render passes are declared every frame and run by the frame graph, which times each of them
+    FrameGraph frameGraph;
+    GlFrameGraphBackend frameGraphBackend;
+    frameGraphBackend.Profiler = &gpuProfiler;
+    PerfOverlay overlay;
+    SceneToggles toggles;
+    toggles.SortTransparent = sortTransparent;
+    toggles.WeightedOit = weightedOit;
+    toggles.PostProcessOutline = !stencilOutline;
+
+    // render loop, warmup frames (negative) replay the start of the camera path and are not measured
+    // -----------------------------------------------------------------------------------------------
+    for (int frame = headless.Enabled ? -headless.WarmupFrames : 0; headless.Enabled ? frame < headless.Frames : !glfwWindowShouldClose(window); frame++)
+    {
+        long long frameBegin = Profiler::Now();
+        if (lastFrameBegin != 0)
+        {
+            lastFrameZones = Profiler::Collect(lastFrameBegin, frameBegin);
+            overlay.AddFrameTime(static_cast<float>((frameBegin - lastFrameBegin) / 1e6));
+        }
+        lastFrameBegin = frameBegin;
+        PROFILE_SCOPE("Frame");
+        gpuProfiler.BeginFrame();
+        auto frameStart = std::chrono::steady_clock::now();
+
         // per-frame time logic
         // --------------------
-        float currentFrame = static_cast<float>(glfwGetTime());
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+        if (headless.Enabled)
+        {
+            // fixed timestep and camera path so runs on different machines render the same frames
+            deltaTime = 1.0f / 60.0f;
+            cameraPath.Apply(camera, frame < 0 ? frame + headless.WarmupFrames : frame);
+        }
+        else
+        {
+            float currentFrame = static_cast<float>(glfwGetTime());
+            deltaTime = currentFrame - lastFrame;
+            lastFrame = currentFrame;
 
-        // input
-        // -----
-        processInput(window);
+            // input
+            // -----
+            processInput(window);
+            if (!headless.RecordCameraPathFile.empty())
+                recordedPath.Record(camera.Position, camera.Front);
+        }
 
         // render
         // ------
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+        ResetRenderStats();
+        ResetGlCallCounters();
+        int frameWidth = static_cast<int>(headless.Width);
+        int frameHeight = static_cast<int>(headless.Height);
+        if (window)
+            glfwGetFramebufferSize(window, &frameWidth, &frameHeight);
+        glEnable(GL_FRAMEBUFFER_SRGB);
+        TextureBindCount() = 0;
 
         ImGui_ImplOpenGL3_NewFrame();
-        ImGui_ImplGlfw_NewFrame();
+        if (window)
+            ImGui_ImplGlfw_NewFrame();
+        else
+            io.DeltaTime = deltaTime;
         ImGui::NewFrame();
 
-        glStencilFunc(GL_NOTEQUAL, 1, 0xFF); // All fragments should pass the stencil test
-        glStencilMask(0x00); // Draw floor as normal, but don't write the floor to the stencil buffer
-        shader.use();
+        // separate textures: a bind per material. Packed textures: the arrays are bound once and every draw only
+        // sets which array unit, layer and atlas rectangle to sample
+        Shader& sceneShader = toggles.PackedTextures ? shaderTextureArray : shader;
+        sceneShader.use();
+        if (toggles.PackedTextures)
+            texturePacker.BindArrays(0);
+        auto useTexture = [&](unsigned int texture, int packedHandle)
+        {
+            if (toggles.PackedTextures)
+            {
+                if (packedHandle < 0)
+                    return;
+                const PackedTexture& packed = texturePacker.Get(packedHandle);
+                sceneShader.setInt("textures", packed.ArrayIndex);
+                sceneShader.setFloat("layer", static_cast<float>(packed.Layer));
+                sceneShader.setVec4("uvRect", packed.UVRect);
+            }
+            else
+                BindTexture(GL_TEXTURE_2D, texture);
+        };
 
         glm::mat4 model = glm::mat4(1.0f);
         glm::mat4 view = camera.GetViewMatrix();
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-
-        // floor
-        glBindVertexArray(planeVAO);
-        glBindTexture(GL_TEXTURE_2D, floorTexture);
-        shader.setMat4("model", glm::mat4(1.0f));
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        glBindVertexArray(0);
-
-        glBindVertexArray(grassVAO);
-        glBindTexture(GL_TEXTURE_2D, grassTexture);
-        for (glm::vec3 grassPos : vegetation)
+        // the aspect of what we draw into, which follows the window (and is larger than it on high DPI displays).
+        // A minimized window has an empty framebuffer.
+        float aspect = frameWidth > 0 && frameHeight > 0 ? (float)frameWidth / (float)frameHeight : (float)SCR_WIDTH / (float)SCR_HEIGHT;
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), aspect, 0.1f, 100.0f);
+        sceneShader.setMat4("view", view);
+        sceneShader.setMat4("projection", projection);
+
+        // bounding spheres against the view frustum, the floor covers most of the view and is always drawn
+        Frustum frustum = Frustum::FromMatrix(projection * view);
+        CullingStats culling;
+        auto visible = [&](const glm::vec3& center, float radius)
+        {
+            if (!toggles.Culling)
+                return true;
+            culling.Tested++;
+            bool inside = frustum.IntersectsSphere(center, radius);
+            if (!inside)
+                culling.Culled++;
+            return inside;
+        };
+        // the outline cubes are scaled by 1.05, their sphere covers the cubes too
+        const float CUBE_RADIUS = 0.87f * 1.05f;
+        bool cubeVisible[2] = { visible(cubePositions[0], CUBE_RADIUS), visible(cubePositions[1], CUBE_RADIUS) };
+
+        // the passes of the frame with the targets they read and write, run by frameGraph.Execute below. Whatever
+        // they draw ends up in the target (the window or the headless framebuffer).
+        frameGraph.Reset();
+        FrameGraphResource target = frameGraph.Import("Target", targetFramebuffer, frameWidth, frameHeight);
+        // the post-process outline needs the selection mask next to the colour, so the opaque passes render into
+        // transient targets and the outline pass copies them to the target
+        bool postProcessOutline = toggles.Outline && toggles.PostProcessOutline && selection.Count() > 0;
+        FrameGraphResource sceneColor = target;
+        FrameGraphResource sceneDepth = FRAME_GRAPH_NO_RESOURCE; // the target has its own
+
+        FrameGraphPassBuilder floorPass = frameGraph.AddPass("Floor", [&](FrameGraphContext&)
         {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, grassPos);
-            shader.setMat4("model", model);
+            glClearColor(0.01f, 0.01f, 0.01f, 1.0f); // linear value of the 0.1 grey we used before
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+            glStencilFunc(GL_NOTEQUAL, 1, 0xFF); // All fragments should pass the stencil test
+            glStencilMask(0x00); // Draw floor as normal, but don't write the floor to the stencil buffer
+
+            // floor
+            glBindVertexArray(planeVAO);
+            useTexture(floorTexture, floorPacked);
+            sceneShader.setMat4("model", glm::mat4(1.0f));
             glDrawArrays(GL_TRIANGLES, 0, 6);
+            glBindVertexArray(0);
+        });
+        if (postProcessOutline)
+        {
+            sceneColor = floorPass.Create("Scene colour", { frameWidth, frameHeight, GL_SRGB8_ALPHA8 });
+            // the same format as the target's, the outline pass blits it over
+            sceneDepth = floorPass.Create("Scene depth", { frameWidth, frameHeight, GL_DEPTH24_STENCIL8 });
+        }
+        else
+            sceneColor = floorPass.Write(sceneColor);
+
+        FoliageStats foliageStats;
+        if (toggles.Foliage && foliage.Blades() > 0)
+        {
+            FrameGraphPassBuilder pass = frameGraph.AddPass("Foliage", [&](FrameGraphContext&)
+            {
+                shaderFoliage.use();
+                shaderFoliage.setMat4("view", view);
+                shaderFoliage.setMat4("projection", projection);
+                // blades are seen from both sides
+                glDisable(GL_CULL_FACE);
+                foliageStats = foliage.Draw(frustum, camera.Position, toggles.Culling);
+                glEnable(GL_CULL_FACE);
+            });
+            sceneColor = pass.Write(sceneColor);
+            sceneDepth = pass.Write(sceneDepth);
+        }
+
+        FrameGraphResource selectionMask = FRAME_GRAPH_NO_RESOURCE;
+        {
+            FrameGraphPassBuilder pass = frameGraph.AddPass("Cubes", [&](FrameGraphContext&)
+            {
+                // 1st render pass: Draw objects as normal, the selected ones writing to the stencil buffer (or the
+                // selection mask of the post-process outline)
+                glStencilFunc(GL_ALWAYS, 1, 0xFF);
+                if (postProcessOutline)
+                {
+                    const float zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+                    glClearBufferfv(GL_COLOR, 1, zero);
+                }
+
+                // cubes
+                sceneShader.use();
+                glBindVertexArray(cubeVAO);
+                useTexture(cubeTexture, cubePacked);
+                for (int i = 0; i < 2; i++)
+                {
+                    if (!cubeVisible[i])
+                        continue;
+                    bool selected = selection.IsSelected(i);
+                    if (postProcessOutline)
+                        sceneShader.setFloat("selected", selected ? 1.0f : 0.0f);
+                    else
+                        glStencilMask(selected ? 0xFF : 0x00);
+                    model = glm::mat4(1.0f);
+                    model = glm::translate(model, cubePositions[i]);
+                    sceneShader.setMat4("model", model);
+                    glDrawArrays(GL_TRIANGLES, 0, 36);
+                }
+                glStencilMask(0xFF);
+            });
+            sceneColor = pass.Write(sceneColor);
+            if (postProcessOutline)
+                selectionMask = OutlineRenderer::CreateMask(pass, frameWidth, frameHeight);
+            sceneDepth = pass.Write(sceneDepth);
+        }
+
+        if (postProcessOutline)
+            target = outline.AddPasses(frameGraph, sceneColor, sceneDepth, selectionMask, target);
+        else if (toggles.Outline)
+        {
+            target = frameGraph.AddPass("Outline", [&](FrameGraphContext&)
+            {
+                // 2nd render pass: Draw slightly scaled versions of the objects while stencil writing is
+                // disabled because the stencil buffer is now filled with several 1s. The parts of the buffer
+                // that are 1 are not drawn.
+                glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
+                glStencilMask(0x00); // disable writing to the stencil buffer
+                glDisable(GL_DEPTH_TEST);
+
+                shaderSingleColor.use();
+                shaderSingleColor.setMat4("view", view);
+                shaderSingleColor.setMat4("projection", projection);
+                // Scaled-up cubes
+                const float SCALE = 1.05f;
+                glBindVertexArray(cubeVAO);
+                // the outline doesn't sample, so this bind is only there in the separate textures path
+                if (!toggles.PackedTextures)
+                    BindTexture(GL_TEXTURE_2D, cubeTexture);
+                for (int i = 0; i < 2; i++)
+                {
+                    if (!cubeVisible[i] || !selection.IsSelected(i))
+                        continue;
+                    model = glm::mat4(1.0f);
+                    model = glm::translate(model, cubePositions[i]);
+                    model = glm::scale(model, glm::vec3(SCALE));
+                    shaderSingleColor.setMat4("model", model);
+                    glDrawArrays(GL_TRIANGLES, 0, 36);
+                }
+                glBindVertexArray(0);
+
+                glStencilMask(0xFF);
+                glStencilFunc(GL_ALWAYS, 1, 0xFF);
+                glEnable(GL_DEPTH_TEST);
+            }).Write(sceneColor);
+        }
+        else
+            target = sceneColor;
+
+        // transparent surfaces after everything opaque, blended over it
+        if (toggles.Grass)
+        {
+            target = frameGraph.AddPass("Grass", [&](FrameGraphContext&)
+            {
+                if (toggles.SortTransparent)
+                    grassBucket.Sort(camera.Position, camera.Front);
+                sceneShader.use();
+                glBindVertexArray(grassVAO);
+                useTexture(grassTexture, grassPacked);
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                for (unsigned int index : grassBucket.Order())
+                {
+                    if (!visible(grassBucket.Center(index), 0.71f))
+                        continue;
+                    model = glm::mat4(1.0f);
+                    model = glm::translate(model, vegetation[index]);
+                    sceneShader.setMat4("model", model);
+                    glDrawArrays(GL_TRIANGLES, 0, 6);
+                }
+                glDisable(GL_BLEND);
+                glBindVertexArray(0);
+            }).Write(target);
+        }
+
+        auto uploadPanes = [&]()
+        {
+            // weighted blended OIT doesn't care about the order, the panes stay as they were uploaded
+            bool sortPanes = toggles.SortTransparent && !toggles.WeightedOit;
+            glBindBuffer(GL_ARRAY_BUFFER, paneInstanceVBO);
+            if (sortPanes)
+            {
+                paneBucket.Sort(camera.Position, camera.Front);
+                const std::vector<unsigned int>& order = paneBucket.Order();
+                for (size_t i = 0; i < order.size(); i++)
+                    sortedPanes[i] = panes[order[i]];
+                // orphan the buffer so the driver doesn't wait for last frame's draw to finish reading it
+                glBufferData(GL_ARRAY_BUFFER, panes.size() * sizeof(PaneInstance), nullptr, GL_STREAM_DRAW);
+                glBufferSubData(GL_ARRAY_BUFFER, 0, sortedPanes.size() * sizeof(PaneInstance), sortedPanes.data());
+                panesUploadedSorted = true;
+            }
+            else if (panesUploadedSorted)
+            {
+                glBufferData(GL_ARRAY_BUFFER, panes.size() * sizeof(PaneInstance), panes.data(), GL_STREAM_DRAW);
+                panesUploadedSorted = false;
+            }
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        };
+        auto drawPanes = [&](Shader& paneShader)
+        {
+            paneShader.use();
+            paneShader.setMat4("view", view);
+            paneShader.setMat4("projection", projection);
+            // panes are seen from both sides
+            glDisable(GL_CULL_FACE);
+            glBindVertexArray(paneVAO);
+            glDrawArraysInstanced(GL_TRIANGLES, 0, 6, static_cast<GLsizei>(panes.size()));
+            glBindVertexArray(0);
+            glEnable(GL_CULL_FACE);
+        };
+        if (!panes.empty() && toggles.WeightedOit)
+        {
+            target = oit.AddPasses(frameGraph, target, shaderOitComposite, [&]()
+            {
+                uploadPanes();
+                drawPanes(shaderOitAccumulate);
+            });
+        }
+        else if (!panes.empty())
+        {
+            target = frameGraph.AddPass("Glass", [&](FrameGraphContext&)
+            {
+                uploadPanes();
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                glDepthMask(GL_FALSE);
+                drawPanes(shaderTransparent);
+                glDepthMask(GL_TRUE);
+                glDisable(GL_BLEND);
+            }).Write(target);
+        }
+
+        // a pass like the others, so the overlay shows what it costs itself
+        target = frameGraph.AddPass("Overlay", [&](FrameGraphContext&)
+        {
+            // ImGui colours are already sRGB
+            glDisable(GL_FRAMEBUFFER_SRGB);
+
+            if (overlayVisible)
+            {
+                PerfOverlayFrame overlayFrame;
+                overlayFrame.CpuZones = &lastFrameZones;
+                overlayFrame.Gpu = &gpuProfiler;
+                overlayFrame.Stats = CurrentRenderStats();
+                overlayFrame.Memory = CurrentGpuMemory();
+                overlayFrame.Culling = culling;
+                overlayFrame.Foliage = foliageStats;
+                overlayFrame.TextureBinds = TextureBindCount();
+                overlayFrame.TextureArrays = static_cast<unsigned int>(texturePacker.Arrays().size());
+                overlayFrame.Graph = &frameGraph;
+                if (headless.GlCalls)
+                    overlayFrame.GlCalls = &CurrentGlCallCounters();
+                overlay.Draw(overlayFrame, toggles);
+            }
+
+            ImGui::Render();
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        }).Write(target);
+
+        frameGraph.Compile();
+        if (frameGraphPath && frame == 0)
+        {
+            std::ofstream dot(frameGraphPath);
+            frameGraph.WriteGraphviz(dot);
+        }
+        frameGraph.Execute(frameGraphBackend);
+        gpuProfiler.EndFrame();
+
+        if (headless.Enabled)
+        {
+            {
+                PROFILE_SCOPE("glFinish");
+                glFinish(); // there is no swap to wait for, so wait for the GPU here to include its time
+            }
+            if (frame >= 0)
+            {
+                headlessStats.AddFrame(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count(), CurrentRenderStats());
+                if (headless.GlCalls)
+                    headlessStats.AddGlCalls(CurrentGlCallCounters());
+            }
+            continue;
         }
-        glBindVertexArray(0);
-
-        // 1st render pass: Draw objects as normal, writing to the stencil buffer
-        glStencilFunc(GL_ALWAYS, 1, 0xFF);
-        glStencilMask(0xFF); // Enable writing to the stencil buffer
-
-        shader.use();
-        shader.setMat4("view", view);
-        shader.setMat4("projection", projection);
-        // cubes
-        glBindVertexArray(cubeVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, cubeTexture);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-1.0f, 0.0f, -1.0f));
-        shader.setMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(2.0f, 0.0f, 0.0f));
-        shader.setMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        // 2nd render pass: Draw slightly scaled versions of the objects while stencil writing is
-        // disabled because the stencil buffer is now filled with several 1s. The parts of the buffer
-        // that are 1 are not drawn.
-        glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
-        glStencilMask(0x00); // disable writing to the stencil buffer
-        glDisable(GL_DEPTH_TEST);
-        
-        shaderSingleColor.use();
-        shaderSingleColor.setMat4("view", view);
-        shaderSingleColor.setMat4("projection", projection);
-        // Scaled-up cubes
-        const float SCALE = 1.05f;
-        glBindVertexArray(cubeVAO);
-        //glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, cubeTexture);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-1.0f, 0.0f, -1.0f));
-        model = glm::scale(model, glm::vec3(SCALE));
-        shaderSingleColor.setMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(2.0f, 0.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(SCALE));
-        shaderSingleColor.setMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-
-        glStencilMask(0xFF);
-        glStencilFunc(GL_ALWAYS, 1, 0xFF);
-        glEnable(GL_DEPTH_TEST);
-
-        ImGui::Begin("Test Window");
-        ImGui::Text("Hello!");
-        ImGui::End();
-
-        ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
+        {
+            PROFILE_SCOPE("glfwSwapBuffers"); // includes waiting for vsync
+            glfwSwapBuffers(window);
+        }
         glfwPollEvents();
     }
 
+    if (headless.Enabled)
+    {
+        headlessStats.Print("03 Advanced OpenGL (headless, " + std::to_string(headless.Width) + "x" + std::to_string(headless.Height) + ")");
+        if (!headless.JsonPath.empty())
+            headlessStats.WriteJson(headless.JsonPath, "03 Advanced OpenGL", headless);
+        if (!headless.ScreenshotPath.empty())
+            headlessContext.SaveScreenshot(headless.ScreenshotPath);
+        if (gpuProfiler.Supported())
+        {
+            std::cout << "GPU frame: avg " << gpuProfiler.Frame().AverageMs << " ms" << std::endl;
+            for (const GpuPassTiming& pass : gpuProfiler.Passes())
+                std::cout << "  " << pass.Name << ": avg " << pass.AverageMs << " ms" << std::endl;
+        }
+        const FrameGraphStats& graph = frameGraph.Stats();
+        std::cout << "Frame graph: " << graph.Passes << " passes (" << graph.CulledPasses << " culled), " << graph.TransientTargets << " transient targets in " << graph.Textures << " textures, "
+            << graph.Bytes / (1024.0 * 1024.0) << " MB (" << graph.UnaliasedBytes / (1024.0 * 1024.0) << " MB without sharing)" << std::endl;
+    }
+    else if (!headless.RecordCameraPathFile.empty())
+        recordedPath.Save(headless.RecordCameraPathFile);
+    if (!headless.TracePath.empty())
+        Profiler::WriteChromeTrace(headless.TracePath);
+
     ImGui_ImplOpenGL3_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
+    if (window)
+        ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
 
     // optional: de-allocate all resources once they've outlived their purpose:
     // ------------------------------------------------------------------------
+    frameGraph.Release(frameGraphBackend);
+    frameGraphBackend.Release();
+    gpuProfiler.Release();
+    oit.Release();
+    foliage.Release();
+    outline.Release();
     glDeleteVertexArrays(1, &cubeVAO);
     glDeleteVertexArrays(1, &planeVAO);
     glDeleteBuffers(1, &cubeVBO);
     glDeleteBuffers(1, &planeVBO);
+    glDeleteVertexArrays(1, &paneVAO);
+    glDeleteBuffers(1, &paneVBO);
+    glDeleteBuffers(1, &paneInstanceVBO);
+    texturePacker.Delete();
 
-    glfwTerminate();
+    if (headless.Enabled)
+        headlessContext.Destroy();
+    else
+        glfwTerminate();
     return 0;
 }
 
+// glfw: create the window, make its context current and load the OpenGL functions
+// --------------------------------------------------------------------------------
+GLFWwindow* createWindow(bool debugContext)
+{
+    // glfw: initialize and configure
+    // ------------------------------
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+    // colour textures are sampled as linear values, the default framebuffer encodes them back to sRGB
+    glfwWindowHint(GLFW_SRGB_CAPABLE, GLFW_TRUE);
+    // the driver only reliably reports performance warnings (GL_KHR_debug) to debug contexts
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, debugContext ? GLFW_TRUE : GLFW_FALSE);
+
+    // glfw window creation
+    // --------------------
+    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+    if (window == NULL)
+    {
+        std::cout << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return NULL;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetCursorPosCallback(window, mouse_callback);
+    glfwSetScrollCallback(window, scroll_callback);
+
+    // tell GLFW to capture our mouse
+    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+    // glad: load all OpenGL function pointers
+    // ---------------------------------------
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        return NULL;
+    }
+
+    return window;
+}
+
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 // ---------------------------------------------------------------------------------------------------------
 void processInput(GLFWwindow* window)
@@ -357,6 +924,22 @@ void processInput(GLFWwindow* window)
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
+    // toggles act on the press, not on every frame the key is held
+    static bool f1WasDown = false;
+    static bool tabWasDown = false;
+    bool f1Down = glfwGetKey(window, GLFW_KEY_F1) == GLFW_PRESS;
+    bool tabDown = glfwGetKey(window, GLFW_KEY_TAB) == GLFW_PRESS;
+    if (f1Down && !f1WasDown)
+        overlayVisible = !overlayVisible;
+    if (tabDown && !tabWasDown)
+    {
+        cursorCaptured = !cursorCaptured;
+        glfwSetInputMode(window, GLFW_CURSOR, cursorCaptured ? GLFW_CURSOR_DISABLED : GLFW_CURSOR_NORMAL);
+        firstMouse = true; // no jump when the camera takes the mouse back
+    }
+    f1WasDown = f1Down;
+    tabWasDown = tabDown;
+
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
         camera.ProcessKeyboard(FORWARD, deltaTime);
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
@@ -380,6 +963,9 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 // -------------------------------------------------------
 void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
 {
+    if (!cursorCaptured)
+        return;
+
     float xpos = static_cast<float>(xposIn);
     float ypos = static_cast<float>(yposIn);
 
@@ -406,43 +992,325 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
     camera.ProcessMouseScroll(static_cast<float>(yoffset));
 }
 
-// utility function for loading a 2D texture from file
-// ---------------------------------------------------
-unsigned int loadTexture(char const* path)
+// utility function for loading a 2D texture from file, through the texture cache
+// -----------------------------------------------------------------------------
+unsigned int loadTexture(TextureCache& cache, char const* path, TextureImportDesc desc)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
+    PROFILE_SCOPE("loadTexture");
+    unsigned int textureID = 0;
+    CachedTexture cached;
+    if (importDescForFile(path, &desc) && cache.Load(path, desc, &cached))
+        textureID = CreateTexture(cached.Levels, cached.Channels, desc);
+    else
+        std::cout << "Texture failed to load at path: " << path << std::endl;
 
+    return textureID;
+}
+
+// completes the import settings of an image from its header. For blending tutorial: use GL_CLAMP_TO_EDGE to prevent
+// semi-transparent borders. Due to interpolation it takes texels from next repeat. Alpha tested textures also keep
+// their coverage in the mips so the grass doesn't thin out in the distance. The chain is built once and cached, so
+// it gets the sharper Kaiser filter.
+// ----------------------------------------------------------------------------------------------------------------
+bool importDescForFile(const char* path, TextureImportDesc* desc)
+{
+    int width, height, nrComponents;
+    if (!stbi_info(path, &width, &height, &nrComponents))
+        return false;
+    if (nrComponents == 4)
+    {
+        desc->Repeat = false;
+        desc->PreserveAlphaCoverage = true;
+    }
+    desc->Filter = MIP_FILTER_KAISER;
+    return true;
+}
+
+// times building the mip chain on the CPU (box and Kaiser) against uploading level 0 and calling glGenerateMipmap.
+// glFinish makes sure the driver path is measured completely (on llvmpipe the mips are built on the CPU as well).
+// ---------------------------------------------------------------------------------------------------------------
+void benchmarkMipmapGeneration(const char* path)
+{
     int width, height, nrComponents;
     unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
+    if (!data)
+    {
+        std::cout << "Texture failed to load at path: " << path << std::endl;
+        return;
+    }
+    GLenum format = nrComponents == 1 ? GL_RED : nrComponents == 3 ? GL_RGB : GL_RGBA;
+
+    const int ITERATIONS = 10;
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    auto msSince = [](std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / ITERATIONS;
+    };
+
+    // driver path
+    glFinish();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ITERATIONS; i++)
     {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
+        glFinish();
+    }
+    double driverMs = msSince(start);
+
+    // CPU paths, generation and upload timed separately
+    double generateMs[2], uploadMs[2];
+    MipFilter filters[2] = { MIP_FILTER_BOX, MIP_FILTER_KAISER };
+    for (int f = 0; f < 2; f++)
+    {
+        MipChainOptions options;
+        options.Filter = filters[f];
+        options.SRGB = true;
+        options.PreserveAlphaCoverage = format == GL_RGBA;
 
-        // For blending tutorial: use GL_CLAMP_TO_EDGE to prevent semi-transparent borders. Due to
-        // interpolation it takes texels from next repeat
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        std::vector<MipLevel> mipChain;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < ITERATIONS; i++)
+            mipChain = GenerateMipChain(data, width, height, nrComponents, options);
+        generateMs[f] = msSince(start);
 
-        stbi_image_free(data);
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < ITERATIONS; i++)
+        {
+            UploadMipChain(mipChain, format, format);
+            glFinish();
+        }
+        uploadMs[f] = msSince(start);
     }
-    else
+
+    std::cout << path << " (" << width << "x" << height << "x" << nrComponents << ")" << std::endl;
+    std::cout << "  glGenerateMipmap:    " << driverMs << " ms" << std::endl;
+    std::cout << "  CPU box:             " << generateMs[0] << " ms generate + " << uploadMs[0] << " ms upload" << std::endl;
+    std::cout << "  CPU kaiser:          " << generateMs[1] << " ms generate + " << uploadMs[1] << " ms upload" << std::endl;
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glDeleteTextures(1, &textureID);
+    stbi_image_free(data);
+}
+
+// times sorting count transparent instances (100k by default) back to front with two camera motions: walking
+// forward while looking around a little, and orbiting the instances. Compares the radix sort from scratch every
+// frame, repairing the previous order, and std::stable_sort on the same keys as a reference. Every order is
+// checked to really run back to front.
+// ---------------------------------------------------------------------------------------------------------------
+void benchmarkTransparentSort(size_t count)
+{
+    if (count == 0)
+        count = 100000;
+    const int FRAMES = 120;
+
+    std::mt19937 random(43);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<glm::vec3> centers(count);
+    for (size_t i = 0; i < count; i++)
+        centers[i] = glm::vec3(unit(random) * 100.0f - 50.0f, unit(random) * 20.0f, unit(random) * 100.0f - 50.0f);
+    std::vector<unsigned int> reference(count);
+    std::vector<float> depths(count);
+
+    auto isBackToFront = [&](const std::vector<unsigned int>& order, const glm::vec3& position, const glm::vec3& front)
     {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+        for (size_t i = 1; i < order.size(); i++)
+            if (glm::dot(centers[order[i - 1]] - position, front) < glm::dot(centers[order[i]] - position, front))
+                return false;
+        return true;
+    };
+
+    std::cout << "Sorting " << count << " transparent instances back to front, " << FRAMES << " frames" << std::endl;
+    const char* motions[2] = { "walking (0.1 units, 0.01 degrees per frame)", "orbiting (0.25 degrees per frame)" };
+    for (int motion = 0; motion < 2; motion++)
+    {
+        TransparentBucket full;
+        TransparentBucket incremental;
+        for (const glm::vec3& center : centers)
+        {
+            full.Add(center);
+            incremental.Add(center);
+        }
+
+        double fullMs = 0.0, incrementalMs = 0.0, referenceMs = 0.0;
+        int incrementalFrames = 0;
+        bool sorted = true;
+        for (int frame = 0; frame < FRAMES; frame++)
+        {
+            glm::vec3 position, front;
+            if (motion == 0)
+            {
+                float angle = glm::radians(frame * 0.01f);
+                front = glm::vec3(std::sin(angle), 0.0f, -std::cos(angle));
+                position = glm::vec3(0.0f, 10.0f, 60.0f) + front * (frame * 0.1f);
+            }
+            else
+            {
+                // 80 units out, looking at the middle of the instances
+                float angle = glm::radians(frame * 0.25f);
+                position = glm::vec3(80.0f * std::cos(angle), 10.0f, 80.0f * std::sin(angle));
+                front = glm::normalize(glm::vec3(0.0f, 10.0f, 0.0f) - position);
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            full.Sort(position, front, false);
+            fullMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            start = std::chrono::steady_clock::now();
+            incremental.Sort(position, front);
+            incrementalMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (incremental.LastSortWasIncremental())
+                incrementalFrames++;
+
+            start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < count; i++)
+            {
+                reference[i] = static_cast<unsigned int>(i);
+                depths[i] = glm::dot(centers[i] - position, front);
+            }
+            std::stable_sort(reference.begin(), reference.end(), [&](unsigned int a, unsigned int b) { return depths[a] > depths[b]; });
+            referenceMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            sorted = sorted && isBackToFront(full.Order(), position, front) && isBackToFront(incremental.Order(), position, front) && isBackToFront(reference, position, front);
+        }
+
+        std::cout << "  " << motions[motion] << std::endl;
+        std::cout << "    radix sort every frame:  " << fullMs / FRAMES << " ms" << std::endl;
+        std::cout << "    incremental:             " << incrementalMs / FRAMES << " ms (" << incrementalFrames << " of " << FRAMES << " frames only repaired the previous order)" << std::endl;
+        std::cout << "    std::stable_sort:        " << referenceMs / FRAMES << " ms" << std::endl;
+        std::cout << "    orders back to front:    " << (sorted ? "yes" : "NO") << std::endl;
     }
+}
 
-    return textureID;
+// draws a grid of 1, 100 and 10000 selected cubes with no outline, the stencil outline (every cube a second time)
+// and the post-process outline (one full screen pass, thin and jump flooded) and prints the time per frame.
+// glFinish makes sure the GPU work is measured completely.
+// ---------------------------------------------------------------------------------------------------------------
+void benchmarkOutlines(unsigned int cubeVAO, Shader& shader, Shader& shaderSingleColor, OutlineRenderer& outline, unsigned int targetFramebuffer, int width, int height)
+{
+    const int FRAMES = 30;
+    const int WARMUP_FRAMES = 3;
+    const unsigned int counts[3] = { 1, 100, 10000 };
+    enum { NO_OUTLINE, STENCIL, POST_PROCESS_THIN, POST_PROCESS_WIDE, METHOD_COUNT };
+    const char* names[METHOD_COUNT] = { "no outline", "stencil", "post-process 2 px", "post-process 8 px (jump flood)" };
+
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 7.0f, 9.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)width / (float)height, 0.1f, 100.0f);
+    shader.use();
+    shader.setMat4("view", view);
+    shader.setMat4("projection", projection);
+    shader.setFloat("selected", 1.0f);
+    shaderSingleColor.use();
+    shaderSingleColor.setMat4("view", view);
+    shaderSingleColor.setMat4("projection", projection);
+    // the same passes as the scene, run by a frame graph of their own
+    FrameGraph graph;
+    GlFrameGraphBackend backend;
+
+    std::cout << "Outlining selected cubes at " << width << "x" << height << ", ms per frame" << std::endl;
+    for (unsigned int count : counts)
+    {
+        // a square grid over 10x10 units, the cubes fill 60% of their cell
+        int side = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(count))));
+        float cell = 10.0f / side;
+        std::vector<glm::mat4> models;
+        std::vector<glm::mat4> outlineModels;
+        for (unsigned int i = 0; i < count; i++)
+        {
+            glm::vec3 position((i % side + 0.5f) * cell - 5.0f, 0.0f, (i / side + 0.5f) * cell - 5.0f);
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+            models.push_back(glm::scale(model, glm::vec3(cell * 0.6f)));
+            outlineModels.push_back(glm::scale(model, glm::vec3(cell * 0.6f * 1.05f)));
+        }
+
+        std::cout << "  " << count << (count == 1 ? " cube" : " cubes") << std::endl;
+        for (int method = 0; method < METHOD_COUNT; method++)
+        {
+            bool postProcess = method == POST_PROCESS_THIN || method == POST_PROCESS_WIDE;
+            outline.Width = method == POST_PROCESS_WIDE ? 8.0f : 2.0f;
+            auto start = std::chrono::steady_clock::now();
+            for (int frame = -WARMUP_FRAMES; frame < FRAMES; frame++)
+            {
+                if (frame == 0)
+                    start = std::chrono::steady_clock::now();
+                graph.Reset();
+                FrameGraphResource target = graph.Import("Target", targetFramebuffer, width, height);
+                FrameGraphPassBuilder cubes = graph.AddPass("Cubes", [&](FrameGraphContext&)
+                {
+                    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+                    if (postProcess)
+                    {
+                        const float zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+                        glClearBufferfv(GL_COLOR, 1, zero);
+                    }
+                    shader.use();
+                    glStencilFunc(GL_ALWAYS, 1, 0xFF);
+                    glStencilMask(0xFF);
+                    glBindVertexArray(cubeVAO);
+                    for (const glm::mat4& model : models)
+                    {
+                        shader.setMat4("model", model);
+                        glDrawArrays(GL_TRIANGLES, 0, 36);
+                    }
+                    glBindVertexArray(0);
+                });
+                if (postProcess)
+                {
+                    FrameGraphResource color = cubes.Create("Scene colour", { width, height, GL_SRGB8_ALPHA8 });
+                    FrameGraphResource mask = OutlineRenderer::CreateMask(cubes, width, height);
+                    FrameGraphResource depth = cubes.Create("Scene depth", { width, height, GL_DEPTH24_STENCIL8 });
+                    outline.AddPasses(graph, color, depth, mask, target);
+                }
+                else
+                {
+                    target = cubes.Write(target);
+                    if (method == STENCIL)
+                    {
+                        graph.AddPass("Outline", [&](FrameGraphContext&)
+                        {
+                            glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
+                            glStencilMask(0x00);
+                            glDisable(GL_DEPTH_TEST);
+                            shaderSingleColor.use();
+                            glBindVertexArray(cubeVAO);
+                            for (const glm::mat4& model : outlineModels)
+                            {
+                                shaderSingleColor.setMat4("model", model);
+                                glDrawArrays(GL_TRIANGLES, 0, 36);
+                            }
+                            glBindVertexArray(0);
+                            glStencilMask(0xFF);
+                            glStencilFunc(GL_ALWAYS, 1, 0xFF);
+                            glEnable(GL_DEPTH_TEST);
+                        }).Write(target);
+                    }
+                }
+                graph.Execute(backend);
+                glFinish();
+            }
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / FRAMES;
+            std::cout << "    " << names[method] << ": " << ms << std::endl;
+        }
+    }
+    graph.Release(backend);
+    backend.Release();
+}
+
+// loads an image into the packer with the same import settings (and cache entry) as loadTexture, returns its packer
+// handle
+// -----------------------------------------------------------------------------------------------------------------
+int addPackedTexture(TextureCache& cache, TexturePacker& packer, char const* path, TextureImportDesc desc)
+{
+    PROFILE_SCOPE("addPackedTexture");
+    int handle = -1;
+    CachedTexture cached;
+    if (importDescForFile(path, &desc) && cache.Load(path, desc, &cached))
+        handle = packer.Add(cached.Levels, cached.Channels, desc);
+    else
+        std::cout << "Texture failed to load at path: " << path << std::endl;
+
+    return handle;
 }
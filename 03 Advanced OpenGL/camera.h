@@ -63,6 +63,16 @@ public:
         return glm::lookAt(Position, Position + Front, Up);
     }
 
+    // places the camera at position looking at target (used by scripted camera paths instead of mouse input)
+    void LookAt(glm::vec3 position, glm::vec3 target)
+    {
+        glm::vec3 direction = glm::normalize(target - position);
+        Position = position;
+        Yaw = glm::degrees(atan2(direction.z, direction.x));
+        Pitch = glm::degrees(asin(direction.y));
+        updateCameraVectors();
+    }
+
     // processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
     void ProcessKeyboard(Camera_Movement direction, float deltaTime)
     {
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "frustum.h"
+#include "profiler.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// the field is split into this many chunks along x and along z, each culled and drawn on its own
+#define FOLIAGE_CHUNKS_PER_SIDE 16
+// chunks closer than this draw all their blades, further ones a share falling off with the squared distance
+#define FOLIAGE_FULL_DENSITY_DISTANCE 3.0f
+// but never less than this share, so the far field doesn't go bald
+#define FOLIAGE_MIN_DENSITY 0.05f
+
+// a blade as the instanced attributes of shaders/foliage.vert, 24 bytes
+struct GrassInstance {
+    glm::vec4 PositionRotation; // xyz the root, w the rotation around y in radians
+    float Scale; // height of the blade
+    uint8_t Tint[4]; // linear rgb, normalized by the vertex fetch
+};
+
+// blades drawn and chunks tested and culled in a frame
+struct FoliageStats {
+    unsigned int Blades = 0;
+    unsigned int Draws = 0;
+    int ChunksTested = 0;
+    int ChunksCulled = 0;
+};
+
+// a grass field of up to millions of blades, scattered once over a rectangle with a seeded distribution. The
+// instances are stored chunk by chunk in one static instance buffer, and every visible chunk is drawn with one
+// instanced call. OpenGL 3.3 has no base instance, so the instance attributes are pointed at the chunk's first
+// blade before each call. The blades of a chunk are in random order, so drawing only the first part of them
+// thins the chunk out evenly, which is how distant chunks save vertices.
+class Foliage
+{
+public:
+    // scatters bladeCount blades over the rectangle min..max (xz) at height y, the same ones for the same seed
+    void Init(unsigned int bladeCount, const glm::vec2& min, const glm::vec2& max, float y, unsigned int seed)
+    {
+        PROFILE_SCOPE("Foliage::Init");
+        Release();
+        this->min = glm::vec3(min.x, y, min.y);
+        this->max = glm::vec3(max.x, y + MAX_SCALE, max.y);
+        chunks.clear();
+
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::vector<GrassInstance> instances(bladeCount);
+        glm::vec2 chunkSize = (max - min) / static_cast<float>(FOLIAGE_CHUNKS_PER_SIDE);
+        const unsigned int chunkCount = FOLIAGE_CHUNKS_PER_SIDE * FOLIAGE_CHUNKS_PER_SIDE;
+        unsigned int first = 0;
+        for (unsigned int chunk = 0; chunk < chunkCount; chunk++)
+        {
+            unsigned int count = bladeCount / chunkCount + (chunk < bladeCount % chunkCount ? 1 : 0);
+            glm::vec2 chunkMin = min + chunkSize * glm::vec2(chunk % FOLIAGE_CHUNKS_PER_SIDE, chunk / FOLIAGE_CHUNKS_PER_SIDE);
+            for (unsigned int i = first; i < first + count; i++)
+            {
+                GrassInstance& blade = instances[i];
+                blade.PositionRotation = glm::vec4(chunkMin.x + unit(random) * chunkSize.x, y, chunkMin.y + unit(random) * chunkSize.y, unit(random) * 6.2831853f);
+                blade.Scale = MIN_SCALE + unit(random) * (MAX_SCALE - MIN_SCALE);
+                // from a dark to a yellowish green
+                float dry = unit(random);
+                blade.Tint[0] = static_cast<uint8_t>(10 + dry * 60);
+                blade.Tint[1] = static_cast<uint8_t>(70 + unit(random) * 60);
+                blade.Tint[2] = static_cast<uint8_t>(5 + dry * 10);
+                blade.Tint[3] = 255;
+            }
+            chunks.push_back({ first, count });
+            first += count;
+        }
+        this->chunkSize = chunkSize;
+
+        // a blade is a triangle strip tapering to its tip, x across the blade and y from the root to the tip
+        const float bladeVertices[] = {
+            -1.0f, 0.0f,
+             1.0f, 0.0f,
+            -1.0f, 0.5f,
+             1.0f, 0.5f,
+             0.0f, 1.0f
+        };
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &bladeVBO);
+        glGenBuffers(1, &instanceVBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, bladeVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(bladeVertices), bladeVertices, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(GrassInstance), instances.data(), GL_STATIC_DRAW);
+        for (unsigned int attribute = 2; attribute <= 4; attribute++)
+        {
+            glEnableVertexAttribArray(attribute);
+            glVertexAttribDivisor(attribute, 1);
+        }
+        pointInstancesAt(0);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    unsigned int Blades() const
+    {
+        return chunks.empty() ? 0 : chunks.back().First + chunks.back().Count;
+    }
+
+    // draws the chunks that intersect the frustum (all of them when cull is false). The caller binds a program
+    // with shaders/foliage.vert and sets its view and projection.
+    FoliageStats Draw(const Frustum& frustum, const glm::vec3& cameraPosition, bool cull)
+    {
+        PROFILE_SCOPE("Foliage::Draw");
+        FoliageStats stats;
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        for (unsigned int chunk = 0; chunk < chunks.size(); chunk++)
+        {
+            glm::vec3 chunkMin = min + glm::vec3(chunkSize.x * (chunk % FOLIAGE_CHUNKS_PER_SIDE), 0.0f, chunkSize.y * (chunk / FOLIAGE_CHUNKS_PER_SIDE));
+            glm::vec3 chunkMax = chunkMin + glm::vec3(chunkSize.x, max.y - min.y, chunkSize.y);
+            // blades are rooted inside their chunk but lean and spread past its edges
+            glm::vec3 reach(MAX_SCALE * (BEND + HALF_WIDTH), 0.0f, MAX_SCALE * (BEND + HALF_WIDTH));
+            chunkMin -= reach;
+            chunkMax += reach;
+            if (cull)
+            {
+                stats.ChunksTested++;
+                if (!frustum.IntersectsBox(chunkMin, chunkMax))
+                {
+                    stats.ChunksCulled++;
+                    continue;
+                }
+            }
+
+            float distance = glm::length(glm::clamp(cameraPosition, chunkMin, chunkMax) - cameraPosition);
+            float density = distance <= FOLIAGE_FULL_DENSITY_DISTANCE ? 1.0f : std::max(FOLIAGE_MIN_DENSITY, (FOLIAGE_FULL_DENSITY_DISTANCE * FOLIAGE_FULL_DENSITY_DISTANCE) / (distance * distance));
+            unsigned int count = static_cast<unsigned int>(chunks[chunk].Count * density);
+            if (count == 0)
+                continue;
+            pointInstancesAt(chunks[chunk].First);
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 5, count);
+            stats.Blades += count;
+            stats.Draws++;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+        return stats;
+    }
+
+    void Release()
+    {
+        if (!VAO)
+            return;
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &bladeVBO);
+        glDeleteBuffers(1, &instanceVBO);
+        VAO = 0;
+        chunks.clear();
+    }
+
+private:
+    static constexpr float MIN_SCALE = 0.08f;
+    static constexpr float MAX_SCALE = 0.22f;
+    // the blade shape of shaders/foliage.vert, relative to the blade height
+    static constexpr float HALF_WIDTH = 0.08f;
+    static constexpr float BEND = 0.3f;
+
+    struct Chunk {
+        unsigned int First;
+        unsigned int Count;
+    };
+
+    std::vector<Chunk> chunks; // row by row along x, then z
+    glm::vec3 min = glm::vec3(0.0f);
+    glm::vec3 max = glm::vec3(0.0f);
+    glm::vec2 chunkSize = glm::vec2(0.0f);
+    unsigned int VAO = 0;
+    unsigned int bladeVBO = 0;
+    unsigned int instanceVBO = 0;
+
+    // the instance attributes start at blade first, instanceVBO must be bound
+    void pointInstancesAt(unsigned int first)
+    {
+        const char* base = reinterpret_cast<const char*>(static_cast<size_t>(first) * sizeof(GrassInstance));
+        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(GrassInstance), base + offsetof(GrassInstance, PositionRotation));
+        glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(GrassInstance), base + offsetof(GrassInstance, Scale));
+        glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(GrassInstance), base + offsetof(GrassInstance, Tint));
+    }
+};
@@ -0,0 +1,620 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "profiler.h"
+#include "render_stats.h"
+
+#include <algorithm>
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <iterator>
+#include <ostream>
+#include <vector>
+
+// handles passed to Read and Write are ignored when they are this, so optional targets need no branches
+#define FRAME_GRAPH_NO_RESOURCE -1
+
+// a version of a resource: every write returns a new one, and passes that read it run after the pass that wrote it
+typedef int FrameGraphResource;
+
+// a render target the graph creates for the frame
+struct FrameGraphTextureDesc {
+    int Width;
+    int Height;
+    GLenum InternalFormat;
+};
+
+inline bool operator==(const FrameGraphTextureDesc& a, const FrameGraphTextureDesc& b)
+{
+    return a.Width == b.Width && a.Height == b.Height && a.InternalFormat == b.InternalFormat;
+}
+
+inline bool IsDepthFormat(GLenum internalFormat)
+{
+    return internalFormat == GL_DEPTH24_STENCIL8 || internalFormat == GL_DEPTH32F_STENCIL8 ||
+        internalFormat == GL_DEPTH_COMPONENT16 || internalFormat == GL_DEPTH_COMPONENT24 || internalFormat == GL_DEPTH_COMPONENT32F;
+}
+
+inline bool HasStencil(GLenum internalFormat)
+{
+    return internalFormat == GL_DEPTH24_STENCIL8 || internalFormat == GL_DEPTH32F_STENCIL8;
+}
+
+struct FrameGraphAttachment {
+    unsigned int Texture;
+    GLenum InternalFormat;
+};
+
+// what the graph needs from the graphics API. The graph itself makes no GL calls, so it can be driven (and its
+// order, culling and aliasing checked) without a GPU by a backend that only records what it is asked to do.
+class FrameGraphBackend
+{
+public:
+    virtual ~FrameGraphBackend() {}
+
+    virtual unsigned int CreateTexture(const FrameGraphTextureDesc& desc) = 0;
+    virtual void DestroyTexture(unsigned int texture) = 0;
+    // a framebuffer with the textures attached: depth formats to the depth (stencil) attachment, the others to the
+    // colour attachments in order, all of them drawn to
+    virtual unsigned int Framebuffer(const std::vector<FrameGraphAttachment>& attachments) = 0;
+    virtual void BindRenderTarget(unsigned int framebuffer, int width, int height) = 0;
+    // around every pass, for timing. name is a string literal.
+    virtual void BeginPass(const char* name) = 0;
+    virtual void EndPass() = 0;
+};
+
+// passes, culled passes and how much the transient targets share
+struct FrameGraphStats {
+    int Passes = 0;
+    int CulledPasses = 0;
+    int TransientTargets = 0;
+    int Textures = 0; // the transient targets live in this many textures
+    unsigned long long Bytes = 0;
+    unsigned long long UnaliasedBytes = 0; // with a texture for every transient target
+};
+
+class FrameGraph;
+
+// what a pass gets while it executes: the textures behind the resources it reads and framebuffers to blit from
+class FrameGraphContext
+{
+public:
+    FrameGraphContext(const FrameGraph& graph, FrameGraphBackend& backend) : graph(graph), backend(backend)
+    {
+    }
+
+    // the texture of a transient resource
+    unsigned int Texture(FrameGraphResource resource) const;
+    // the framebuffer of an imported resource, or one with the given transient targets attached
+    unsigned int Framebuffer(std::initializer_list<FrameGraphResource> resources) const;
+
+    // the framebuffer the graph bound for the pass' writes
+    unsigned int RenderTarget() const
+    {
+        return renderTarget;
+    }
+
+    int Width() const
+    {
+        return width;
+    }
+
+    int Height() const
+    {
+        return height;
+    }
+
+private:
+    friend class FrameGraph;
+    const FrameGraph& graph;
+    FrameGraphBackend& backend;
+    unsigned int renderTarget = 0;
+    int width = 0;
+    int height = 0;
+};
+
+// declares what a pass reads and writes, returned by FrameGraph::AddPass
+class FrameGraphPassBuilder
+{
+public:
+    FrameGraphPassBuilder(FrameGraph& graph, int pass) : graph(graph), pass(pass)
+    {
+    }
+
+    // a new transient target the pass draws into, which lives until the last pass that reads it
+    FrameGraphResource Create(const char* name, const FrameGraphTextureDesc& desc);
+    FrameGraphResource Read(FrameGraphResource resource);
+    // the pass draws into resource, keeping what it holds (so it runs after the passes that wrote or read the
+    // version passed in). Returns the version later passes have to use.
+    FrameGraphResource Write(FrameGraphResource resource);
+
+private:
+    FrameGraph& graph;
+    int pass;
+};
+
+// a frame's render passes, declared with the resources they read and write instead of hand ordered. Compile leaves
+// out the passes nothing uses (everything ends up in the imported resources, like the default framebuffer, the rest
+// is culled), orders the others after the passes whose results they need and assigns textures to the transient
+// targets: a target only lives from its first to its last use, and targets whose lifetimes don't overlap share a
+// texture when they have the same size and format (OpenGL 3.3 can't place textures of different formats in the same
+// memory). Execute binds each pass' targets and runs it. Declare the passes again every frame, the textures stay
+// pooled from frame to frame.
+//
+// A pass writes either one imported framebuffer or transient targets, which are attached in the order the pass
+// writes them, and leaves the draw framebuffer the graph bound for it bound.
+class FrameGraph
+{
+public:
+    // forgets the passes and resources of the last frame, not the pooled textures
+    void Reset()
+    {
+        passes.clear();
+        resources.clear();
+        versions.clear();
+        order.clear();
+        slots.clear();
+        stats = FrameGraphStats();
+        compiled = false;
+    }
+
+    // a framebuffer the graph doesn't own, its contents are kept after the frame
+    FrameGraphResource Import(const char* name, unsigned int framebuffer, int width, int height)
+    {
+        Resource resource;
+        resource.Name = name;
+        resource.Desc = { width, height, GL_NONE };
+        resource.Imported = true;
+        resource.Framebuffer = framebuffer;
+        resources.push_back(resource);
+        return addVersion(static_cast<int>(resources.size()) - 1, -1);
+    }
+
+    FrameGraphPassBuilder AddPass(const char* name, std::function<void(FrameGraphContext&)> execute)
+    {
+        Pass pass;
+        pass.Name = name;
+        pass.Execute = execute;
+        passes.push_back(pass);
+        return FrameGraphPassBuilder(*this, static_cast<int>(passes.size()) - 1);
+    }
+
+    FrameGraphTextureDesc Desc(FrameGraphResource resource) const
+    {
+        return resources[versions[resource].Resource].Desc;
+    }
+
+    // culls, orders and assigns textures, Execute does it when it wasn't called
+    void Compile()
+    {
+        PROFILE_SCOPE("FrameGraph::Compile");
+        cull();
+        sort();
+        alias();
+        compiled = true;
+    }
+
+    void Execute(FrameGraphBackend& backend)
+    {
+        PROFILE_SCOPE("FrameGraph::Execute");
+        if (!compiled)
+            Compile();
+        acquireTextures(backend);
+
+        FrameGraphContext context(*this, backend);
+        std::vector<FrameGraphAttachment> attachments;
+        unsigned int boundTarget = ~0u;
+        for (int index : order)
+        {
+            const Pass& pass = passes[index];
+            PROFILE_SCOPE(pass.Name);
+            backend.BeginPass(pass.Name);
+            attachments.clear();
+            const Resource* imported = nullptr;
+            const Resource* first = nullptr;
+            for (FrameGraphResource written : pass.Writes)
+            {
+                const Resource& resource = resources[versions[written].Resource];
+                if (resource.Imported)
+                    imported = &resource;
+                else
+                    attachments.push_back({ slots[resource.Slot].Texture, resource.Desc.InternalFormat });
+                if (!first)
+                    first = &resource;
+            }
+            if (imported)
+                context.renderTarget = imported->Framebuffer;
+            else if (!attachments.empty())
+                context.renderTarget = backend.Framebuffer(attachments);
+            // rebinding the same framebuffer is not free on every driver (llvmpipe flushes), so passes that draw
+            // where the last one did keep its binding
+            if (first && (context.renderTarget != boundTarget || first->Desc.Width != context.width || first->Desc.Height != context.height))
+            {
+                context.width = first->Desc.Width;
+                context.height = first->Desc.Height;
+                backend.BindRenderTarget(context.renderTarget, context.width, context.height);
+                boundTarget = context.renderTarget;
+            }
+            pass.Execute(context);
+            backend.EndPass();
+        }
+    }
+
+    // after Compile
+    const FrameGraphStats& Stats() const
+    {
+        return stats;
+    }
+
+    // the passes (culled ones dashed) and the versions of the resources they read and write, in Graphviz dot. Run
+    // dot -Tsvg on it to see the frame. Transient targets list the texture they share.
+    void WriteGraphviz(std::ostream& out) const
+    {
+        out << "digraph FrameGraph {" << std::endl;
+        out << "    rankdir=LR;" << std::endl;
+        out << "    node [fontname=\"Helvetica\", fontsize=10];" << std::endl;
+        for (size_t i = 0; i < passes.size(); i++)
+        {
+            out << "    pass" << i << " [shape=box, style=\"rounded" << (passes[i].Culled ? ",dashed\", fontcolor=gray" : ",filled\", fillcolor=\"#ffd9a0\"");
+            out << ", label=\"" << passes[i].Name;
+            if (!passes[i].Culled)
+                out << " (" << std::distance(order.begin(), std::find(order.begin(), order.end(), static_cast<int>(i))) + 1 << ")";
+            out << "\"];" << std::endl;
+        }
+        for (size_t i = 0; i < versions.size(); i++)
+        {
+            const Resource& resource = resources[versions[i].Resource];
+            out << "    resource" << i << " [shape=" << (resource.Imported ? "doubleoctagon" : "ellipse") << ", label=\"" << resource.Name << " v" << versions[i].Version;
+            if (!resource.Imported)
+            {
+                out << "\\n" << resource.Desc.Width << "x" << resource.Desc.Height << " " << formatName(resource.Desc.InternalFormat);
+                if (resource.Slot >= 0)
+                    out << "\\ntexture " << resource.Slot;
+            }
+            out << "\"];" << std::endl;
+        }
+        for (size_t i = 0; i < passes.size(); i++)
+        {
+            for (FrameGraphResource read : passes[i].Reads)
+                out << "    resource" << read << " -> pass" << i << ";" << std::endl;
+            for (FrameGraphResource written : passes[i].Writes)
+            {
+                int previous = versions[written].Previous;
+                if (previous >= 0)
+                    out << "    resource" << previous << " -> pass" << i << " [style=dotted];" << std::endl;
+                out << "    pass" << i << " -> resource" << written << ";" << std::endl;
+            }
+        }
+        out << "}" << std::endl;
+    }
+
+    // destroys the pooled textures
+    void Release(FrameGraphBackend& backend)
+    {
+        for (const PooledTexture& pooled : pool)
+            backend.DestroyTexture(pooled.Texture);
+        pool.clear();
+        Reset();
+    }
+
+private:
+    friend class FrameGraphContext;
+    friend class FrameGraphPassBuilder;
+
+    struct Resource {
+        const char* Name = "";
+        FrameGraphTextureDesc Desc = { 0, 0, GL_NONE };
+        bool Imported = false;
+        unsigned int Framebuffer = 0; // imported
+        int FirstUse = -1; // positions in order
+        int LastUse = -1;
+        int Slot = -1; // index into slots
+    };
+
+    struct Version {
+        int Resource;
+        int Version;
+        int Producer; // the pass that wrote it, -1 for imported contents
+        int Previous; // the version the write kept, -1 for a new target
+        std::vector<int> Readers;
+        bool Latest;
+    };
+
+    struct Pass {
+        const char* Name;
+        std::function<void(FrameGraphContext&)> Execute;
+        std::vector<FrameGraphResource> Reads;
+        std::vector<FrameGraphResource> Writes; // the new versions
+        bool Culled = false;
+    };
+
+    // a texture transient targets share in this frame
+    struct Slot {
+        FrameGraphTextureDesc Desc;
+        unsigned int Texture;
+    };
+
+    struct PooledTexture {
+        FrameGraphTextureDesc Desc;
+        unsigned int Texture;
+        bool Used;
+    };
+
+    std::vector<Pass> passes;
+    std::vector<Resource> resources;
+    std::vector<Version> versions; // FrameGraphResource indexes these
+    std::vector<int> order; // the passes that are not culled, in execution order
+    std::vector<Slot> slots;
+    std::vector<PooledTexture> pool;
+    FrameGraphStats stats;
+    bool compiled = false;
+
+    FrameGraphResource addVersion(int resource, int producer)
+    {
+        Version version;
+        version.Resource = resource;
+        version.Version = 0;
+        version.Producer = producer;
+        version.Previous = -1;
+        version.Latest = true;
+        versions.push_back(version);
+        return static_cast<FrameGraphResource>(versions.size()) - 1;
+    }
+
+    FrameGraphResource create(int pass, const char* name, const FrameGraphTextureDesc& desc)
+    {
+        Resource resource;
+        resource.Name = name;
+        resource.Desc = desc;
+        resources.push_back(resource);
+        FrameGraphResource version = addVersion(static_cast<int>(resources.size()) - 1, pass);
+        versions[version].Version = 1;
+        passes[pass].Writes.push_back(version);
+        return version;
+    }
+
+    FrameGraphResource read(int pass, FrameGraphResource resource)
+    {
+        if (resource == FRAME_GRAPH_NO_RESOURCE)
+            return resource;
+        versions[resource].Readers.push_back(pass);
+        passes[pass].Reads.push_back(resource);
+        return resource;
+    }
+
+    FrameGraphResource write(int pass, FrameGraphResource resource)
+    {
+        if (resource == FRAME_GRAPH_NO_RESOURCE)
+            return resource;
+        if (!versions[resource].Latest)
+        {
+            std::cout << "Frame graph: " << passes[pass].Name << " writes an old version of " << resources[versions[resource].Resource].Name << std::endl;
+            return resource;
+        }
+        versions[resource].Latest = false;
+        FrameGraphResource version = addVersion(versions[resource].Resource, pass);
+        versions[version].Version = versions[resource].Version + 1;
+        versions[version].Previous = resource;
+        passes[pass].Writes.push_back(version);
+        return version;
+    }
+
+    // a pass is needed when it writes the last version of an imported resource or a version a needed pass uses
+    void cull()
+    {
+        std::vector<bool> needed(versions.size(), false);
+        std::vector<int> pending;
+        for (size_t i = 0; i < versions.size(); i++)
+            if (versions[i].Latest && resources[versions[i].Resource].Imported)
+                pending.push_back(static_cast<int>(i));
+        for (Pass& pass : passes)
+            pass.Culled = true;
+        while (!pending.empty())
+        {
+            int version = pending.back();
+            pending.pop_back();
+            if (needed[version])
+                continue;
+            needed[version] = true;
+            int producer = versions[version].Producer;
+            if (producer < 0 || !passes[producer].Culled)
+                continue;
+            passes[producer].Culled = false;
+            for (FrameGraphResource read : passes[producer].Reads)
+                pending.push_back(read);
+            for (FrameGraphResource written : passes[producer].Writes)
+                if (versions[written].Previous >= 0)
+                    pending.push_back(versions[written].Previous);
+        }
+    }
+
+    // topological order of the passes left, the earliest declared first among those that are ready. A pass runs after
+    // the producers of what it reads, and a write after the producer and the readers of the version it replaces.
+    void sort()
+    {
+        std::vector<std::vector<int>> before(passes.size());
+        for (size_t i = 0; i < passes.size(); i++)
+        {
+            if (passes[i].Culled)
+                continue;
+            for (FrameGraphResource read : passes[i].Reads)
+                before[i].push_back(versions[read].Producer);
+            for (FrameGraphResource written : passes[i].Writes)
+            {
+                int previous = versions[written].Previous;
+                if (previous < 0)
+                    continue;
+                before[i].push_back(versions[previous].Producer);
+                for (int reader : versions[previous].Readers)
+                    before[i].push_back(reader);
+            }
+        }
+
+        std::vector<bool> done(passes.size(), false);
+        int remaining = 0;
+        for (size_t i = 0; i < passes.size(); i++)
+            remaining += passes[i].Culled ? 0 : 1;
+        while (static_cast<int>(order.size()) < remaining)
+        {
+            int next = -1;
+            for (size_t i = 0; i < passes.size() && next < 0; i++)
+            {
+                if (passes[i].Culled || done[i])
+                    continue;
+                bool ready = true;
+                for (int dependency : before[i])
+                    if (dependency >= 0 && dependency != static_cast<int>(i) && !passes[dependency].Culled && !done[dependency])
+                        ready = false;
+                if (ready)
+                    next = static_cast<int>(i);
+            }
+            if (next < 0)
+            {
+                std::cout << "Frame graph: the passes depend on each other in a cycle" << std::endl;
+                break;
+            }
+            done[next] = true;
+            order.push_back(next);
+        }
+    }
+
+    // lifetimes of the transient targets, then a texture for each from a free list of those no longer in use
+    void alias()
+    {
+        for (size_t position = 0; position < order.size(); position++)
+        {
+            const Pass& pass = passes[order[position]];
+            for (const std::vector<FrameGraphResource>* used : { &pass.Reads, &pass.Writes })
+                for (FrameGraphResource version : *used)
+                {
+                    Resource& resource = resources[versions[version].Resource];
+                    if (resource.FirstUse < 0)
+                        resource.FirstUse = static_cast<int>(position);
+                    resource.LastUse = static_cast<int>(position);
+                }
+        }
+
+        std::vector<int> freeSlots;
+        for (size_t position = 0; position < order.size(); position++)
+        {
+            for (Resource& resource : resources)
+            {
+                if (resource.Imported || resource.FirstUse != static_cast<int>(position))
+                    continue;
+                auto free = std::find_if(freeSlots.begin(), freeSlots.end(), [&](int slot) { return slots[slot].Desc == resource.Desc; });
+                if (free != freeSlots.end())
+                {
+                    resource.Slot = *free;
+                    freeSlots.erase(free);
+                }
+                else
+                {
+                    resource.Slot = static_cast<int>(slots.size());
+                    slots.push_back({ resource.Desc, 0 });
+                }
+            }
+            for (const Resource& resource : resources)
+                if (!resource.Imported && resource.LastUse == static_cast<int>(position))
+                    freeSlots.push_back(resource.Slot);
+        }
+
+        stats.Passes = static_cast<int>(passes.size());
+        stats.CulledPasses = stats.Passes - static_cast<int>(order.size());
+        for (const Resource& resource : resources)
+            if (!resource.Imported && resource.Slot >= 0)
+            {
+                stats.TransientTargets++;
+                stats.UnaliasedBytes += bytes(resource.Desc);
+            }
+        stats.Textures = static_cast<int>(slots.size());
+        for (const Slot& slot : slots)
+            stats.Bytes += bytes(slot.Desc);
+    }
+
+    // textures for this frame's slots from the pool, and the pooled ones no slot needs destroyed (targets of an
+    // old size or of passes that no longer run)
+    void acquireTextures(FrameGraphBackend& backend)
+    {
+        for (PooledTexture& pooled : pool)
+            pooled.Used = false;
+        for (Slot& slot : slots)
+        {
+            auto pooled = std::find_if(pool.begin(), pool.end(), [&](const PooledTexture& texture) { return !texture.Used && texture.Desc == slot.Desc; });
+            if (pooled == pool.end())
+            {
+                pool.push_back({ slot.Desc, backend.CreateTexture(slot.Desc), false });
+                pooled = pool.end() - 1;
+            }
+            pooled->Used = true;
+            slot.Texture = pooled->Texture;
+        }
+        for (size_t i = pool.size(); i-- > 0;)
+        {
+            if (pool[i].Used)
+                continue;
+            backend.DestroyTexture(pool[i].Texture);
+            pool.erase(pool.begin() + i);
+        }
+    }
+
+    static unsigned long long bytes(const FrameGraphTextureDesc& desc)
+    {
+        return static_cast<unsigned long long>(desc.Width) * desc.Height * TexelBytes(desc.InternalFormat);
+    }
+
+    static const char* formatName(GLenum internalFormat)
+    {
+        switch (internalFormat)
+        {
+        case GL_R8: return "R8";
+        case GL_R16F: return "R16F";
+        case GL_RG32F: return "RG32F";
+        case GL_RGBA8: return "RGBA8";
+        case GL_SRGB8_ALPHA8: return "SRGB8_ALPHA8";
+        case GL_RGBA16F: return "RGBA16F";
+        case GL_RGBA32F: return "RGBA32F";
+        case GL_DEPTH24_STENCIL8: return "DEPTH24_STENCIL8";
+        case GL_DEPTH_COMPONENT24: return "DEPTH_COMPONENT24";
+        case GL_DEPTH_COMPONENT32F: return "DEPTH_COMPONENT32F";
+        default: return "?";
+        }
+    }
+};
+
+inline FrameGraphResource FrameGraphPassBuilder::Create(const char* name, const FrameGraphTextureDesc& desc)
+{
+    return graph.create(pass, name, desc);
+}
+
+inline FrameGraphResource FrameGraphPassBuilder::Read(FrameGraphResource resource)
+{
+    return graph.read(pass, resource);
+}
+
+inline FrameGraphResource FrameGraphPassBuilder::Write(FrameGraphResource resource)
+{
+    return graph.write(pass, resource);
+}
+
+inline unsigned int FrameGraphContext::Texture(FrameGraphResource resource) const
+{
+    const FrameGraph::Resource& target = graph.resources[graph.versions[resource].Resource];
+    return target.Imported ? 0 : graph.slots[target.Slot].Texture;
+}
+
+inline unsigned int FrameGraphContext::Framebuffer(std::initializer_list<FrameGraphResource> resources) const
+{
+    std::vector<FrameGraphAttachment> attachments;
+    for (FrameGraphResource resource : resources)
+    {
+        if (resource == FRAME_GRAPH_NO_RESOURCE)
+            continue;
+        const FrameGraph::Resource& target = graph.resources[graph.versions[resource].Resource];
+        if (target.Imported)
+            return target.Framebuffer;
+        attachments.push_back({ graph.slots[target.Slot].Texture, target.Desc.InternalFormat });
+    }
+    return backend.Framebuffer(attachments);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// the six planes of a view frustum, pointing inwards, taken from a projection * view matrix (Gribb and Hartmann)
+struct Frustum {
+    glm::vec4 Planes[6]; // left, right, bottom, top, near, far as (normal, distance)
+
+    static Frustum FromMatrix(const glm::mat4& viewProjection)
+    {
+        // glm is column major, m[column][row]
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++)
+            rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+        Frustum frustum;
+        frustum.Planes[0] = rows[3] + rows[0];
+        frustum.Planes[1] = rows[3] - rows[0];
+        frustum.Planes[2] = rows[3] + rows[1];
+        frustum.Planes[3] = rows[3] - rows[1];
+        frustum.Planes[4] = rows[3] + rows[2];
+        frustum.Planes[5] = rows[3] - rows[2];
+        for (glm::vec4& plane : frustum.Planes)
+            plane /= glm::length(glm::vec3(plane));
+        return frustum;
+    }
+
+    // false only when the sphere is completely outside one of the planes
+    bool IntersectsSphere(const glm::vec3& center, float radius) const
+    {
+        for (const glm::vec4& plane : Planes)
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+                return false;
+        return true;
+    }
+
+    // false only when the box is completely outside one of the planes, tested with the corner furthest along
+    // each plane's normal
+    bool IntersectsBox(const glm::vec3& min, const glm::vec3& max) const
+    {
+        for (const glm::vec4& plane : Planes)
+        {
+            glm::vec3 corner(plane.x >= 0.0f ? max.x : min.x, plane.y >= 0.0f ? max.y : min.y, plane.z >= 0.0f ? max.z : min.z);
+            if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+};
+
+// objects tested against the frustum in a frame and how many of them were skipped
+struct CullingStats {
+    int Tested = 0;
+    int Culled = 0;
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "frame_graph.h"
+#include "gpu_profiler.h"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <vector>
+
+// the OpenGL side: textures with nearest filtering, framebuffers cached by their attachments and, when Profiler is
+// set, a GPU timer around every pass
+class GlFrameGraphBackend : public FrameGraphBackend
+{
+public:
+    GpuProfiler* Profiler = nullptr;
+
+    unsigned int CreateTexture(const FrameGraphTextureDesc& desc) override
+    {
+        GLenum format = GL_RGBA;
+        GLenum type = GL_UNSIGNED_BYTE;
+        switch (desc.InternalFormat)
+        {
+        case GL_R8: format = GL_RED; break;
+        case GL_R16F: case GL_R32F: format = GL_RED; type = GL_FLOAT; break;
+        case GL_RG32F: case GL_RG16F: format = GL_RG; type = GL_FLOAT; break;
+        case GL_RGBA16F: case GL_RGBA32F: type = GL_FLOAT; break;
+        case GL_DEPTH24_STENCIL8: format = GL_DEPTH_STENCIL; type = GL_UNSIGNED_INT_24_8; break;
+        case GL_DEPTH_COMPONENT24: format = GL_DEPTH_COMPONENT; type = GL_UNSIGNED_INT; break;
+        case GL_DEPTH_COMPONENT32F: format = GL_DEPTH_COMPONENT; type = GL_FLOAT; break;
+        }
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, desc.InternalFormat, desc.Width, desc.Height, 0, format, type, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    }
+
+    void DestroyTexture(unsigned int texture) override
+    {
+        for (auto cached = framebuffers.begin(); cached != framebuffers.end();)
+        {
+            if (std::find(cached->first.begin(), cached->first.end(), texture) != cached->first.end())
+            {
+                glDeleteFramebuffers(1, &cached->second);
+                cached = framebuffers.erase(cached);
+            }
+            else
+                ++cached;
+        }
+        glDeleteTextures(1, &texture);
+    }
+
+    unsigned int Framebuffer(const std::vector<FrameGraphAttachment>& attachments) override
+    {
+        std::vector<unsigned int> key;
+        for (const FrameGraphAttachment& attachment : attachments)
+            key.push_back(attachment.Texture);
+        auto cached = framebuffers.find(key);
+        if (cached != framebuffers.end())
+            return cached->second;
+
+        // passes ask for framebuffers while they execute (to blit from), so the one they draw into and read from
+        // stays bound
+        GLint drawFramebuffer = 0, readFramebuffer = 0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer);
+        glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+        unsigned int framebuffer;
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        std::vector<GLenum> drawBuffers;
+        for (const FrameGraphAttachment& attachment : attachments)
+        {
+            GLenum point = GL_COLOR_ATTACHMENT0 + static_cast<GLenum>(drawBuffers.size());
+            if (IsDepthFormat(attachment.InternalFormat))
+                point = HasStencil(attachment.InternalFormat) ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+            else
+                drawBuffers.push_back(point);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, point, GL_TEXTURE_2D, attachment.Texture, 0);
+        }
+        if (drawBuffers.empty())
+        {
+            // depth only
+            const GLenum none = GL_NONE;
+            glDrawBuffers(1, &none);
+            glReadBuffer(GL_NONE);
+        }
+        else
+            glDrawBuffers(static_cast<GLsizei>(drawBuffers.size()), drawBuffers.data());
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "Frame graph framebuffer is incomplete" << std::endl;
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+        framebuffers[key] = framebuffer;
+        return framebuffer;
+    }
+
+    void BindRenderTarget(unsigned int framebuffer, int width, int height) override
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, width, height);
+    }
+
+    void BeginPass(const char* name) override
+    {
+        if (Profiler)
+            Profiler->BeginPass(name);
+    }
+
+    void EndPass() override
+    {
+        if (Profiler)
+            Profiler->EndPass();
+    }
+
+    // the cached framebuffers, the graph releases its textures itself
+    void Release()
+    {
+        for (auto& cached : framebuffers)
+            glDeleteFramebuffers(1, &cached.second);
+        framebuffers.clear();
+    }
+
+private:
+    std::map<std::vector<unsigned int>, unsigned int> framebuffers; // by the textures attached
+};
@@ -0,0 +1,332 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// entry points wrapped by InstallGlInstrumentation: everything the chapters call through glad (the ImGui backend
+// has its own loader and is not included)
+#define GL_INSTRUMENTED_FUNCTIONS(X) \
+    X(glActiveTexture) \
+    X(glAttachShader) \
+    X(glBindBuffer) \
+    X(glBindFramebuffer) \
+    X(glBindRenderbuffer) \
+    X(glBindTexture) \
+    X(glBindVertexArray) \
+    X(glBlendFunc) \
+    X(glBlendFuncSeparate) \
+    X(glBlitFramebuffer) \
+    X(glBufferData) \
+    X(glBufferSubData) \
+    X(glCheckFramebufferStatus) \
+    X(glClear) \
+    X(glClearBufferfv) \
+    X(glClearColor) \
+    X(glColorMask) \
+    X(glCompileShader) \
+    X(glCompressedTexImage2D) \
+    X(glCreateProgram) \
+    X(glCreateShader) \
+    X(glCullFace) \
+    X(glDeleteBuffers) \
+    X(glDeleteFramebuffers) \
+    X(glDeleteProgram) \
+    X(glDeleteQueries) \
+    X(glDeleteRenderbuffers) \
+    X(glDeleteShader) \
+    X(glDeleteTextures) \
+    X(glDeleteVertexArrays) \
+    X(glDepthFunc) \
+    X(glDepthMask) \
+    X(glDisable) \
+    X(glDrawArrays) \
+    X(glDrawArraysInstanced) \
+    X(glDrawBuffers) \
+    X(glDrawElements) \
+    X(glDrawElementsInstanced) \
+    X(glEnable) \
+    X(glEnableVertexAttribArray) \
+    X(glFinish) \
+    X(glFlush) \
+    X(glFramebufferRenderbuffer) \
+    X(glFramebufferTexture2D) \
+    X(glGenBuffers) \
+    X(glGenFramebuffers) \
+    X(glGenQueries) \
+    X(glGenRenderbuffers) \
+    X(glGenTextures) \
+    X(glGenVertexArrays) \
+    X(glGenerateMipmap) \
+    X(glGetError) \
+    X(glGetIntegerv) \
+    X(glGetProgramInfoLog) \
+    X(glGetProgramiv) \
+    X(glGetQueryObjectui64v) \
+    X(glGetQueryObjectuiv) \
+    X(glGetQueryiv) \
+    X(glGetShaderInfoLog) \
+    X(glGetShaderiv) \
+    X(glGetString) \
+    X(glGetStringi) \
+    X(glGetUniformLocation) \
+    X(glLinkProgram) \
+    X(glPixelStorei) \
+    X(glPolygonMode) \
+    X(glQueryCounter) \
+    X(glReadBuffer) \
+    X(glReadPixels) \
+    X(glRenderbufferStorage) \
+    X(glScissor) \
+    X(glShaderSource) \
+    X(glStencilFunc) \
+    X(glStencilMask) \
+    X(glStencilOp) \
+    X(glTexImage2D) \
+    X(glTexImage3D) \
+    X(glTexParameterf) \
+    X(glTexParameteri) \
+    X(glTexParameteriv) \
+    X(glTexSubImage2D) \
+    X(glTexSubImage3D) \
+    X(glUniform1f) \
+    X(glUniform1i) \
+    X(glUniform2f) \
+    X(glUniform2fv) \
+    X(glUniform3f) \
+    X(glUniform3fv) \
+    X(glUniform4f) \
+    X(glUniform4fv) \
+    X(glUniformMatrix2fv) \
+    X(glUniformMatrix3fv) \
+    X(glUniformMatrix4fv) \
+    X(glUseProgram) \
+    X(glVertexAttribDivisor) \
+    X(glVertexAttribIPointer) \
+    X(glVertexAttribPointer) \
+    X(glViewport)
+
+enum GlFunction {
+#define GL_FUNCTION_ENUM(name) GL_FUNCTION_##name,
+    GL_INSTRUMENTED_FUNCTIONS(GL_FUNCTION_ENUM)
+#undef GL_FUNCTION_ENUM
+    GL_FUNCTION_COUNT
+};
+
+// GL_KHR_debug / OpenGL 4.3 names, which a glad generated for 3.3 core does not have
+#define INSTRUMENTATION_GL_DEBUG_OUTPUT_SYNCHRONOUS 0x8242
+#define INSTRUMENTATION_GL_DEBUG_TYPE_PERFORMANCE 0x8250
+#define INSTRUMENTATION_GL_DEBUG_OUTPUT 0x92E0
+#define INSTRUMENTATION_GL_CONTEXT_FLAGS 0x821E
+#define INSTRUMENTATION_GL_CONTEXT_FLAG_DEBUG_BIT 0x00000002
+#define INSTRUMENTATION_GL_DONT_CARE 0x1100
+
+// calls per entry point and the CPU time spent inside them (in the driver) since the last ResetGlCallCounters
+struct GlCallCounters {
+    unsigned long long Calls[GL_FUNCTION_COUNT] = {};
+    unsigned long long Nanoseconds[GL_FUNCTION_COUNT] = {};
+
+    unsigned long long TotalCalls() const
+    {
+        unsigned long long total = 0;
+        for (unsigned long long calls : Calls)
+            total += calls;
+        return total;
+    }
+
+    unsigned long long TotalNanoseconds() const
+    {
+        unsigned long long total = 0;
+        for (unsigned long long nanoseconds : Nanoseconds)
+            total += nanoseconds;
+        return total;
+    }
+};
+
+// a driver message of the performance category (GL_KHR_debug) and how often it was reported
+struct GlDebugMessage {
+    std::string Text;
+    unsigned long long Count;
+};
+
+inline GlCallCounters& CurrentGlCallCounters()
+{
+    static GlCallCounters counters;
+    return counters;
+}
+
+inline void ResetGlCallCounters()
+{
+    CurrentGlCallCounters() = GlCallCounters();
+}
+
+inline const char* GlFunctionName(int function)
+{
+    static const char* names[] = {
+#define GL_FUNCTION_NAME(name) #name,
+        GL_INSTRUMENTED_FUNCTIONS(GL_FUNCTION_NAME)
+#undef GL_FUNCTION_NAME
+    };
+    return function >= 0 && function < GL_FUNCTION_COUNT ? names[function] : "unknown";
+}
+
+typedef void (APIENTRY* GlDebugMessageProc)(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam);
+typedef void (APIENTRY* GlDebugMessageCallbackProc)(GlDebugMessageProc callback, const void* userParam);
+typedef void (APIENTRY* GlDebugMessageControlProc)(GLenum source, GLenum type, GLenum severity, GLsizei count, const GLuint* ids, GLboolean enabled);
+
+inline bool& GlDebugOutputEnabled()
+{
+    static bool enabled = false;
+    return enabled;
+}
+
+// distinct performance messages and how often each came. The driver may call back from its own threads when the
+// context is not a debug context, so the map is locked
+inline std::mutex& GlDebugMessagesMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+inline std::map<std::string, unsigned long long>& ReceivedGlDebugMessages()
+{
+    static std::map<std::string, unsigned long long> messages;
+    return messages;
+}
+
+// most frequent first
+inline std::vector<GlDebugMessage> GlDebugMessages()
+{
+    std::vector<GlDebugMessage> messages;
+    {
+        std::lock_guard<std::mutex> lock(GlDebugMessagesMutex());
+        for (const std::pair<const std::string, unsigned long long>& message : ReceivedGlDebugMessages())
+            messages.push_back({ message.first, message.second });
+    }
+    std::sort(messages.begin(), messages.end(), [](const GlDebugMessage& a, const GlDebugMessage& b) { return a.Count > b.Count; });
+    return messages;
+}
+
+inline void APIENTRY GlDebugMessageCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam)
+{
+    if (type != INSTRUMENTATION_GL_DEBUG_TYPE_PERFORMANCE)
+        return;
+    std::string text = length >= 0 ? std::string(message, length) : std::string(message);
+    std::lock_guard<std::mutex> lock(GlDebugMessagesMutex());
+    if (ReceivedGlDebugMessages()[text]++ == 0)
+        std::cout << "GL performance warning: " << text << std::endl;
+}
+
+inline bool GlDebugOutputSupported()
+{
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if (major > 4 || (major == 4 && minor >= 3))
+        return true;
+    GLint extensionCount = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+    for (GLint i = 0; i < extensionCount; i++)
+    {
+        const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (extension && std::strcmp(extension, "GL_KHR_debug") == 0)
+            return true;
+    }
+    return false;
+}
+
+// adds the time between its construction and destruction to one entry point. A scope rather than two statements
+// around the call so the wrapper below can return the call's result directly
+class DriverTimer
+{
+public:
+    DriverTimer(int function) : function(function), start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~DriverTimer()
+    {
+        GlCallCounters& counters = CurrentGlCallCounters();
+        counters.Calls[function]++;
+        counters.Nanoseconds[function] += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    int function;
+    std::chrono::steady_clock::time_point start;
+};
+
+// one wrapper per entry point, generated from the glad pointer type: the real pointer it replaced and a call with the
+// same signature that times and forwards to it
+template <int Function, typename Proc>
+struct InstrumentedCall;
+
+template <int Function, typename Result, typename... Args>
+struct InstrumentedCall<Function, Result (APIENTRY*)(Args...)> {
+    static Result (APIENTRY* Real)(Args...);
+
+    static Result APIENTRY Call(Args... args)
+    {
+        DriverTimer timer(Function);
+        return Real(args...);
+    }
+};
+
+template <int Function, typename Result, typename... Args>
+Result (APIENTRY* InstrumentedCall<Function, Result (APIENTRY*)(Args...)>::Real)(Args...) = nullptr;
+
+// name is only pasted or stringized, never passed on, so glad's gl<Name> macros don't expand it
+#define GL_INSTALL_WRAPPER(name) \
+    { \
+        typedef InstrumentedCall<GL_FUNCTION_##name, std::remove_reference<decltype(glad_##name)>::type> Wrapper; \
+        if (glad_##name) \
+        { \
+            Wrapper::Real = glad_##name; \
+            glad_##name = Wrapper::Call; \
+        } \
+    }
+
+// wraps the glad pointers of GL_INSTRUMENTED_FUNCTIONS in counting and timing wrappers and, when the context supports
+// GL_KHR_debug (or OpenGL 4.3), collects its performance messages (implicit syncs, shader recompiles, ...), which
+// drivers only report reliably in debug contexts. Call after InstallRenderStatsHooks, whose hooks are then timed as
+// part of the calls they forward. getProcAddress loads the debug output functions, which a 3.3 glad does not have.
+inline void InstallGlInstrumentation(void* (*getProcAddress)(const char* name))
+{
+    static bool installed = false;
+    if (installed)
+        return;
+    installed = true;
+
+    GlDebugMessageCallbackProc debugMessageCallback = nullptr;
+    GlDebugMessageControlProc debugMessageControl = nullptr;
+    if (GlDebugOutputSupported())
+    {
+        debugMessageCallback = reinterpret_cast<GlDebugMessageCallbackProc>(getProcAddress("glDebugMessageCallback"));
+        debugMessageControl = reinterpret_cast<GlDebugMessageControlProc>(getProcAddress("glDebugMessageControl"));
+    }
+    if (debugMessageCallback && debugMessageControl)
+    {
+        GLint flags = 0;
+        glGetIntegerv(INSTRUMENTATION_GL_CONTEXT_FLAGS, &flags);
+        if (!(flags & INSTRUMENTATION_GL_CONTEXT_FLAG_DEBUG_BIT))
+            std::cout << "Not a debug context, the driver may not report performance warnings" << std::endl;
+        glEnable(INSTRUMENTATION_GL_DEBUG_OUTPUT);
+        glEnable(INSTRUMENTATION_GL_DEBUG_OUTPUT_SYNCHRONOUS); // messages arrive inside the call that caused them
+        debugMessageControl(INSTRUMENTATION_GL_DONT_CARE, INSTRUMENTATION_GL_DONT_CARE, INSTRUMENTATION_GL_DONT_CARE, 0, nullptr, GL_FALSE);
+        debugMessageControl(INSTRUMENTATION_GL_DONT_CARE, INSTRUMENTATION_GL_DEBUG_TYPE_PERFORMANCE, INSTRUMENTATION_GL_DONT_CARE, 0, nullptr, GL_TRUE);
+        debugMessageCallback(GlDebugMessageCallback, nullptr);
+        GlDebugOutputEnabled() = true;
+    }
+    else
+        std::cout << "GL_KHR_debug is not available, driver performance warnings are not collected" << std::endl;
+
+    GL_INSTRUMENTED_FUNCTIONS(GL_INSTALL_WRAPPER)
+}
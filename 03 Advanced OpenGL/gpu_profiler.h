@@ -0,0 +1,226 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstring>
+#include <vector>
+
+// frames of queries in flight. A frame's results are read back this many frames after it was submitted, when the
+// GPU has long finished it, so reading them never waits
+#define GPU_PROFILER_FRAMES 3
+// samples in the rolling averages
+#define GPU_PROFILER_HISTORY 64
+
+// GPU time of one pass (or of the whole frame), in milliseconds
+struct GpuPassTiming {
+    const char* Name = nullptr;
+    double LastMs = 0.0;
+    double AverageMs = 0.0; // over the last GPU_PROFILER_HISTORY frames that had the pass
+    float History[GPU_PROFILER_HISTORY] = {};
+    int Samples = 0; // total, the newest sample is History[(Samples - 1) % GPU_PROFILER_HISTORY]
+};
+
+// times named passes on the GPU with GL_TIMESTAMP queries (glQueryCounter) written before and after each pass.
+// Timestamps rather than GL_TIME_ELAPSED, as only one elapsed query can be active at a time while timestamps nest
+// (the frame contains the passes). The queries of each frame go to one of GPU_PROFILER_FRAMES slots which is read
+// back when it comes round again. When the driver has no timer (some software rasterisers report 0 counter bits)
+// every call does nothing and Supported() is false.
+class GpuProfiler
+{
+public:
+    // call once the OpenGL context is current
+    void Init()
+    {
+        GLint bits = 0;
+        glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+        supported = bits > 0;
+        frame.Name = "Frame";
+        while (glGetError() != GL_NO_ERROR)
+            ; // drivers without timer queries may reject the target
+    }
+
+    bool Supported() const
+    {
+        return supported;
+    }
+
+    // reads back the slot this frame reuses and starts timing the frame
+    void BeginFrame()
+    {
+        if (!supported)
+            return;
+        Slot& slot = slots[frameIndex % GPU_PROFILER_FRAMES];
+        if (slot.Used > 0)
+            readBack(slot);
+        slot.Used = 0;
+        slot.Passes.clear();
+        frameQuery = beginQuery(slot, "Frame");
+    }
+
+    void EndFrame()
+    {
+        if (!supported)
+            return;
+        endQuery(slots[frameIndex % GPU_PROFILER_FRAMES], frameQuery);
+        frameIndex++;
+    }
+
+    // passes may nest. name must outlive the profiler (a string literal)
+    void BeginPass(const char* name)
+    {
+        if (!supported)
+            return;
+        openPasses.push_back(beginQuery(slots[frameIndex % GPU_PROFILER_FRAMES], name));
+    }
+
+    void EndPass()
+    {
+        if (!supported || openPasses.empty())
+            return;
+        endQuery(slots[frameIndex % GPU_PROFILER_FRAMES], openPasses.back());
+        openPasses.pop_back();
+    }
+
+    // the whole frame, from BeginFrame to EndFrame
+    const GpuPassTiming& Frame() const
+    {
+        return frame;
+    }
+
+    // in the order they were first seen
+    const std::vector<GpuPassTiming>& Passes() const
+    {
+        return passes;
+    }
+
+    // frames whose queries were not finished when their slot came round again and were dropped instead of waited for
+    unsigned long long DroppedFrames() const
+    {
+        return droppedFrames;
+    }
+
+    void Release()
+    {
+        for (Slot& slot : slots)
+        {
+            if (!slot.Queries.empty())
+                glDeleteQueries(static_cast<GLsizei>(slot.Queries.size()), slot.Queries.data());
+            slot.Queries.clear();
+            slot.Passes.clear();
+            slot.Used = 0;
+        }
+    }
+
+private:
+    struct PassQueries {
+        const char* Name;
+        int Begin; // indices into Slot::Queries
+        int End;
+    };
+
+    struct Slot {
+        std::vector<GLuint> Queries; // grown on demand and reused every time the slot comes round
+        int Used = 0;
+        std::vector<PassQueries> Passes;
+    };
+
+    bool supported = false;
+    Slot slots[GPU_PROFILER_FRAMES];
+    unsigned long long frameIndex = 0;
+    int frameQuery = -1;
+    std::vector<int> openPasses; // indices into the current slot's Passes
+    GpuPassTiming frame;
+    std::vector<GpuPassTiming> passes;
+    unsigned long long droppedFrames = 0;
+
+    int timestamp(Slot& slot)
+    {
+        if (slot.Used == static_cast<int>(slot.Queries.size()))
+        {
+            GLuint query = 0;
+            glGenQueries(1, &query);
+            slot.Queries.push_back(query);
+        }
+        int index = slot.Used++;
+        glQueryCounter(slot.Queries[index], GL_TIMESTAMP);
+        return index;
+    }
+
+    int beginQuery(Slot& slot, const char* name)
+    {
+        PassQueries pass;
+        pass.Name = name;
+        pass.Begin = timestamp(slot);
+        pass.End = -1;
+        slot.Passes.push_back(pass);
+        return static_cast<int>(slot.Passes.size()) - 1;
+    }
+
+    void endQuery(Slot& slot, int pass)
+    {
+        slot.Passes[pass].End = timestamp(slot);
+    }
+
+    void readBack(const Slot& slot)
+    {
+        // queries complete in order, so the last one being available means the whole frame is
+        GLuint available = 0;
+        glGetQueryObjectuiv(slot.Queries[slot.Used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+        {
+            droppedFrames++;
+            return;
+        }
+        for (const PassQueries& pass : slot.Passes)
+        {
+            if (pass.End < 0)
+                continue; // EndPass was never called
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(slot.Queries[pass.Begin], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(slot.Queries[pass.End], GL_QUERY_RESULT, &end);
+            double ms = end > begin ? (end - begin) / 1e6 : 0.0;
+            // BeginFrame always adds the frame as the slot's first pass
+            addSample(&pass == &slot.Passes[0] ? frame : timing(pass.Name), ms);
+        }
+    }
+
+    GpuPassTiming& timing(const char* name)
+    {
+        for (GpuPassTiming& pass : passes)
+            if (std::strcmp(pass.Name, name) == 0)
+                return pass;
+        passes.push_back(GpuPassTiming());
+        passes.back().Name = name;
+        return passes.back();
+    }
+
+    static void addSample(GpuPassTiming& timing, double ms)
+    {
+        timing.LastMs = ms;
+        timing.History[timing.Samples % GPU_PROFILER_HISTORY] = static_cast<float>(ms);
+        timing.Samples++;
+        int count = timing.Samples < GPU_PROFILER_HISTORY ? timing.Samples : GPU_PROFILER_HISTORY;
+        double sum = 0.0;
+        for (int i = 0; i < count; i++)
+            sum += timing.History[i];
+        timing.AverageMs = sum / count;
+    }
+};
+
+// times the GPU work submitted between its construction and destruction as a pass
+class GpuPassScope
+{
+public:
+    GpuPassScope(GpuProfiler& profiler, const char* name) : profiler(profiler)
+    {
+        profiler.BeginPass(name);
+    }
+
+    ~GpuPassScope()
+    {
+        profiler.EndPass();
+    }
+
+private:
+    GpuProfiler& profiler;
+};
@@ -0,0 +1,451 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "camera.h"
+#include "gl_instrumentation.h"
+#include "render_stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <GLFW/glfw3.h>
+#else
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+// command line options of a headless run: --headless, --frames N, --size WxH, --screenshot file.ppm, --warmup N,
+// --json file.json, --camera-path file, --record-camera file, --trace file.json and --gl-calls. --benchmark is
+// --headless with 60 warmup frames unless --warmup is given
+struct HeadlessOptions {
+    bool Enabled = false;
+    int Frames = 300;
+    int WarmupFrames = 0; // rendered before the measured frames and left out of the stats
+    int Width = 0;
+    int Height = 0;
+    std::string ScreenshotPath; // the last frame is written here as a PPM image when set
+    std::string JsonPath; // benchmark results are written here when set
+    std::string CameraPathFile; // recorded camera path to replay instead of the orbit
+    std::string RecordCameraPathFile; // windowed runs record the camera path here when set
+    std::string TracePath; // the profiler zones are written here as a Chrome trace on exit when set
+    bool GlCalls = false; // count and time every GL call and collect driver performance warnings (debug context)
+};
+
+inline HeadlessOptions ParseHeadlessOptions(int argc, char* argv[], int defaultWidth, int defaultHeight)
+{
+    HeadlessOptions options;
+    options.Width = defaultWidth;
+    options.Height = defaultHeight;
+    bool benchmark = false;
+    bool warmupSet = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--headless") == 0)
+            options.Enabled = true;
+        else if (std::strcmp(argv[i], "--benchmark") == 0)
+            options.Enabled = benchmark = true;
+        else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            options.Frames = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+        {
+            options.WarmupFrames = std::max(0, std::atoi(argv[++i]));
+            warmupSet = true;
+        }
+        else if (std::strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+        {
+            int width, height;
+            if (std::sscanf(argv[++i], "%dx%d", &width, &height) == 2 && width > 0 && height > 0)
+            {
+                options.Width = width;
+                options.Height = height;
+            }
+        }
+        else if (std::strcmp(argv[i], "--screenshot") == 0 && i + 1 < argc)
+            options.ScreenshotPath = argv[++i];
+        else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+            options.JsonPath = argv[++i];
+        else if (std::strcmp(argv[i], "--camera-path") == 0 && i + 1 < argc)
+            options.CameraPathFile = argv[++i];
+        else if (std::strcmp(argv[i], "--record-camera") == 0 && i + 1 < argc)
+            options.RecordCameraPathFile = argv[++i];
+        else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+            options.TracePath = argv[++i];
+        else if (std::strcmp(argv[i], "--gl-calls") == 0)
+            options.GlCalls = true;
+    }
+    if (benchmark && !warmupSet)
+        options.WarmupFrames = 60; // shader compiles, first texture uses and driver caches settle in these
+    return options;
+}
+
+// OpenGL 3.3 core context without a window, for running the scene on machines without a display or GPU (Mesa
+// llvmpipe on CI). Uses a surfaceless EGL context on Linux and a hidden GLFW window on Windows. The scene renders
+// into an offscreen sRGB framebuffer (like the sRGB capable window) that stays bound for the whole run.
+class HeadlessContext
+{
+public:
+    ~HeadlessContext()
+    {
+        Destroy();
+    }
+
+    // creates the context, makes it current, loads the OpenGL functions and binds the offscreen framebuffer. A debug
+    // context makes the driver report performance warnings through GL_KHR_debug, at some cost
+    bool Create(int width, int height, bool debugContext = false)
+    {
+        this->width = width;
+        this->height = height;
+
+#ifdef _WIN32
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, debugContext ? GLFW_TRUE : GLFW_FALSE);
+        GLFWwindow* window = glfwCreateWindow(width, height, "LearnOpenGL (headless)", NULL, NULL);
+        if (window == NULL)
+        {
+            std::cout << "Failed to create hidden GLFW window" << std::endl;
+            glfwTerminate();
+            return false;
+        }
+        glfwMakeContextCurrent(window);
+        context = window;
+
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return false;
+        }
+#else
+        // surfaceless display (Mesa), so no X/Wayland server is needed. Falls back to the default display
+        EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay)
+            eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if (eglDisplay == EGL_NO_DISPLAY)
+            eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, nullptr, nullptr))
+        {
+            std::cout << "Failed to initialize EGL" << std::endl;
+            return false;
+        }
+        display = eglDisplay;
+
+        const EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_SURFACE_TYPE, 0, EGL_NONE };
+        EGLConfig config;
+        EGLint configCount = 0;
+        if (!eglBindAPI(EGL_OPENGL_API) || !eglChooseConfig(eglDisplay, configAttributes, &config, 1, &configCount) || configCount == 0)
+        {
+            std::cout << "No EGL config supports desktop OpenGL" << std::endl;
+            return false;
+        }
+
+        const EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3,
+            EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_CONTEXT_OPENGL_DEBUG, debugContext ? EGL_TRUE : EGL_FALSE,
+            EGL_NONE
+        };
+        EGLContext eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttributes);
+        if (eglContext == EGL_NO_CONTEXT || !eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext))
+        {
+            std::cout << "Failed to create a surfaceless OpenGL 3.3 core context" << std::endl;
+            return false;
+        }
+        context = eglContext;
+
+        if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return false;
+        }
+#endif
+
+        // there is no default framebuffer to draw to, so the scene renders into this one instead
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glGenRenderbuffers(1, &colorBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_SRGB8_ALPHA8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+        glGenRenderbuffers(1, &depthStencilBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthStencilBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthStencilBuffer);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cout << "Offscreen framebuffer is incomplete" << std::endl;
+            return false;
+        }
+
+        glViewport(0, 0, width, height);
+        return true;
+    }
+
+    void Destroy()
+    {
+        if (!context)
+            return;
+
+        glDeleteRenderbuffers(1, &colorBuffer);
+        glDeleteRenderbuffers(1, &depthStencilBuffer);
+        glDeleteFramebuffers(1, &framebuffer);
+        framebuffer = 0;
+
+#ifdef _WIN32
+        glfwDestroyWindow(static_cast<GLFWwindow*>(context));
+        glfwTerminate();
+#else
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(display, context);
+        eglTerminate(display);
+#endif
+        context = nullptr;
+        display = nullptr;
+    }
+
+    // for InstallGlInstrumentation, which loads functions glad was not generated with
+    static void* GetProcAddress(const char* name)
+    {
+#ifdef _WIN32
+        return reinterpret_cast<void*>(glfwGetProcAddress(name));
+#else
+        return reinterpret_cast<void*>(eglGetProcAddress(name));
+#endif
+    }
+
+    // the framebuffer the scene renders into, bind it wherever the windowed path binds framebuffer 0
+    unsigned int Framebuffer() const
+    {
+        return framebuffer;
+    }
+
+    bool SaveScreenshot(const std::string& path) const
+    {
+        std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * 3);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+        std::ofstream file(path, std::ios::binary);
+        file << "P6\n" << width << " " << height << "\n255\n";
+        // OpenGL rows start at the bottom
+        for (int y = height - 1; y >= 0; y--)
+            file.write(reinterpret_cast<const char*>(&pixels[static_cast<size_t>(y) * width * 3]), width * 3);
+        return file.good();
+    }
+
+private:
+    void* display = nullptr;
+    void* context = nullptr;
+    int width = 0;
+    int height = 0;
+    unsigned int framebuffer = 0;
+    unsigned int colorBuffer = 0;
+    unsigned int depthStencilBuffer = 0;
+};
+
+// CPU frame times and render stats of a run, reported as min/median/p95/p99/max and per frame averages
+class FrameStats
+{
+public:
+    void AddFrame(double milliseconds, const RenderStats& renderStats = RenderStats())
+    {
+        frameTimes.push_back(milliseconds);
+        totals.DrawCalls += renderStats.DrawCalls;
+        totals.Triangles += renderStats.Triangles;
+        totals.StateChanges += renderStats.StateChanges;
+    }
+
+    // GL calls of the frame added last, for runs with --gl-calls
+    void AddGlCalls(const GlCallCounters& counters)
+    {
+        glCallFrames++;
+        for (int i = 0; i < GL_FUNCTION_COUNT; i++)
+        {
+            glCallTotals.Calls[i] += counters.Calls[i];
+            glCallTotals.Nanoseconds[i] += counters.Nanoseconds[i];
+        }
+    }
+
+    double Percentile(double p) const
+    {
+        if (frameTimes.empty())
+            return 0.0;
+        std::vector<double> sorted = frameTimes;
+        std::sort(sorted.begin(), sorted.end());
+        size_t index = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+        return sorted[std::min(sorted.size() - 1, index > 0 ? index - 1 : 0)];
+    }
+
+    void Print(const std::string& name) const
+    {
+        if (frameTimes.empty())
+            return;
+        double average = std::accumulate(frameTimes.begin(), frameTimes.end(), 0.0) / frameTimes.size();
+        std::printf("%s: %zu frames, avg %.3f ms (%.1f fps), min %.3f ms, median %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+            name.c_str(), frameTimes.size(), average, 1000.0 / average, Percentile(0.0), Percentile(50.0), Percentile(95.0),
+            Percentile(99.0), Percentile(100.0));
+        if (glCallFrames > 0)
+        {
+            std::printf("GL calls: %.1f per frame, %.3f ms per frame in the driver\n", glCallTotals.TotalCalls() / static_cast<double>(glCallFrames),
+                glCallTotals.TotalNanoseconds() / 1e6 / glCallFrames);
+            std::vector<int> functions = calledGlFunctions();
+            for (size_t i = 0; i < functions.size() && i < 5; i++)
+                std::printf("  %s: %.1f calls, %.3f ms\n", GlFunctionName(functions[i]), glCallTotals.Calls[functions[i]] / static_cast<double>(glCallFrames),
+                    glCallTotals.Nanoseconds[functions[i]] / 1e6 / glCallFrames);
+        }
+    }
+
+    // writes the results as one JSON object (see README.md for the fields)
+    bool WriteJson(const std::string& path, const std::string& scene, const HeadlessOptions& options) const
+    {
+        if (frameTimes.empty())
+            return false;
+        double frameCount = static_cast<double>(frameTimes.size());
+        double average = std::accumulate(frameTimes.begin(), frameTimes.end(), 0.0) / frameCount;
+        const char* renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+
+        FILE* file = std::fopen(path.c_str(), "w");
+        if (!file)
+        {
+            std::cout << "Failed to write benchmark results: " << path << std::endl;
+            return false;
+        }
+        std::fprintf(file, "{\n");
+        std::fprintf(file, "  \"scene\": \"%s\",\n", jsonEscape(scene).c_str());
+        std::fprintf(file, "  \"renderer\": \"%s\",\n", jsonEscape(renderer ? renderer : "unknown").c_str());
+        std::fprintf(file, "  \"width\": %d,\n  \"height\": %d,\n", options.Width, options.Height);
+        std::fprintf(file, "  \"warmupFrames\": %d,\n  \"frames\": %zu,\n", options.WarmupFrames, frameTimes.size());
+        std::fprintf(file, "  \"cameraPath\": \"%s\",\n", jsonEscape(options.CameraPathFile.empty() ? "orbit" : options.CameraPathFile).c_str());
+        std::fprintf(file, "  \"cpuFrameMs\": { \"avg\": %.4f, \"min\": %.4f, \"median\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f },\n",
+            average, Percentile(0.0), Percentile(50.0), Percentile(95.0), Percentile(99.0), Percentile(100.0));
+        std::fprintf(file, "  \"drawCallsPerFrame\": %.1f,\n", totals.DrawCalls / frameCount);
+        std::fprintf(file, "  \"trianglesPerFrame\": %.1f,\n", totals.Triangles / frameCount);
+        std::fprintf(file, "  \"stateChangesPerFrame\": %.1f", totals.StateChanges / frameCount);
+        if (glCallFrames > 0)
+        {
+            std::fprintf(file, ",\n  \"glCallsPerFrame\": %.1f,\n", glCallTotals.TotalCalls() / static_cast<double>(glCallFrames));
+            std::fprintf(file, "  \"glDriverMsPerFrame\": %.4f,\n", glCallTotals.TotalNanoseconds() / 1e6 / glCallFrames);
+            std::fprintf(file, "  \"glFunctions\": [");
+            std::vector<int> functions = calledGlFunctions();
+            for (size_t i = 0; i < functions.size(); i++)
+                std::fprintf(file, "%s\n    { \"name\": \"%s\", \"callsPerFrame\": %.1f, \"msPerFrame\": %.4f }", i > 0 ? "," : "",
+                    GlFunctionName(functions[i]), glCallTotals.Calls[functions[i]] / static_cast<double>(glCallFrames),
+                    glCallTotals.Nanoseconds[functions[i]] / 1e6 / glCallFrames);
+            std::fprintf(file, "\n  ],\n");
+            std::fprintf(file, "  \"glDebugOutput\": %s,\n", GlDebugOutputEnabled() ? "true" : "false");
+            std::fprintf(file, "  \"glPerformanceMessages\": [");
+            std::vector<GlDebugMessage> messages = GlDebugMessages();
+            for (size_t i = 0; i < messages.size(); i++)
+                std::fprintf(file, "%s\n    { \"count\": %llu, \"message\": \"%s\" }", i > 0 ? "," : "", messages[i].Count, jsonEscape(messages[i].Text).c_str());
+            std::fprintf(file, messages.empty() ? "]" : "\n  ]");
+        }
+        std::fprintf(file, "\n");
+        std::fprintf(file, "}\n");
+        return std::fclose(file) == 0;
+    }
+
+private:
+    std::vector<double> frameTimes;
+    RenderStats totals;
+    int glCallFrames = 0;
+    GlCallCounters glCallTotals;
+
+    // entry points called during the run, most driver time first
+    std::vector<int> calledGlFunctions() const
+    {
+        std::vector<int> functions;
+        for (int i = 0; i < GL_FUNCTION_COUNT; i++)
+            if (glCallTotals.Calls[i] > 0)
+                functions.push_back(i);
+        std::sort(functions.begin(), functions.end(), [this](int a, int b) { return glCallTotals.Nanoseconds[a] > glCallTotals.Nanoseconds[b]; });
+        return functions;
+    }
+
+    static std::string jsonEscape(const std::string& text)
+    {
+        std::string escaped;
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            escaped += static_cast<unsigned char>(c) < 0x20 ? ' ' : c; // driver messages may contain newlines
+        }
+        return escaped;
+    }
+};
+
+// camera poses replayed one per frame, so headless runs render the same frames on every machine. Paths are either
+// generated (Orbit) or recorded from a windowed run and stored as text, one "px py pz fx fy fz" pose per line
+class CameraPath
+{
+public:
+    // one orbit around target over frameCount frames, looking at it
+    static CameraPath Orbit(glm::vec3 target, float radius, float height, int frameCount)
+    {
+        CameraPath path;
+        for (int frame = 0; frame < frameCount; frame++)
+        {
+            float angle = 2.0f * 3.14159265f * frame / frameCount;
+            glm::vec3 position = target + glm::vec3(radius * std::sin(angle), height, radius * std::cos(angle));
+            path.Record(position, glm::normalize(target - position));
+        }
+        return path;
+    }
+
+    bool Load(const std::string& path)
+    {
+        std::ifstream file(path);
+        if (!file)
+            return false;
+        positions.clear();
+        fronts.clear();
+        glm::vec3 position, front;
+        while (file >> position.x >> position.y >> position.z >> front.x >> front.y >> front.z)
+            Record(position, front);
+        return !positions.empty();
+    }
+
+    bool Save(const std::string& path) const
+    {
+        std::ofstream file(path);
+        for (size_t i = 0; i < positions.size(); i++)
+        {
+            file << positions[i].x << " " << positions[i].y << " " << positions[i].z << " "
+                << fronts[i].x << " " << fronts[i].y << " " << fronts[i].z << "\n";
+        }
+        return file.good();
+    }
+
+    void Record(glm::vec3 position, glm::vec3 front)
+    {
+        positions.push_back(position);
+        fronts.push_back(front);
+    }
+
+    // moves the camera to the pose of the given frame, the path repeats when it is shorter than the run
+    void Apply(Camera& camera, int frame) const
+    {
+        size_t index = static_cast<size_t>(frame) % positions.size();
+        camera.LookAt(positions[index], positions[index] + fronts[index]);
+    }
+
+private:
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> fronts;
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// read-only memory mapping of a whole file. Pages are loaded on first access straight from the OS page cache, so
+// reading a warm file doesn't copy it into our own buffers
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile() { Close(); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const std::string& path)
+    {
+        Close();
+#ifdef _WIN32
+        fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (fileHandle == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+        {
+            Close();
+            return false;
+        }
+        mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mappingHandle)
+            bytes = static_cast<const unsigned char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+        if (!bytes)
+        {
+            Close();
+            return false;
+        }
+        length = static_cast<size_t>(fileSize.QuadPart);
+#else
+        fileDescriptor = ::open(path.c_str(), O_RDONLY);
+        if (fileDescriptor < 0)
+            return false;
+        struct stat status;
+        if (fstat(fileDescriptor, &status) != 0 || status.st_size == 0)
+        {
+            Close();
+            return false;
+        }
+        void* mapping = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+        if (mapping == MAP_FAILED)
+        {
+            Close();
+            return false;
+        }
+        bytes = static_cast<const unsigned char*>(mapping);
+        length = static_cast<size_t>(status.st_size);
+#endif
+        return true;
+    }
+
+    void Close()
+    {
+#ifdef _WIN32
+        if (bytes)
+            UnmapViewOfFile(bytes);
+        if (mappingHandle)
+            CloseHandle(mappingHandle);
+        if (fileHandle != INVALID_HANDLE_VALUE)
+            CloseHandle(fileHandle);
+        mappingHandle = nullptr;
+        fileHandle = INVALID_HANDLE_VALUE;
+#else
+        if (bytes)
+            munmap(const_cast<unsigned char*>(bytes), length);
+        if (fileDescriptor >= 0)
+            ::close(fileDescriptor);
+        fileDescriptor = -1;
+#endif
+        bytes = nullptr;
+        length = 0;
+    }
+
+    const unsigned char* Data() const { return bytes; }
+    size_t Size() const { return length; }
+    bool IsOpen() const { return bytes != nullptr; }
+
+private:
+    const unsigned char* bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE fileHandle = INVALID_HANDLE_VALUE;
+    HANDLE mappingHandle = nullptr;
+#else
+    int fileDescriptor = -1;
+#endif
+};
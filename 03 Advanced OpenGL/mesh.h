@@ -6,6 +6,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "shader.h"
+#include "texture.h"
 
 #include <string>
 #include <vector>
@@ -80,8 +81,8 @@ public:
 
             // now set the sampler to the correct texture unit
             glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            // and finally bind the texture (counted, see TextureBindCount)
+            BindTexture(GL_TEXTURE_2D, textures[i].id);
         }
 
         // draw mesh
@@ -0,0 +1,390 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// SSE2 is part of every x64 target, so the filters below only fall back to scalar code on 32-bit/ARM builds
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIPMAP_USE_SSE2
+#endif
+
+// Filters available for building the mip chain on the CPU instead of relying on glGenerateMipmap
+enum MipFilter {
+    MIP_FILTER_BOX,     // 2x2 average, cheap and what most drivers do
+    MIP_FILTER_KAISER   // windowed sinc, sharper minification with less blurring
+};
+
+struct MipChainOptions {
+    MipFilter Filter = MIP_FILTER_BOX;
+    // colour channels hold sRGB encoded values, so filter them in linear space (alpha is always linear)
+    bool SRGB = false;
+    // sample neighbours across the edges (GL_REPEAT) instead of clamping (GL_CLAMP_TO_EDGE)
+    bool Wrap = true;
+    // rescale alpha on every level so the fraction of texels passing the alpha test stays the same as on level 0.
+    // without this cutout textures (grass.png) fade out and disappear in the distance.
+    bool PreserveAlphaCoverage = false;
+    // must match the discard threshold used by the fragment shader (see 1.1.depth_testing.frag)
+    float AlphaReference = 0.1f;
+};
+
+struct MipLevel {
+    int Width;
+    int Height;
+    std::vector<unsigned char> Pixels; // tightly packed, same channel count as the source image
+};
+
+namespace mipmap_detail
+{
+    // a float RGBA image. Every texel is 4 floats (also for 1-3 channel sources) so a texel maps to one SSE register
+    struct Image {
+        int Width = 0;
+        int Height = 0;
+        std::vector<float> Texels;
+
+        float* at(int x, int y) { return &Texels[4 * (static_cast<size_t>(y) * Width + x)]; }
+        const float* at(int x, int y) const { return &Texels[4 * (static_cast<size_t>(y) * Width + x)]; }
+    };
+
+    inline float srgbToLinear(float c)
+    {
+        return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    inline float linearToSrgb(float c)
+    {
+        return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+    }
+
+    // 8-bit sRGB -> linear float, one entry per possible byte value
+    // (the tables are function statics so their one-time initialization is thread safe)
+    inline const float* srgbDecodeTable()
+    {
+        static const std::vector<float> table = [] {
+            std::vector<float> values(256);
+            for (int i = 0; i < 256; i++)
+                values[i] = srgbToLinear(i / 255.0f);
+            return values;
+        }();
+        return table.data();
+    }
+
+    // linear float -> 8-bit sRGB. 4096 buckets are enough to round-trip every byte value exactly
+    const int SRGB_ENCODE_TABLE_SIZE = 4096;
+    inline const unsigned char* srgbEncodeTable()
+    {
+        static const std::vector<unsigned char> table = [] {
+            std::vector<unsigned char> values(SRGB_ENCODE_TABLE_SIZE);
+            for (int i = 0; i < SRGB_ENCODE_TABLE_SIZE; i++)
+            {
+                float linear = (i + 0.5f) / SRGB_ENCODE_TABLE_SIZE;
+                values[i] = static_cast<unsigned char>(linearToSrgb(linear) * 255.0f + 0.5f);
+            }
+            return values;
+        }();
+        return table.data();
+    }
+
+    inline int wrapCoord(int i, int size, bool wrap)
+    {
+        if (wrap)
+        {
+            i %= size;
+            return i < 0 ? i + size : i;
+        }
+        return std::min(std::max(i, 0), size - 1);
+    }
+
+    // converts 8-bit pixels into linear, alpha-premultiplied float texels
+    inline Image decode(const unsigned char* data, int width, int height, int channels, bool srgb)
+    {
+        const float* decodeTable = srgbDecodeTable();
+        Image image;
+        image.Width = width;
+        image.Height = height;
+        image.Texels.resize(4 * static_cast<size_t>(width) * height);
+        size_t texelCount = static_cast<size_t>(width) * height;
+        for (size_t i = 0; i < texelCount; i++)
+        {
+            const unsigned char* src = data + i * channels;
+            float* dst = &image.Texels[4 * i];
+            float alpha = channels == 4 ? src[3] / 255.0f : 1.0f;
+            int colorChannels = channels == 4 ? 3 : channels;
+            for (int c = 0; c < 4; c++)
+            {
+                if (c < colorChannels)
+                    dst[c] = (srgb ? decodeTable[src[c]] : src[c] / 255.0f) * alpha;
+                else
+                    dst[c] = 0.0f;
+            }
+            dst[3] = alpha;
+        }
+        return image;
+    }
+
+    // 2x2 average. Odd sized levels clamp the second tap so the last row/column is not lost
+    inline Image downsampleBox(const Image& src)
+    {
+        Image dst;
+        dst.Width = std::max(1, src.Width / 2);
+        dst.Height = std::max(1, src.Height / 2);
+        dst.Texels.resize(4 * static_cast<size_t>(dst.Width) * dst.Height);
+        for (int y = 0; y < dst.Height; y++)
+        {
+            int y0 = std::min(2 * y, src.Height - 1);
+            int y1 = std::min(2 * y + 1, src.Height - 1);
+            for (int x = 0; x < dst.Width; x++)
+            {
+                int x0 = std::min(2 * x, src.Width - 1);
+                int x1 = std::min(2 * x + 1, src.Width - 1);
+#ifdef MIPMAP_USE_SSE2
+                __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(src.at(x0, y0)), _mm_loadu_ps(src.at(x1, y0))),
+                                        _mm_add_ps(_mm_loadu_ps(src.at(x0, y1)), _mm_loadu_ps(src.at(x1, y1))));
+                _mm_storeu_ps(dst.at(x, y), _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+                for (int c = 0; c < 4; c++)
+                    dst.at(x, y)[c] = 0.25f * (src.at(x0, y0)[c] + src.at(x1, y0)[c] + src.at(x0, y1)[c] + src.at(x1, y1)[c]);
+#endif
+            }
+        }
+        return dst;
+    }
+
+    inline double besselI0(double x)
+    {
+        // power series of the zeroth order modified Bessel function, converges quickly for the small x we use
+        double sum = 1.0;
+        double term = 1.0;
+        for (int k = 1; k < 32; k++)
+        {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+            if (term < 1e-12 * sum)
+                break;
+        }
+        return sum;
+    }
+
+    const int KAISER_RADIUS = 3;       // in destination texels
+    const double KAISER_ALPHA = 4.0;
+    const int KAISER_TAPS = 4 * KAISER_RADIUS; // source taps per output texel along one axis
+
+    // weights of a 2:1 Kaiser windowed sinc. Every destination texel sits between two source texels, so the
+    // tap offsets (and the weights) are the same for every output texel and only need computing once.
+    inline const float* kaiserWeights()
+    {
+        static const std::vector<float> weights = [] {
+            const double pi = 3.14159265358979323846;
+            std::vector<double> values(KAISER_TAPS);
+            double total = 0.0;
+            for (int i = 0; i < KAISER_TAPS; i++)
+            {
+                // distance between the source texel centre and the destination texel centre, in source texels
+                double d = (i - KAISER_TAPS / 2) + 0.5;
+                double t = d / 2.0; // in destination texels
+                double sinc = std::sin(pi * t) / (pi * t);
+                double r = t / KAISER_RADIUS;
+                double window = std::fabs(r) >= 1.0 ? 0.0 : besselI0(KAISER_ALPHA * std::sqrt(1.0 - r * r)) / besselI0(KAISER_ALPHA);
+                values[i] = sinc * window;
+                total += values[i];
+            }
+            std::vector<float> normalized(KAISER_TAPS);
+            for (int i = 0; i < KAISER_TAPS; i++)
+                normalized[i] = static_cast<float>(values[i] / total);
+            return normalized;
+        }();
+        return weights.data();
+    }
+
+    // separable Kaiser filter: horizontal pass into a half-width temporary, then a vertical pass
+    inline Image downsampleKaiser(const Image& src, bool wrap)
+    {
+        const float* weights = kaiserWeights();
+
+        Image tmp;
+        tmp.Width = std::max(1, src.Width / 2);
+        tmp.Height = src.Height;
+        tmp.Texels.resize(4 * static_cast<size_t>(tmp.Width) * tmp.Height);
+        for (int y = 0; y < tmp.Height; y++)
+        {
+            for (int x = 0; x < tmp.Width; x++)
+            {
+                int first = 2 * x - KAISER_TAPS / 2 + 1;
+#ifdef MIPMAP_USE_SSE2
+                __m128 sum = _mm_setzero_ps();
+                for (int i = 0; i < KAISER_TAPS; i++)
+                {
+                    int sx = wrapCoord(first + i, src.Width, wrap);
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(src.at(sx, y)), _mm_set1_ps(weights[i])));
+                }
+                _mm_storeu_ps(tmp.at(x, y), sum);
+#else
+                float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+                for (int i = 0; i < KAISER_TAPS; i++)
+                {
+                    const float* texel = src.at(wrapCoord(first + i, src.Width, wrap), y);
+                    for (int c = 0; c < 4; c++)
+                        sum[c] += texel[c] * weights[i];
+                }
+                std::copy(sum, sum + 4, tmp.at(x, y));
+#endif
+            }
+        }
+
+        Image dst;
+        dst.Width = tmp.Width;
+        dst.Height = std::max(1, src.Height / 2);
+        dst.Texels.resize(4 * static_cast<size_t>(dst.Width) * dst.Height);
+        for (int y = 0; y < dst.Height; y++)
+        {
+            int first = 2 * y - KAISER_TAPS / 2 + 1;
+            for (int x = 0; x < dst.Width; x++)
+            {
+#ifdef MIPMAP_USE_SSE2
+                __m128 sum = _mm_setzero_ps();
+                for (int i = 0; i < KAISER_TAPS; i++)
+                {
+                    int sy = wrapCoord(first + i, tmp.Height, wrap);
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(tmp.at(x, sy)), _mm_set1_ps(weights[i])));
+                }
+                // the negative lobes of the sinc can overshoot, keep the result in range
+                sum = _mm_min_ps(_mm_max_ps(sum, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+                _mm_storeu_ps(dst.at(x, y), sum);
+#else
+                float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+                for (int i = 0; i < KAISER_TAPS; i++)
+                {
+                    const float* texel = tmp.at(x, wrapCoord(first + i, tmp.Height, wrap));
+                    for (int c = 0; c < 4; c++)
+                        sum[c] += texel[c] * weights[i];
+                }
+                for (int c = 0; c < 4; c++)
+                    dst.at(x, y)[c] = std::min(std::max(sum[c], 0.0f), 1.0f);
+#endif
+            }
+        }
+        return dst;
+    }
+
+    // fraction of texels that survive the alpha test after scaling alpha by 'scale'
+    inline float alphaCoverage(const Image& image, float reference, float scale)
+    {
+        size_t texelCount = static_cast<size_t>(image.Width) * image.Height;
+        size_t covered = 0;
+        for (size_t i = 0; i < texelCount; i++)
+        {
+            if (image.Texels[4 * i + 3] * scale > reference)
+                covered++;
+        }
+        return static_cast<float>(covered) / texelCount;
+    }
+
+    // binary search for the alpha scale that gives the same coverage as the source level
+    inline float coveragePreservingScale(const Image& image, float reference, float targetCoverage)
+    {
+        // coverage is a step function of the scale, so an exact match is not always possible; keep the closest one
+        float low = 0.0f;
+        float high = 4.0f;
+        float scale = 1.0f;
+        float bestScale = 1.0f;
+        float bestError = 2.0f;
+        for (int i = 0; i < 10; i++)
+        {
+            float coverage = alphaCoverage(image, reference, scale);
+            float error = std::fabs(coverage - targetCoverage);
+            if (error < bestError)
+            {
+                bestError = error;
+                bestScale = scale;
+            }
+            if (coverage < targetCoverage)
+                low = scale;
+            else if (coverage > targetCoverage)
+                high = scale;
+            else
+                break;
+            scale = 0.5f * (low + high);
+        }
+        return bestScale;
+    }
+
+    // converts float texels back to 8-bit (undoing the premultiplication and the sRGB decode)
+    inline MipLevel encode(const Image& image, int channels, bool srgb, float alphaScale)
+    {
+        const unsigned char* encodeTable = srgbEncodeTable();
+        MipLevel level;
+        level.Width = image.Width;
+        level.Height = image.Height;
+        level.Pixels.resize(static_cast<size_t>(image.Width) * image.Height * channels);
+        size_t texelCount = static_cast<size_t>(image.Width) * image.Height;
+        int colorChannels = channels == 4 ? 3 : channels;
+        for (size_t i = 0; i < texelCount; i++)
+        {
+            const float* src = &image.Texels[4 * i];
+            unsigned char* dst = &level.Pixels[i * channels];
+            float alpha = src[3];
+            float invAlpha = alpha > 0.0f ? 1.0f / alpha : 0.0f;
+            for (int c = 0; c < colorChannels; c++)
+            {
+                float value = std::min(std::max(src[c] * invAlpha, 0.0f), 1.0f);
+                if (srgb)
+                    dst[c] = encodeTable[std::min(static_cast<int>(value * SRGB_ENCODE_TABLE_SIZE), SRGB_ENCODE_TABLE_SIZE - 1)];
+                else
+                    dst[c] = static_cast<unsigned char>(value * 255.0f + 0.5f);
+            }
+            if (channels == 4)
+                dst[3] = static_cast<unsigned char>(std::min(alpha * alphaScale, 1.0f) * 255.0f + 0.5f);
+        }
+        return level;
+    }
+}
+
+// builds the complete mip chain (level 0 included) of an 8-bit image on the CPU. This does not touch OpenGL,
+// so it can run on a worker thread or offline and the result can be cached and uploaded with UploadMipChain.
+inline std::vector<MipLevel> GenerateMipChain(const unsigned char* data, int width, int height, int channels, const MipChainOptions& options = MipChainOptions())
+{
+    PROFILE_SCOPE("GenerateMipChain");
+    using namespace mipmap_detail;
+
+    std::vector<MipLevel> levels;
+    MipLevel base;
+    base.Width = width;
+    base.Height = height;
+    base.Pixels.assign(data, data + static_cast<size_t>(width) * height * channels);
+    levels.push_back(base);
+
+    bool preserveCoverage = options.PreserveAlphaCoverage && channels == 4;
+    Image current = decode(data, width, height, channels, options.SRGB);
+    float targetCoverage = preserveCoverage ? alphaCoverage(current, options.AlphaReference, 1.0f) : 0.0f;
+
+    while (current.Width > 1 || current.Height > 1)
+    {
+        // every level is filtered from the previous (unscaled) one; the coverage scale is only applied when encoding
+        if (options.Filter == MIP_FILTER_KAISER)
+            current = downsampleKaiser(current, options.Wrap);
+        else
+            current = downsampleBox(current);
+
+        float alphaScale = preserveCoverage ? coveragePreservingScale(current, options.AlphaReference, targetCoverage) : 1.0f;
+        levels.push_back(encode(current, channels, options.SRGB, alphaScale));
+    }
+    return levels;
+}
+
+// uploads a mip chain produced by GenerateMipChain into the currently bound GL_TEXTURE_2D
+inline void UploadMipChain(const std::vector<MipLevel>& levels, GLenum internalFormat, GLenum format)
+{
+    // rows of 1 and 3 channel levels are not 4 byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (unsigned int i = 0; i < levels.size(); i++)
+        glTexImage2D(GL_TEXTURE_2D, i, internalFormat, levels[i].Width, levels[i].Height, 0, format, GL_UNSIGNED_BYTE, levels[i].Pixels.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(levels.size()) - 1);
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "frame_graph.h"
+#include "shader.h"
+
+#include <memory>
+#include <vector>
+
+// outlines at least this wide (in pixels) are found with a jump flood, thinner ones by looking at the neighbours
+#define OUTLINE_JUMP_FLOOD_MIN_WIDTH 3
+
+// the objects to outline, by an id the caller picks (e.g. the object's index)
+class SelectionSet
+{
+public:
+    void Select(unsigned int id)
+    {
+        if (id >= selected.size())
+            selected.resize(id + 1, false);
+        if (!selected[id])
+            count++;
+        selected[id] = true;
+    }
+
+    void Deselect(unsigned int id)
+    {
+        if (id < selected.size() && selected[id])
+        {
+            selected[id] = false;
+            count--;
+        }
+    }
+
+    bool IsSelected(unsigned int id) const
+    {
+        return id < selected.size() && selected[id];
+    }
+
+    void Clear()
+    {
+        selected.clear();
+        count = 0;
+    }
+
+    unsigned int Count() const
+    {
+        return count;
+    }
+
+private:
+    std::vector<bool> selected;
+    unsigned int count = 0;
+};
+
+// outlines the selected objects with a full screen pass instead of drawing them a second time. The opaque passes
+// render into transient targets, and the pass drawing the outlined kind of objects writes a second colour target
+// (R8) as well, a selection mask that is 1 where a selected object is the nearest surface. The outline pass copies
+// the scene to the real framebuffer and draws the outline around the mask, so the cost is the same for one selected
+// object or ten thousand. Thin outlines come from one pass that looks for the mask within the width around each
+// pixel. Wide ones would need too many samples that way, so a jump flood (Rong and Tan 2006) first finds the
+// nearest masked pixel for every pixel in log2(width) passes.
+class OutlineRenderer
+{
+public:
+    float Width = 4.0f; // in pixels
+    glm::vec3 Color = glm::pow(glm::vec3(0.9f, 0.65f, 0.16f), glm::vec3(2.2f)); // linear, like shader_single_color.frag
+
+    void Init()
+    {
+        edgeShader.reset(new Shader("shaders/fullscreen.vert", "shaders/outline_edge.frag"));
+        jumpFloodInitShader.reset(new Shader("shaders/fullscreen.vert", "shaders/jump_flood_init.frag"));
+        jumpFloodStepShader.reset(new Shader("shaders/fullscreen.vert", "shaders/jump_flood_step.frag"));
+        jumpFloodOutlineShader.reset(new Shader("shaders/fullscreen.vert", "shaders/outline_jump_flood.frag"));
+        glGenVertexArrays(1, &emptyVAO);
+    }
+
+    // the selection mask, written by the pass as its next colour target. That pass has to clear it, its fragment
+    // shaders write the selection to the matching location (layout (location = 1) out float after the colour).
+    static FrameGraphResource CreateMask(FrameGraphPassBuilder& pass, int width, int height)
+    {
+        return pass.Create("Selection mask", { width, height, GL_R8 });
+    }
+
+    // adds the passes that copy the scene's colour and depth/stencil to target and draw the outline over it, returns
+    // the target's new version. The jump flood is declared for thin outlines as well, the graph culls it when the
+    // outline pass doesn't read its result.
+    FrameGraphResource AddPasses(FrameGraph& graph, FrameGraphResource sceneColor, FrameGraphResource sceneDepth, FrameGraphResource mask, FrameGraphResource target)
+    {
+        FrameGraphTextureDesc maskDesc = graph.Desc(mask);
+        const FrameGraphTextureDesc seedsDesc = { maskDesc.Width, maskDesc.Height, GL_RG32F };
+
+        // every masked pixel seeds itself
+        FrameGraphPassBuilder init = graph.AddPass("Jump flood init", [this, mask](FrameGraphContext& context)
+        {
+            jumpFloodInitShader->use();
+            jumpFloodInitShader->setInt("mask", 0);
+            drawFullScreen(context.Texture(mask));
+        });
+        init.Read(mask);
+        FrameGraphResource seeds = init.Create("Jump flood seeds", seedsDesc);
+
+        // then each step looks at 8 neighbours step pixels away and keeps the nearest seed. Steps halve from the
+        // largest power of two not above the width, so seeds travel up to 2 * step - 1 pixels. Every step writes
+        // a new target, the graph lets them take turns in two textures.
+        int step = 1;
+        while (step * 2 <= static_cast<int>(Width))
+            step *= 2;
+        for (; step >= 1; step /= 2)
+        {
+            FrameGraphPassBuilder pass = graph.AddPass("Jump flood step", [this, seeds, step](FrameGraphContext& context)
+            {
+                jumpFloodStepShader->use();
+                jumpFloodStepShader->setInt("seeds", 0);
+                jumpFloodStepShader->setInt("step", step);
+                drawFullScreen(context.Texture(seeds));
+            });
+            pass.Read(seeds);
+            seeds = pass.Create("Jump flood seeds", seedsDesc);
+        }
+
+        bool jumpFlood = Width >= OUTLINE_JUMP_FLOOD_MIN_WIDTH;
+        FrameGraphPassBuilder pass = graph.AddPass("Outline", [this, sceneColor, sceneDepth, mask, seeds, jumpFlood](FrameGraphContext& context)
+        {
+            int width = context.Width();
+            int height = context.Height();
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, context.Framebuffer({ sceneColor, sceneDepth }));
+            glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+
+            Shader* outlineShader = jumpFlood ? jumpFloodOutlineShader.get() : edgeShader.get();
+            outlineShader->use();
+            outlineShader->setInt("mask", 0);
+            outlineShader->setFloat("width", Width);
+            outlineShader->setVec3("color", Color);
+            if (jumpFlood)
+            {
+                outlineShader->setInt("seeds", 1);
+                glActiveTexture(GL_TEXTURE1);
+                glBindTexture(GL_TEXTURE_2D, context.Texture(seeds));
+                glActiveTexture(GL_TEXTURE0);
+            }
+
+            glDisable(GL_DEPTH_TEST);
+            glDisable(GL_STENCIL_TEST);
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            drawFullScreen(context.Texture(mask));
+            glDisable(GL_BLEND);
+            glEnable(GL_STENCIL_TEST);
+            glEnable(GL_DEPTH_TEST);
+        });
+        pass.Read(sceneColor);
+        pass.Read(sceneDepth);
+        pass.Read(mask);
+        if (jumpFlood)
+            pass.Read(seeds);
+        return pass.Write(target);
+    }
+
+    void Release()
+    {
+        if (emptyVAO)
+            glDeleteVertexArrays(1, &emptyVAO);
+        emptyVAO = 0;
+    }
+
+private:
+    unsigned int emptyVAO = 0; // the full screen triangle has no attributes, but core profile draws need a VAO
+    std::unique_ptr<Shader> edgeShader;
+    std::unique_ptr<Shader> jumpFloodInitShader;
+    std::unique_ptr<Shader> jumpFloodStepShader;
+    std::unique_ptr<Shader> jumpFloodOutlineShader;
+
+    // the bound shader over the whole target, with texture on unit 0
+    void drawFullScreen(unsigned int texture)
+    {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glBindVertexArray(emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+    }
+};
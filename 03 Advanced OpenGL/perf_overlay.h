@@ -0,0 +1,163 @@
+#pragma once
+
+#include <imgui.h>
+
+#include "foliage.h"
+#include "frame_graph.h"
+#include "frustum.h"
+#include "gl_instrumentation.h"
+#include "gpu_profiler.h"
+#include "profiler.h"
+#include "render_stats.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+// frames kept for the frame time graph
+#define PERF_OVERLAY_HISTORY 240
+
+// parts of the scene the overlay can switch off at runtime to compare frames with and without them
+struct SceneToggles {
+    bool Outline = true;
+    bool PostProcessOutline = true; // one full screen pass around a selection mask instead of the stencil outline
+    bool Grass = true;
+    bool Foliage = true; // the instanced grass field
+    bool Culling = true; // skip objects outside the view frustum
+    bool PackedTextures = false;
+    bool SortTransparent = true; // back to front, unsorted shows what blending in the wrong order looks like
+    bool WeightedOit = false; // weighted blended order-independent transparency for the glass panes instead
+};
+
+// what the render loop measured for the overlay to show
+struct PerfOverlayFrame {
+    const std::vector<ProfileEvent>* CpuZones = nullptr; // of the previous frame
+    const GpuProfiler* Gpu = nullptr;
+    RenderStats Stats;
+    GpuMemoryStats Memory;
+    CullingStats Culling;
+    FoliageStats Foliage;
+    unsigned int TextureBinds = 0;
+    unsigned int TextureArrays = 0;
+    const GlCallCounters* GlCalls = nullptr; // with --gl-calls, of the frame so far
+    const FrameGraph* Graph = nullptr; // compiled
+};
+
+// performance HUD: frame time histogram, CPU zones and GPU passes, render counters and the scene toggles. The
+// overlay is drawn inside the "Overlay" CPU zone and GPU pass, so its own cost shows up next to the scene's.
+class PerfOverlay
+{
+public:
+    // CPU time of a whole frame, including waiting for the swap
+    void AddFrameTime(float ms)
+    {
+        frameTimes[frameCount % PERF_OVERLAY_HISTORY] = ms;
+        frameCount++;
+    }
+
+    void Draw(const PerfOverlayFrame& frame, SceneToggles& toggles)
+    {
+        ImGui::SetNextWindowPos(ImVec2(10.0f, 10.0f), ImGuiCond_FirstUseEver);
+        ImGui::SetNextWindowBgAlpha(0.8f);
+        ImGui::Begin("Performance", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoFocusOnAppearing);
+
+        int count = std::min(frameCount, PERF_OVERLAY_HISTORY);
+        if (count > 0)
+        {
+            float last = frameTimes[(frameCount - 1) % PERF_OVERLAY_HISTORY];
+            float sum = 0.0f;
+            float highest = 0.0f;
+            for (int i = 0; i < count; i++)
+            {
+                sum += frameTimes[i];
+                highest = std::max(highest, frameTimes[i]);
+            }
+            ImGui::Text("Frame: %.2f ms (%.0f fps), avg %.2f ms, max %.2f ms", last, last > 0.0f ? 1000.0f / last : 0.0f, sum / count, highest);
+            // oldest on the left; the scale keeps 60 fps at half height until a spike needs more room
+            int offset = frameCount > PERF_OVERLAY_HISTORY ? frameCount % PERF_OVERLAY_HISTORY : 0;
+            ImGui::PlotHistogram("##frametimes", frameTimes, count, offset, "CPU frame ms", 0.0f, std::max(33.3f, highest), ImVec2(360.0f, 60.0f));
+        }
+        if (frame.Gpu->Supported())
+        {
+            const GpuPassTiming& gpuFrame = frame.Gpu->Frame();
+            int gpuCount = std::min(gpuFrame.Samples, GPU_PROFILER_HISTORY);
+            int offset = gpuFrame.Samples > GPU_PROFILER_HISTORY ? gpuFrame.Samples % GPU_PROFILER_HISTORY : 0;
+            ImGui::PlotLines("##gpuframe", gpuFrame.History, gpuCount, offset, "GPU frame ms", 0.0f, std::max(16.7f, static_cast<float>(gpuFrame.AverageMs) * 2.0f), ImVec2(360.0f, 40.0f));
+        }
+
+        double overlayCpuMs = 0.0;
+        for (const ProfileEvent& zone : *frame.CpuZones)
+            if (std::strcmp(zone.Name, "Overlay") == 0)
+                overlayCpuMs += (zone.End - zone.Start) / 1e6;
+        double overlayGpuMs = 0.0;
+        for (const GpuPassTiming& pass : frame.Gpu->Passes())
+            if (std::strcmp(pass.Name, "Overlay") == 0)
+                overlayGpuMs = pass.AverageMs;
+        ImGui::Text("Overlay cost: CPU %.3f ms, GPU %.3f ms (F1 hides it)", overlayCpuMs, overlayGpuMs);
+
+        if (ImGui::CollapsingHeader("CPU zones", ImGuiTreeNodeFlags_DefaultOpen))
+        {
+            // nested by depth
+            for (const ProfileEvent& zone : *frame.CpuZones)
+                ImGui::Text("%*s%s: %.3f ms", zone.Depth * 2, "", zone.Name, (zone.End - zone.Start) / 1e6);
+            if (ImGui::Button("Save trace"))
+                Profiler::WriteChromeTrace("trace.json");
+        }
+
+        if (ImGui::CollapsingHeader("GPU passes", ImGuiTreeNodeFlags_DefaultOpen))
+        {
+            if (frame.Gpu->Supported())
+            {
+                ImGui::Text("Frame: %.3f ms (avg %.3f ms)", frame.Gpu->Frame().LastMs, frame.Gpu->Frame().AverageMs);
+                for (const GpuPassTiming& pass : frame.Gpu->Passes())
+                    ImGui::Text("  %s: %.3f ms (avg %.3f ms)", pass.Name, pass.LastMs, pass.AverageMs);
+                if (frame.Gpu->DroppedFrames() > 0)
+                    ImGui::Text("Dropped results: %llu frames", frame.Gpu->DroppedFrames());
+            }
+            else
+                ImGui::Text("GPU timer queries are not supported");
+        }
+
+        if (ImGui::CollapsingHeader("Counters", ImGuiTreeNodeFlags_DefaultOpen))
+        {
+            ImGui::Text("Draw calls: %llu, triangles: %llu", frame.Stats.DrawCalls, frame.Stats.Triangles);
+            ImGui::Text("State changes: %llu, program switches: %llu", frame.Stats.StateChanges, frame.Stats.ProgramSwitches);
+            ImGui::Text("Texture binds: %u (%u arrays)", frame.TextureBinds, frame.TextureArrays);
+            ImGui::Text("Culled: %d of %d objects", frame.Culling.Culled, frame.Culling.Tested);
+            ImGui::Text("Grass: %u blades in %u draws, culled %d of %d chunks", frame.Foliage.Blades, frame.Foliage.Draws, frame.Foliage.ChunksCulled, frame.Foliage.ChunksTested);
+            if (frame.GlCalls)
+                ImGui::Text("GL calls: %llu, %.3f ms in the driver", frame.GlCalls->TotalCalls(), frame.GlCalls->TotalNanoseconds() / 1e6);
+            ImGui::Text("Memory: textures %.2f MB, buffers %.2f MB", frame.Memory.TextureBytes / (1024.0 * 1024.0), frame.Memory.BufferBytes / (1024.0 * 1024.0));
+            if (frame.Graph)
+            {
+                const FrameGraphStats& graph = frame.Graph->Stats();
+                ImGui::Text("Frame graph: %d passes (%d culled), %d transient targets in %d textures", graph.Passes, graph.CulledPasses, graph.TransientTargets, graph.Textures);
+                ImGui::Text("Transient targets: %.2f MB (%.2f MB without sharing)", graph.Bytes / (1024.0 * 1024.0), graph.UnaliasedBytes / (1024.0 * 1024.0));
+                if (ImGui::Button("Save frame graph"))
+                {
+                    std::ofstream dot("frame_graph.dot");
+                    frame.Graph->WriteGraphviz(dot);
+                }
+            }
+        }
+
+        if (ImGui::CollapsingHeader("Scene", ImGuiTreeNodeFlags_DefaultOpen))
+        {
+            ImGui::Checkbox("Outline", &toggles.Outline);
+            ImGui::Checkbox("Post-process outline", &toggles.PostProcessOutline);
+            ImGui::Checkbox("Grass", &toggles.Grass);
+            ImGui::Checkbox("Grass field", &toggles.Foliage);
+            ImGui::Checkbox("Frustum culling", &toggles.Culling);
+            ImGui::Checkbox("Packed textures", &toggles.PackedTextures);
+            ImGui::Checkbox("Sort transparent", &toggles.SortTransparent);
+            ImGui::Checkbox("Weighted blended OIT", &toggles.WeightedOit);
+            ImGui::Text("Tab frees the mouse to use these");
+        }
+        ImGui::End();
+    }
+
+private:
+    float frameTimes[PERF_OVERLAY_HISTORY] = {};
+    int frameCount = 0;
+};
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// scoped zones compile to nothing when this is 0 (e.g. /D PROFILER_ENABLED=0)
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+// zones per thread kept before the oldest are overwritten (32 bytes each)
+#define PROFILER_RING_SIZE (1 << 16)
+
+// one finished zone. Times are steady clock nanoseconds, Depth is the number of zones that were open on the same
+// thread when it started
+struct ProfileEvent {
+    const char* Name;
+    long long Start;
+    long long End;
+    int Depth;
+    unsigned int ThreadId;
+};
+
+// hierarchical CPU profiler. Every thread records its zones into its own fixed size ring buffer which only that
+// thread writes, so recording takes no lock. The oldest zones are overwritten once a buffer is full. Readers copy
+// the buffers (Collect, WriteChromeTrace) while the threads keep running.
+class Profiler
+{
+public:
+    static long long Now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // adds a finished zone to the calling thread's buffer. name must outlive the profiler (a string literal)
+    static void Record(const char* name, long long start, long long end, int depth)
+    {
+        ThreadBuffer& buffer = threadBuffer();
+        unsigned long long index = buffer.Written.load(std::memory_order_relaxed);
+        ProfileEvent& event = buffer.Events[index % PROFILER_RING_SIZE];
+        event.Name = name;
+        event.Start = start;
+        event.End = end;
+        event.Depth = depth;
+        event.ThreadId = buffer.ThreadId;
+        buffer.Written.store(index + 1, std::memory_order_release);
+    }
+
+    // nesting depth bookkeeping for ProfileScope
+    static int EnterZone()
+    {
+        return threadBuffer().Depth++;
+    }
+
+    static void LeaveZone()
+    {
+        threadBuffer().Depth--;
+    }
+
+    // zones of all threads that started at or after begin and ended at or before end, in start order. Zones are
+    // recorded when they end, so each buffer is only scanned back from its newest zone to the first that ended
+    // before begin, which keeps collecting the last frame cheap
+    static std::vector<ProfileEvent> Collect(long long begin, long long end)
+    {
+        std::vector<ProfileEvent> events;
+        std::lock_guard<std::mutex> lock(buffersMutex());
+        for (const std::unique_ptr<ThreadBuffer>& buffer : buffers())
+        {
+            size_t bufferStart = events.size();
+            unsigned long long written = buffer->Written.load(std::memory_order_acquire);
+            unsigned long long first = written > PROFILER_RING_SIZE ? written - PROFILER_RING_SIZE : 0;
+            unsigned long long i = written;
+            for (; i > first; i--)
+            {
+                const ProfileEvent& event = buffer->Events[(i - 1) % PROFILER_RING_SIZE];
+                if (event.End < begin)
+                    break;
+                if (event.Start >= begin && event.End <= end)
+                    events.push_back(event);
+            }
+
+            // the owner kept writing meanwhile: give up on this buffer if the scanned slots may have been reused
+            unsigned long long writtenAfter = buffer->Written.load(std::memory_order_acquire);
+            if (writtenAfter > PROFILER_RING_SIZE && writtenAfter - PROFILER_RING_SIZE > i)
+                events.resize(bufferStart);
+        }
+        std::sort(events.begin(), events.end(), [](const ProfileEvent& a, const ProfileEvent& b)
+            { return a.Start < b.Start || (a.Start == b.Start && a.Depth < b.Depth); });
+        return events;
+    }
+
+    // writes everything still in the buffers in the Chrome trace event format (chrome://tracing, ui.perfetto.dev)
+    static bool WriteChromeTrace(const std::string& path)
+    {
+        std::vector<ProfileEvent> events = allEvents();
+        long long origin = events.empty() ? 0 : events[0].Start;
+        for (const ProfileEvent& event : events)
+            origin = std::min(origin, event.Start);
+
+        FILE* file = std::fopen(path.c_str(), "w");
+        if (!file)
+        {
+            std::cout << "Failed to write trace: " << path << std::endl;
+            return false;
+        }
+        // complete ("X") events in microseconds, the viewers nest them by time per thread
+        std::fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+        for (size_t i = 0; i < events.size(); i++)
+        {
+            const ProfileEvent& event = events[i];
+            std::fprintf(file, "{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}%s\n",
+                event.Name, event.ThreadId, (event.Start - origin) / 1000.0, (event.End - event.Start) / 1000.0,
+                i + 1 < events.size() ? "," : "");
+        }
+        std::fprintf(file, "]}\n");
+        return std::fclose(file) == 0;
+    }
+
+private:
+    struct ThreadBuffer {
+        unsigned int ThreadId = 0;
+        int Depth = 0;
+        // only the owning thread writes. Written counts every zone ever recorded, the slot of zone i is i % PROFILER_RING_SIZE
+        std::atomic<unsigned long long> Written{ 0 };
+        std::vector<ProfileEvent> Events = std::vector<ProfileEvent>(PROFILER_RING_SIZE);
+    };
+
+    // buffers are never freed, so zones of threads that have exited can still be exported
+    static std::mutex& buffersMutex()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    static std::vector<std::unique_ptr<ThreadBuffer>>& buffers()
+    {
+        static std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+        return buffers;
+    }
+
+    static ThreadBuffer& threadBuffer()
+    {
+        thread_local ThreadBuffer* buffer = nullptr;
+        if (!buffer)
+        {
+            std::lock_guard<std::mutex> lock(buffersMutex());
+            buffers().push_back(std::unique_ptr<ThreadBuffer>(new ThreadBuffer()));
+            buffer = buffers().back().get();
+            buffer->ThreadId = static_cast<unsigned int>(buffers().size());
+        }
+        return *buffer;
+    }
+
+    // copies the zones of one buffer that were not overwritten while copying
+    static void copyEvents(const ThreadBuffer& buffer, std::vector<ProfileEvent>* out)
+    {
+        unsigned long long written = buffer.Written.load(std::memory_order_acquire);
+        unsigned long long first = written > PROFILER_RING_SIZE ? written - PROFILER_RING_SIZE : 0;
+        size_t outStart = out->size();
+        for (unsigned long long i = first; i < written; i++)
+            out->push_back(buffer.Events[i % PROFILER_RING_SIZE]);
+
+        // the owner kept writing meanwhile: drop the copies of slots it may have reused
+        unsigned long long writtenAfter = buffer.Written.load(std::memory_order_acquire);
+        unsigned long long firstValid = writtenAfter > PROFILER_RING_SIZE ? writtenAfter - PROFILER_RING_SIZE : 0;
+        if (firstValid > first)
+        {
+            size_t stale = static_cast<size_t>(std::min(firstValid - first, written - first));
+            out->erase(out->begin() + outStart, out->begin() + outStart + stale);
+        }
+    }
+
+    static std::vector<ProfileEvent> allEvents()
+    {
+        std::vector<ProfileEvent> events;
+        std::lock_guard<std::mutex> lock(buffersMutex());
+        for (const std::unique_ptr<ThreadBuffer>& buffer : buffers())
+            copyEvents(*buffer, &events);
+        return events;
+    }
+};
+
+// records the time between its construction and destruction as a zone
+class ProfileScope
+{
+public:
+    ProfileScope(const char* name) : name(name), depth(Profiler::EnterZone()), start(Profiler::Now())
+    {
+    }
+
+    ~ProfileScope()
+    {
+        Profiler::Record(name, start, Profiler::Now(), depth);
+        Profiler::LeaveZone();
+    }
+
+private:
+    const char* name;
+    int depth;
+    long long start;
+};
+
+#if PROFILER_ENABLED
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_FUNCTION()
+#endif
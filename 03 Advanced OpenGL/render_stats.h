@@ -0,0 +1,279 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <map>
+#include <utility>
+
+// draw calls, triangles and state changes counted since the last ResetRenderStats
+struct RenderStats {
+    unsigned long long DrawCalls = 0;
+    unsigned long long Triangles = 0;
+    // program, vertex array, texture and framebuffer binds plus fixed function state (enable/disable, depth, stencil, blend, cull)
+    unsigned long long StateChanges = 0;
+    unsigned long long ProgramSwitches = 0; // glUseProgram calls, also counted in StateChanges
+};
+
+inline RenderStats& CurrentRenderStats()
+{
+    static RenderStats stats;
+    return stats;
+}
+
+inline void ResetRenderStats()
+{
+    CurrentRenderStats() = RenderStats();
+}
+
+inline unsigned long long TriangleCount(GLenum mode, GLsizei count)
+{
+    switch (mode)
+    {
+    case GL_TRIANGLES: return count / 3;
+    case GL_TRIANGLE_STRIP:
+    case GL_TRIANGLE_FAN: return count > 2 ? count - 2 : 0;
+    default: return 0; // points and lines
+    }
+}
+
+// the glad pointer a hook replaced, called by the hook after counting
+#define REAL_GL_FUNCTION(name, type) \
+    inline type& Real_##name() \
+    { \
+        static type real = nullptr; \
+        return real; \
+    }
+
+REAL_GL_FUNCTION(glDrawArrays, PFNGLDRAWARRAYSPROC)
+REAL_GL_FUNCTION(glDrawElements, PFNGLDRAWELEMENTSPROC)
+REAL_GL_FUNCTION(glDrawArraysInstanced, PFNGLDRAWARRAYSINSTANCEDPROC)
+REAL_GL_FUNCTION(glDrawElementsInstanced, PFNGLDRAWELEMENTSINSTANCEDPROC)
+
+inline void APIENTRY CountedDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+    CurrentRenderStats().DrawCalls++;
+    CurrentRenderStats().Triangles += TriangleCount(mode, count);
+    Real_glDrawArrays()(mode, first, count);
+}
+
+inline void APIENTRY CountedDrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices)
+{
+    CurrentRenderStats().DrawCalls++;
+    CurrentRenderStats().Triangles += TriangleCount(mode, count);
+    Real_glDrawElements()(mode, count, type, indices);
+}
+
+inline void APIENTRY CountedDrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instanceCount)
+{
+    CurrentRenderStats().DrawCalls++;
+    CurrentRenderStats().Triangles += TriangleCount(mode, count) * instanceCount;
+    Real_glDrawArraysInstanced()(mode, first, count, instanceCount);
+}
+
+inline void APIENTRY CountedDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instanceCount)
+{
+    CurrentRenderStats().DrawCalls++;
+    CurrentRenderStats().Triangles += TriangleCount(mode, count) * instanceCount;
+    Real_glDrawElementsInstanced()(mode, count, type, indices, instanceCount);
+}
+
+// the real pointer plus a Counted_<name> hook that counts a state change and forwards. name is only ever pasted
+// (never passed on to another macro), so glad's own gl<Name> macros don't expand it
+#define COUNTED_STATE_CHANGE(name, type, params, args) \
+    inline type& Real_##name() \
+    { \
+        static type real = nullptr; \
+        return real; \
+    } \
+    inline void APIENTRY Counted_##name params \
+    { \
+        CurrentRenderStats().StateChanges++; \
+        Real_##name() args; \
+    }
+
+COUNTED_STATE_CHANGE(glBindVertexArray, PFNGLBINDVERTEXARRAYPROC, (GLuint array), (array))
+COUNTED_STATE_CHANGE(glBindTexture, PFNGLBINDTEXTUREPROC, (GLenum target, GLuint texture), (target, texture))
+COUNTED_STATE_CHANGE(glBindFramebuffer, PFNGLBINDFRAMEBUFFERPROC, (GLenum target, GLuint framebuffer), (target, framebuffer))
+COUNTED_STATE_CHANGE(glEnable, PFNGLENABLEPROC, (GLenum cap), (cap))
+COUNTED_STATE_CHANGE(glDisable, PFNGLDISABLEPROC, (GLenum cap), (cap))
+COUNTED_STATE_CHANGE(glDepthFunc, PFNGLDEPTHFUNCPROC, (GLenum func), (func))
+COUNTED_STATE_CHANGE(glDepthMask, PFNGLDEPTHMASKPROC, (GLboolean flag), (flag))
+COUNTED_STATE_CHANGE(glStencilFunc, PFNGLSTENCILFUNCPROC, (GLenum func, GLint ref, GLuint mask), (func, ref, mask))
+COUNTED_STATE_CHANGE(glStencilOp, PFNGLSTENCILOPPROC, (GLenum fail, GLenum zfail, GLenum zpass), (fail, zfail, zpass))
+COUNTED_STATE_CHANGE(glStencilMask, PFNGLSTENCILMASKPROC, (GLuint mask), (mask))
+COUNTED_STATE_CHANGE(glBlendFunc, PFNGLBLENDFUNCPROC, (GLenum sfactor, GLenum dfactor), (sfactor, dfactor))
+COUNTED_STATE_CHANGE(glBlendFuncSeparate, PFNGLBLENDFUNCSEPARATEPROC, (GLenum sfactorRGB, GLenum dfactorRGB, GLenum sfactorAlpha, GLenum dfactorAlpha), (sfactorRGB, dfactorRGB, sfactorAlpha, dfactorAlpha))
+COUNTED_STATE_CHANGE(glCullFace, PFNGLCULLFACEPROC, (GLenum mode), (mode))
+
+REAL_GL_FUNCTION(glUseProgram, PFNGLUSEPROGRAMPROC)
+
+inline void APIENTRY CountedUseProgram(GLuint program)
+{
+    CurrentRenderStats().StateChanges++;
+    CurrentRenderStats().ProgramSwitches++;
+    Real_glUseProgram()(program);
+}
+
+// estimated video memory of the buffers and textures alive, from the sizes passed to glBufferData, glTexImage2D and
+// glTexImage3D since the hooks were installed. Drivers may pad (RGB is often stored as RGBA), renderbuffers are not
+// included.
+struct GpuMemoryStats {
+    unsigned long long BufferBytes = 0;
+    unsigned long long TextureBytes = 0;
+};
+
+inline GpuMemoryStats& CurrentGpuMemory()
+{
+    static GpuMemoryStats memory;
+    return memory;
+}
+
+// bytes of every buffer and of every texture image (texture, face * 32 + level)
+inline std::map<GLuint, unsigned long long>& TrackedBufferSizes()
+{
+    static std::map<GLuint, unsigned long long> sizes;
+    return sizes;
+}
+
+inline std::map<std::pair<GLuint, int>, unsigned long long>& TrackedTextureSizes()
+{
+    static std::map<std::pair<GLuint, int>, unsigned long long> sizes;
+    return sizes;
+}
+
+inline unsigned int TexelBytes(GLint internalFormat)
+{
+    switch (internalFormat)
+    {
+    case GL_R8: case GL_RED: return 1;
+    case GL_RG8: case GL_RG: case GL_R16F: return 2;
+    case GL_RGB8: case GL_SRGB8: case GL_RGB: return 3;
+    case GL_RGB16F: return 6;
+    case GL_RGBA16F: case GL_RG32F: return 8;
+    case GL_RGB32F: return 12;
+    case GL_RGBA32F: return 16;
+    default: return 4; // RGBA8, sRGB8 alpha8, R32F, depth24 stencil8, ...
+    }
+}
+
+inline GLuint BoundObject(GLenum binding)
+{
+    GLint object = 0;
+    glGetIntegerv(binding, &object);
+    return static_cast<GLuint>(object);
+}
+
+// replaces the tracked size of an object and keeps the totals in step
+template <typename Key>
+inline void TrackSize(std::map<Key, unsigned long long>& sizes, const Key& key, unsigned long long bytes, unsigned long long& total)
+{
+    unsigned long long& size = sizes[key];
+    total = total - size + bytes;
+    size = bytes;
+}
+
+REAL_GL_FUNCTION(glBufferData, PFNGLBUFFERDATAPROC)
+REAL_GL_FUNCTION(glDeleteBuffers, PFNGLDELETEBUFFERSPROC)
+REAL_GL_FUNCTION(glTexImage2D, PFNGLTEXIMAGE2DPROC)
+REAL_GL_FUNCTION(glTexImage3D, PFNGLTEXIMAGE3DPROC)
+REAL_GL_FUNCTION(glDeleteTextures, PFNGLDELETETEXTURESPROC)
+
+inline void APIENTRY TrackedBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
+{
+    GLenum binding = target == GL_ARRAY_BUFFER ? GL_ARRAY_BUFFER_BINDING :
+        target == GL_ELEMENT_ARRAY_BUFFER ? GL_ELEMENT_ARRAY_BUFFER_BINDING :
+        target == GL_UNIFORM_BUFFER ? GL_UNIFORM_BUFFER_BINDING : 0;
+    if (binding != 0)
+        TrackSize(TrackedBufferSizes(), BoundObject(binding), static_cast<unsigned long long>(size), CurrentGpuMemory().BufferBytes);
+    Real_glBufferData()(target, size, data, usage);
+}
+
+inline void APIENTRY TrackedDeleteBuffers(GLsizei n, const GLuint* buffers)
+{
+    for (GLsizei i = 0; i < n; i++)
+    {
+        auto tracked = TrackedBufferSizes().find(buffers[i]);
+        if (tracked == TrackedBufferSizes().end())
+            continue;
+        CurrentGpuMemory().BufferBytes -= tracked->second;
+        TrackedBufferSizes().erase(tracked);
+    }
+    Real_glDeleteBuffers()(n, buffers);
+}
+
+inline void APIENTRY TrackedTexImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void* pixels)
+{
+    bool cubeFace = target >= GL_TEXTURE_CUBE_MAP_POSITIVE_X && target <= GL_TEXTURE_CUBE_MAP_NEGATIVE_Z;
+    GLenum binding = target == GL_TEXTURE_2D ? GL_TEXTURE_BINDING_2D : cubeFace ? GL_TEXTURE_BINDING_CUBE_MAP : 0;
+    if (binding != 0)
+    {
+        int face = cubeFace ? static_cast<int>(target - GL_TEXTURE_CUBE_MAP_POSITIVE_X) : 0;
+        unsigned long long bytes = static_cast<unsigned long long>(width) * height * TexelBytes(internalFormat);
+        TrackSize(TrackedTextureSizes(), std::make_pair(BoundObject(binding), face * 32 + level), bytes, CurrentGpuMemory().TextureBytes);
+    }
+    Real_glTexImage2D()(target, level, internalFormat, width, height, border, format, type, pixels);
+}
+
+inline void APIENTRY TrackedTexImage3D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const void* pixels)
+{
+    GLenum binding = target == GL_TEXTURE_2D_ARRAY ? GL_TEXTURE_BINDING_2D_ARRAY : target == GL_TEXTURE_3D ? GL_TEXTURE_BINDING_3D : 0;
+    if (binding != 0)
+    {
+        unsigned long long bytes = static_cast<unsigned long long>(width) * height * depth * TexelBytes(internalFormat);
+        TrackSize(TrackedTextureSizes(), std::make_pair(BoundObject(binding), level), bytes, CurrentGpuMemory().TextureBytes);
+    }
+    Real_glTexImage3D()(target, level, internalFormat, width, height, depth, border, format, type, pixels);
+}
+
+inline void APIENTRY TrackedDeleteTextures(GLsizei n, const GLuint* textures)
+{
+    std::map<std::pair<GLuint, int>, unsigned long long>& sizes = TrackedTextureSizes();
+    for (GLsizei i = 0; i < n; i++)
+    {
+        auto image = sizes.lower_bound(std::make_pair(textures[i], 0));
+        while (image != sizes.end() && image->first.first == textures[i])
+        {
+            CurrentGpuMemory().TextureBytes -= image->second;
+            image = sizes.erase(image);
+        }
+    }
+    Real_glDeleteTextures()(n, textures);
+}
+
+#define INSTALL_GL_HOOK(name, hook) \
+    Real_##name() = glad_##name; \
+    glad_##name = hook
+
+// routes the glad draw and state change entry points through the counting hooks above, so the render code is
+// measured without changing it. Call once after glad has loaded the OpenGL functions and before creating buffers
+// and textures, so their memory is tracked. Calls made by the ImGui backend go through its own loader and are not
+// counted.
+inline void InstallRenderStatsHooks()
+{
+    if (Real_glDrawArrays())
+        return; // already installed
+
+    INSTALL_GL_HOOK(glDrawArrays, CountedDrawArrays);
+    INSTALL_GL_HOOK(glDrawElements, CountedDrawElements);
+    INSTALL_GL_HOOK(glDrawArraysInstanced, CountedDrawArraysInstanced);
+    INSTALL_GL_HOOK(glDrawElementsInstanced, CountedDrawElementsInstanced);
+    INSTALL_GL_HOOK(glUseProgram, CountedUseProgram);
+    INSTALL_GL_HOOK(glBindVertexArray, Counted_glBindVertexArray);
+    INSTALL_GL_HOOK(glBindTexture, Counted_glBindTexture);
+    INSTALL_GL_HOOK(glBindFramebuffer, Counted_glBindFramebuffer);
+    INSTALL_GL_HOOK(glEnable, Counted_glEnable);
+    INSTALL_GL_HOOK(glDisable, Counted_glDisable);
+    INSTALL_GL_HOOK(glDepthFunc, Counted_glDepthFunc);
+    INSTALL_GL_HOOK(glDepthMask, Counted_glDepthMask);
+    INSTALL_GL_HOOK(glStencilFunc, Counted_glStencilFunc);
+    INSTALL_GL_HOOK(glStencilOp, Counted_glStencilOp);
+    INSTALL_GL_HOOK(glStencilMask, Counted_glStencilMask);
+    INSTALL_GL_HOOK(glBlendFunc, Counted_glBlendFunc);
+    INSTALL_GL_HOOK(glBlendFuncSeparate, Counted_glBlendFuncSeparate);
+    INSTALL_GL_HOOK(glCullFace, Counted_glCullFace);
+    INSTALL_GL_HOOK(glBufferData, TrackedBufferData);
+    INSTALL_GL_HOOK(glDeleteBuffers, TrackedDeleteBuffers);
+    INSTALL_GL_HOOK(glTexImage2D, TrackedTexImage2D);
+    INSTALL_GL_HOOK(glTexImage3D, TrackedTexImage3D);
+    INSTALL_GL_HOOK(glDeleteTextures, TrackedDeleteTextures);
+}
@@ -1,9 +1,12 @@
 #version 330 core
-out vec4 FragColor;
+layout (location = 0) out vec4 FragColor;
+// the selection mask of the outline (see OutlineRenderer in outline.h), only written while it is a draw buffer
+layout (location = 1) out float Selected;
 
 in vec2 TexCoords;
 
 uniform sampler2D texture1;
+uniform float selected;
 
 float near = 0.1;
 float far = 100.0;
@@ -26,4 +29,5 @@ void main()
         discard;
     }
     FragColor = texColor;
+    Selected = selected;
 }
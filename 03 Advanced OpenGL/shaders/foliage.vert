@@ -0,0 +1,27 @@
+#version 330 core
+layout (location = 0) in vec2 aBlade; // x -1..1 across the root, y 0 at the root to 1 at the tip
+// per instance (see GrassInstance in foliage.h)
+layout (location = 2) in vec4 aPositionRotation;
+layout (location = 3) in float aScale;
+layout (location = 4) in vec4 aTint;
+
+out vec3 Color;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+const float HALF_WIDTH = 0.08; // of the root, relative to the height
+const float BEND = 0.3; // how far the tip leans forward, relative to the height
+
+void main()
+{
+    float height = aBlade.y;
+    // narrower towards the tip, which leans forward
+    vec3 local = vec3(aBlade.x * HALF_WIDTH * (1.0 - height), height, height * height * BEND) * aScale;
+    float c = cos(aPositionRotation.w);
+    float s = sin(aPositionRotation.w);
+    vec3 world = aPositionRotation.xyz + vec3(c * local.x + s * local.z, local.y, c * local.z - s * local.x);
+    // darker at the root, where the blades shade each other
+    Color = aTint.rgb * mix(0.3, 1.0, height);
+    gl_Position = projection * view * vec4(world, 1.0);
+}
@@ -0,0 +1,11 @@
+#version 330 core
+out vec2 Seed;
+
+uniform sampler2D mask;
+
+// every masked pixel is its own nearest seed, the others have none yet (far away)
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    Seed = texelFetch(mask, pixel, 0).r > 0.5 ? vec2(pixel) : vec2(-1e6);
+}
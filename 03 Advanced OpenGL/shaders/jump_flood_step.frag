@@ -0,0 +1,28 @@
+#version 330 core
+out vec2 Seed;
+
+uniform sampler2D seeds;
+uniform int step;
+
+// keeps the nearest of the seeds found by this pixel and its 8 neighbours step pixels away
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    ivec2 last = textureSize(seeds, 0) - 1;
+    vec2 best = texelFetch(seeds, pixel, 0).rg;
+    float bestDistance = distance(best, vec2(pixel));
+    for (int y = -1; y <= 1; y++)
+    {
+        for (int x = -1; x <= 1; x++)
+        {
+            vec2 seed = texelFetch(seeds, clamp(pixel + ivec2(x, y) * step, ivec2(0), last), 0).rg;
+            float seedDistance = distance(seed, vec2(pixel));
+            if (seedDistance < bestDistance)
+            {
+                best = seed;
+                bestDistance = seedDistance;
+            }
+        }
+    }
+    Seed = best;
+}
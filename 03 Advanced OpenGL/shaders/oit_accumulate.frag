@@ -0,0 +1,18 @@
+#version 330 core
+layout (location = 0) out vec4 Accumulation;
+layout (location = 1) out float Weight;
+
+in vec4 Color;
+
+// Weighted blended OIT (McGuire and Bavoil 2013), drawn in any order with GL_ONE, GL_ONE for colour and GL_ZERO,
+// GL_ONE_MINUS_SRC_ALPHA for alpha. Accumulation.rgb sums the weighted premultiplied colours, Accumulation.a ends
+// up as the product of (1 - alpha) and Weight sums the weighted alphas.
+void main()
+{
+    // nearer and more opaque layers count more. The constants are the paper's equation 10, for depths in 0..1
+    // of a far plane around 100.
+    float a = Color.a;
+    float weight = clamp(pow(min(1.0, a * 10.0) + 0.01, 3.0) * 1e8 * pow(1.0 - gl_FragCoord.z * 0.9, 3.0), 1e-2, 3e3);
+    Accumulation = vec4(Color.rgb * a * weight, a);
+    Weight = a * weight;
+}
@@ -0,0 +1,23 @@
+#version 330 core
+out vec4 FragColor;
+
+uniform sampler2D accumulation;
+uniform sampler2D weights;
+
+// blended over the scene with GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA: the weighted average colour of the layers,
+// covering as much as the product of their alphas lets through
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec4 accum = texelFetch(accumulation, pixel, 0);
+    float revealage = accum.a;
+    // no transparent surface here
+    if (revealage >= 1.0)
+    {
+        discard;
+    }
+    float weight = texelFetch(weights, pixel, 0).r;
+    // a float16 sum can overflow to infinity with many near layers
+    vec3 average = accum.rgb / clamp(weight, 1e-5, 5e4);
+    FragColor = vec4(average, 1.0 - revealage);
+}
@@ -0,0 +1,36 @@
+#version 330 core
+out vec4 FragColor;
+
+uniform sampler2D mask;
+uniform float width;
+uniform vec3 color;
+
+// a pixel outside the selection mask is part of the outline when a masked pixel lies within the width (up to 2
+// pixels, wider outlines use the jump flood). The outline fades out over its last pixel.
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    ivec2 last = textureSize(mask, 0) - 1;
+    if (texelFetch(mask, pixel, 0).r > 0.5)
+    {
+        discard;
+    }
+    int radius = int(ceil(width));
+    float nearest = 1e6;
+    for (int y = -radius; y <= radius; y++)
+    {
+        for (int x = -radius; x <= radius; x++)
+        {
+            if (texelFetch(mask, clamp(pixel + ivec2(x, y), ivec2(0), last), 0).r > 0.5)
+            {
+                nearest = min(nearest, length(vec2(x, y)));
+            }
+        }
+    }
+    float coverage = clamp(width + 0.5 - nearest, 0.0, 1.0);
+    if (coverage <= 0.0)
+    {
+        discard;
+    }
+    FragColor = vec4(color, coverage);
+}
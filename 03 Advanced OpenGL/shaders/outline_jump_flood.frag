@@ -0,0 +1,25 @@
+#version 330 core
+out vec4 FragColor;
+
+uniform sampler2D mask;
+uniform sampler2D seeds;
+uniform float width;
+uniform vec3 color;
+
+// a pixel outside the selection mask is part of the outline when the jump flood found a masked pixel within the
+// width. The outline fades out over its last pixel.
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    if (texelFetch(mask, pixel, 0).r > 0.5)
+    {
+        discard;
+    }
+    float nearest = distance(texelFetch(seeds, pixel, 0).rg, vec2(pixel));
+    float coverage = clamp(width + 0.5 - nearest, 0.0, 1.0);
+    if (coverage <= 0.0)
+    {
+        discard;
+    }
+    FragColor = vec4(color, coverage);
+}
@@ -3,5 +3,6 @@ out vec4 FragColor;
 
 void main()
 {
-    FragColor = vec4(0.9, 0.65, 0.16, 1.0);
+    // The framebuffer is sRGB encoded, so write the linear value of the outline colour
+    FragColor = vec4(pow(vec3(0.9, 0.65, 0.16), vec3(2.2)), 1.0);
 }
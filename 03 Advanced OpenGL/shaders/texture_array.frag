@@ -0,0 +1,27 @@
+#version 330 core
+layout (location = 0) out vec4 FragColor;
+// the selection mask of the outline (see OutlineRenderer in outline.h), only written while it is a draw buffer
+layout (location = 1) out float Selected;
+
+in vec2 TexCoords;
+
+// All textures of the scene live in a few texture arrays (see texture_array.h). A draw picks its texture with
+// the array's unit, a layer and the texture's rectangle inside the layer.
+uniform sampler2DArray textures;
+uniform float layer;
+uniform vec4 uvRect; // xy offset, zw scale
+uniform float selected;
+
+void main()
+{
+    // Repeat inside the rectangle. The gradients come from the unwrapped coordinates so the mip level doesn't
+    // jump where fract wraps around.
+    vec2 uv = uvRect.xy + fract(TexCoords) * uvRect.zw;
+    vec4 texColor = textureGrad(textures, vec3(uv, layer), dFdx(TexCoords) * uvRect.zw, dFdy(TexCoords) * uvRect.zw);
+    if (texColor.a < 0.1)
+    {
+        discard;
+    }
+    FragColor = texColor;
+    Selected = selected;
+}
@@ -0,0 +1,10 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec4 Color;
+
+// drawn back to front with GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA blending
+void main()
+{
+    FragColor = Color;
+}
@@ -0,0 +1,17 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+// per instance (see TransparentBucket in transparency.h): xyz the pane's centre, w its size. rgb the linear
+// colour, a the opacity.
+layout (location = 2) in vec4 aCenterSize;
+layout (location = 3) in vec4 aColor;
+
+out vec4 Color;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    Color = aColor;
+    gl_Position = projection * view * vec4(aCenterSize.xyz + aPos * aCenterSize.w, 1.0);
+}
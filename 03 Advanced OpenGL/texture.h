@@ -0,0 +1,202 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "mipmap.h"
+
+#include <string>
+#include <vector>
+
+// How the 8-bit values of an image are interpreted when sampled
+enum TextureColorSpace {
+    TEXTURE_COLOR_SPACE_LINEAR, // data maps: normals, specular, roughness, ao, height
+    TEXTURE_COLOR_SPACE_SRGB    // colour maps: sampled through an sRGB internal format so the shader gets linear values
+};
+
+// describes how an image file becomes a GL texture: which channels are kept, what they are stored as and how
+// they are presented to the shader. Colour maps keep their channels in an sRGB format, single channel maps are
+// stored as GL_R8 (a third of GL_RGB8) and swizzled back to grey so shaders sampling .rgb keep working.
+struct TextureImportDesc {
+    TextureColorSpace ColorSpace = TEXTURE_COLOR_SPACE_SRGB;
+    // number of channels to store, taken from the front of the source texel (R, RG, RGB, RGBA). 0 keeps the source count
+    int Channels = 0;
+    // internal format to upload to. 0 picks GL_R8/GL_RG8/GL_RGB8/GL_RGBA8 or their sRGB variants from Channels and ColorSpace
+    GLenum InternalFormat = 0;
+    // what the shader reads for r, g, b and a
+    GLint Swizzle[4] = { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA };
+    // GL_REPEAT when true, GL_CLAMP_TO_EDGE otherwise (cutout textures like grass.png bleed their opposite edge)
+    bool Repeat = true;
+    // keep the alpha tested coverage of the mips (see MipChainOptions)
+    bool PreserveAlphaCoverage = false;
+    // filter of the mips. MIP_FILTER_KAISER is sharper but slower, worth it where the chain is cached (loadTexture)
+    MipFilter Filter = MIP_FILTER_BOX;
+};
+
+// colour map (diffuse/albedo), alpha is kept if the image has one
+inline TextureImportDesc ColorTextureDesc()
+{
+    return TextureImportDesc();
+}
+
+// single channel data map stored in the red channel and read back as grey
+inline TextureImportDesc GreyscaleTextureDesc()
+{
+    TextureImportDesc desc;
+    desc.ColorSpace = TEXTURE_COLOR_SPACE_LINEAR;
+    desc.Channels = 1;
+    desc.Swizzle[0] = GL_RED;
+    desc.Swizzle[1] = GL_RED;
+    desc.Swizzle[2] = GL_RED;
+    desc.Swizzle[3] = GL_ONE;
+    return desc;
+}
+
+// tangent space normal map, linear RGB
+inline TextureImportDesc NormalTextureDesc()
+{
+    TextureImportDesc desc;
+    desc.ColorSpace = TEXTURE_COLOR_SPACE_LINEAR;
+    desc.Channels = 3;
+    return desc;
+}
+
+// picks the import descriptor for a material texture from the sampler type name used by Mesh::Draw.
+// with gamma off every texture is imported as linear data, which is how the shaders were written before.
+inline TextureImportDesc TextureDescForType(const std::string& typeName, bool gamma)
+{
+    TextureImportDesc desc;
+    if (typeName == "texture_diffuse")
+        desc = ColorTextureDesc();
+    else if (typeName == "texture_specular" || typeName == "texture_height")
+        desc = GreyscaleTextureDesc();
+    else
+        desc = NormalTextureDesc();
+
+    if (!gamma)
+        desc.ColorSpace = TEXTURE_COLOR_SPACE_LINEAR;
+    return desc;
+}
+
+inline GLenum TextureInternalFormat(const TextureImportDesc& desc, int channels)
+{
+    if (desc.InternalFormat != 0)
+        return desc.InternalFormat;
+
+    bool srgb = desc.ColorSpace == TEXTURE_COLOR_SPACE_SRGB;
+    switch (channels)
+    {
+    case 1: return GL_R8; // there are no core single/dual channel sRGB formats
+    case 2: return GL_RG8;
+    case 3: return srgb ? GL_SRGB8 : GL_RGB8;
+    default: return srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+    }
+}
+
+inline GLenum TextureFormat(int channels)
+{
+    switch (channels)
+    {
+    case 1: return GL_RED;
+    case 2: return GL_RG;
+    case 3: return GL_RGB;
+    default: return GL_RGBA;
+    }
+}
+
+// number of channels kept from a source image with the given channel count
+inline int TextureStoredChannels(const TextureImportDesc& desc, int channels)
+{
+    return desc.Channels != 0 ? std::min(desc.Channels, channels) : channels;
+}
+
+// copies the first storedChannels channels of every texel into a tightly packed image
+inline std::vector<unsigned char> SelectChannels(const unsigned char* data, int width, int height, int channels, int storedChannels)
+{
+    size_t texelCount = static_cast<size_t>(width) * height;
+    std::vector<unsigned char> packed(texelCount * storedChannels);
+    for (size_t i = 0; i < texelCount; i++)
+        for (int c = 0; c < storedChannels; c++)
+            packed[i * storedChannels + c] = data[i * channels + c];
+    return packed;
+}
+
+// number of glBindTexture calls made through BindTexture since the counter was last reset
+inline unsigned int& TextureBindCount()
+{
+    static unsigned int count = 0;
+    return count;
+}
+
+// glBindTexture that is counted in TextureBindCount
+inline void BindTexture(GLenum target, unsigned int texture)
+{
+    glBindTexture(target, texture);
+    TextureBindCount()++;
+}
+
+// the mip chain options that build the levels of a texture imported with desc
+inline MipChainOptions TextureMipOptions(const TextureImportDesc& desc)
+{
+    MipChainOptions options;
+    options.Filter = desc.Filter;
+    options.SRGB = desc.ColorSpace == TEXTURE_COLOR_SPACE_SRGB;
+    options.Wrap = desc.Repeat;
+    options.PreserveAlphaCoverage = desc.PreserveAlphaCoverage;
+    return options;
+}
+
+// a mip level in memory owned elsewhere (a MipLevel or the mapping of the texture cache)
+struct MipLevelView {
+    int Width;
+    int Height;
+    const unsigned char* Pixels; // tightly packed
+};
+
+inline std::vector<MipLevelView> ViewMipChain(const std::vector<MipLevel>& levels)
+{
+    std::vector<MipLevelView> views;
+    for (const MipLevel& level : levels)
+        views.push_back({ level.Width, level.Height, level.Pixels.data() });
+    return views;
+}
+
+// creates a GL_TEXTURE_2D from a complete mip chain of channels channel texels as described by desc, returns its id
+inline unsigned int CreateTexture(const std::vector<MipLevelView>& levels, int channels, const TextureImportDesc& desc)
+{
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+
+    // rows of 1 and 3 channel levels are not 4 byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    GLenum internalFormat = TextureInternalFormat(desc, channels);
+    for (unsigned int i = 0; i < levels.size(); i++)
+        glTexImage2D(GL_TEXTURE_2D, i, internalFormat, levels[i].Width, levels[i].Height, 0, TextureFormat(channels), GL_UNSIGNED_BYTE, levels[i].Pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(levels.size()) - 1);
+
+    glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, desc.Swizzle);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, desc.Repeat ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, desc.Repeat ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    return textureID;
+}
+
+// creates a GL_TEXTURE_2D (mips included) from decoded 8-bit pixels as described by desc and returns its id. The
+// mip chain is built on the spot, loads that go through the TextureCache only upload
+inline unsigned int UploadTexture(const unsigned char* data, int width, int height, int channels, const TextureImportDesc& desc)
+{
+    int storedChannels = TextureStoredChannels(desc, channels);
+    std::vector<unsigned char> packed;
+    if (storedChannels != channels)
+    {
+        packed = SelectChannels(data, width, height, channels, storedChannels);
+        data = packed.data();
+    }
+
+    std::vector<MipLevel> mipChain = GenerateMipChain(data, width, height, storedChannels, TextureMipOptions(desc));
+    return CreateTexture(ViewMipChain(mipChain), storedChannels, desc);
+}
@@ -0,0 +1,299 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "mipmap.h"
+#include "profiler.h"
+#include "texture.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// where a texture ended up after packing. Sample it with
+//     texture(array, vec3(UVRect.xy + fract(uv) * UVRect.zw, Layer))
+// (see shaders/texture_array.frag). Textures that got a whole layer have UVRect (0, 0, 1, 1).
+struct PackedTexture {
+    unsigned int Array = 0; // the GL_TEXTURE_2D_ARRAY holding the texture
+    int ArrayIndex = 0;     // index of Array in TexturePacker::Arrays, i.e. its unit offset after BindArrays
+    int Layer = 0;
+    glm::vec4 UVRect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f); // xy offset, zw scale
+};
+
+// packs textures into a few GL_TEXTURE_2D_ARRAYs so a whole scene is drawn with its textures bound once and a
+// layer index + atlas rectangle per draw instead of a glBindTexture per material. Textures with the same size and
+// format become layers of one array, small textures are packed with a padded border into shared atlas pages.
+class TexturePacker
+{
+public:
+    // textures up to this size (both sides) share atlas pages, bigger ones get a layer of their own
+    int AtlasMaxTextureSize = 256;
+    int AtlasSize = 1024;
+    // border (in texels) around every atlas entry, filled with the entry's own wrapped or clamped texels. The atlas
+    // only gets log2(Padding) mip levels so neighbouring entries never bleed into each other.
+    int Padding = 8;
+
+    // copies the pixels and returns the handle to pass to Get once Build has run
+    int Add(const unsigned char* data, int width, int height, int channels, const TextureImportDesc& desc)
+    {
+        Source source;
+        source.Width = width;
+        source.Height = height;
+        source.Channels = TextureStoredChannels(desc, channels);
+        source.Pixels = SelectChannels(data, width, height, channels, source.Channels);
+        source.Desc = desc;
+        source.InternalFormat = TextureInternalFormat(desc, source.Channels);
+        sources.push_back(source);
+        return static_cast<int>(sources.size()) - 1;
+    }
+
+    // the same with the mip chain already built from the stored channels with TextureMipOptions(desc) (e.g. by the
+    // TextureCache). Textures that get a layer of their own upload it as it is instead of building it again.
+    int Add(const std::vector<MipLevelView>& levels, int channels, const TextureImportDesc& desc)
+    {
+        Source source;
+        source.Width = levels[0].Width;
+        source.Height = levels[0].Height;
+        source.Channels = channels;
+        source.Pixels.assign(levels[0].Pixels, levels[0].Pixels + static_cast<size_t>(source.Width) * source.Height * channels);
+        for (const MipLevelView& view : levels)
+        {
+            MipLevel level;
+            level.Width = view.Width;
+            level.Height = view.Height;
+            level.Pixels.assign(view.Pixels, view.Pixels + static_cast<size_t>(view.Width) * view.Height * channels);
+            source.Levels.push_back(std::move(level));
+        }
+        source.Desc = desc;
+        source.InternalFormat = TextureInternalFormat(desc, channels);
+        sources.push_back(std::move(source));
+        return static_cast<int>(sources.size()) - 1;
+    }
+
+    // creates the texture arrays and releases the CPU copies of the pixels
+    void Build()
+    {
+        PROFILE_SCOPE("TexturePacker::Build");
+        packed.assign(sources.size(), PackedTexture());
+
+        std::vector<std::vector<int>> layerGroups;
+        std::vector<std::vector<int>> atlasGroups;
+        for (int i = 0; i < static_cast<int>(sources.size()); i++)
+        {
+            const Source& source = sources[i];
+            bool atlas = source.Width <= AtlasMaxTextureSize && source.Height <= AtlasMaxTextureSize &&
+                AtlasMaxTextureSize + 2 * Padding <= AtlasSize;
+            std::vector<std::vector<int>>& groups = atlas ? atlasGroups : layerGroups;
+
+            bool grouped = false;
+            for (std::vector<int>& group : groups)
+            {
+                const Source& first = sources[group[0]];
+                bool sameSize = first.Width == source.Width && first.Height == source.Height;
+                // atlas pages handle repeat in their padding, layers need the sampler's wrap mode
+                bool sameWrap = first.Desc.Repeat == source.Desc.Repeat;
+                if (sameFormat(first, source) && (atlas || (sameSize && sameWrap)))
+                {
+                    group.push_back(i);
+                    grouped = true;
+                    break;
+                }
+            }
+            if (!grouped)
+                groups.push_back(std::vector<int>(1, i));
+        }
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (const std::vector<int>& group : layerGroups)
+            buildLayers(group);
+        for (const std::vector<int>& group : atlasGroups)
+            buildAtlas(group);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        sources.clear();
+    }
+
+    const PackedTexture& Get(int handle) const
+    {
+        return packed[handle];
+    }
+
+    const std::vector<unsigned int>& Arrays() const
+    {
+        return arrays;
+    }
+
+    // binds array i to texture unit firstUnit + i, once per frame
+    void BindArrays(int firstUnit) const
+    {
+        for (unsigned int i = 0; i < arrays.size(); i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+            BindTexture(GL_TEXTURE_2D_ARRAY, arrays[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void Delete()
+    {
+        if (!arrays.empty())
+            glDeleteTextures(static_cast<GLsizei>(arrays.size()), arrays.data());
+        arrays.clear();
+    }
+
+private:
+    struct Source {
+        std::vector<unsigned char> Pixels; // tightly packed, Channels per texel
+        std::vector<MipLevel> Levels; // the complete mip chain when it was added with one, empty otherwise
+        int Width;
+        int Height;
+        int Channels;
+        TextureImportDesc Desc;
+        GLenum InternalFormat;
+    };
+
+    std::vector<Source> sources;
+    std::vector<PackedTexture> packed;
+    std::vector<unsigned int> arrays;
+
+    static bool sameFormat(const Source& a, const Source& b)
+    {
+        return a.InternalFormat == b.InternalFormat && a.Channels == b.Channels &&
+            std::memcmp(a.Desc.Swizzle, b.Desc.Swizzle, sizeof(a.Desc.Swizzle)) == 0;
+    }
+
+    // creates an array with storage for every level of the given mip chain sizes and sets the shared state
+    unsigned int createArray(const Source& format, int width, int height, int layers, int levels)
+    {
+        unsigned int array;
+        glGenTextures(1, &array);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+        for (int level = 0; level < levels; level++)
+        {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, level, format.InternalFormat, std::max(1, width >> level), std::max(1, height >> level),
+                layers, 0, TextureFormat(format.Channels), GL_UNSIGNED_BYTE, nullptr);
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        glTexParameteriv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SWIZZLE_RGBA, format.Desc.Swizzle);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        arrays.push_back(array);
+        return array;
+    }
+
+    void uploadLayer(const std::vector<MipLevel>& levels, int layer, int channels, int levelCount)
+    {
+        for (int level = 0; level < levelCount; level++)
+        {
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, levels[level].Width, levels[level].Height, 1,
+                TextureFormat(channels), GL_UNSIGNED_BYTE, levels[level].Pixels.data());
+        }
+    }
+
+    // same size, same format: one full layer per texture
+    void buildLayers(const std::vector<int>& group)
+    {
+        const Source& first = sources[group[0]];
+        unsigned int array = 0;
+        for (int layer = 0; layer < static_cast<int>(group.size()); layer++)
+        {
+            const Source& source = sources[group[layer]];
+            std::vector<MipLevel> levels = !source.Levels.empty() ? source.Levels :
+                GenerateMipChain(source.Pixels.data(), source.Width, source.Height, source.Channels, TextureMipOptions(source.Desc));
+            if (layer == 0)
+            {
+                array = createArray(first, first.Width, first.Height, static_cast<int>(group.size()), static_cast<int>(levels.size()));
+                GLint wrap = first.Desc.Repeat ? GL_REPEAT : GL_CLAMP_TO_EDGE;
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrap);
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrap);
+            }
+            uploadLayer(levels, layer, source.Channels, static_cast<int>(levels.size()));
+
+            PackedTexture& result = packed[group[layer]];
+            result.Array = array;
+            result.ArrayIndex = static_cast<int>(arrays.size()) - 1;
+            result.Layer = layer;
+        }
+    }
+
+    // small textures of the same format: shelf packed into AtlasSize x AtlasSize pages, one page per layer
+    void buildAtlas(std::vector<int> group)
+    {
+        const Source& first = sources[group[0]];
+        int channels = first.Channels;
+
+        // tallest first keeps the shelves tight
+        std::sort(group.begin(), group.end(), [this](int a, int b) { return sources[a].Height > sources[b].Height; });
+
+        std::vector<std::vector<unsigned char>> pages;
+        int x = 0, y = 0, shelfHeight = 0;
+        for (int index : group)
+        {
+            const Source& source = sources[index];
+            int paddedWidth = source.Width + 2 * Padding;
+            int paddedHeight = source.Height + 2 * Padding;
+            if (x + paddedWidth > AtlasSize)
+            {
+                x = 0;
+                y += shelfHeight;
+                shelfHeight = 0;
+            }
+            if (pages.empty() || y + paddedHeight > AtlasSize)
+            {
+                pages.push_back(std::vector<unsigned char>(static_cast<size_t>(AtlasSize) * AtlasSize * channels, 0));
+                x = 0;
+                y = 0;
+                shelfHeight = 0;
+            }
+
+            // copy the texture with its border: wrapped texels for repeating textures, clamped ones otherwise
+            std::vector<unsigned char>& page = pages.back();
+            for (int py = -Padding; py < source.Height + Padding; py++)
+            {
+                int sy = source.Desc.Repeat ? (py + source.Height) % source.Height : std::min(std::max(py, 0), source.Height - 1);
+                for (int px = -Padding; px < source.Width + Padding; px++)
+                {
+                    int sx = source.Desc.Repeat ? (px + source.Width) % source.Width : std::min(std::max(px, 0), source.Width - 1);
+                    const unsigned char* from = &source.Pixels[(static_cast<size_t>(sy) * source.Width + sx) * channels];
+                    unsigned char* to = &page[(static_cast<size_t>(y + Padding + py) * AtlasSize + x + Padding + px) * channels];
+                    std::memcpy(to, from, channels);
+                }
+            }
+
+            PackedTexture& result = packed[index];
+            result.Layer = static_cast<int>(pages.size()) - 1;
+            result.UVRect = glm::vec4(static_cast<float>(x + Padding) / AtlasSize, static_cast<float>(y + Padding) / AtlasSize,
+                static_cast<float>(source.Width) / AtlasSize, static_cast<float>(source.Height) / AtlasSize);
+
+            x += paddedWidth;
+            shelfHeight = std::max(shelfHeight, paddedHeight);
+        }
+
+        // level n averages 2^n texels, so the border keeps neighbours apart for 1 + log2(Padding) levels
+        int levelCount = 1;
+        while ((2 << (levelCount - 1)) <= Padding)
+            levelCount++;
+
+        MipChainOptions options = TextureMipOptions(first.Desc);
+        options.Filter = MIP_FILTER_BOX; // the Kaiser taps reach further than the border
+        options.Wrap = false;
+        options.PreserveAlphaCoverage = false; // per entry coverage can't be kept on a shared page
+        unsigned int array = createArray(first, AtlasSize, AtlasSize, static_cast<int>(pages.size()), levelCount);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        for (int layer = 0; layer < static_cast<int>(pages.size()); layer++)
+        {
+            std::vector<MipLevel> levels = GenerateMipChain(pages[layer].data(), AtlasSize, AtlasSize, channels, options);
+            uploadLayer(levels, layer, channels, std::min(levelCount, static_cast<int>(levels.size())));
+        }
+
+        for (int index : group)
+        {
+            packed[index].Array = array;
+            packed[index].ArrayIndex = static_cast<int>(arrays.size()) - 1;
+        }
+    }
+};
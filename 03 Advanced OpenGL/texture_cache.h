@@ -0,0 +1,366 @@
+#pragma once
+
+#include <stb_image.h>
+
+#include "mapped_file.h"
+#include "mipmap.h"
+#include "profiler.h"
+#include "texture.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// first bytes of a pack file
+#define TEXTURE_CACHE_MAGIC "TXCP"
+
+// a texture as the cache hands it out: the stored channels and the complete mip chain, level 0 first. The pixels
+// stay valid until TextureCache::Save is called or the cache is destroyed.
+struct CachedTexture {
+    int Channels = 0;
+    std::vector<MipLevelView> Levels;
+};
+
+// keeps decoded images with their CPU built mip chains (see GenerateMipChain) in a single pack file that is memory
+// mapped at startup, so warm loads skip the decoding and the filtering and only upload. The pack has the layout of
+// the one in 02 Model loading. Entries are keyed by the source path, a hash of the source file and everything in
+// the import desc that changes the pixels (stored channels, colour space, wrapping, alpha coverage, filter); an
+// edited image simply misses and replaces its old entry on the next save.
+class TextureCache
+{
+public:
+    // pack entries outside these limits are ignored, whatever they claim about their data
+    static const int MAX_SIZE = 16384;
+    static const int MAX_LEVELS = 15; // of a MAX_SIZE image
+
+    explicit TextureCache(const std::string& packPath)
+        : packPath(packPath)
+    {
+        openPack();
+    }
+
+    // fills texture with the pixels of the image at path as imported with desc, decoding it and building its mips
+    // (and queuing it for the next save) on a miss. Returns false if the image can't be loaded.
+    bool Load(const std::string& path, const TextureImportDesc& desc, CachedTexture* texture)
+    {
+        PROFILE_SCOPE("TextureCache::Load");
+        // mapped rather than read, hashing a warm file costs no copy and a miss decodes from the same bytes
+        MappedFile source;
+        if (!source.Open(path))
+            return false;
+        uint64_t sourceHash = fnv1a(source.Data(), source.Size());
+        uint32_t flags = descFlags(desc);
+        uint64_t key = keyHash(path, flags);
+
+        auto found = entries.find(key);
+        if (found != entries.end() && found->second.Path == path && found->second.Flags == flags && found->second.SourceHash == sourceHash)
+        {
+            fillTexture(found->second, mapping.Data() + found->second.DataOffset, texture);
+            hitCount++;
+            return true;
+        }
+        auto decoded = pending.find(key);
+        if (decoded != pending.end() && decoded->second->Info.SourceHash == sourceHash)
+        {
+            fillPending(*decoded->second, texture);
+            hitCount++;
+            return true;
+        }
+
+        int width, height, nrComponents;
+        unsigned char* data = stbi_load_from_memory(source.Data(), static_cast<int>(source.Size()), &width, &height, &nrComponents, 0);
+        if (!data)
+            return false;
+        int storedChannels = TextureStoredChannels(desc, nrComponents);
+        std::vector<unsigned char> packed;
+        const unsigned char* pixels = data;
+        if (storedChannels != nrComponents)
+        {
+            packed = SelectChannels(data, width, height, nrComponents, storedChannels);
+            pixels = packed.data();
+        }
+
+        std::unique_ptr<PendingTexture> entry(new PendingTexture());
+        entry->Info.Path = path;
+        entry->Info.SourceHash = sourceHash;
+        entry->Info.Flags = flags;
+        entry->Info.Width = width;
+        entry->Info.Height = height;
+        entry->Info.Channels = storedChannels;
+        entry->Levels = GenerateMipChain(pixels, width, height, storedChannels, TextureMipOptions(desc));
+        entry->Info.LevelCount = static_cast<int>(entry->Levels.size());
+        stbi_image_free(data);
+
+        fillPending(*entry, texture);
+        pending[key] = std::move(entry);
+        missCount++;
+        return true;
+    }
+
+    // rewrites the pack file with the entries decoded since it was mapped and maps it again. Does nothing if every
+    // load was a hit.
+    bool Save()
+    {
+        PROFILE_SCOPE("TextureCache::Save");
+        if (pending.empty())
+            return true;
+
+        std::string tempPath = packPath + ".tmp";
+        std::ofstream file(tempPath, std::ios::binary);
+        if (!file)
+        {
+            std::cout << "Failed to write texture cache: " << tempPath << std::endl;
+            return false;
+        }
+
+        std::vector<unsigned char> table;
+        uint32_t entryCount = 0;
+        uint64_t offset = HEADER_SIZE;
+        file.write(std::string(HEADER_SIZE, '\0').data(), HEADER_SIZE);
+        auto writeEntry = [&](uint64_t key, const Entry& entry, const unsigned char* const* levels)
+        {
+            uint64_t padding = (DATA_ALIGNMENT - offset % DATA_ALIGNMENT) % DATA_ALIGNMENT;
+            file.write(std::string(padding, '\0').data(), padding);
+            offset += padding;
+
+            uint64_t dataSize = 0;
+            for (int level = 0; level < entry.LevelCount; level++)
+            {
+                size_t size = levelSize(entry, level);
+                file.write(reinterpret_cast<const char*>(levels[level]), size);
+                dataSize += size;
+            }
+
+            putU64(table, key);
+            putU64(table, entry.SourceHash);
+            putU64(table, offset);
+            putU64(table, dataSize);
+            putU32(table, entry.Flags);
+            putU32(table, entry.Width);
+            putU32(table, entry.Height);
+            putU32(table, entry.Channels);
+            putU32(table, entry.LevelCount);
+            putU32(table, static_cast<uint32_t>(entry.Path.size()));
+            table.insert(table.end(), entry.Path.begin(), entry.Path.end());
+            offset += dataSize;
+            entryCount++;
+        };
+
+        // keep the mapped entries that weren't replaced, then append the newly decoded ones
+        std::vector<const unsigned char*> levels;
+        for (const auto& mapped : entries)
+        {
+            if (pending.count(mapped.first) != 0)
+                continue;
+            levels.clear();
+            const unsigned char* data = mapping.Data() + mapped.second.DataOffset;
+            for (int level = 0; level < mapped.second.LevelCount; level++)
+            {
+                levels.push_back(data);
+                data += levelSize(mapped.second, level);
+            }
+            writeEntry(mapped.first, mapped.second, levels.data());
+        }
+        for (const auto& decoded : pending)
+        {
+            levels.clear();
+            for (const MipLevel& level : decoded.second->Levels)
+                levels.push_back(level.Pixels.data());
+            writeEntry(decoded.first, decoded.second->Info, levels.data());
+        }
+        file.write(reinterpret_cast<const char*>(table.data()), table.size());
+
+        std::vector<unsigned char> header(TEXTURE_CACHE_MAGIC, TEXTURE_CACHE_MAGIC + 4);
+        putU32(header, PACK_VERSION);
+        putU32(header, entryCount);
+        putU32(header, 0);
+        putU64(header, offset);
+        putU64(header, table.size());
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(header.data()), header.size());
+        file.close();
+        if (!file)
+        {
+            std::cout << "Failed to write texture cache: " << tempPath << std::endl;
+            std::remove(tempPath.c_str());
+            return false;
+        }
+
+        // the old pack has to be unmapped before it can be replaced on Windows
+        mapping.Close();
+        std::remove(packPath.c_str());
+        if (std::rename(tempPath.c_str(), packPath.c_str()) != 0)
+            std::cout << "Failed to replace texture cache: " << packPath << std::endl;
+        pending.clear();
+        openPack();
+        return true;
+    }
+
+    unsigned int HitCount() const { return hitCount; }
+    unsigned int MissCount() const { return missCount; }
+
+private:
+    struct Entry {
+        std::string Path;
+        uint64_t SourceHash;
+        uint32_t Flags;
+        int Width;
+        int Height;
+        int Channels;
+        int LevelCount;
+        uint64_t DataOffset; // from the start of the pack file
+        uint64_t DataSize;
+    };
+
+    struct PendingTexture {
+        Entry Info;
+        std::vector<MipLevel> Levels;
+    };
+
+    static const uint32_t PACK_VERSION = 1;
+    static const size_t HEADER_SIZE = 4 + 3 * 4 + 2 * 8; // magic, version, entry count, reserved, table offset, table size
+    static const size_t ENTRY_SIZE = 4 * 8 + 6 * 4; // followed by the path
+    static const uint64_t DATA_ALIGNMENT = 16;
+
+    std::string packPath;
+    MappedFile mapping;
+    std::unordered_map<uint64_t, Entry> entries; // key hash -> entry in the mapped pack
+    std::unordered_map<uint64_t, std::unique_ptr<PendingTexture>> pending; // key hash -> decoded on a miss
+    unsigned int hitCount = 0;
+    unsigned int missCount = 0;
+
+    static uint64_t fnv1a(const unsigned char* data, size_t size, uint64_t hash = 14695981039346656037ull)
+    {
+        for (size_t i = 0; i < size; i++)
+            hash = (hash ^ data[i]) * 1099511628211ull;
+        return hash;
+    }
+
+    static uint32_t descFlags(const TextureImportDesc& desc)
+    {
+        return (desc.ColorSpace == TEXTURE_COLOR_SPACE_SRGB ? 1u : 0u) | (desc.Repeat ? 2u : 0u) |
+            (desc.PreserveAlphaCoverage ? 4u : 0u) | (static_cast<uint32_t>(desc.Filter) << 4) |
+            (static_cast<uint32_t>(desc.Channels) << 8);
+    }
+
+    static uint64_t keyHash(const std::string& path, uint32_t flags)
+    {
+        unsigned char flagBytes[4] = { static_cast<unsigned char>(flags), static_cast<unsigned char>(flags >> 8),
+            static_cast<unsigned char>(flags >> 16), static_cast<unsigned char>(flags >> 24) };
+        return fnv1a(flagBytes, 4, fnv1a(reinterpret_cast<const unsigned char*>(path.data()), path.size()));
+    }
+
+    static void putU32(std::vector<unsigned char>& out, uint32_t value)
+    {
+        for (int i = 0; i < 4; i++)
+            out.push_back((value >> (8 * i)) & 0xFF);
+    }
+
+    static void putU64(std::vector<unsigned char>& out, uint64_t value)
+    {
+        for (int i = 0; i < 8; i++)
+            out.push_back((value >> (8 * i)) & 0xFF);
+    }
+
+    static uint32_t getU32(const unsigned char* in)
+    {
+        return in[0] | (in[1] << 8) | (in[2] << 16) | (static_cast<uint32_t>(in[3]) << 24);
+    }
+
+    static uint64_t getU64(const unsigned char* in)
+    {
+        return getU32(in) | (static_cast<uint64_t>(getU32(in + 4)) << 32);
+    }
+
+    static size_t levelSize(const Entry& entry, int level)
+    {
+        return static_cast<size_t>(std::max(1, entry.Width >> level)) * std::max(1, entry.Height >> level) * entry.Channels;
+    }
+
+    // the header of an entry comes from a file that may be corrupt or edited by hand, so its sizes are checked and
+    // the whole mip chain has to fit into its data before anything reads it
+    static bool validEntry(const Entry& entry, size_t packSize)
+    {
+        if (entry.Width < 1 || entry.Width > MAX_SIZE || entry.Height < 1 || entry.Height > MAX_SIZE ||
+            entry.Channels < 1 || entry.Channels > 4 || entry.LevelCount < 1 || entry.LevelCount > MAX_LEVELS)
+            return false;
+        if (entry.DataOffset > packSize || entry.DataSize > packSize - entry.DataOffset)
+            return false;
+        uint64_t chainSize = 0;
+        for (int level = 0; level < entry.LevelCount; level++)
+            chainSize += levelSize(entry, level);
+        return chainSize <= entry.DataSize;
+    }
+
+    void openPack()
+    {
+        entries.clear();
+        if (!mapping.Open(packPath))
+            return; // no cache yet, everything misses
+
+        const unsigned char* data = mapping.Data();
+        size_t size = mapping.Size();
+        if (size < HEADER_SIZE || std::memcmp(data, TEXTURE_CACHE_MAGIC, 4) != 0 || getU32(data + 4) != PACK_VERSION)
+        {
+            std::cout << "Ignoring texture cache with unknown format: " << packPath << std::endl;
+            mapping.Close();
+            return;
+        }
+        uint32_t entryCount = getU32(data + 8);
+        uint64_t tableOffset = getU64(data + 16);
+        uint64_t tableSize = getU64(data + 24);
+        if (tableOffset > size || tableSize > size - tableOffset)
+        {
+            mapping.Close();
+            return;
+        }
+
+        const unsigned char* cursor = data + tableOffset;
+        const unsigned char* tableEnd = cursor + tableSize;
+        for (uint32_t i = 0; i < entryCount && static_cast<size_t>(tableEnd - cursor) >= ENTRY_SIZE; i++)
+        {
+            uint64_t key = getU64(cursor);
+            Entry entry;
+            entry.SourceHash = getU64(cursor + 8);
+            entry.DataOffset = getU64(cursor + 16);
+            entry.DataSize = getU64(cursor + 24);
+            entry.Flags = getU32(cursor + 32);
+            entry.Width = static_cast<int>(getU32(cursor + 36));
+            entry.Height = static_cast<int>(getU32(cursor + 40));
+            entry.Channels = static_cast<int>(getU32(cursor + 44));
+            entry.LevelCount = static_cast<int>(getU32(cursor + 48));
+            uint32_t pathLength = getU32(cursor + 52);
+            cursor += ENTRY_SIZE;
+            if (pathLength > static_cast<size_t>(tableEnd - cursor))
+                break;
+            entry.Path.assign(reinterpret_cast<const char*>(cursor), pathLength);
+            cursor += pathLength;
+            // a broken entry only costs its own image a decode
+            if (validEntry(entry, size))
+                entries[key] = entry;
+        }
+    }
+
+    static void fillTexture(const Entry& entry, const unsigned char* data, CachedTexture* texture)
+    {
+        texture->Channels = entry.Channels;
+        texture->Levels.clear();
+        for (int level = 0; level < entry.LevelCount; level++)
+        {
+            texture->Levels.push_back({ std::max(1, entry.Width >> level), std::max(1, entry.Height >> level), data });
+            data += levelSize(entry, level);
+        }
+    }
+
+    static void fillPending(const PendingTexture& pending, CachedTexture* texture)
+    {
+        texture->Channels = pending.Info.Channels;
+        texture->Levels = ViewMipChain(pending.Levels);
+    }
+};
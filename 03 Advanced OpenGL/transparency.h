@@ -0,0 +1,241 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "frame_graph.h"
+#include "profiler.h"
+#include "shader.h"
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+// repairing last frame's order may take up to this many moves per instance before the bucket gives up and sorts
+// from scratch. Small camera moves need far fewer, a jump or a turn far more.
+#define TRANSPARENT_SORT_MAX_MOVES_PER_INSTANCE 4
+
+// transparent instances, sorted back to front by their distance along the view direction so blending them in that
+// order composes them correctly. Every frame the order of the previous frame is repaired with an insertion sort,
+// which is close to free while the camera moves a little. When it would take too many moves the instances are
+// sorted from scratch with a radix sort over the depth bits. Both sorts are stable, so instances at the same depth
+// keep their relative order from frame to frame and don't flicker.
+class TransparentBucket
+{
+public:
+    void Clear()
+    {
+        centers.clear();
+        order.clear();
+        keys.clear();
+    }
+
+    // returns the instance's index, which Order() refers to
+    unsigned int Add(const glm::vec3& center)
+    {
+        unsigned int index = static_cast<unsigned int>(centers.size());
+        centers.push_back(center);
+        order.push_back(index);
+        keys.push_back(0);
+        return index;
+    }
+
+    size_t Size() const
+    {
+        return centers.size();
+    }
+
+    const glm::vec3& Center(unsigned int index) const
+    {
+        return centers[index];
+    }
+
+    // instance indices, the farthest first
+    const std::vector<unsigned int>& Order() const
+    {
+        return order;
+    }
+
+    // true when the last Sort only repaired the previous order
+    bool LastSortWasIncremental() const
+    {
+        return lastIncremental;
+    }
+
+    // incremental = false always sorts from scratch (for measuring)
+    void Sort(const glm::vec3& cameraPosition, const glm::vec3& cameraFront, bool incremental = true)
+    {
+        PROFILE_SCOPE("TransparentBucket::Sort");
+        const size_t count = order.size();
+        for (size_t i = 0; i < count; i++)
+            keys[i] = DepthKey(glm::dot(centers[order[i]] - cameraPosition, cameraFront));
+
+        lastIncremental = incremental && repairOrder(count * TRANSPARENT_SORT_MAX_MOVES_PER_INSTANCE);
+        if (!lastIncremental)
+            radixSort();
+    }
+
+    // an unsigned key that sorts in the opposite order of the float depth, so ascending keys are back to front.
+    // Positive floats order like their bits, negative ones reversed: flip all bits of negatives and only the sign
+    // bit of the rest, then invert the whole key.
+    static uint32_t DepthKey(float depth)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &depth, sizeof(bits));
+        uint32_t ascending = (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+        return ~ascending;
+    }
+
+private:
+    std::vector<glm::vec3> centers;
+    std::vector<unsigned int> order;
+    std::vector<uint32_t> keys; // key of order[i]
+    std::vector<unsigned int> scratchOrder;
+    std::vector<uint32_t> scratchKeys;
+    bool lastIncremental = false;
+
+    // insertion sort of the previous order, false when it ran out of moves (the order is then partly repaired,
+    // which the radix sort doesn't mind)
+    bool repairOrder(size_t maxMoves)
+    {
+        size_t moves = 0;
+        for (size_t i = 1; i < order.size(); i++)
+        {
+            uint32_t key = keys[i];
+            if (keys[i - 1] <= key)
+                continue;
+            unsigned int index = order[i];
+            size_t j = i;
+            while (j > 0 && keys[j - 1] > key)
+            {
+                keys[j] = keys[j - 1];
+                order[j] = order[j - 1];
+                j--;
+            }
+            keys[j] = key;
+            order[j] = index;
+            moves += i - j;
+            if (moves > maxMoves)
+                return false;
+        }
+        return true;
+    }
+
+    // LSD radix sort over the 4 bytes of the keys, skipping the bytes every key shares (usually the exponent of
+    // instances at similar depths)
+    void radixSort()
+    {
+        const size_t count = order.size();
+        size_t histograms[4][256] = {};
+        for (size_t i = 0; i < count; i++)
+            for (int pass = 0; pass < 4; pass++)
+                histograms[pass][(keys[i] >> (pass * 8)) & 0xFF]++;
+
+        scratchOrder.resize(count);
+        scratchKeys.resize(count);
+        for (int pass = 0; pass < 4; pass++)
+        {
+            size_t* histogram = histograms[pass];
+            if (count == 0 || histogram[(keys[0] >> (pass * 8)) & 0xFF] == count)
+                continue;
+            // histogram to start offsets
+            size_t offset = 0;
+            for (int bucket = 0; bucket < 256; bucket++)
+            {
+                size_t bucketCount = histogram[bucket];
+                histogram[bucket] = offset;
+                offset += bucketCount;
+            }
+            for (size_t i = 0; i < count; i++)
+            {
+                size_t destination = histogram[(keys[i] >> (pass * 8)) & 0xFF]++;
+                scratchKeys[destination] = keys[i];
+                scratchOrder[destination] = order[i];
+            }
+            keys.swap(scratchKeys);
+            order.swap(scratchOrder);
+        }
+    }
+};
+
+// weighted blended order-independent transparency (McGuire and Bavoil 2013). Transparent surfaces are drawn in any
+// order into two transient targets: the sum of their weighted premultiplied colours (RGBA16F, whose alpha collects
+// the product of (1 - alpha), how much of the scene shows through) and the sum of their weighted alphas (R16F). The
+// weight falls off with depth, so nearer layers dominate. A full screen pass then blends the weighted average
+// colour over the scene. Not exact like sorting, but independent of the number of overlapping layers and without
+// any CPU work. OpenGL 3.3 has no blend state per draw buffer, so both targets share glBlendFuncSeparate: colour
+// channels add up, alpha multiplies.
+class WeightedBlendedOit
+{
+public:
+    void Init()
+    {
+        glGenVertexArrays(1, &emptyVAO);
+    }
+
+    // adds the pass that draws the transparent surfaces into the accumulation targets (drawSurfaces, with
+    // shaders/oit_accumulate.frag) and the one that blends their average over scene with compositeShader
+    // (shaders/oit_composite.frag). Returns the scene's new version.
+    FrameGraphResource AddPasses(FrameGraph& graph, FrameGraphResource scene, Shader& compositeShader, std::function<void()> drawSurfaces)
+    {
+        FrameGraphTextureDesc sceneDesc = graph.Desc(scene);
+        FrameGraphPassBuilder accumulate = graph.AddPass("Glass", [scene, drawSurfaces](FrameGraphContext& context)
+        {
+            // transparent surfaces are hidden by opaque ones in front of them, so they test against the scene's depth
+            int width = context.Width();
+            int height = context.Height();
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, context.Framebuffer({ scene }));
+            glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+            // accumulation (0, 0, 0, 1): nothing added, everything revealed. The weight target only has red, 0.
+            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+
+            glDepthMask(GL_FALSE);
+            glEnable(GL_BLEND);
+            glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+            drawSurfaces();
+        });
+        accumulate.Read(scene);
+        FrameGraphResource accumulation = accumulate.Create("OIT accumulation", { sceneDesc.Width, sceneDesc.Height, GL_RGBA16F });
+        FrameGraphResource weights = accumulate.Create("OIT weights", { sceneDesc.Width, sceneDesc.Height, GL_R16F });
+        // the same format as the scene's, glBlitFramebuffer needs that
+        accumulate.Create("OIT depth", { sceneDesc.Width, sceneDesc.Height, GL_DEPTH24_STENCIL8 });
+
+        FrameGraphPassBuilder composite = graph.AddPass("OIT composite", [this, &compositeShader, accumulation, weights](FrameGraphContext& context)
+        {
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            glDisable(GL_DEPTH_TEST);
+
+            compositeShader.use();
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, context.Texture(accumulation));
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, context.Texture(weights));
+            glActiveTexture(GL_TEXTURE0);
+            compositeShader.setInt("accumulation", 0);
+            compositeShader.setInt("weights", 1);
+            glBindVertexArray(emptyVAO);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            glBindVertexArray(0);
+
+            glEnable(GL_DEPTH_TEST);
+            glDisable(GL_BLEND);
+            glDepthMask(GL_TRUE);
+        });
+        composite.Read(accumulation);
+        composite.Read(weights);
+        return composite.Write(scene);
+    }
+
+    void Release()
+    {
+        if (emptyVAO)
+            glDeleteVertexArrays(1, &emptyVAO);
+        emptyVAO = 0;
+    }
+
+private:
+    unsigned int emptyVAO = 0; // the full screen triangle has no attributes, but core profile draws need a VAO
+};
@@ -0,0 +1,246 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Command line tool that runs every chapter scene headless with the same camera settings and
+// frame counts and collects their results into one JSON file. Each chapter is started from its
+// own directory (shaders, textures and models are loaded relative to it) with --benchmark.
+//
+// Usage: Benchmark [options]
+//   --bin-dir <dir>        directory with the chapter executables (default: next to Benchmark)
+//   --root <dir>           repository root with the chapter directories (default: ..)
+//   --scene <name>         only run this scene, can be repeated (default: all)
+//   --warmup <n>           frames rendered before measuring (default: 60)
+//   --frames <n>           measured frames (default: 600)
+//   --size <WxH>           render size (default: the window size of each chapter)
+//   --camera-path <file>   replay a recorded camera path instead of each scene's orbit
+//   --gl-calls             also report GL calls per entry point, driver time and performance warnings
+//   --out <file>           results file (default: benchmark.json)
+
+struct Scene
+{
+    const char* name; // Also the name of its directory and executable, unless chapter is set
+    const char* arguments;
+    const char* chapter;
+};
+
+// The lighting chapter runs its original scene (forward shading, 4 point lights) under the chapter's name,
+// then its default of 1024 lights and forward and deferred shading at 4, 64 and 512 point lights
+const Scene scenes[] = {
+    { "00 Getting started", "", nullptr },
+    { "01 Lighting", "--lights 4", nullptr },
+    { "01 Lighting (forward, 1024 lights)", "", "01 Lighting" },
+    { "01 Lighting (deferred, 4 lights)", "--lights 4 --deferred", "01 Lighting" },
+    { "01 Lighting (forward, 64 lights)", "--lights 64", "01 Lighting" },
+    { "01 Lighting (deferred, 64 lights)", "--lights 64 --deferred", "01 Lighting" },
+    { "01 Lighting (forward, 512 lights)", "--lights 512", "01 Lighting" },
+    { "01 Lighting (deferred, 512 lights)", "--lights 512 --deferred", "01 Lighting" },
+    { "02 Model loading", "", nullptr },
+    { "03 Advanced OpenGL", "", nullptr },
+};
+
+struct BenchmarkOptions
+{
+    std::string binDir;
+    std::string root = "..";
+    std::vector<std::string> onlyScenes;
+    int warmupFrames = 60;
+    int frames = 600;
+    std::string size;
+    std::string cameraPath;
+    bool glCalls = false;
+    std::string outPath = "benchmark.json";
+};
+
+std::string directoryOf(const std::string& path);
+std::string absolutePath(const std::string& path);
+std::string quote(const std::string& text);
+bool runScene(const Scene& scene, const BenchmarkOptions& options, std::string* result);
+
+int main(int argc, char* argv[])
+{
+    BenchmarkOptions options;
+    options.binDir = directoryOf(argv[0]);
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--bin-dir" && i + 1 < argc)
+        {
+            options.binDir = argv[++i];
+        }
+        else if (arg == "--root" && i + 1 < argc)
+        {
+            options.root = argv[++i];
+        }
+        else if (arg == "--scene" && i + 1 < argc)
+        {
+            options.onlyScenes.push_back(argv[++i]);
+        }
+        else if (arg == "--warmup" && i + 1 < argc)
+        {
+            options.warmupFrames = std::atoi(argv[++i]);
+        }
+        else if (arg == "--frames" && i + 1 < argc)
+        {
+            options.frames = std::atoi(argv[++i]);
+        }
+        else if (arg == "--size" && i + 1 < argc)
+        {
+            options.size = argv[++i];
+        }
+        else if (arg == "--camera-path" && i + 1 < argc)
+        {
+            options.cameraPath = absolutePath(argv[++i]);
+        }
+        else if (arg == "--gl-calls")
+        {
+            options.glCalls = true;
+        }
+        else if (arg == "--out" && i + 1 < argc)
+        {
+            options.outPath = argv[++i];
+        }
+        else
+        {
+            std::cout << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+    // The scenes run from their own directories
+    options.binDir = absolutePath(options.binDir);
+    options.root = absolutePath(options.root);
+
+    std::vector<std::string> results;
+    int failures = 0;
+    for (const Scene& scene : scenes)
+    {
+        bool selected = options.onlyScenes.empty();
+        for (const std::string& name : options.onlyScenes)
+        {
+            selected = selected || name == scene.name;
+        }
+        if (!selected)
+        {
+            continue;
+        }
+
+        std::string result;
+        if (runScene(scene, options, &result))
+        {
+            results.push_back(result);
+        }
+        else
+        {
+            std::cout << scene.name << ": failed" << std::endl;
+            failures++;
+        }
+    }
+
+    std::ofstream out(options.outPath);
+    out << "[\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        out << results[i] << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "]\n";
+    if (!out.good())
+    {
+        std::cout << "Failed to write " << options.outPath << std::endl;
+        return 1;
+    }
+    std::cout << "Wrote " << results.size() << " scene results to " << options.outPath << std::endl;
+
+    return failures == 0 ? 0 : 1;
+}
+
+bool runScene(const Scene& scene, const BenchmarkOptions& options, std::string* result)
+{
+    std::string chapter = scene.chapter ? scene.chapter : scene.name;
+    std::string sceneDir = options.root + "/" + chapter;
+    std::string jsonPath = sceneDir + "/benchmark_result.json";
+    std::remove(jsonPath.c_str());
+
+#ifdef _WIN32
+    std::string executable = options.binDir + "\\" + chapter + ".exe";
+    // cmd strips the outer quotes of the whole line, so the command is quoted once more
+    std::string command = "\"cd /d " + quote(sceneDir) + " && " + quote(executable);
+#else
+    std::string executable = options.binDir + "/" + chapter;
+    std::string command = "cd " + quote(sceneDir) + " && " + quote(executable);
+#endif
+    command += " --benchmark --warmup " + std::to_string(options.warmupFrames) +
+        " --frames " + std::to_string(options.frames) + " --json " + quote(jsonPath);
+    if (scene.arguments[0] != '\0')
+    {
+        command += " " + std::string(scene.arguments);
+    }
+    if (!options.size.empty())
+    {
+        command += " --size " + options.size;
+    }
+    if (!options.cameraPath.empty())
+    {
+        command += " --camera-path " + quote(options.cameraPath);
+    }
+    if (options.glCalls)
+    {
+        command += " --gl-calls";
+    }
+#ifdef _WIN32
+    command += "\"";
+#endif
+
+    std::cout << "Running " << scene.name << std::endl;
+    if (std::system(command.c_str()) != 0)
+    {
+        return false;
+    }
+
+    std::ifstream file(jsonPath);
+    if (!file)
+    {
+        return false;
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    *result = contents.str();
+    while (!result->empty() && (result->back() == '\n' || result->back() == '\r'))
+    {
+        result->pop_back();
+    }
+    file.close();
+    std::remove(jsonPath.c_str());
+    return !result->empty();
+}
+
+std::string directoryOf(const std::string& path)
+{
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? "." : path.substr(0, slash);
+}
+
+std::string absolutePath(const std::string& path)
+{
+#ifdef _WIN32
+    char buffer[4096];
+    return _fullpath(buffer, path.c_str(), sizeof(buffer)) ? buffer : path;
+#else
+    char* resolved = realpath(path.c_str(), nullptr);
+    if (!resolved)
+    {
+        return path;
+    }
+    std::string absolute = resolved;
+    std::free(resolved);
+    return absolute;
+#endif
+}
+
+std::string quote(const std::string& text)
+{
+    return "\"" + text + "\"";
+}
@@ -0,0 +1,491 @@
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "frame_graph.h"
+
+// Checks the frame graph of 03 Advanced OpenGL without a GPU. The graph is driven by a backend that
+// only records what it is asked to do (textures and framebuffers are just numbers), with the passes
+// of that chapter's frame declared the same way the chapter, outline.h and transparency.h declare
+// them. Checks that unused passes are culled, that passes run after the ones they depend on
+// (write-after-read included) and that transient targets share textures. Exits with 1 if a check
+// fails.
+//
+// Usage: FrameGraphTest
+
+// OUTLINE_JUMP_FLOOD_MIN_WIDTH of outline.h, thinner outlines don't read the jump flood
+#define JUMP_FLOOD_MIN_WIDTH 3
+
+// The toggles of 03 Advanced OpenGL that change which passes are declared
+struct FrameOptions
+{
+    int width = 1280;
+    int height = 720;
+    bool postProcessOutline = true;
+    float outlineWidth = 4.0f;
+    bool foliage = true;
+    bool grass = true;
+    bool weightedOit = true;
+};
+
+// What a pass was given by the graph while it executed
+struct ExecutedPass
+{
+    std::string name;
+    unsigned int framebuffer;
+    int width;
+    int height;
+};
+
+// A FrameGraphBackend that makes no GL calls. Framebuffers are cached by their attachments like
+// GlFrameGraphBackend does, so the same textures give the same framebuffer.
+class RecordingBackend : public FrameGraphBackend
+{
+public:
+    std::vector<ExecutedPass> passes;
+    std::map<unsigned int, FrameGraphTextureDesc> textures; // Alive ones
+    std::map<unsigned int, std::vector<FrameGraphAttachment>> attachments; // By framebuffer
+    int created = 0;
+    int destroyed = 0;
+    int destroyedUnknown = 0;
+
+    unsigned int CreateTexture(const FrameGraphTextureDesc& desc) override
+    {
+        unsigned int texture = nextTexture++;
+        textures[texture] = desc;
+        created++;
+        return texture;
+    }
+
+    void DestroyTexture(unsigned int texture) override
+    {
+        if (textures.erase(texture) == 0)
+        {
+            destroyedUnknown++;
+        }
+        destroyed++;
+    }
+
+    unsigned int Framebuffer(const std::vector<FrameGraphAttachment>& attached) override
+    {
+        for (const auto& framebuffer : attachments)
+        {
+            if (sameTextures(framebuffer.second, attached))
+            {
+                return framebuffer.first;
+            }
+        }
+        unsigned int framebuffer = nextFramebuffer++;
+        attachments[framebuffer] = attached;
+        return framebuffer;
+    }
+
+    void BindRenderTarget(unsigned int framebuffer, int width, int height) override
+    {
+        boundFramebuffer = framebuffer;
+        boundWidth = width;
+        boundHeight = height;
+    }
+
+    void BeginPass(const char* name) override
+    {
+        passes.push_back({ name, 0, 0, 0 });
+    }
+
+    void EndPass() override
+    {
+        passes.back().framebuffer = boundFramebuffer;
+        passes.back().width = boundWidth;
+        passes.back().height = boundHeight;
+    }
+
+    // The framebuffer last bound for a pass
+    unsigned int bound() const
+    {
+        return boundFramebuffer;
+    }
+
+    // The texture attached to the pass' framebuffer with this format, 0 if there is none
+    unsigned int attachment(const ExecutedPass& pass, GLenum internalFormat) const
+    {
+        auto found = attachments.find(pass.framebuffer);
+        if (found == attachments.end())
+        {
+            return 0;
+        }
+        for (const FrameGraphAttachment& attached : found->second)
+        {
+            if (attached.InternalFormat == internalFormat)
+            {
+                return attached.Texture;
+            }
+        }
+        return 0;
+    }
+
+private:
+    unsigned int nextTexture = 1;
+    unsigned int nextFramebuffer = 1000; // Apart from the imported target's
+    unsigned int boundFramebuffer = 0;
+    int boundWidth = 0;
+    int boundHeight = 0;
+
+    static bool sameTextures(const std::vector<FrameGraphAttachment>& a, const std::vector<FrameGraphAttachment>& b)
+    {
+        if (a.size() != b.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); i++)
+        {
+            if (a[i].Texture != b[i].Texture)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+bool failed = false;
+
+void check(bool condition, const std::string& what);
+void declareFrame(FrameGraph& graph, const FrameOptions& options);
+std::vector<std::string> executedNames(const RecordingBackend& backend);
+std::string joined(const std::vector<std::string>& names);
+void testCulling();
+void testOrdering();
+void testWriteAfterRead();
+void testSharing();
+void testFramebufferInPass();
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1)
+    {
+        std::cout << "Unknown option: " << argv[1] << std::endl;
+        return 1;
+    }
+
+    testCulling();
+    testOrdering();
+    testWriteAfterRead();
+    testSharing();
+    testFramebufferInPass();
+
+    if (failed)
+    {
+        return 1;
+    }
+    std::cout << "All frame graph checks passed" << std::endl;
+    return 0;
+}
+
+void check(bool condition, const std::string& what)
+{
+    if (!condition)
+    {
+        std::cout << "FAILED: " << what << std::endl;
+        failed = true;
+    }
+}
+
+// The passes of a frame of 03 Advanced OpenGL, with the same reads, writes and targets but passes
+// that draw nothing
+void declareFrame(FrameGraph& graph, const FrameOptions& options)
+{
+    auto nothing = [](FrameGraphContext&) {};
+    int width = options.width;
+    int height = options.height;
+    FrameGraphResource target = graph.Import("Target", 0, width, height);
+    FrameGraphResource sceneColor = target;
+    FrameGraphResource sceneDepth = FRAME_GRAPH_NO_RESOURCE;
+
+    FrameGraphPassBuilder floorPass = graph.AddPass("Floor", nothing);
+    if (options.postProcessOutline)
+    {
+        sceneColor = floorPass.Create("Scene colour", { width, height, GL_SRGB8_ALPHA8 });
+        sceneDepth = floorPass.Create("Scene depth", { width, height, GL_DEPTH24_STENCIL8 });
+    }
+    else
+    {
+        sceneColor = floorPass.Write(sceneColor);
+    }
+
+    if (options.foliage)
+    {
+        FrameGraphPassBuilder pass = graph.AddPass("Foliage", nothing);
+        sceneColor = pass.Write(sceneColor);
+        sceneDepth = pass.Write(sceneDepth);
+    }
+
+    FrameGraphResource selectionMask = FRAME_GRAPH_NO_RESOURCE;
+    {
+        FrameGraphPassBuilder pass = graph.AddPass("Cubes", nothing);
+        sceneColor = pass.Write(sceneColor);
+        if (options.postProcessOutline)
+        {
+            selectionMask = pass.Create("Selection mask", { width, height, GL_R8 });
+        }
+        sceneDepth = pass.Write(sceneDepth);
+    }
+
+    // OutlineRenderer::AddPasses
+    if (options.postProcessOutline)
+    {
+        const FrameGraphTextureDesc seedsDesc = { width, height, GL_RG32F };
+        FrameGraphPassBuilder init = graph.AddPass("Jump flood init", nothing);
+        init.Read(selectionMask);
+        FrameGraphResource seeds = init.Create("Jump flood seeds", seedsDesc);
+        int step = 1;
+        while (step * 2 <= static_cast<int>(options.outlineWidth))
+        {
+            step *= 2;
+        }
+        for (; step >= 1; step /= 2)
+        {
+            FrameGraphPassBuilder pass = graph.AddPass("Jump flood step", nothing);
+            pass.Read(seeds);
+            seeds = pass.Create("Jump flood seeds", seedsDesc);
+        }
+        FrameGraphPassBuilder pass = graph.AddPass("Outline", nothing);
+        pass.Read(sceneColor);
+        pass.Read(sceneDepth);
+        pass.Read(selectionMask);
+        if (options.outlineWidth >= JUMP_FLOOD_MIN_WIDTH)
+        {
+            pass.Read(seeds);
+        }
+        target = pass.Write(target);
+    }
+    else
+    {
+        target = graph.AddPass("Outline", nothing).Write(sceneColor);
+    }
+
+    if (options.grass)
+    {
+        target = graph.AddPass("Grass", nothing).Write(target);
+    }
+
+    // WeightedBlendedOit::AddPasses
+    if (options.weightedOit)
+    {
+        FrameGraphPassBuilder accumulate = graph.AddPass("Glass", nothing);
+        accumulate.Read(target);
+        FrameGraphResource accumulation = accumulate.Create("OIT accumulation", { width, height, GL_RGBA16F });
+        FrameGraphResource weights = accumulate.Create("OIT weights", { width, height, GL_R16F });
+        accumulate.Create("OIT depth", { width, height, GL_DEPTH24_STENCIL8 });
+        FrameGraphPassBuilder composite = graph.AddPass("OIT composite", nothing);
+        composite.Read(accumulation);
+        composite.Read(weights);
+        target = composite.Write(target);
+    }
+    else
+    {
+        target = graph.AddPass("Glass", nothing).Write(target);
+    }
+
+    graph.AddPass("Overlay", nothing).Write(target);
+}
+
+std::vector<std::string> executedNames(const RecordingBackend& backend)
+{
+    std::vector<std::string> names;
+    for (const ExecutedPass& pass : backend.passes)
+    {
+        names.push_back(pass.name);
+    }
+    return names;
+}
+
+std::string joined(const std::vector<std::string>& names)
+{
+    std::string text;
+    for (const std::string& name : names)
+    {
+        text += (text.empty() ? "" : ", ") + name;
+    }
+    return text;
+}
+
+// A thin outline doesn't read the jump flood, so its init and steps run only for wide outlines
+void testCulling()
+{
+    FrameGraph graph;
+    RecordingBackend backend;
+    FrameOptions options;
+    options.outlineWidth = 2.0f; // Steps 2 and 1
+    declareFrame(graph, options);
+    graph.Execute(backend);
+    const FrameGraphStats& thin = graph.Stats();
+    check(thin.CulledPasses == 3, "a thin outline culls the jump flood init and its 2 steps, " + std::to_string(thin.CulledPasses) + " culled");
+    for (const ExecutedPass& pass : backend.passes)
+    {
+        check(pass.name.compare(0, 10, "Jump flood") != 0, "a thin outline doesn't run " + pass.name);
+    }
+    for (const auto& texture : backend.textures)
+    {
+        check(texture.second.InternalFormat != GL_RG32F, "a thin outline creates no jump flood seeds");
+    }
+    check(thin.TransientTargets == 6, "the culled seeds are not transient targets of the frame");
+
+    graph.Reset();
+    backend.passes.clear();
+    options.outlineWidth = 4.0f;
+    declareFrame(graph, options);
+    graph.Execute(backend);
+    check(graph.Stats().CulledPasses == 0, "a wide outline culls nothing");
+    check(std::count_if(backend.passes.begin(), backend.passes.end(), [](const ExecutedPass& pass) { return pass.name.compare(0, 10, "Jump flood") == 0; }) == 4,
+        "a wide outline runs the jump flood init and its steps 4, 2 and 1");
+    graph.Release(backend);
+}
+
+// The frame runs in the order it was declared in, the jump flood between the cubes and the outline
+void testOrdering()
+{
+    FrameGraph graph;
+    RecordingBackend backend;
+    declareFrame(graph, FrameOptions());
+    graph.Execute(backend);
+    std::vector<std::string> expected = { "Floor", "Foliage", "Cubes", "Jump flood init", "Jump flood step", "Jump flood step",
+        "Jump flood step", "Outline", "Grass", "Glass", "OIT composite", "Overlay" };
+    std::vector<std::string> executed = executedNames(backend);
+    check(executed == expected, "the frame runs in order, got " + joined(executed));
+
+    // Passes drawing into the target get its framebuffer at the full size
+    for (const ExecutedPass& pass : backend.passes)
+    {
+        if (pass.name == "Outline" || pass.name == "Grass" || pass.name == "OIT composite" || pass.name == "Overlay")
+        {
+            check(pass.framebuffer == 0 && pass.width == 1280 && pass.height == 720, pass.name + " draws into the imported target");
+        }
+    }
+    graph.Release(backend);
+}
+
+// A pass that replaces a version runs after the passes reading that version, even when they were
+// declared after it
+void testWriteAfterRead()
+{
+    FrameGraph graph;
+    RecordingBackend backend;
+    auto nothing = [](FrameGraphContext&) {};
+    FrameGraphResource target = graph.Import("Target", 0, 64, 64);
+    FrameGraphResource first = graph.AddPass("Write 1", nothing).Write(target);
+    FrameGraphResource second = graph.AddPass("Write 2", nothing).Write(first);
+    FrameGraphPassBuilder read = graph.AddPass("Read 1", nothing);
+    read.Read(first);
+    FrameGraphResource copy = read.Create("Copy", { 64, 64, GL_RGBA8 });
+    FrameGraphPassBuilder last = graph.AddPass("Last", nothing);
+    last.Read(copy);
+    last.Write(second);
+    graph.Execute(backend);
+
+    std::vector<std::string> expected = { "Write 1", "Read 1", "Write 2", "Last" };
+    std::vector<std::string> executed = executedNames(backend);
+    check(executed == expected, "a write runs after the reads of the version it replaces, got " + joined(executed));
+    graph.Release(backend);
+}
+
+// With the OIT targets the frame has 10 transient targets in 7 textures, which are pooled from
+// frame to frame and recreated when the size changes
+void testSharing()
+{
+    FrameGraph graph;
+    RecordingBackend backend;
+    declareFrame(graph, FrameOptions());
+    graph.Execute(backend);
+    const FrameGraphStats& stats = graph.Stats();
+    const unsigned long long pixels = 1280ull * 720ull;
+    check(stats.Passes == 12, "12 passes, got " + std::to_string(stats.Passes));
+    check(stats.TransientTargets == 10, "10 transient targets, got " + std::to_string(stats.TransientTargets));
+    check(stats.Textures == 7, "7 textures, got " + std::to_string(stats.Textures));
+    // Colour 4, depth 4, mask 1, 4 seeds 8, accumulation 8, weights 2 and the OIT depth 4 bytes a pixel
+    check(stats.UnaliasedBytes == pixels * 55, "the unshared targets take " + std::to_string(stats.UnaliasedBytes) + " bytes");
+    // The seeds in 2 textures and the OIT depth in the scene depth's
+    check(stats.Bytes == pixels * 35, "the shared textures take " + std::to_string(stats.Bytes) + " bytes");
+    check(backend.created == 7 && backend.textures.size() == 7, "7 textures created, got " + std::to_string(backend.created));
+
+    std::vector<unsigned int> seeds;
+    unsigned int sceneDepth = 0;
+    unsigned int oitDepth = 0;
+    for (const ExecutedPass& pass : backend.passes)
+    {
+        if (pass.name.compare(0, 10, "Jump flood") == 0)
+        {
+            seeds.push_back(backend.attachment(pass, GL_RG32F));
+        }
+        else if (pass.name == "Cubes")
+        {
+            sceneDepth = backend.attachment(pass, GL_DEPTH24_STENCIL8);
+        }
+        else if (pass.name == "Glass")
+        {
+            oitDepth = backend.attachment(pass, GL_DEPTH24_STENCIL8);
+        }
+    }
+    check(seeds.size() == 4 && std::set<unsigned int>(seeds.begin(), seeds.end()).size() == 2, "the jump flood seeds share 2 textures");
+    for (size_t i = 1; i < seeds.size(); i++)
+    {
+        check(seeds[i] != seeds[i - 1], "a jump flood step doesn't write the seeds it reads");
+    }
+    check(sceneDepth != 0 && oitDepth == sceneDepth, "the OIT depth reuses the scene depth's texture");
+
+    // The next frame takes the same textures from the pool
+    graph.Reset();
+    declareFrame(graph, FrameOptions());
+    graph.Execute(backend);
+    check(backend.created == 7 && backend.destroyed == 0, "the next frame reuses the pooled textures");
+
+    // A resized frame replaces all of them
+    FrameOptions resized;
+    resized.width = 640;
+    resized.height = 360;
+    graph.Reset();
+    declareFrame(graph, resized);
+    graph.Execute(backend);
+    check(backend.created == 14 && backend.destroyed == 7, "a resized frame replaces the pooled textures");
+    for (const auto& texture : backend.textures)
+    {
+        check(texture.second.Width == 640 && texture.second.Height == 360, "only textures of the new size stay pooled");
+    }
+
+    graph.Release(backend);
+    check(backend.textures.empty() && backend.destroyedUnknown == 0, "Release destroys every pooled texture once");
+}
+
+// A pass asking for a framebuffer while it executes, like the outline's composite, gets one without its
+// render target being unbound
+void testFramebufferInPass()
+{
+    FrameGraph graph;
+    RecordingBackend backend;
+    FrameGraphResource target = graph.Import("Target", 0, 64, 64);
+    FrameGraphPassBuilder scene = graph.AddPass("Scene", [](FrameGraphContext&) {});
+    FrameGraphResource color = scene.Create("Color", { 64, 64, GL_RGBA8 });
+    FrameGraphResource depth = scene.Create("Depth", { 64, 64, GL_DEPTH24_STENCIL8 });
+    unsigned int boundBefore = 1;
+    unsigned int blitFrom = 0;
+    unsigned int boundAfter = 1;
+    unsigned int renderTarget = 1;
+    FrameGraphPassBuilder composite = graph.AddPass("Composite", [&](FrameGraphContext& context)
+    {
+        boundBefore = backend.bound();
+        blitFrom = context.Framebuffer({ color });
+        boundAfter = backend.bound();
+        renderTarget = context.RenderTarget();
+    });
+    composite.Read(color);
+    composite.Read(depth);
+    composite.Write(target);
+    graph.Execute(backend);
+
+    check(blitFrom != 0 && blitFrom != renderTarget, "a pass gets a new framebuffer for the targets it reads");
+    check(backend.attachments.size() == 2, "the colour alone gets its own framebuffer");
+    check(renderTarget == 0 && boundBefore == 0 && boundAfter == 0, "asking for a framebuffer leaves the pass' render target bound");
+    graph.Release(backend);
+}
@@ -0,0 +1,414 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+
+#include "JobSystem.h"
+#include "MeshConversion.h"
+
+// Stress test of the job system in 02 Model loading. Runs fine grained workloads with 1 worker up to
+// one worker per remaining core and prints the scheduling overhead per job and the speedup over a
+// single thread, checking every result on the way. Exits with 1 if a check fails. The mesh conversion
+// of Model (aiMesh to vertices and indices) is measured the same way.
+//
+// Usage: JobStress [options]
+//   --threads <n>   highest thread count to test, main thread included (default: all hardware threads)
+//   --jobs <n>      jobs per workload (default: 1000000)
+//   --repeat <n>    runs per workload and thread count, the fastest one is reported (default: 3)
+//   --meshes <n>    meshes of the generated model for the mesh conversion (default: 500)
+//   --vertices <n>  average vertices of a generated mesh, their sizes vary (default: 6000)
+//   --model <path>  convert the meshes of this model file instead of the generated ones
+
+struct StressOptions
+{
+    unsigned int threads = 0;
+    unsigned int jobs = 1000000;
+    int repeat = 3;
+    unsigned int meshes = 500;
+    unsigned int vertices = 6000;
+    std::string model;
+};
+
+struct StressResult
+{
+    unsigned int threads;
+    double emptyNsPerJob;
+    double spawnNsPerJob;
+    double parallelForMs;
+    double dependencyNsPerJob;
+    double meshConvertMs;
+};
+
+bool failed = false;
+
+double elapsedMs(std::chrono::steady_clock::time_point start);
+void check(bool condition, const char* what, unsigned int threads);
+double emptyJobs(JobSystem& jobs, unsigned int count);
+double spawnTree(JobSystem& jobs, unsigned int count);
+double parallelFor(JobSystem& jobs, const std::vector<float>& values, double expected);
+double dependencyChain(JobSystem& jobs, unsigned int count);
+void mainThreadAffinity(JobSystem& jobs);
+std::vector<std::unique_ptr<aiMesh>> generateMeshes(unsigned int meshCount, unsigned int vertexCount);
+double meshConversion(JobSystem* jobs, const std::vector<const aiMesh*>& meshes, std::vector<MeshData>* expected);
+
+int main(int argc, char* argv[])
+{
+    StressOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc)
+        {
+            options.threads = std::atoi(argv[++i]);
+        }
+        else if (arg == "--jobs" && i + 1 < argc)
+        {
+            options.jobs = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--repeat" && i + 1 < argc)
+        {
+            options.repeat = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--meshes" && i + 1 < argc)
+        {
+            options.meshes = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--vertices" && i + 1 < argc)
+        {
+            options.vertices = std::max(3, std::atoi(argv[++i]));
+        }
+        else if (arg == "--model" && i + 1 < argc)
+        {
+            options.model = argv[++i];
+        }
+        else
+        {
+            std::cout << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (options.threads < 2)
+    {
+        options.threads = std::max(2u, std::thread::hardware_concurrency());
+    }
+
+    // Enough work per element that the parallel loop is bound by the cores, not by scheduling
+    std::vector<float> values(options.jobs * 16);
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        values[i] = static_cast<float>(i % 1000);
+    }
+    double expected = 0.0;
+    double serialMs = 1e30;
+    for (int run = 0; run < options.repeat; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        expected = 0.0;
+        for (float value : values)
+        {
+            expected += std::sqrt(value);
+        }
+        serialMs = std::min(serialMs, elapsedMs(start));
+    }
+
+    // Meshes to convert, the serial conversion is the baseline and the expected result
+    Assimp::Importer importer;
+    std::vector<std::unique_ptr<aiMesh>> generated;
+    std::vector<const aiMesh*> meshes;
+    if (!options.model.empty())
+    {
+        const aiScene* scene = importer.ReadFile(options.model, aiProcess_Triangulate);
+        if (!scene)
+        {
+            std::cout << "Failed to load " << options.model << ": " << importer.GetErrorString() << std::endl;
+            return 1;
+        }
+        meshes.assign(scene->mMeshes, scene->mMeshes + scene->mNumMeshes);
+    }
+    else
+    {
+        generated = generateMeshes(options.meshes, options.vertices);
+        for (const std::unique_ptr<aiMesh>& mesh : generated)
+        {
+            meshes.push_back(mesh.get());
+        }
+    }
+    std::vector<MeshData> expectedMeshes;
+    double serialMeshMs = 1e30;
+    for (int run = 0; run < options.repeat; run++)
+    {
+        serialMeshMs = std::min(serialMeshMs, meshConversion(nullptr, meshes, &expectedMeshes));
+    }
+
+    std::vector<StressResult> results;
+    for (unsigned int threads = 2; threads <= options.threads; threads++)
+    {
+        StressResult result = { threads, 1e30, 1e30, 1e30, 1e30, 1e30 };
+        JobSystem jobs(threads - 1);
+        mainThreadAffinity(jobs);
+        for (int run = 0; run < options.repeat; run++)
+        {
+            result.emptyNsPerJob = std::min(result.emptyNsPerJob, emptyJobs(jobs, options.jobs));
+            result.spawnNsPerJob = std::min(result.spawnNsPerJob, spawnTree(jobs, options.jobs));
+            result.parallelForMs = std::min(result.parallelForMs, parallelFor(jobs, values, expected));
+            result.dependencyNsPerJob = std::min(result.dependencyNsPerJob, dependencyChain(jobs, options.jobs));
+            result.meshConvertMs = std::min(result.meshConvertMs, meshConversion(&jobs, meshes, &expectedMeshes));
+        }
+        results.push_back(result);
+    }
+
+    std::printf("%u jobs per workload, parallel loop over %zu values (serial: %.2f ms)\n",
+        options.jobs, values.size(), serialMs);
+    std::printf("threads  empty ns/job  spawn ns/job  dependent ns/job  parallel loop ms  speedup\n");
+    for (const StressResult& result : results)
+    {
+        std::printf("%7u  %12.1f  %12.1f  %16.1f  %16.2f  %6.2fx\n", result.threads, result.emptyNsPerJob,
+            result.spawnNsPerJob, result.dependencyNsPerJob, result.parallelForMs, serialMs / result.parallelForMs);
+    }
+
+    size_t vertexCount = 0;
+    for (const aiMesh* mesh : meshes)
+    {
+        vertexCount += mesh->mNumVertices;
+    }
+    std::printf("\nMesh conversion of %zu meshes, %zu vertices (serial: %.2f ms)\n",
+        meshes.size(), vertexCount, serialMeshMs);
+    std::printf("threads  convert ms  speedup\n");
+    for (const StressResult& result : results)
+    {
+        std::printf("%7u  %10.2f  %6.2fx\n", result.threads, result.meshConvertMs, serialMeshMs / result.meshConvertMs);
+    }
+    return failed ? 1 : 0;
+}
+
+double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void check(bool condition, const char* what, unsigned int threads)
+{
+    if (!condition)
+    {
+        std::cout << "FAILED: " << what << " with " << threads << " threads" << std::endl;
+        failed = true;
+    }
+}
+
+// Independent empty jobs submitted from the main thread, which the workers steal one by one
+double emptyJobs(JobSystem& jobs, unsigned int count)
+{
+    std::atomic<unsigned int> ran(0);
+    JobCounter counter;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < count; i++)
+    {
+        jobs.run([&ran]() { ran.fetch_add(1, std::memory_order_relaxed); }, &counter);
+    }
+    jobs.wait(counter);
+    double ms = elapsedMs(start);
+    check(ran.load() == count, "empty jobs", jobs.getWorkerCount() + 1);
+    return ms * 1e6 / count;
+}
+
+static void spawnNode(JobSystem& jobs, JobCounter& counter, std::atomic<unsigned int>& leaves, unsigned int size)
+{
+    if (size <= 1)
+    {
+        leaves.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    unsigned int half = size / 2;
+    jobs.run([&jobs, &counter, &leaves, half]() { spawnNode(jobs, counter, leaves, half); }, &counter);
+    jobs.run([&jobs, &counter, &leaves, size, half]() { spawnNode(jobs, counter, leaves, size - half); }, &counter);
+}
+
+// Binary tree of jobs spawned from the workers themselves, so every level is spread by stealing
+double spawnTree(JobSystem& jobs, unsigned int count)
+{
+    std::atomic<unsigned int> leaves(0);
+    JobCounter counter;
+    auto start = std::chrono::steady_clock::now();
+    jobs.run([&jobs, &counter, &leaves, count]() { spawnNode(jobs, counter, leaves, count); }, &counter);
+    jobs.wait(counter);
+    double ms = elapsedMs(start);
+    check(leaves.load() == count, "spawn tree", jobs.getWorkerCount() + 1);
+    // A tree with count leaves has 2 * count - 1 jobs
+    return ms * 1e6 / (2.0 * count - 1.0);
+}
+
+double parallelFor(JobSystem& jobs, const std::vector<float>& values, double expected)
+{
+    const size_t batchSize = 4096;
+    std::vector<double> sums((values.size() + batchSize - 1) / batchSize, 0.0);
+    JobCounter counter;
+    auto start = std::chrono::steady_clock::now();
+    jobs.parallelFor(values.size(), batchSize, [&values, &sums, batchSize](size_t begin, size_t end)
+        {
+            double sum = 0.0;
+            for (size_t i = begin; i < end; i++)
+            {
+                sum += std::sqrt(values[i]);
+            }
+            sums[begin / batchSize] = sum;
+        }, &counter);
+    jobs.wait(counter);
+    double ms = elapsedMs(start);
+
+    double total = 0.0;
+    for (double sum : sums)
+    {
+        total += sum;
+    }
+    check(std::abs(total - expected) <= 1e-6 * expected, "parallel loop", jobs.getWorkerCount() + 1);
+    return ms;
+}
+
+// Stages of jobs where each stage only starts once the previous one is done
+double dependencyChain(JobSystem& jobs, unsigned int count)
+{
+    const unsigned int stageCount = 100;
+    unsigned int jobsPerStage = std::max(1u, count / stageCount);
+    std::vector<std::unique_ptr<JobCounter>> stages;
+    std::vector<std::unique_ptr<std::atomic<unsigned int>>> ran;
+    for (unsigned int stage = 0; stage < stageCount; stage++)
+    {
+        stages.emplace_back(new JobCounter());
+        ran.emplace_back(new std::atomic<unsigned int>(0));
+    }
+
+    std::atomic<unsigned int> outOfOrder(0);
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int stage = 0; stage < stageCount; stage++)
+    {
+        JobCounter* after = stage > 0 ? stages[stage - 1].get() : nullptr;
+        std::atomic<unsigned int>* previous = stage > 0 ? ran[stage - 1].get() : nullptr;
+        std::atomic<unsigned int>* current = ran[stage].get();
+        for (unsigned int i = 0; i < jobsPerStage; i++)
+        {
+            jobs.run([previous, current, jobsPerStage, &outOfOrder]()
+                {
+                    if (previous && previous->load() != jobsPerStage)
+                    {
+                        outOfOrder.fetch_add(1);
+                    }
+                    current->fetch_add(1);
+                }, stages[stage].get(), after);
+        }
+    }
+    jobs.wait(*stages.back());
+    double ms = elapsedMs(start);
+    check(outOfOrder.load() == 0 && ran.back()->load() == jobsPerStage, "dependency chain", jobs.getWorkerCount() + 1);
+    return ms * 1e6 / (stageCount * jobsPerStage);
+}
+
+// Worker jobs hand results to jobs that must run on the main thread, like GL uploads after decoding
+void mainThreadAffinity(JobSystem& jobs)
+{
+    const unsigned int count = 1000;
+    std::atomic<unsigned int> onMainThread(0);
+    std::atomic<unsigned int> elsewhere(0);
+    JobCounter decoded;
+    JobCounter uploaded;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        jobs.run([&jobs, &uploaded, &onMainThread, &elsewhere]()
+            {
+                jobs.runOnMainThread([&jobs, &onMainThread, &elsewhere]()
+                    {
+                        (jobs.isMainThread() ? onMainThread : elsewhere).fetch_add(1);
+                    }, &uploaded);
+            }, &decoded);
+    }
+    jobs.wait(decoded);
+    jobs.wait(uploaded);
+    check(onMainThread.load() == count && elsewhere.load() == 0, "main thread jobs", jobs.getWorkerCount() + 1);
+}
+
+// Grids of quads with normals and texture coordinates, about the shape of an exported mesh
+std::vector<std::unique_ptr<aiMesh>> generateMeshes(unsigned int meshCount, unsigned int vertexCount)
+{
+    std::vector<std::unique_ptr<aiMesh>> meshes;
+    unsigned int side = std::max(2u, static_cast<unsigned int>(std::sqrt(static_cast<double>(vertexCount))));
+    for (unsigned int m = 0; m < meshCount; m++)
+    {
+        std::unique_ptr<aiMesh> mesh(new aiMesh());
+        // Vary the size so some meshes are several times bigger than others, like in a real model
+        unsigned int rows = std::max(2u, side * (1 + m % 4) / 2);
+        mesh->mNumVertices = rows * side;
+        mesh->mVertices = new aiVector3D[mesh->mNumVertices];
+        mesh->mNormals = new aiVector3D[mesh->mNumVertices];
+        mesh->mTextureCoords[0] = new aiVector3D[mesh->mNumVertices];
+        for (unsigned int y = 0; y < rows; y++)
+        {
+            for (unsigned int x = 0; x < side; x++)
+            {
+                unsigned int i = y * side + x;
+                mesh->mVertices[i].x = static_cast<float>(x);
+                mesh->mVertices[i].y = static_cast<float>(m);
+                mesh->mVertices[i].z = static_cast<float>(y);
+                mesh->mNormals[i].y = 1.0f;
+                mesh->mTextureCoords[0][i].x = static_cast<float>(x) / (side - 1);
+                mesh->mTextureCoords[0][i].y = static_cast<float>(y) / (rows - 1);
+            }
+        }
+
+        mesh->mNumFaces = 2 * (rows - 1) * (side - 1);
+        mesh->mFaces = new aiFace[mesh->mNumFaces];
+        unsigned int face = 0;
+        for (unsigned int y = 0; y + 1 < rows; y++)
+        {
+            for (unsigned int x = 0; x + 1 < side; x++)
+            {
+                unsigned int i = y * side + x;
+                const unsigned int quad[2][3] = { { i, i + side, i + 1 }, { i + 1, i + side, i + side + 1 } };
+                for (const unsigned int* corners : quad)
+                {
+                    mesh->mFaces[face].mNumIndices = 3;
+                    mesh->mFaces[face].mIndices = new unsigned int[3]{ corners[0], corners[1], corners[2] };
+                    face++;
+                }
+            }
+        }
+        meshes.push_back(std::move(mesh));
+    }
+    return meshes;
+}
+
+// Converts every mesh like Model does while loading. Without jobs it fills expected, otherwise the
+// result is compared against it.
+double meshConversion(JobSystem* jobs, const std::vector<const aiMesh*>& meshes, std::vector<MeshData>* expected)
+{
+    std::vector<MeshData> data;
+    auto start = std::chrono::steady_clock::now();
+    convertMeshes(meshes, &data, jobs);
+    double ms = elapsedMs(start);
+
+    if (!jobs)
+    {
+        *expected = std::move(data);
+        return ms;
+    }
+    bool same = data.size() == expected->size();
+    for (size_t i = 0; same && i < data.size(); i++)
+    {
+        const MeshData& a = data[i];
+        const MeshData& b = (*expected)[i];
+        same = a.indices == b.indices && a.verticies.size() == b.verticies.size() &&
+            (a.verticies.empty() || std::memcmp(a.verticies.data(), b.verticies.data(), a.verticies.size() * sizeof(Vertex)) == 0);
+    }
+    check(same, "mesh conversion", jobs->getWorkerCount() + 1);
+    return ms;
+}
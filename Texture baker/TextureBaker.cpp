@@ -0,0 +1,268 @@
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "Ktx2.h"
+#include "Mipmap.h"
+#include "TextureCompression.h"
+
+// Offline tool that bakes JPEG/PNG textures into block compressed KTX2 files (mip chain included).
+// The output is written next to the source image, which is where Model::textureFromFile looks for it.
+//
+// Usage: TextureBaker [options] <image>...
+//   --format <auto|bc1|bc3|bc4|bc5|bc7>  block format (default: auto, picked from the file name)
+//   --srgb / --linear                    override the colour space picked by auto (mips of sRGB images
+//                                        are filtered in linear light)
+//   --srgb-format                        mark sRGB images as sRGB in the KTX2 file. Off by default, as
+//                                        02 Model loading renders without gamma correction and samples
+//                                        colour maps as UNORM like the JPEG/PNG it replaces
+//   --threads <n>                        encoder threads (default: all hardware threads)
+//   --no-mips                            only bake level 0
+//   --mip-filter <kaiser|box>            filter of the mips (default: kaiser)
+//   --alpha-coverage                     keep the alpha tested coverage of level 0 in the mips (cutouts)
+//   --min-psnr <dB>                      fail (exit code 1) if a texture's level 0 PSNR is lower
+
+struct BakeOptions
+{
+    bool autoFormat = true;
+    BlockFormat format = BlockFormat::BC7;
+    int srgbOverride = -1; // -1: auto, 0: linear, 1: sRGB
+    bool srgbFormat = false;
+    unsigned int threads = 0;
+    bool mips = true;
+    MipFilter mipFilter = MipFilter::Kaiser;
+    bool alphaCoverage = false;
+    double minPsnr = 0.0;
+};
+
+void printUsage();
+bool bakeTexture(const std::string& path, const BakeOptions& options);
+void chooseFormat(const std::string& path, BlockFormat* format, bool* srgb);
+int psnrChannels(BlockFormat format, int sourceChannels);
+
+int main(int argc, char* argv[])
+{
+    BakeOptions options;
+    std::vector<std::string> inputs;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--format" && i + 1 < argc)
+        {
+            std::string name = argv[++i];
+            options.autoFormat = name == "auto";
+            if (!options.autoFormat && !parseBlockFormat(name, &options.format))
+            {
+                std::cout << "Unknown format: " << name << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "--srgb")
+        {
+            options.srgbOverride = 1;
+        }
+        else if (arg == "--linear")
+        {
+            options.srgbOverride = 0;
+        }
+        else if (arg == "--srgb-format")
+        {
+            options.srgbFormat = true;
+        }
+        else if (arg == "--threads" && i + 1 < argc)
+        {
+            options.threads = std::atoi(argv[++i]);
+        }
+        else if (arg == "--no-mips")
+        {
+            options.mips = false;
+        }
+        else if (arg == "--mip-filter" && i + 1 < argc)
+        {
+            std::string name = argv[++i];
+            if (name != "kaiser" && name != "box")
+            {
+                std::cout << "Unknown mip filter: " << name << std::endl;
+                return 1;
+            }
+            options.mipFilter = name == "kaiser" ? MipFilter::Kaiser : MipFilter::Box;
+        }
+        else if (arg == "--alpha-coverage")
+        {
+            options.alphaCoverage = true;
+        }
+        else if (arg == "--min-psnr" && i + 1 < argc)
+        {
+            options.minPsnr = std::atof(argv[++i]);
+        }
+        else if (arg[0] == '-')
+        {
+            printUsage();
+            return 1;
+        }
+        else
+        {
+            inputs.push_back(arg);
+        }
+    }
+
+    if (inputs.empty())
+    {
+        printUsage();
+        return 1;
+    }
+
+    bool success = true;
+    for (const std::string& input : inputs)
+    {
+        success &= bakeTexture(input, options);
+    }
+    return success ? 0 : 1;
+}
+
+void printUsage()
+{
+    std::cout << "Usage: TextureBaker [--format auto|bc1|bc3|bc4|bc5|bc7] [--srgb|--linear] [--srgb-format]" << std::endl;
+    std::cout << "                    [--threads n] [--no-mips] [--mip-filter kaiser|box] [--alpha-coverage]" << std::endl;
+    std::cout << "                    [--min-psnr dB] <image>..." << std::endl;
+}
+
+bool bakeTexture(const std::string& path, const BakeOptions& options)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    int width, height, channels;
+    // Always decode to RGBA, the encoders work on 4x4 RGBA blocks
+    unsigned char* data = stbi_load(path.c_str(), &width, &height, &channels, 4);
+    if (!data)
+    {
+        std::cout << path << ": failed to load (" << stbi_failure_reason() << ")" << std::endl;
+        return false;
+    }
+
+    BlockFormat format;
+    bool srgb;
+    chooseFormat(path, &format, &srgb);
+    if (!options.autoFormat)
+    {
+        format = options.format;
+    }
+    if (options.srgbOverride >= 0)
+    {
+        srgb = options.srgbOverride == 1;
+    }
+    if (format == BlockFormat::BC4 || format == BlockFormat::BC5)
+    {
+        srgb = false;
+    }
+
+    std::vector<MipLevel> mipChain;
+    if (options.mips)
+    {
+        MipChainOptions mipOptions;
+        mipOptions.filter = options.mipFilter;
+        mipOptions.srgb = srgb;
+        mipOptions.preserveAlphaCoverage = options.alphaCoverage && channels == 4;
+        mipChain = generateMipChain(data, width, height, 4, mipOptions);
+    }
+    else
+    {
+        mipChain.push_back({ width, height, std::vector<unsigned char>(data, data + static_cast<size_t>(width) * height * 4) });
+    }
+
+    Ktx2Texture ktx;
+    ktx.format = format;
+    ktx.srgb = srgb && options.srgbFormat;
+    ktx.width = width;
+    ktx.height = height;
+    size_t compressedBytes = 0;
+    for (const MipLevel& level : mipChain)
+    {
+        ktx.levels.push_back(compressImage(level.pixels.data(), level.width, level.height, format, options.threads));
+        compressedBytes += ktx.levels.back().size();
+    }
+
+    // Quality report on the full resolution level
+    std::vector<unsigned char> decoded = decompressImage(ktx.levels[0].data(), width, height, format);
+    double psnr = computePsnr(data, decoded.data(), width, height, psnrChannels(format, channels));
+    stbi_image_free(data);
+
+    std::string outputPath = path.substr(0, path.find_last_of('.')) + ".ktx2";
+    if (!writeKtx2(outputPath, ktx))
+    {
+        std::cout << path << ": failed to write " << outputPath << std::endl;
+        return false;
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    size_t uncompressedBytes = 0;
+    for (const MipLevel& level : mipChain)
+    {
+        uncompressedBytes += static_cast<size_t>(level.width) * level.height * (channels == 4 ? 4 : 3);
+    }
+
+    std::cout << std::fixed << std::setprecision(2)
+        << path << " -> " << outputPath << ": " << blockFormatName(format) << (ktx.srgb ? " sRGB" : " UNORM") << (srgb ? " (sRGB mips)" : "")
+        << ", " << width << "x" << height << ", " << mipChain.size() << " levels, "
+        << uncompressedBytes / 1024.0 << " KiB -> " << compressedBytes / 1024.0 << " KiB, "
+        << "PSNR " << psnr << " dB, " << ms << " ms" << std::endl;
+
+    if (psnr < options.minPsnr)
+    {
+        std::cout << path << ": PSNR below the required " << options.minPsnr << " dB" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Picks the format from the texture's role, which the backpack's textures encode in their file names
+void chooseFormat(const std::string& path, BlockFormat* format, bool* srgb)
+{
+    std::string name = path.substr(path.find_last_of("/\\") + 1);
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+    if (name.find("normal") != std::string::npos)
+    {
+        *format = BlockFormat::BC5;
+        *srgb = false;
+    }
+    else if (name.find("roughness") != std::string::npos || name.find("ao") == 0 || name.find("_ao") != std::string::npos)
+    {
+        *format = BlockFormat::BC4;
+        *srgb = false;
+    }
+    else if (name.find("specular") != std::string::npos)
+    {
+        // Data map, but the shaders read it as RGB
+        *format = BlockFormat::BC1;
+        *srgb = false;
+    }
+    else
+    {
+        // Colour map. BC7 handles alpha as well, so it's used with and without
+        *format = BlockFormat::BC7;
+        *srgb = true;
+    }
+}
+
+// Channels that carry information for the PSNR (the rest is either constant or not stored)
+int psnrChannels(BlockFormat format, int sourceChannels)
+{
+    switch (format)
+    {
+    case BlockFormat::BC1: return 3;
+    case BlockFormat::BC3: return 4;
+    case BlockFormat::BC4: return 1;
+    case BlockFormat::BC5: return 2;
+    case BlockFormat::BC7: return sourceChannels == 4 ? 4 : 3;
+    }
+    return 4;
+}